@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides a capture file format for raw NV12 frames.
+ *
+ * A capture file starts with a 64 byte FrameCaptureHeader holding the caps
+ * of the frames, followed by fixed size records. Every record starts with a
+ * 64 byte FrameCaptureRecord holding the timestamp, followed by the packed
+ * Y and UV planes (stride equal to the width). Records are 64 byte aligned,
+ * so frames can be read straight from the memory mapped file. The file is
+ * sized for the maximum number of frames up front and written through a
+ * shared mapping, so recording a frame is a plain copy without syscalls.
+ * The frame count in the header is updated after every frame, so a capture
+ * stays readable if the application is killed.
+ */
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#define FRAME_CAPTURE_MAGIC   "QIMFRAME"
+#define FRAME_CAPTURE_VERSION 1
+#define FRAME_CAPTURE_ALIGN   64
+
+/**
+ * FrameCaptureHeader:
+ * @magic      : FRAME_CAPTURE_MAGIC, not NUL terminated.
+ * @version    : FRAME_CAPTURE_VERSION.
+ * @header_size: Size of this header in bytes.
+ * @width      : Frame width in pixels.
+ * @height     : Frame height in pixels.
+ * @fps_n      : Framerate numerator.
+ * @fps_d      : Framerate denominator.
+ * @frame_size : Size of the packed NV12 frame in bytes.
+ * @record_size: Size of a record, timestamp and frame, in bytes.
+ * @n_frames   : Number of frames in the file.
+ *
+ * Header at the start of a capture file.
+ */
+typedef struct {
+  gchar   magic[8];
+  guint32 version;
+  guint32 header_size;
+  guint32 width;
+  guint32 height;
+  guint32 fps_n;
+  guint32 fps_d;
+  guint32 frame_size;
+  guint32 record_size;
+  guint64 n_frames;
+  guint8  reserved[16];
+} FrameCaptureHeader;
+
+/**
+ * FrameCaptureRecord:
+ * @pts : Presentation timestamp of the frame in ns, or G_MAXUINT64.
+ *
+ * Header of every frame record.
+ */
+typedef struct {
+  guint64 pts;
+  guint8  reserved[56];
+} FrameCaptureRecord;
+
+G_STATIC_ASSERT (sizeof (FrameCaptureHeader) == FRAME_CAPTURE_ALIGN);
+G_STATIC_ASSERT (sizeof (FrameCaptureRecord) == FRAME_CAPTURE_ALIGN);
+
+/**
+ * FrameCapture:
+ * @header    : Header of the mapped file.
+ * @max_frames: Number of frames the file has room for.
+ *
+ * Capture file opened for writing or reading.
+ */
+typedef struct {
+  FrameCaptureHeader *header;
+  guint64            max_frames;
+
+  // Private
+  gint               fd;
+  guint8             *map;
+  gsize              map_size;
+  gboolean           writable;
+} FrameCapture;
+
+/**
+ * Size of a packed NV12 frame.
+ */
+static inline gsize
+frame_capture_frame_size (guint width, guint height)
+{
+  return (gsize) width * height + (gsize) width * ((height + 1) / 2);
+}
+
+static inline guint8 *
+frame_capture_record (FrameCapture * cap, guint64 index)
+{
+  return cap->map + cap->header->header_size +
+      index * cap->header->record_size;
+}
+
+/**
+ * Closes a capture file. A file opened for writing is truncated to the
+ * frames actually written.
+ *
+ * @param cap Capture created with frame_capture_create() or
+ *            frame_capture_open().
+ */
+static inline void
+frame_capture_close (FrameCapture * cap)
+{
+  gsize size = 0;
+
+  if (cap == NULL)
+    return;
+
+  if (cap->map != NULL) {
+    size = cap->header->header_size +
+        cap->header->n_frames * cap->header->record_size;
+    munmap (cap->map, cap->map_size);
+  }
+
+  if (cap->writable && cap->fd >= 0 && ftruncate (cap->fd, size) != 0)
+    g_printerr ("\n Failed to truncate the capture file: %s\n",
+        g_strerror (errno));
+
+  if (cap->fd >= 0)
+    close (cap->fd);
+
+  g_free (cap);
+}
+
+/**
+ * Creates a capture file with room for @max_frames frames of the given
+ * size. The whole file is mapped, frames are added with
+ * frame_capture_write_nv12().
+ *
+ * @param path Path of the file, an existing file is overwritten.
+ * @param width Frame width in pixels.
+ * @param height Frame height in pixels.
+ * @param fps_n Framerate numerator.
+ * @param fps_d Framerate denominator.
+ * @param max_frames Maximum number of frames.
+ * @return New capture or NULL on failure.
+ */
+static inline FrameCapture *
+frame_capture_create (const gchar * path, guint width, guint height,
+    guint fps_n, guint fps_d, guint64 max_frames)
+{
+  FrameCapture *cap = NULL;
+  gsize frame_size = frame_capture_frame_size (width, height);
+  gsize record_size = 0;
+
+  // Interleaved UV rows are only as wide as the Y rows for even widths
+  if (width == 0 || height == 0 || (width % 2) != 0 || max_frames == 0)
+    return NULL;
+
+  record_size = (sizeof (FrameCaptureRecord) + frame_size +
+      FRAME_CAPTURE_ALIGN - 1) & ~((gsize) FRAME_CAPTURE_ALIGN - 1);
+
+  cap = g_new0 (FrameCapture, 1);
+  cap->writable = TRUE;
+  cap->max_frames = max_frames;
+  cap->map_size = sizeof (FrameCaptureHeader) + max_frames * record_size;
+
+  cap->fd = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (cap->fd < 0 || ftruncate (cap->fd, cap->map_size) != 0) {
+    g_printerr ("\n Failed to create capture file %s: %s\n", path,
+        g_strerror (errno));
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  cap->map = (guint8 *) mmap (NULL, cap->map_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, cap->fd, 0);
+  if (cap->map == MAP_FAILED) {
+    g_printerr ("\n Failed to map capture file %s: %s\n", path,
+        g_strerror (errno));
+    cap->map = NULL;
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  cap->header = (FrameCaptureHeader *) cap->map;
+  memcpy (cap->header->magic, FRAME_CAPTURE_MAGIC, sizeof (cap->header->magic));
+  cap->header->version = FRAME_CAPTURE_VERSION;
+  cap->header->header_size = sizeof (FrameCaptureHeader);
+  cap->header->width = width;
+  cap->header->height = height;
+  cap->header->fps_n = fps_n;
+  cap->header->fps_d = fps_d;
+  cap->header->frame_size = frame_size;
+  cap->header->record_size = record_size;
+  cap->header->n_frames = 0;
+
+  return cap;
+}
+
+/**
+ * Appends an NV12 frame to a capture file, removing the plane strides.
+ *
+ * @param cap Capture created with frame_capture_create().
+ * @param y Y plane.
+ * @param y_stride Stride of the Y plane in bytes.
+ * @param uv Interleaved UV plane.
+ * @param uv_stride Stride of the UV plane in bytes.
+ * @param pts Presentation timestamp of the frame in ns.
+ * @return FALSE if the file is full.
+ */
+static inline gboolean
+frame_capture_write_nv12 (FrameCapture * cap, const guint8 * y, gint y_stride,
+    const guint8 * uv, gint uv_stride, guint64 pts)
+{
+  FrameCaptureHeader *header = cap->header;
+  guint8 *record = NULL, *dst = NULL;
+
+  if (header->n_frames >= cap->max_frames)
+    return FALSE;
+
+  record = frame_capture_record (cap, header->n_frames);
+  ((FrameCaptureRecord *) record)->pts = pts;
+  dst = record + sizeof (FrameCaptureRecord);
+
+  for (guint row = 0; row < header->height; row++, dst += header->width)
+    memcpy (dst, y + (gsize) row * y_stride, header->width);
+
+  for (guint row = 0; row < (header->height + 1) / 2; row++,
+      dst += header->width)
+    memcpy (dst, uv + (gsize) row * uv_stride, header->width);
+
+  header->n_frames++;
+  return TRUE;
+}
+
+/**
+ * Opens a capture file for reading. The file is mapped read only and
+ * frames are accessed in place with frame_capture_get_frame().
+ *
+ * @param path Path of the file.
+ * @return Capture or NULL if the file can not be read or is invalid.
+ */
+static inline FrameCapture *
+frame_capture_open (const gchar * path)
+{
+  FrameCapture *cap = g_new0 (FrameCapture, 1);
+  FrameCaptureHeader *header = NULL;
+  struct stat st;
+
+  cap->fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (cap->fd < 0 || fstat (cap->fd, &st) != 0) {
+    g_printerr ("\n Failed to open capture file %s: %s\n", path,
+        g_strerror (errno));
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  if ((gsize) st.st_size < sizeof (FrameCaptureHeader)) {
+    g_printerr ("\n Capture file %s is too small!\n", path);
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  cap->map_size = st.st_size;
+  cap->map = (guint8 *) mmap (NULL, cap->map_size, PROT_READ, MAP_PRIVATE,
+      cap->fd, 0);
+  if (cap->map == MAP_FAILED) {
+    g_printerr ("\n Failed to map capture file %s: %s\n", path,
+        g_strerror (errno));
+    cap->map = NULL;
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  cap->header = header = (FrameCaptureHeader *) cap->map;
+
+  if (memcmp (header->magic, FRAME_CAPTURE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != FRAME_CAPTURE_VERSION ||
+      header->header_size < sizeof (FrameCaptureHeader) ||
+      header->header_size > cap->map_size ||
+      header->width == 0 || header->height == 0 || (header->width % 2) != 0 ||
+      header->frame_size !=
+          frame_capture_frame_size (header->width, header->height) ||
+      header->record_size < sizeof (FrameCaptureRecord) + header->frame_size ||
+      header->n_frames > (cap->map_size - header->header_size) /
+          header->record_size) {
+    g_printerr ("\n %s is not a valid capture file!\n", path);
+    frame_capture_close (cap);
+    return NULL;
+  }
+
+  cap->max_frames = header->n_frames;
+
+  // Replay reads the records front to back
+  madvise (cap->map, cap->map_size, MADV_SEQUENTIAL);
+  return cap;
+}
+
+/**
+ * Gets a frame of a capture file. The UV plane follows the Y plane at
+ * offset width * height, both planes have a stride equal to the width.
+ *
+ * @param cap Capture opened with frame_capture_open().
+ * @param index Index of the frame.
+ * @param pts Filled with the presentation timestamp of the frame.
+ * @return Frame data or NULL if @index is out of range.
+ */
+static inline const guint8 *
+frame_capture_get_frame (FrameCapture * cap, guint64 index, guint64 * pts)
+{
+  const guint8 *record = NULL;
+
+  if (index >= cap->header->n_frames)
+    return NULL;
+
+  record = frame_capture_record (cap, index);
+  *pts = ((const FrameCaptureRecord *) record)->pts;
+  return record + sizeof (FrameCaptureRecord);
+}
+
+#endif //FRAME_CAPTURE_H
@@ -0,0 +1,357 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides a pool of pre-allocated frame buffers.
+ *
+ * All buffers are allocated when the pool is created and recycled through
+ * an intrusive free list afterwards, so acquiring and releasing a buffer
+ * never allocates memory. Buffers are aligned for SIMD access and can
+ * optionally be backed by DMA-BUF heap memory, so they can be shared with
+ * hardware blocks by file descriptor. The pool is thread safe.
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+
+#include <glib.h>
+
+#define FRAME_POOL_ALIGN 64
+
+// DMA-BUF heaps tried in order when a dmabuf backed pool is requested.
+static const gchar *frame_pool_dma_heaps[] = {
+  "/dev/dma_heap/qcom,system",
+  "/dev/dma_heap/system",
+  NULL
+};
+
+typedef struct _FramePool FramePool;
+typedef struct _FramePoolBuffer FramePoolBuffer;
+
+/**
+ * FramePoolBuffer:
+ * @data  : CPU address of the buffer memory.
+ * @size  : Size of the buffer memory in bytes.
+ * @fd    : DMA-BUF file descriptor, or -1 for heap memory.
+ * @index : Index of the buffer inside its pool.
+ * @pts   : Presentation timestamp of the frame stored in the buffer.
+ * @time  : Monotonic time in us when the frame was captured.
+ * @width : Width of the frame the buffer contents were made from, 0 if
+ *          unknown.
+ * @height: Height of the frame the buffer contents were made from.
+ * @pool  : Pool owning the buffer.
+ *
+ * Buffer handed out by frame_pool_acquire().
+ */
+struct _FramePoolBuffer {
+  gpointer        data;
+  gsize           size;
+  gint            fd;
+  guint           index;
+  guint64         pts;
+  gint64          time;
+  gint            width;
+  gint            height;
+  FramePool       *pool;
+
+  // Private
+  FramePoolBuffer *next;
+};
+
+/**
+ * FramePoolStats:
+ * @n_buffers : Number of buffers in the pool.
+ * @in_use    : Number of buffers currently acquired.
+ * @high_water: Largest number of buffers acquired at the same time.
+ * @acquired  : Total number of successful acquisitions.
+ * @exhausted : Number of acquisitions that failed because no buffer was free.
+ *
+ * Usage statistics of a pool.
+ */
+typedef struct {
+  guint   n_buffers;
+  guint   in_use;
+  guint   high_water;
+  guint64 acquired;
+  guint64 exhausted;
+} FramePoolStats;
+
+struct _FramePool {
+  GMutex          lock;
+  GCond           cond;
+  FramePoolBuffer *buffers;
+  FramePoolBuffer *free_list;
+  gboolean        dmabuf;
+  FramePoolStats  stats;
+};
+
+/**
+ * Allocates the memory of a buffer from a DMA-BUF heap. On failure errno
+ * is that of the failing call, not of the cleanup after it.
+ */
+static inline gboolean
+frame_pool_dmabuf_alloc (FramePoolBuffer * buf, gsize size)
+{
+  struct dma_heap_allocation_data alloc;
+  gint heap_fd = -1, error = 0;
+
+  for (gint i = 0; frame_pool_dma_heaps[i] != NULL && heap_fd < 0; i++)
+    heap_fd = open (frame_pool_dma_heaps[i], O_RDONLY | O_CLOEXEC);
+
+  if (heap_fd < 0)
+    return FALSE;
+
+  memset (&alloc, 0, sizeof (alloc));
+  alloc.len = size;
+  alloc.fd_flags = O_RDWR | O_CLOEXEC;
+
+  if (ioctl (heap_fd, DMA_HEAP_IOCTL_ALLOC, &alloc) < 0) {
+    error = errno;
+    close (heap_fd);
+    errno = error;
+    return FALSE;
+  }
+  close (heap_fd);
+
+  buf->data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      alloc.fd, 0);
+  if (buf->data == MAP_FAILED) {
+    error = errno;
+    buf->data = NULL;
+    close (alloc.fd);
+    errno = error;
+    return FALSE;
+  }
+
+  buf->fd = alloc.fd;
+  return TRUE;
+}
+
+/**
+ * Frees a pool and all of its buffers. All buffers must have been released.
+ *
+ * @param pool Pool created with frame_pool_new().
+ */
+static inline void
+frame_pool_free (FramePool * pool)
+{
+  if (pool == NULL)
+    return;
+
+  if (pool->stats.in_use != 0)
+    g_printerr ("\n Frame pool freed with %u buffers in use!\n",
+        pool->stats.in_use);
+
+  for (guint i = 0; pool->buffers != NULL && i < pool->stats.n_buffers; i++) {
+    FramePoolBuffer *buf = &pool->buffers[i];
+
+    if (buf->fd >= 0) {
+      if (buf->data != NULL)
+        munmap (buf->data, buf->size);
+      close (buf->fd);
+    } else {
+      free (buf->data);
+    }
+  }
+
+  g_free (pool->buffers);
+  g_mutex_clear (&pool->lock);
+  g_cond_clear (&pool->cond);
+  g_free (pool);
+}
+
+/**
+ * Creates a pool and allocates all of its buffers up front. When @dmabuf
+ * is set the backing is decided by the first buffer: if it cannot be
+ * allocated from a DMA-BUF heap the whole pool falls back to heap memory
+ * and a warning is printed. A DMA-BUF failure after the first buffer fails
+ * the pool, so all buffers of a pool always have the same backing.
+ *
+ * @param size Size of every buffer in bytes.
+ * @param n_buffers Number of buffers in the pool.
+ * @param dmabuf Whether to allocate the buffers from a DMA-BUF heap.
+ * @return New pool or NULL on failure.
+ */
+static inline FramePool *
+frame_pool_new (gsize size, guint n_buffers, gboolean dmabuf)
+{
+  FramePool *pool = NULL;
+
+  if (size == 0 || n_buffers == 0)
+    return NULL;
+
+  pool = g_new0 (FramePool, 1);
+  g_mutex_init (&pool->lock);
+  g_cond_init (&pool->cond);
+
+  pool->buffers = g_new0 (FramePoolBuffer, n_buffers);
+  pool->stats.n_buffers = n_buffers;
+  pool->dmabuf = dmabuf;
+
+  // Keep buffer sizes a multiple of the alignment for SIMD tails
+  size = (size + FRAME_POOL_ALIGN - 1) & ~((gsize) FRAME_POOL_ALIGN - 1);
+
+  // frame_pool_free() of a partly allocated pool must not close fd 0
+  for (guint i = 0; i < n_buffers; i++)
+    pool->buffers[i].fd = -1;
+
+  for (guint i = 0; i < n_buffers; i++) {
+    FramePoolBuffer *buf = &pool->buffers[i];
+
+    buf->size = size;
+    buf->index = i;
+    buf->pool = pool;
+
+    if (pool->dmabuf && !frame_pool_dmabuf_alloc (buf, size)) {
+      gint error = errno;
+
+      if (i != 0) {
+        g_printerr ("\n DMA-BUF heap allocation of buffer %u failed (%s)\n",
+            i, g_strerror (error));
+        frame_pool_free (pool);
+        return NULL;
+      }
+
+      g_printerr ("\n DMA-BUF heap allocation failed (%s), using heap memory\n",
+          g_strerror (error));
+      pool->dmabuf = FALSE;
+    }
+
+    if (!pool->dmabuf &&
+        posix_memalign (&buf->data, FRAME_POOL_ALIGN, size) != 0) {
+      buf->data = NULL;
+      frame_pool_free (pool);
+      return NULL;
+    }
+
+    buf->next = pool->free_list;
+    pool->free_list = buf;
+  }
+
+  return pool;
+}
+
+/**
+ * Takes a buffer from the pool.
+ *
+ * @param pool Pool to take the buffer from.
+ * @param timeout_us Time to wait for a free buffer, 0 to return at once
+ *                   and -1 to wait forever.
+ * @return Buffer or NULL if no buffer became free in time.
+ */
+static inline FramePoolBuffer *
+frame_pool_acquire (FramePool * pool, gint64 timeout_us)
+{
+  FramePoolBuffer *buf = NULL;
+  gint64 deadline = 0;
+
+  if (timeout_us > 0)
+    deadline = g_get_monotonic_time () + timeout_us;
+
+  g_mutex_lock (&pool->lock);
+
+  while (pool->free_list == NULL && timeout_us != 0) {
+    if (timeout_us < 0)
+      g_cond_wait (&pool->cond, &pool->lock);
+    else if (!g_cond_wait_until (&pool->cond, &pool->lock, deadline))
+      break;
+  }
+
+  if ((buf = pool->free_list) != NULL) {
+    pool->free_list = buf->next;
+    buf->next = NULL;
+    pool->stats.in_use++;
+    pool->stats.acquired++;
+    pool->stats.high_water = MAX (pool->stats.high_water, pool->stats.in_use);
+  } else {
+    pool->stats.exhausted++;
+  }
+
+  g_mutex_unlock (&pool->lock);
+  return buf;
+}
+
+/**
+ * Returns a buffer to its pool.
+ *
+ * @param buf Buffer acquired with frame_pool_acquire().
+ */
+static inline void
+frame_pool_release (FramePoolBuffer * buf)
+{
+  FramePool *pool = buf->pool;
+
+  g_mutex_lock (&pool->lock);
+  buf->next = pool->free_list;
+  pool->free_list = buf;
+  pool->stats.in_use--;
+  g_cond_signal (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+}
+
+/**
+ * Brackets CPU access to a DMA-BUF backed buffer, so caches are kept
+ * coherent with hardware users of the same memory. No-op for heap memory.
+ *
+ * @param buf Acquired buffer.
+ * @param start TRUE before the CPU access, FALSE after it.
+ * @param write Whether the CPU writes to the buffer.
+ */
+static inline void
+frame_pool_buffer_sync (FramePoolBuffer * buf, gboolean start, gboolean write)
+{
+  struct dma_buf_sync sync;
+
+  if (buf->fd < 0)
+    return;
+
+  sync.flags = (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) |
+      (write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+  ioctl (buf->fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+/**
+ * Copies the usage statistics of a pool.
+ *
+ * @param pool Pool to query.
+ * @param stats Filled with the current statistics.
+ */
+static inline void
+frame_pool_get_stats (FramePool * pool, FramePoolStats * stats)
+{
+  g_mutex_lock (&pool->lock);
+  *stats = pool->stats;
+  g_mutex_unlock (&pool->lock);
+}
+
+/**
+ * Prints the usage statistics of a pool.
+ *
+ * @param pool Pool to print.
+ * @param name Name of the pool used in the output.
+ */
+static inline void
+frame_pool_print_stats (FramePool * pool, const gchar * name)
+{
+  FramePoolStats stats;
+
+  frame_pool_get_stats (pool, &stats);
+  g_print ("\n %s pool: %u buffers (%s), in use %u, high water %u, "
+      "acquired %" G_GUINT64_FORMAT ", exhausted %" G_GUINT64_FORMAT "\n",
+      name, stats.n_buffers, pool->dmabuf ? "dmabuf" : "heap", stats.in_use,
+      stats.high_water, stats.acquired, stats.exhausted);
+}
+
+#endif //FRAME_POOL_H
@@ -205,6 +205,59 @@ eos_cb (GstBus * bus, GstMessage * message, gpointer userdata)
   g_main_loop_quit (mloop);
 }
 
+/**
+ * Handles latency events by redistributing the latency in the pipeline and
+ * printing the new configured latency.
+ *
+ * @param bus Gstreamer bus for Mesaage passing in Pipeline.
+ * @param message Gstreamer latency Event Message.
+ * @param userdata Pointer to Application Pipeline.
+ */
+static void
+latency_cb (GstBus * bus, GstMessage * message, gpointer userdata)
+{
+  GstElement *pipeline = GST_ELEMENT (userdata);
+  GstQuery *query = NULL;
+  GstClockTime min_latency = 0, max_latency = 0;
+  gboolean live = FALSE;
+
+  gst_bin_recalculate_latency (GST_BIN (pipeline));
+
+  query = gst_query_new_latency ();
+  if (gst_element_query (pipeline, query)) {
+    gst_query_parse_latency (query, &live, &min_latency, &max_latency);
+    g_print ("\nPipeline latency: live=%d min=%" GST_TIME_FORMAT
+        " max=%" GST_TIME_FORMAT "\n", live, GST_TIME_ARGS (min_latency),
+        GST_TIME_ARGS (max_latency));
+  }
+  gst_query_unref (query);
+}
+
+/**
+ * Handles QoS events by printing which element dropped buffers and how
+ * late they were.
+ *
+ * @param bus Gstreamer bus for Mesaage passing in Pipeline.
+ * @param message Gstreamer QoS Event Message.
+ * @param userdata Unused.
+ */
+static void
+qos_cb (GstBus * bus, GstMessage * message, gpointer userdata)
+{
+  GstFormat format;
+  guint64 processed = 0, dropped = 0;
+  gint64 jitter = 0;
+  gdouble proportion = 0.0;
+  gint quality = 0;
+
+  gst_message_parse_qos_values (message, &jitter, &proportion, &quality);
+  gst_message_parse_qos_stats (message, &format, &processed, &dropped);
+
+  g_print ("\nQoS from '%s': jitter=%" G_GINT64_FORMAT " ns, proportion=%.3f, "
+      "processed=%" G_GUINT64_FORMAT ", dropped=%" G_GUINT64_FORMAT "\n",
+      GST_MESSAGE_SRC_NAME (message), jitter, proportion, processed, dropped);
+}
+
 /**
  * Handles state change events for the pipeline
  *
@@ -290,4 +343,499 @@ get_enum_value (GstElement * element, const gchar * prop_name,
   return ret;
 }
 
+/**
+ * GstWatchdogElement:
+ * @element   : Element being watched.
+ * @state     : Last state the element changed to.
+ * @last_in   : Monotonic time in us of the last buffer on a sink pad.
+ * @last_out  : Monotonic time in us of the last buffer on a src pad.
+ * @last_flow : Monotonic time in us of the last buffer the stall detection
+ *              looks at, on a src pad or on a sink pad for sinks.
+ * @has_src   : Whether the element has src pads.
+ * @buffers   : Number of buffers pushed on the src pads, or received on
+ *              the sink pads for sinks.
+ * @proc_sum  : Sum of the processing times in us.
+ * @proc_max  : Largest processing time in us.
+ * @proc_count: Number of processing time samples.
+ * @stalled   : Whether a stall is currently reported for the element.
+ * @removed   : Whether the element was removed from the pipeline.
+ * @pads      : Pads with a watchdog probe.
+ * @probe_ids : Probe ids, in the same order as @pads.
+ * @watchdog  : Watchdog owning the statistics.
+ * @lock      : Protects the buffer flow fields from @last_in to
+ *              @proc_count, @has_src, @pads and @probe_ids.
+ *
+ * Buffer flow statistics of one element. The processing time is the time
+ * from a buffer arriving on a sink pad to the next buffer leaving a src
+ * pad, which for queues includes the time spent queued. The pad probes
+ * only take the lock of their element, so elements streaming on different
+ * threads never contend.
+ */
+typedef struct {
+  GstElement *element;
+  GstState   state;
+  gint64     last_in;
+  gint64     last_out;
+  gint64     last_flow;
+  gboolean   has_src;
+  guint64    buffers;
+  gint64     proc_sum;
+  gint64     proc_max;
+  guint64    proc_count;
+  gboolean   stalled;
+  gboolean   removed;
+  GPtrArray  *pads;
+  GArray     *probe_ids;
+  gpointer   watchdog;
+  GMutex     lock;
+} GstWatchdogElement;
+
+/**
+ * GstPipelineWatchdog:
+ * @pipeline: Pipeline being watched.
+ * @elements: Array of GstWatchdogElement, one per element with pads.
+ * @lock    : Protects @elements, @playing_since and the element states.
+ * @stall_ms: Time without buffers after which an element is stalled.
+ * @timer_id: Main loop source checking for stalls.
+ * @dumps   : Number of pipeline graphs dumped.
+ * @playing_since: Monotonic time in us of the pipeline's last transition to
+ *                 PLAYING, 0 while it is not PLAYING.
+ *
+ * Tracks buffer flow through every element of a pipeline with pad probes
+ * and reports elements which stopped producing buffers, or sinks which
+ * stopped receiving them. The stall clock of an element starts when the
+ * pipeline goes to PLAYING, so elements which never produce a buffer are
+ * reported as well. Elements and pads added while the pipeline runs, e.g.
+ * by decodebin, are watched from the moment they appear.
+ */
+typedef struct {
+  GstElement *pipeline;
+  GPtrArray  *elements;
+  GMutex     lock;
+  guint      stall_ms;
+  guint      timer_id;
+  guint      dumps;
+  gint64     playing_since;
+} GstPipelineWatchdog;
+
+/**
+ * Pad probe recording the buffer flow of an element.
+ *
+ * @param pad Pad the buffer is passing.
+ * @param info Probe information.
+ * @param userdata Pointer to the GstWatchdogElement of the pad's element.
+ * @return GST_PAD_PROBE_OK to let the buffer pass.
+ */
+static GstPadProbeReturn
+watchdog_pad_probe (GstPad * pad, GstPadProbeInfo * info, gpointer userdata)
+{
+  GstWatchdogElement *wdelem = (GstWatchdogElement *) userdata;
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&wdelem->lock);
+
+  if (GST_PAD_DIRECTION (pad) == GST_PAD_SINK) {
+    wdelem->last_in = now;
+
+    if (!wdelem->has_src) {
+      wdelem->last_flow = now;
+      wdelem->buffers++;
+    }
+  } else {
+    wdelem->last_out = now;
+    wdelem->last_flow = now;
+    wdelem->buffers++;
+
+    if (wdelem->last_in > 0) {
+      gint64 proc = now - wdelem->last_in;
+
+      wdelem->proc_sum += proc;
+      wdelem->proc_max = MAX (wdelem->proc_max, proc);
+      wdelem->proc_count++;
+      wdelem->last_in = 0;
+    }
+  }
+
+  g_mutex_unlock (&wdelem->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * Prints the buffer flow statistics of every watched element.
+ *
+ * @param watchdog Pipeline watchdog.
+ */
+static void
+gst_pipeline_watchdog_print_stats (GstPipelineWatchdog * watchdog)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&watchdog->lock);
+  g_print ("\n%-24s %-8s %10s %12s %12s %14s\n", "element", "state",
+      "buffers", "avg (ms)", "max (ms)", "last out (ms)");
+
+  for (guint i = 0; i < watchdog->elements->len; i++) {
+    GstWatchdogElement *wdelem = (GstWatchdogElement *)
+        g_ptr_array_index (watchdog->elements, i);
+    gdouble avg = 0.0;
+
+    g_mutex_lock (&wdelem->lock);
+    if (wdelem->pads->len == 0) {
+      g_mutex_unlock (&wdelem->lock);
+      continue;
+    }
+
+    if (wdelem->proc_count > 0)
+      avg = (gdouble) wdelem->proc_sum / wdelem->proc_count / 1000.0;
+
+    g_print ("%-24s %-8s %10" G_GUINT64_FORMAT " %12.3f %12.3f %14.1f\n",
+        GST_ELEMENT_NAME (wdelem->element),
+        gst_element_state_get_name (wdelem->state), wdelem->buffers, avg,
+        wdelem->proc_max / 1000.0,
+        wdelem->last_out ? (now - wdelem->last_out) / 1000.0 : -1.0);
+    g_mutex_unlock (&wdelem->lock);
+  }
+
+  g_mutex_unlock (&watchdog->lock);
+}
+
+/**
+ * Periodic check for elements which stopped producing buffers. On a new
+ * stall the statistics are printed and the pipeline graph is dumped to
+ * $GST_DEBUG_DUMP_DOT_DIR.
+ *
+ * @param userdata Pointer to the GstPipelineWatchdog.
+ * @return TRUE to keep the check running.
+ */
+static gboolean
+watchdog_check_stalls (gpointer userdata)
+{
+  GstPipelineWatchdog *watchdog = (GstPipelineWatchdog *) userdata;
+  gint64 now = g_get_monotonic_time ();
+  gint64 limit = (gint64) watchdog->stall_ms * 1000;
+  gboolean new_stall = FALSE;
+
+  g_mutex_lock (&watchdog->lock);
+  if (watchdog->playing_since == 0) {
+    g_mutex_unlock (&watchdog->lock);
+    return TRUE;
+  }
+
+  for (guint i = 0; i < watchdog->elements->len; i++) {
+    GstWatchdogElement *wdelem = (GstWatchdogElement *)
+        g_ptr_array_index (watchdog->elements, i);
+    gint64 since = 0;
+    gboolean stalled = FALSE, has_pads = FALSE;
+
+    // Buffers from before the last pause do not count
+    g_mutex_lock (&wdelem->lock);
+    since = MAX (wdelem->last_flow, watchdog->playing_since);
+    has_pads = wdelem->pads->len > 0;
+    g_mutex_unlock (&wdelem->lock);
+    stalled = has_pads && !wdelem->removed && now - since > limit;
+
+    if (stalled && !wdelem->stalled) {
+      g_printerr ("\nWatchdog: '%s' %s no buffers for %" G_GINT64_FORMAT
+          " ms!\n", GST_ELEMENT_NAME (wdelem->element),
+          wdelem->has_src ? "produced" : "received", (now - since) / 1000);
+      new_stall = TRUE;
+    } else if (!stalled && wdelem->stalled) {
+      g_print ("\nWatchdog: '%s' resumed buffer flow\n",
+          GST_ELEMENT_NAME (wdelem->element));
+    }
+
+    wdelem->stalled = stalled;
+  }
+  g_mutex_unlock (&watchdog->lock);
+
+  if (new_stall) {
+    gchar *name = g_strdup_printf ("stall-%u", watchdog->dumps++);
+
+    gst_pipeline_watchdog_print_stats (watchdog);
+    GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (watchdog->pipeline),
+        GST_DEBUG_GRAPH_SHOW_ALL, name);
+    g_free (name);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Records element state changes, so stall reports show the element states,
+ * and starts the stall clock when the pipeline goes to PLAYING.
+ *
+ * @param bus Gstreamer bus for Mesaage passing in Pipeline.
+ * @param message Gstreamer state changed Message.
+ * @param userdata Pointer to the GstPipelineWatchdog.
+ */
+static void
+watchdog_state_changed_cb (GstBus * bus, GstMessage * message,
+    gpointer userdata)
+{
+  GstPipelineWatchdog *watchdog = (GstPipelineWatchdog *) userdata;
+  GstState old_st, new_st, pending;
+
+  gst_message_parse_state_changed (message, &old_st, &new_st, &pending);
+
+  g_mutex_lock (&watchdog->lock);
+  if (GST_MESSAGE_SRC (message) == GST_OBJECT_CAST (watchdog->pipeline)) {
+    if (new_st != GST_STATE_PLAYING)
+      watchdog->playing_since = 0;
+    else if (old_st != GST_STATE_PLAYING)
+      watchdog->playing_since = g_get_monotonic_time ();
+  }
+
+  for (guint i = 0; i < watchdog->elements->len; i++) {
+    GstWatchdogElement *wdelem = (GstWatchdogElement *)
+        g_ptr_array_index (watchdog->elements, i);
+
+    if (GST_MESSAGE_SRC (message) == GST_OBJECT_CAST (wdelem->element)) {
+      wdelem->state = new_st;
+      break;
+    }
+  }
+  g_mutex_unlock (&watchdog->lock);
+}
+
+/**
+ * Removes the probes of a watched element and frees its statistics.
+ *
+ * @param data Pointer to the GstWatchdogElement.
+ */
+static void
+watchdog_element_free (gpointer data)
+{
+  GstWatchdogElement *wdelem = (GstWatchdogElement *) data;
+
+  g_signal_handlers_disconnect_by_data (wdelem->element, wdelem);
+
+  for (guint i = 0; i < wdelem->pads->len; i++)
+    gst_pad_remove_probe (GST_PAD (g_ptr_array_index (wdelem->pads, i)),
+        g_array_index (wdelem->probe_ids, gulong, i));
+
+  g_ptr_array_free (wdelem->pads, TRUE);
+  g_array_free (wdelem->probe_ids, TRUE);
+  g_mutex_clear (&wdelem->lock);
+  gst_object_unref (wdelem->element);
+  g_free (wdelem);
+}
+
+/**
+ * Installs the buffer probe on a pad of a watched element, once per pad.
+ *
+ * @param wdelem Watched element owning the pad.
+ * @param pad Pad to probe.
+ */
+static void
+watchdog_watch_pad (GstWatchdogElement * wdelem, GstPad * pad)
+{
+  gulong id = 0;
+
+  g_mutex_lock (&wdelem->lock);
+  for (guint i = 0; i < wdelem->pads->len; i++) {
+    if (g_ptr_array_index (wdelem->pads, i) == pad) {
+      g_mutex_unlock (&wdelem->lock);
+      return;
+    }
+  }
+
+  if (GST_PAD_DIRECTION (pad) == GST_PAD_SRC)
+    wdelem->has_src = TRUE;
+
+  id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, watchdog_pad_probe,
+      wdelem, NULL);
+  g_ptr_array_add (wdelem->pads, gst_object_ref (pad));
+  g_array_append_val (wdelem->probe_ids, id);
+  g_mutex_unlock (&wdelem->lock);
+}
+
+/**
+ * Watches the pads an element creates while running, e.g. the sometimes
+ * pads of demuxers.
+ *
+ * @param element Element the pad was added to.
+ * @param pad New pad.
+ * @param userdata Pointer to the GstWatchdogElement of the element.
+ */
+static void
+watchdog_pad_added_cb (GstElement * element, GstPad * pad, gpointer userdata)
+{
+  watchdog_watch_pad ((GstWatchdogElement *) userdata, pad);
+}
+
+/**
+ * Starts watching an element and all of its pads, including pads added
+ * later. Bins are covered by their children.
+ *
+ * @param watchdog Pipeline watchdog.
+ * @param element Element to watch, watching it twice is a no-op.
+ */
+static void
+watchdog_watch_element (GstPipelineWatchdog * watchdog, GstElement * element)
+{
+  GstWatchdogElement *wdelem = NULL;
+  GstIterator *it = NULL;
+  GValue item = G_VALUE_INIT;
+
+  if (GST_IS_BIN (element))
+    return;
+
+  g_mutex_lock (&watchdog->lock);
+  for (guint i = 0; i < watchdog->elements->len; i++) {
+    GstWatchdogElement *other = (GstWatchdogElement *)
+        g_ptr_array_index (watchdog->elements, i);
+
+    if (other->element == element && !other->removed) {
+      g_mutex_unlock (&watchdog->lock);
+      return;
+    }
+  }
+
+  wdelem = g_new0 (GstWatchdogElement, 1);
+  wdelem->element = (GstElement *) gst_object_ref (element);
+  wdelem->state = GST_STATE (element);
+  wdelem->pads = g_ptr_array_new_with_free_func (gst_object_unref);
+  wdelem->probe_ids = g_array_new (FALSE, FALSE, sizeof (gulong));
+  wdelem->watchdog = watchdog;
+  g_mutex_init (&wdelem->lock);
+  g_ptr_array_add (watchdog->elements, wdelem);
+  g_mutex_unlock (&watchdog->lock);
+
+  // Connected first, a pad added meanwhile is then probed only once
+  g_signal_connect (element, "pad-added", G_CALLBACK (watchdog_pad_added_cb),
+      wdelem);
+
+  it = gst_element_iterate_pads (element);
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    watchdog_watch_pad (wdelem, GST_PAD (g_value_get_object (&item)));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+/**
+ * Watches an element added to the pipeline or one of its bins while the
+ * watchdog runs. For an added bin its children are watched as well.
+ *
+ * @param bin Pipeline the signal is emitted on.
+ * @param sub_bin Bin the element was added to.
+ * @param element New element.
+ * @param userdata Pointer to the GstPipelineWatchdog.
+ */
+static void
+watchdog_element_added_cb (GstBin * bin, GstBin * sub_bin,
+    GstElement * element, gpointer userdata)
+{
+  GstPipelineWatchdog *watchdog = (GstPipelineWatchdog *) userdata;
+  GstIterator *it = NULL;
+  GValue item = G_VALUE_INIT;
+
+  if (!GST_IS_BIN (element)) {
+    watchdog_watch_element (watchdog, element);
+    return;
+  }
+
+  it = gst_bin_iterate_recurse (GST_BIN (element));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    watchdog_watch_element (watchdog,
+        GST_ELEMENT (g_value_get_object (&item)));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+/**
+ * Stops reporting an element removed from the pipeline. Its statistics
+ * are kept until the watchdog is freed, as its probes may still run.
+ *
+ * @param bin Pipeline the signal is emitted on.
+ * @param sub_bin Bin the element was removed from.
+ * @param element Removed element.
+ * @param userdata Pointer to the GstPipelineWatchdog.
+ */
+static void
+watchdog_element_removed_cb (GstBin * bin, GstBin * sub_bin,
+    GstElement * element, gpointer userdata)
+{
+  GstPipelineWatchdog *watchdog = (GstPipelineWatchdog *) userdata;
+
+  g_mutex_lock (&watchdog->lock);
+  for (guint i = 0; i < watchdog->elements->len; i++) {
+    GstWatchdogElement *wdelem = (GstWatchdogElement *)
+        g_ptr_array_index (watchdog->elements, i);
+
+    if (wdelem->element == element)
+      wdelem->removed = TRUE;
+  }
+  g_mutex_unlock (&watchdog->lock);
+}
+
+/**
+ * Creates a watchdog for all elements of the pipeline, including elements
+ * and pads added later. Must be called from the thread running the default
+ * main context, after the pipeline is built and before it is started.
+ *
+ * @param pipeline Pipeline to watch.
+ * @param stall_ms Time without buffers after which an element is stalled.
+ * @return New watchdog, free with gst_pipeline_watchdog_free().
+ */
+static GstPipelineWatchdog *
+gst_pipeline_watchdog_new (GstElement * pipeline, guint stall_ms)
+{
+  GstPipelineWatchdog *watchdog = g_new0 (GstPipelineWatchdog, 1);
+  GstBus *bus = NULL;
+
+  watchdog->pipeline = (GstElement *) gst_object_ref (pipeline);
+  watchdog->elements = g_ptr_array_new_with_free_func (watchdog_element_free);
+  watchdog->stall_ms = stall_ms;
+  g_mutex_init (&watchdog->lock);
+
+  // Connected first, an element added meanwhile is then watched only once
+  g_signal_connect (pipeline, "deep-element-added",
+      G_CALLBACK (watchdog_element_added_cb), watchdog);
+  g_signal_connect (pipeline, "deep-element-removed",
+      G_CALLBACK (watchdog_element_removed_cb), watchdog);
+  watchdog_element_added_cb (GST_BIN (pipeline), NULL, pipeline, watchdog);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message::state-changed",
+      G_CALLBACK (watchdog_state_changed_cb), watchdog);
+  gst_object_unref (bus);
+
+  watchdog->timer_id = g_timeout_add (MAX (stall_ms / 4, 10),
+      watchdog_check_stalls, watchdog);
+
+  return watchdog;
+}
+
+/**
+ * Stops the watchdog and frees it. The pipeline must be in NULL state.
+ *
+ * @param watchdog Watchdog created with gst_pipeline_watchdog_new().
+ */
+static void
+gst_pipeline_watchdog_free (GstPipelineWatchdog * watchdog)
+{
+  GstBus *bus = NULL;
+
+  if (watchdog == NULL)
+    return;
+
+  g_source_remove (watchdog->timer_id);
+  g_signal_handlers_disconnect_by_data (watchdog->pipeline, watchdog);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (watchdog->pipeline));
+  g_signal_handlers_disconnect_by_data (bus, watchdog);
+  gst_bus_remove_signal_watch (bus);
+  gst_object_unref (bus);
+
+  g_ptr_array_free (watchdog->elements, TRUE);
+  g_mutex_clear (&watchdog->lock);
+  gst_object_unref (watchdog->pipeline);
+  g_free (watchdog);
+}
+
 #endif //GST_SAMPLE_APPS_UTILS_H
@@ -0,0 +1,976 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides an asynchronous ONNX Runtime inference stage.
+ *
+ * Preprocessed tensors from a FramePool are pushed into the stage and run
+ * on a dedicated inference thread, while the outputs are postprocessed on
+ * a separate thread. Every buffer of the pool is wrapped in an input
+ * tensor once and the results are recycled between the threads with their
+ * output tensors bound to the session, so the steady state does not
+ * allocate. Together with the capture and preprocessing threads
+ * of the application, all stages work on different frames at the same
+ * time. The CPU execution provider is used for development on a host and
+ * the QNN execution provider on target. The outputs are decoded as YOLO
+ * detections, pose keypoints or a segmentation overlay when a decoder is
+ * set, otherwise the top-1 class is reported.
+ */
+
+#ifndef ML_INFERENCE_H
+#define ML_INFERENCE_H
+
+#include <glib.h>
+#include <onnxruntime_c_api.h>
+
+#include "frame_pool.h"
+#include "ml_preprocess.h"
+#include "pose_decoder.h"
+#include "seg_decoder.h"
+#include "yolo_decoder.h"
+
+#define ML_INFERENCE_STATS_INTERVAL 100
+
+// Results in flight: one being inferred, one queued and one postprocessed.
+#define ML_INFERENCE_SLOTS 3
+
+// Maximum number of dimensions of a bound output.
+#define ML_INFERENCE_MAX_DIMS 8
+
+// Marks the end of the stream in the stage queues.
+static gint ml_inference_eos;
+#define ML_INFERENCE_EOS ((gpointer) &ml_inference_eos)
+
+/**
+ * MLInferenceResult:
+ * @outputs      : Output tensors of the model.
+ * @time         : Monotonic capture time in us of the frame.
+ * @infer_us     : Duration of the inference in us.
+ * @frame_width  : Width of the frame, 0 if unknown.
+ * @frame_height : Height of the frame, 0 if unknown.
+ *
+ * Inference result handed from the inference to the postprocess thread.
+ * With static output shapes the outputs are allocated once and bound to
+ * the session, otherwise ONNX Runtime allocates them on every run.
+ */
+typedef struct {
+  OrtValue     **outputs;
+  gint64       time;
+  gint64       infer_us;
+  gint         frame_width;
+  gint         frame_height;
+
+  // Private
+  OrtIoBinding *binding;
+} MLInferenceResult;
+
+/**
+ * MLInference:
+ * @width     : Model input width.
+ * @height    : Model input height.
+ * @layout    : Model input layout, NCHW if the 2nd dimension is 3.
+ * @type      : Model input element type.
+ * @input_size: Size of the model input tensor in bytes.
+ * @yolo      : Detection decoder of the outputs, see
+ *              ml_inference_set_yolo_decoder(). The boxes are mapped to
+ *              frame pixels when the frame size is known.
+ * @pose      : Pose decoder of the outputs, see
+ *              ml_inference_set_pose_decoder(). The keypoints are mapped
+ *              to frame pixels when the frame size is known.
+ * @seg       : Segmentation decoder of the outputs, see
+ *              ml_inference_set_seg_decoder().
+ *
+ * Asynchronous inference stage. The input geometry is read from the model
+ * so the preprocessing can be configured to match it.
+ */
+typedef struct {
+  gint           width;
+  gint           height;
+  MLTensorLayout layout;
+  MLTensorType   type;
+  gsize          input_size;
+  YoloDecoder    *yolo;
+  PoseDecoder    *pose;
+  SegDecoder     *seg;
+
+  // Private
+  const OrtApi   *ort;
+  OrtEnv         *env;
+  OrtSession     *session;
+  OrtMemoryInfo  *memory_info;
+  OrtAllocator   *allocator;
+  gchar          *input_name;
+  int64_t        input_dims[4];
+  ONNXTensorElementDataType input_type;
+  gchar          **output_names;
+  gsize          n_outputs;
+  FramePool      *pool;
+  OrtValue       **inputs;
+  guint          n_inputs;
+  gboolean       bound_outputs;
+  MLInferenceResult results[ML_INFERENCE_SLOTS];
+
+  GAsyncQueue    *free_results;
+  GAsyncQueue    *infer_queue;
+  GAsyncQueue    *post_queue;
+  GThread        *infer_thread;
+  GThread        *post_thread;
+
+  // Statistics, updated by the postprocess thread only
+  guint64        frames;
+  gint64         first_time;
+  gint64         infer_sum;
+  gint64         post_sum;
+  gint64         latency_sum;
+  gint64         latency_max;
+} MLInference;
+
+/**
+ * Prints and releases an ONNX Runtime status.
+ *
+ * @param ort ONNX Runtime API.
+ * @param status Status returned by an API call.
+ * @return TRUE if the call succeeded, FALSE otherwise.
+ */
+static inline gboolean
+ml_ort_check (const OrtApi * ort, OrtStatus * status)
+{
+  if (status != NULL) {
+    g_printerr ("\n ORT Error: %s\n", ort->GetErrorMessage (status));
+    ort->ReleaseStatus (status);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Index of the largest element of a float output, used as the generic
+ * postprocessing of classification like models.
+ */
+static inline gsize
+ml_inference_argmax (const gfloat * data, gsize count, gfloat * max)
+{
+  gsize idx = 0;
+
+  for (gsize i = 1; i < count; i++)
+    if (data[i] > data[idx])
+      idx = i;
+
+  *max = data[idx];
+  return idx;
+}
+
+/**
+ * Decodes the outputs of a detection model with the YOLO decoder.
+ *
+ * @return Number of detections or -1 if the outputs are not supported.
+ */
+static inline gint
+ml_inference_decode_yolo (MLInference * inf, OrtValue ** outputs)
+{
+  const OrtApi *ort = inf->ort;
+  YoloTensor tensors[YOLO_MAX_OUTPUTS];
+  gsize n_tensors = MIN (inf->n_outputs, YOLO_MAX_OUTPUTS);
+
+  for (gsize i = 0; i < n_tensors; i++) {
+    OrtTensorTypeAndShapeInfo *info = NULL;
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    void *data = NULL;
+    gboolean ok = FALSE;
+
+    if (!ml_ort_check (ort, ort->GetTensorTypeAndShape (outputs[i], &info)))
+      return -1;
+
+    ok = ml_ort_check (ort, ort->GetTensorElementType (info, &type)) &&
+        ml_ort_check (ort, ort->GetDimensionsCount (info,
+            &tensors[i].n_dims)) &&
+        tensors[i].n_dims <= YOLO_MAX_DIMS &&
+        ml_ort_check (ort, ort->GetDimensions (info, tensors[i].dims,
+            tensors[i].n_dims)) &&
+        ml_ort_check (ort, ort->GetTensorMutableData (outputs[i], &data));
+    ort->ReleaseTensorTypeAndShapeInfo (info);
+
+    if (!ok)
+      return -1;
+
+    tensors[i].data = data;
+    switch (type) {
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        tensors[i].type = YOLO_TENSOR_FLOAT;
+        break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+        tensors[i].type = YOLO_TENSOR_UINT8;
+        break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+        tensors[i].type = YOLO_TENSOR_INT32;
+        break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+        tensors[i].type = YOLO_TENSOR_INT64;
+        break;
+      default:
+        g_printerr ("\n Unsupported element type of output %zu!\n", i);
+        return -1;
+    }
+  }
+
+  return yolo_decoder_process (inf->yolo, tensors, n_tensors);
+}
+
+/**
+ * Decodes the heatmaps of a pose model with the pose decoder.
+ *
+ * @return Number of visible keypoints or -1 if the output is not
+ *         supported.
+ */
+static inline gint
+ml_inference_decode_pose (MLInference * inf, OrtValue ** outputs)
+{
+  const OrtApi *ort = inf->ort;
+  OrtTensorTypeAndShapeInfo *info = NULL;
+  ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+  int64_t dims[4];
+  size_t n_dims = 0;
+  void *data = NULL;
+  gboolean ok = FALSE;
+
+  if (!ml_ort_check (ort, ort->GetTensorTypeAndShape (outputs[0], &info)))
+    return -1;
+
+  ok = ml_ort_check (ort, ort->GetTensorElementType (info, &type)) &&
+      ml_ort_check (ort, ort->GetDimensionsCount (info, &n_dims)) &&
+      n_dims == 4 && ml_ort_check (ort, ort->GetDimensions (info, dims, 4)) &&
+      ml_ort_check (ort, ort->GetTensorMutableData (outputs[0], &data));
+  ort->ReleaseTensorTypeAndShapeInfo (info);
+
+  if (!ok || (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT &&
+          type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8)) {
+    g_printerr ("\n Pose output must be a 4D float or uint8 tensor!\n");
+    return -1;
+  }
+
+  return pose_decoder_process (inf->pose, data,
+      (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) ?
+      ML_TYPE_UINT8 : ML_TYPE_FLOAT32, dims);
+}
+
+/**
+ * Decodes the output of a segmentation model with the segmentation
+ * decoder. The overlay covers the frame, without the letterbox padding of
+ * the model input.
+ *
+ * @return Number of classes present or -1 if the output is not supported.
+ */
+static inline gint
+ml_inference_decode_seg (MLInference * inf, MLInferenceResult * result)
+{
+  const OrtApi *ort = inf->ort;
+  OrtTensorTypeAndShapeInfo *info = NULL;
+  ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+  int64_t dims[4] = { 1, 1, 1, 1 };
+  size_t n_dims = 0;
+  void *data = NULL;
+  gboolean ok = FALSE, classes = FALSE, nchw = FALSE, scores = FALSE;
+  gint width = 0, height = 0, channels = 0, elem_size = 0, n_classes = 0;
+  gint left = 0, top = 0, content_width = inf->width;
+  gint content_height = inf->height;
+  gint out_width = 0, out_height = 0, src_x, src_y, src_width, src_height;
+  gdouble scale_x, scale_y;
+
+  if (!ml_ort_check (ort, ort->GetTensorTypeAndShape (result->outputs[0],
+              &info)))
+    return -1;
+
+  ok = ml_ort_check (ort, ort->GetTensorElementType (info, &type)) &&
+      ml_ort_check (ort, ort->GetDimensionsCount (info, &n_dims)) &&
+      (n_dims == 3 || n_dims == 4) &&
+      ml_ort_check (ort, ort->GetDimensions (info, dims, n_dims)) &&
+      ml_ort_check (ort, ort->GetTensorMutableData (result->outputs[0],
+              &data));
+  ort->ReleaseTensorTypeAndShapeInfo (info);
+
+  scores = type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT ||
+      type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
+  elem_size = (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64) ? 8 :
+      (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32) ? 4 :
+      (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) ? 1 : 0;
+
+  if (ok && n_dims == 3) {
+    // [1, H, W] classes of a model with argmax
+    classes = TRUE;
+    height = (gint) dims[1];
+    width = (gint) dims[2];
+  } else if (ok) {
+    // The classes are the smaller of the 2nd and last dimension, a single
+    // channel of integers holds the class of every pixel
+    nchw = dims[1] <= dims[3];
+    channels = (gint) (nchw ? dims[1] : dims[3]);
+    height = (gint) (nchw ? dims[2] : dims[1]);
+    width = (gint) (nchw ? dims[3] : dims[2]);
+    classes = channels == 1 && elem_size > 0;
+  }
+
+  if (!ok || dims[0] != 1 || width <= 0 || height <= 0 ||
+      (classes && elem_size == 0) || (!classes && !scores)) {
+    g_printerr ("\n Segmentation output must be a [1, C, H, W] or "
+        "[1, H, W, C] float or uint8 tensor, or [1, H, W] classes!\n");
+    return -1;
+  }
+
+  // Without the frame size the overlay is the region of the output
+  if (result->frame_width > 0 && result->frame_height > 0) {
+    ml_preprocess_letterbox (result->frame_width, result->frame_height,
+        inf->width, inf->height, &left, &top, &content_width,
+        &content_height);
+    out_width = result->frame_width;
+    out_height = result->frame_height;
+  }
+
+  scale_x = (gdouble) width / inf->width;
+  scale_y = (gdouble) height / inf->height;
+  src_x = CLAMP ((gint) lrint (left * scale_x), 0, width - 1);
+  src_y = CLAMP ((gint) lrint (top * scale_y), 0, height - 1);
+  src_width = CLAMP ((gint) lrint (content_width * scale_x), 1, width - src_x);
+  src_height = CLAMP ((gint) lrint (content_height * scale_y), 1,
+      height - src_y);
+
+  if (!seg_decoder_set_geometry (inf->seg, width, height, src_x, src_y,
+          src_width, src_height, (out_width > 0) ? out_width : src_width,
+          (out_height > 0) ? out_height : src_height))
+    return -1;
+
+  if (classes)
+    ok = seg_decoder_process_classes (inf->seg, data, elem_size);
+  else
+    ok = seg_decoder_process (inf->seg, data,
+        (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) ? ML_TYPE_UINT8 :
+        ML_TYPE_FLOAT32, nchw ? ML_LAYOUT_NCHW : ML_LAYOUT_NHWC, channels);
+
+  if (!ok)
+    return -1;
+
+  for (gint id = 0; id < SEG_MAX_CLASSES; id++)
+    n_classes += (inf->seg->class_pixels[id] > 0);
+  return n_classes;
+}
+
+/**
+ * Returns a result to the free results. Outputs ONNX Runtime allocated for
+ * dynamic shapes are released, bound outputs are kept for the next run.
+ */
+static inline void
+ml_inference_recycle (MLInference * inf, MLInferenceResult * result)
+{
+  for (gsize i = 0; !inf->bound_outputs && i < inf->n_outputs; i++) {
+    if (result->outputs[i] != NULL)
+      inf->ort->ReleaseValue (result->outputs[i]);
+    result->outputs[i] = NULL;
+  }
+
+  g_async_queue_push (inf->free_results, result);
+}
+
+static gpointer
+ml_inference_thread (gpointer userdata)
+{
+  MLInference *inf = (MLInference *) userdata;
+  const OrtApi *ort = inf->ort;
+  gpointer item = NULL;
+
+  while ((item = g_async_queue_pop (inf->infer_queue)) != ML_INFERENCE_EOS) {
+    FramePoolBuffer *tensor = (FramePoolBuffer *) item;
+    MLInferenceResult *result = NULL;
+    OrtValue *input = NULL;
+    gint64 start = 0;
+    gboolean ok = FALSE;
+
+    // Waits while all results are queued for or in postprocessing
+    result = (MLInferenceResult *) g_async_queue_pop (inf->free_results);
+    start = g_get_monotonic_time ();
+
+    result->time = tensor->time;
+    result->frame_width = tensor->width;
+    result->frame_height = tensor->height;
+
+    // The input tensor of the pool buffer, the input is never copied
+    if (tensor->pool == inf->pool && tensor->index < inf->n_inputs)
+      input = inf->inputs[tensor->index];
+
+    if (input == NULL) {
+      g_printerr ("\n Tensor is not from the pool of the inference stage!\n");
+    } else if (inf->bound_outputs) {
+      ok = ml_ort_check (ort, ort->BindInput (result->binding,
+              inf->input_name, input)) &&
+          ml_ort_check (ort, ort->RunWithBinding (inf->session, NULL,
+              result->binding));
+    } else {
+      const char *input_names[] = { inf->input_name };
+
+      ok = ml_ort_check (ort, ort->Run (inf->session, NULL, input_names,
+          (const OrtValue * const *) &input, 1,
+          (const char * const *) inf->output_names, inf->n_outputs,
+          result->outputs));
+    }
+
+    frame_pool_release (tensor);
+    result->infer_us = g_get_monotonic_time () - start;
+
+    if (!ok) {
+      ml_inference_recycle (inf, result);
+      continue;
+    }
+
+    g_async_queue_push (inf->post_queue, result);
+  }
+
+  g_async_queue_push (inf->post_queue, ML_INFERENCE_EOS);
+  return NULL;
+}
+
+/**
+ * Maps the decoded boxes and keypoints from model input pixels to frame
+ * pixels by undoing the letterbox of the preprocessing. Without the frame
+ * size they stay in model input pixels.
+ */
+static inline void
+ml_inference_map_to_frame (MLInference * inf,
+    const MLInferenceResult * result)
+{
+  gint left = 0, top = 0, width = 0, height = 0;
+  gfloat fw = (gfloat) result->frame_width;
+  gfloat fh = (gfloat) result->frame_height;
+  gfloat r = 0.0F;
+
+  if (result->frame_width <= 0 || result->frame_height <= 0)
+    return;
+
+  r = (gfloat) ml_preprocess_letterbox (result->frame_width,
+      result->frame_height, inf->width, inf->height, &left, &top, &width,
+      &height);
+
+  for (gint i = 0; inf->yolo != NULL && i < inf->yolo->n_detections; i++) {
+    YoloDetection *det = &inf->yolo->detections[i];
+
+    det->x0 = CLAMP ((det->x0 - left) / r, 0.0F, fw);
+    det->y0 = CLAMP ((det->y0 - top) / r, 0.0F, fh);
+    det->x1 = CLAMP ((det->x1 - left) / r, 0.0F, fw);
+    det->y1 = CLAMP ((det->y1 - top) / r, 0.0F, fh);
+  }
+
+  for (gint i = 0; inf->pose != NULL && i < inf->pose->n_keypoints; i++) {
+    PoseKeypoint *kp = &inf->pose->keypoints[i];
+
+    kp->x = CLAMP ((kp->x - left) / r, 0.0F, fw);
+    kp->y = CLAMP ((kp->y - top) / r, 0.0F, fh);
+  }
+}
+
+static gpointer
+ml_postprocess_thread (gpointer userdata)
+{
+  MLInference *inf = (MLInference *) userdata;
+  const OrtApi *ort = inf->ort;
+  gpointer item = NULL;
+
+  while ((item = g_async_queue_pop (inf->post_queue)) != ML_INFERENCE_EOS) {
+    MLInferenceResult *result = (MLInferenceResult *) item;
+    OrtTensorTypeAndShapeInfo *info = NULL;
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    size_t count = 0;
+    void *data = NULL;
+    gsize top = 0;
+    gfloat score = 0.0F;
+    gint n_detections = 0, n_keypoints = 0, n_classes = 0;
+    gint64 start = g_get_monotonic_time (), end;
+
+    // Outputs a decoder does not support are reported once, then the
+    // stage falls back to the top-1 class
+    if (inf->yolo != NULL &&
+        (n_detections = ml_inference_decode_yolo (inf, result->outputs)) < 0) {
+      g_printerr ("\n Disabling the detection decoder!\n");
+      yolo_decoder_free (inf->yolo);
+      inf->yolo = NULL;
+    }
+
+    if (inf->pose != NULL &&
+        (n_keypoints = ml_inference_decode_pose (inf, result->outputs)) < 0) {
+      g_printerr ("\n Disabling the pose decoder!\n");
+      pose_decoder_free (inf->pose);
+      inf->pose = NULL;
+    }
+
+    if (inf->seg != NULL &&
+        (n_classes = ml_inference_decode_seg (inf, result)) < 0) {
+      g_printerr ("\n Disabling the segmentation decoder!\n");
+      seg_decoder_free (inf->seg);
+      inf->seg = NULL;
+    }
+
+    ml_inference_map_to_frame (inf, result);
+
+    if (inf->yolo == NULL && inf->pose == NULL && inf->seg == NULL &&
+        ml_ort_check (ort, ort->GetTensorTypeAndShape (result->outputs[0],
+                &info))) {
+      ml_ort_check (ort, ort->GetTensorElementType (info, &type));
+      ml_ort_check (ort, ort->GetTensorShapeElementCount (info, &count));
+      ort->ReleaseTensorTypeAndShapeInfo (info);
+    }
+
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && count > 0 &&
+        ml_ort_check (ort, ort->GetTensorMutableData (result->outputs[0],
+            &data)))
+      top = ml_inference_argmax ((const gfloat *) data, count, &score);
+
+    end = g_get_monotonic_time ();
+    if (inf->frames == 0)
+      inf->first_time = result->time;
+
+    inf->frames++;
+    inf->infer_sum += result->infer_us;
+    inf->post_sum += end - start;
+    inf->latency_sum += end - result->time;
+    inf->latency_max = MAX (inf->latency_max, end - result->time);
+
+    if (inf->frames % ML_INFERENCE_STATS_INTERVAL == 0) {
+      if (inf->seg != NULL) {
+        gfloat coverage = 0.0F;
+        gint id = seg_decoder_largest_class (inf->seg, &coverage);
+        const gchar *label = seg_decoder_label (inf->seg, id);
+
+        g_print ("\n Inference: %dx%d overlay, %d classes, largest %s (%d) "
+            "covers %.1f%%\n", inf->seg->out_width, inf->seg->out_height,
+            n_classes, (label != NULL) ? label : "-", id, coverage * 100.0F);
+      } else if (inf->pose != NULL) {
+        g_print ("\n Inference: pose score %.4f, %d of %d keypoints and "
+            "%d of %d links visible\n", inf->pose->score, n_keypoints,
+            inf->pose->n_keypoints, inf->pose->n_visible_links,
+            inf->pose->n_links);
+      } else if (inf->yolo == NULL) {
+        g_print ("\n Inference: top-1 index %" G_GSIZE_FORMAT " score %.4f\n",
+            top, score);
+      } else if (n_detections > 0) {
+        const YoloDetection *det = &inf->yolo->detections[0];
+        const gchar *label = yolo_decoder_label (inf->yolo, det->class_id);
+
+        g_print ("\n Inference: %d detections, best %s (%d) score %.4f at "
+            "[%.0f, %.0f, %.0f, %.0f]\n", n_detections,
+            (label != NULL) ? label : "-", det->class_id, det->score,
+            det->x0, det->y0, det->x1, det->y1);
+      } else {
+        g_print ("\n Inference: no detections\n");
+      }
+
+      g_print (" Inference: %.2f fps, inference %.2f ms, postprocess %.3f ms, "
+          "capture to result %.2f ms (max %.2f ms)\n",
+          inf->frames * 1e6 / MAX (end - inf->first_time, 1),
+          inf->infer_sum / 1000.0 / inf->frames,
+          inf->post_sum / 1000.0 / inf->frames,
+          inf->latency_sum / 1000.0 / inf->frames, inf->latency_max / 1000.0);
+    }
+
+    ml_inference_recycle (inf, result);
+  }
+
+  return NULL;
+}
+
+/**
+ * Stops the stage threads after the queued frames are processed and
+ * releases the ONNX Runtime session.
+ *
+ * @param inf Inference stage created with ml_inference_new().
+ */
+static inline void
+ml_inference_free (MLInference * inf)
+{
+  if (inf == NULL)
+    return;
+
+  if (inf->infer_thread != NULL) {
+    g_async_queue_push (inf->infer_queue, ML_INFERENCE_EOS);
+    g_thread_join (inf->infer_thread);
+    g_thread_join (inf->post_thread);
+  }
+
+  if (inf->infer_queue != NULL)
+    g_async_queue_unref (inf->infer_queue);
+  if (inf->post_queue != NULL)
+    g_async_queue_unref (inf->post_queue);
+  if (inf->free_results != NULL)
+    g_async_queue_unref (inf->free_results);
+
+  for (gint s = 0; s < ML_INFERENCE_SLOTS; s++) {
+    MLInferenceResult *result = &inf->results[s];
+
+    for (gsize i = 0; result->outputs != NULL && i < inf->n_outputs; i++)
+      if (result->outputs[i] != NULL)
+        inf->ort->ReleaseValue (result->outputs[i]);
+    g_free (result->outputs);
+
+    if (result->binding != NULL)
+      inf->ort->ReleaseIoBinding (result->binding);
+  }
+
+  for (guint i = 0; i < inf->n_inputs; i++)
+    if (inf->inputs[i] != NULL)
+      inf->ort->ReleaseValue (inf->inputs[i]);
+  g_free (inf->inputs);
+
+  // Names are only allocated once the allocator is known
+  for (gsize i = 0; inf->output_names != NULL && i < inf->n_outputs; i++)
+    if (inf->output_names[i] != NULL)
+      inf->allocator->Free (inf->allocator, inf->output_names[i]);
+  g_free (inf->output_names);
+
+  if (inf->input_name != NULL)
+    inf->allocator->Free (inf->allocator, inf->input_name);
+
+  if (inf->memory_info != NULL)
+    inf->ort->ReleaseMemoryInfo (inf->memory_info);
+  if (inf->session != NULL)
+    inf->ort->ReleaseSession (inf->session);
+  if (inf->env != NULL)
+    inf->ort->ReleaseEnv (inf->env);
+
+  yolo_decoder_free (inf->yolo);
+  pose_decoder_free (inf->pose);
+  seg_decoder_free (inf->seg);
+  g_free (inf);
+}
+
+/**
+ * Reads the shape and element type of an output from the model.
+ *
+ * @return TRUE if the output has a static shape that can be bound.
+ */
+static inline gboolean
+ml_inference_output_shape (MLInference * inf, gsize index, int64_t * dims,
+    size_t * n_dims, ONNXTensorElementDataType * type)
+{
+  const OrtApi *ort = inf->ort;
+  OrtTypeInfo *type_info = NULL;
+  const OrtTensorTypeAndShapeInfo *tensor_info = NULL;
+  gboolean ok = FALSE;
+
+  if (!ml_ort_check (ort, ort->SessionGetOutputTypeInfo (inf->session, index,
+          &type_info)))
+    return FALSE;
+
+  ok = ml_ort_check (ort, ort->CastTypeInfoToTensorInfo (type_info,
+          &tensor_info)) &&
+      ml_ort_check (ort, ort->GetTensorElementType (tensor_info, type)) &&
+      ml_ort_check (ort, ort->GetDimensionsCount (tensor_info, n_dims)) &&
+      *n_dims <= ML_INFERENCE_MAX_DIMS &&
+      ml_ort_check (ort, ort->GetDimensions (tensor_info, dims, *n_dims));
+  ort->ReleaseTypeInfo (type_info);
+
+  for (size_t i = 0; ok && i < *n_dims; i++)
+    ok = dims[i] > 0;
+
+  return ok;
+}
+
+/**
+ * Allocates the recycled results. With static output shapes every result
+ * gets its own output tensors bound to the session once, otherwise ONNX
+ * Runtime allocates the outputs on every run.
+ */
+static inline gboolean
+ml_inference_init_results (MLInference * inf)
+{
+  const OrtApi *ort = inf->ort;
+  int64_t dims[ML_INFERENCE_MAX_DIMS];
+  size_t n_dims = 0;
+  ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+
+  inf->bound_outputs = TRUE;
+  for (gsize i = 0; i < inf->n_outputs && inf->bound_outputs; i++)
+    inf->bound_outputs = ml_inference_output_shape (inf, i, dims, &n_dims,
+        &type);
+
+  if (!inf->bound_outputs)
+    g_print ("\n Model outputs have dynamic shapes, outputs are allocated "
+        "on every run\n");
+
+  inf->free_results = g_async_queue_new ();
+
+  for (gint s = 0; s < ML_INFERENCE_SLOTS; s++) {
+    MLInferenceResult *result = &inf->results[s];
+
+    result->outputs = g_new0 (OrtValue *, inf->n_outputs);
+
+    if (inf->bound_outputs && !ml_ort_check (ort, ort->CreateIoBinding (
+            inf->session, &result->binding)))
+      return FALSE;
+
+    for (gsize i = 0; inf->bound_outputs && i < inf->n_outputs; i++) {
+      if (!ml_inference_output_shape (inf, i, dims, &n_dims, &type) ||
+          !ml_ort_check (ort, ort->CreateTensorAsOrtValue (inf->allocator,
+              dims, n_dims, type, &result->outputs[i])) ||
+          !ml_ort_check (ort, ort->BindOutput (result->binding,
+              inf->output_names[i], result->outputs[i])))
+        return FALSE;
+    }
+
+    g_async_queue_push (inf->free_results, result);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Creates an ONNX Runtime session for a single input image model and
+ * starts the inference and postprocess threads.
+ *
+ * @param model Path to the ONNX model.
+ * @param qnn_backend QNN backend library for the QNN execution provider,
+ *                    e.g. libQnnHtp.so, or NULL for the CPU provider.
+ * @return New inference stage or NULL on failure.
+ */
+static inline MLInference *
+ml_inference_new (const gchar * model, const gchar * qnn_backend)
+{
+  MLInference *inf = g_new0 (MLInference, 1);
+  const OrtApi *ort = OrtGetApiBase ()->GetApi (ORT_API_VERSION);
+  OrtSessionOptions *options = NULL;
+  OrtTypeInfo *type_info = NULL;
+  const OrtTensorTypeAndShapeInfo *tensor_info = NULL;
+  size_t n_inputs = 0, n_dims = 0;
+  gsize elem_size = 0;
+
+  inf->ort = ort;
+
+  if (!ml_ort_check (ort, ort->CreateEnv (ORT_LOGGING_LEVEL_WARNING,
+          "hello-qim", &inf->env)) ||
+      !ml_ort_check (ort, ort->CreateSessionOptions (&options)) ||
+      !ml_ort_check (ort, ort->SetSessionGraphOptimizationLevel (options,
+          ORT_ENABLE_ALL)))
+    goto error;
+
+  if (qnn_backend != NULL) {
+    const char *keys[] = { "backend_path" };
+    const char *values[] = { qnn_backend };
+
+    if (!ml_ort_check (ort, ort->SessionOptionsAppendExecutionProvider (
+            options, "QNN", keys, values, 1)))
+      goto error;
+  }
+
+  if (!ml_ort_check (ort, ort->CreateSession (inf->env, model, options,
+          &inf->session)))
+    goto error;
+
+  ort->ReleaseSessionOptions (options);
+  options = NULL;
+
+  if (!ml_ort_check (ort, ort->GetAllocatorWithDefaultOptions (
+          &inf->allocator)) ||
+      !ml_ort_check (ort, ort->SessionGetInputCount (inf->session,
+          &n_inputs)))
+    goto error;
+
+  if (n_inputs != 1) {
+    g_printerr ("\n Model must have exactly one input, found %zu!\n",
+        n_inputs);
+    goto error;
+  }
+
+  if (!ml_ort_check (ort, ort->SessionGetInputName (inf->session, 0,
+          inf->allocator, &inf->input_name)) ||
+      !ml_ort_check (ort, ort->SessionGetInputTypeInfo (inf->session, 0,
+          &type_info)) ||
+      !ml_ort_check (ort, ort->CastTypeInfoToTensorInfo (type_info,
+          &tensor_info)) ||
+      !ml_ort_check (ort, ort->GetTensorElementType (tensor_info,
+          &inf->input_type)) ||
+      !ml_ort_check (ort, ort->GetDimensionsCount (tensor_info, &n_dims)))
+    goto error;
+
+  if (n_dims != 4 || !ml_ort_check (ort, ort->GetDimensions (tensor_info,
+          inf->input_dims, 4))) {
+    g_printerr ("\n Model input must be a 4D image tensor!\n");
+    goto error;
+  }
+
+  ort->ReleaseTypeInfo (type_info);
+  type_info = NULL;
+
+  // Frames are processed one at a time, so a dynamic batch becomes 1
+  if (inf->input_dims[0] <= 0)
+    inf->input_dims[0] = 1;
+
+  if (inf->input_dims[1] == 3) {
+    inf->layout = ML_LAYOUT_NCHW;
+    inf->height = (gint) inf->input_dims[2];
+    inf->width = (gint) inf->input_dims[3];
+  } else if (inf->input_dims[3] == 3) {
+    inf->layout = ML_LAYOUT_NHWC;
+    inf->height = (gint) inf->input_dims[1];
+    inf->width = (gint) inf->input_dims[2];
+  } else {
+    g_printerr ("\n Model input must have 3 channels!\n");
+    goto error;
+  }
+
+  if (inf->input_dims[0] != 1 || inf->width <= 0 || inf->height <= 0) {
+    g_printerr ("\n Model input must have batch 1 and a fixed size!\n");
+    goto error;
+  }
+
+  switch (inf->input_type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+      inf->type = ML_TYPE_FLOAT32;
+      elem_size = sizeof (gfloat);
+      break;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+      inf->type = ML_TYPE_UINT8;
+      elem_size = sizeof (guint8);
+      break;
+    default:
+      g_printerr ("\n Model input must be float or uint8!\n");
+      goto error;
+  }
+
+  inf->input_size = (gsize) inf->width * inf->height * 3 * elem_size;
+
+  if (!ml_ort_check (ort, ort->SessionGetOutputCount (inf->session,
+          &inf->n_outputs)))
+    goto error;
+
+  inf->output_names = g_new0 (gchar *, inf->n_outputs);
+  for (gsize i = 0; i < inf->n_outputs; i++)
+    if (!ml_ort_check (ort, ort->SessionGetOutputName (inf->session, i,
+            inf->allocator, &inf->output_names[i])))
+      goto error;
+
+  if (!ml_ort_check (ort, ort->CreateCpuMemoryInfo (OrtArenaAllocator,
+          OrtMemTypeDefault, &inf->memory_info)) ||
+      !ml_inference_init_results (inf))
+    goto error;
+
+  inf->infer_queue = g_async_queue_new ();
+  inf->post_queue = g_async_queue_new ();
+  inf->infer_thread = g_thread_new ("ml-inference", ml_inference_thread, inf);
+  inf->post_thread = g_thread_new ("ml-postprocess", ml_postprocess_thread,
+      inf);
+
+  g_print ("\n Model %s: %dx%d %s %s input, %zu outputs, %s provider\n",
+      model, inf->width, inf->height,
+      (inf->layout == ML_LAYOUT_NCHW) ? "nchw" : "nhwc",
+      (inf->type == ML_TYPE_UINT8) ? "uint8" : "float", inf->n_outputs,
+      (qnn_backend != NULL) ? "QNN" : "CPU");
+
+  return inf;
+
+error:
+  if (type_info != NULL)
+    ort->ReleaseTypeInfo (type_info);
+  if (options != NULL)
+    ort->ReleaseSessionOptions (options);
+  ml_inference_free (inf);
+  return NULL;
+}
+
+/**
+ * Decodes the model outputs as YOLO detections instead of reporting the
+ * top-1 class. Must be called before the first tensor is pushed.
+ *
+ * @param inf Inference stage.
+ * @param decoder Decoder for the model outputs, owned by the stage.
+ */
+static inline void
+ml_inference_set_yolo_decoder (MLInference * inf, YoloDecoder * decoder)
+{
+  yolo_decoder_free (inf->yolo);
+  inf->yolo = decoder;
+}
+
+/**
+ * Decodes the model output as pose heatmaps instead of reporting the
+ * top-1 class. Must be called before the first tensor is pushed.
+ *
+ * @param inf Inference stage.
+ * @param decoder Decoder for the model output, owned by the stage.
+ */
+static inline void
+ml_inference_set_pose_decoder (MLInference * inf, PoseDecoder * decoder)
+{
+  pose_decoder_free (inf->pose);
+  inf->pose = decoder;
+}
+
+/**
+ * Decodes the model output as a segmentation mask and RGBA overlay of the
+ * frame instead of reporting the top-1 class. Must be called before the
+ * first tensor is pushed.
+ *
+ * @param inf Inference stage.
+ * @param decoder Decoder for the model output, owned by the stage.
+ */
+static inline void
+ml_inference_set_seg_decoder (MLInference * inf, SegDecoder * decoder)
+{
+  seg_decoder_free (inf->seg);
+  inf->seg = decoder;
+}
+
+/**
+ * Wraps every buffer of the tensor pool in an input tensor once, so the
+ * tensors of the pool are run without creating ONNX Runtime values. Must
+ * be called before the first tensor is pushed, only tensors of this pool
+ * can be pushed afterwards.
+ *
+ * @param inf Inference stage.
+ * @param pool Pool with buffers of at least @input_size bytes, must outlive
+ *             the stage.
+ * @return TRUE on success, FALSE otherwise.
+ */
+static inline gboolean
+ml_inference_set_pool (MLInference * inf, FramePool * pool)
+{
+  const OrtApi *ort = inf->ort;
+
+  if (pool->buffers[0].size < inf->input_size) {
+    g_printerr ("\n Tensor pool buffers are smaller than the model input!\n");
+    return FALSE;
+  }
+
+  inf->pool = pool;
+  inf->inputs = g_new0 (OrtValue *, pool->stats.n_buffers);
+  inf->n_inputs = pool->stats.n_buffers;
+
+  for (guint i = 0; i < inf->n_inputs; i++)
+    if (!ml_ort_check (ort, ort->CreateTensorWithDataAsOrtValue (
+            inf->memory_info, pool->buffers[i].data, inf->input_size,
+            inf->input_dims, 4, inf->input_type, &inf->inputs[i])))
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Queues a tensor for inference. The stage takes ownership of the buffer
+ * and releases it to its pool once the inference has consumed it.
+ *
+ * @param inf Inference stage.
+ * @param tensor Tensor of the pool set with ml_inference_set_pool().
+ */
+static inline void
+ml_inference_push (MLInference * inf, FramePoolBuffer * tensor)
+{
+  g_async_queue_push (inf->infer_queue, tensor);
+}
+
+/**
+ * Returns the number of tensors waiting for inference.
+ *
+ * @param inf Inference stage.
+ */
+static inline gint
+ml_inference_pending (MLInference * inf)
+{
+  return g_async_queue_length (inf->infer_queue);
+}
+
+#endif //ML_INFERENCE_H
@@ -0,0 +1,235 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides the labels of the artifacts/json_labels files and the
+ * quantization constants of the configs.
+ *
+ * A labels file is a JSON array of {"id": N, "color": "0xRRGGBBAA",
+ * "label": "name"} objects. The entries are stored indexed by id, ids
+ * without an entry have no label and a zero color.
+ *
+ * A constants string like "hrnet,q-offsets=<8.0>,q-scales=<0.004>;" gives
+ * the zero point and scale of every uint8 model output, in output order.
+ * A uint8 value q stands for (q - offset) * scale.
+ */
+
+#ifndef ML_LABELS_H
+#define ML_LABELS_H
+
+#include <string.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+// Maximum number of outputs in a constants string.
+#define ML_MAX_CONSTANTS 16
+
+/**
+ * MLLabel:
+ * @label: Name of the class, NULL if the labels file has no entry.
+ * @color: RGBA color of the class.
+ *
+ * Entry of a labels file.
+ */
+typedef struct {
+  gchar   *label;
+  guint32 color;
+} MLLabel;
+
+/**
+ * MLLabels:
+ * @entries  : Entries indexed by id.
+ * @n_entries: Number of entries, the largest id plus one.
+ *
+ * Contents of a labels file.
+ */
+typedef struct {
+  MLLabel *entries;
+  gint    n_entries;
+} MLLabels;
+
+/**
+ * Frees the entries of a labels file.
+ *
+ * @param labels Labels loaded with ml_labels_load().
+ */
+static inline void
+ml_labels_clear (MLLabels * labels)
+{
+  for (gint i = 0; i < labels->n_entries; i++)
+    g_free (labels->entries[i].label);
+
+  g_free (labels->entries);
+  labels->entries = NULL;
+  labels->n_entries = 0;
+}
+
+/**
+ * Loads a labels file, replacing previously loaded labels.
+ *
+ * @param labels Labels to fill.
+ * @param path Path of the labels file.
+ * @return FALSE if the file can not be parsed.
+ */
+static inline gboolean
+ml_labels_load (MLLabels * labels, const gchar * path)
+{
+  JsonParser *parser = json_parser_new ();
+  JsonArray *array = NULL;
+  GError *error = NULL;
+  guint n_entries = 0;
+  gint n_labels = 0;
+
+  if (!json_parser_load_from_file (parser, path, &error)) {
+    g_printerr ("\n Failed to parse labels file %s: %s\n", path,
+        error->message);
+    g_clear_error (&error);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  if (!JSON_NODE_HOLDS_ARRAY (json_parser_get_root (parser))) {
+    g_printerr ("\n Labels file %s is not a JSON array!\n", path);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  array = json_node_get_array (json_parser_get_root (parser));
+  n_entries = json_array_get_length (array);
+
+  for (guint i = 0; i < n_entries; i++) {
+    JsonNode *node = json_array_get_element (array, i);
+    JsonObject *entry = JSON_NODE_HOLDS_OBJECT (node) ?
+        json_node_get_object (node) : NULL;
+    JsonNode *id = entry != NULL ?
+        json_object_get_member (entry, "id") : NULL;
+
+    // The id must be an integer, json-glib returns 0 for other types
+    if (id == NULL || !JSON_NODE_HOLDS_VALUE (id) ||
+        json_node_get_value_type (id) != G_TYPE_INT64 ||
+        json_object_get_int_member (entry, "id") < 0 ||
+        json_object_get_int_member (entry, "id") >= G_MAXINT16) {
+      g_printerr ("\n Entry %u of labels file %s has no valid id!\n", i,
+          path);
+      g_object_unref (parser);
+      return FALSE;
+    }
+    n_labels = MAX (n_labels, (gint) json_object_get_int_member (entry,
+            "id") + 1);
+  }
+
+  ml_labels_clear (labels);
+  labels->entries = g_new0 (MLLabel, n_labels);
+  labels->n_entries = n_labels;
+
+  for (guint i = 0; i < n_entries; i++) {
+    JsonObject *entry = json_array_get_object_element (array, i);
+    MLLabel *label = &labels->entries[json_object_get_int_member (entry, "id")];
+
+    g_free (label->label);
+    label->label = g_strdup (
+        json_object_get_string_member_with_default (entry, "label", NULL));
+    label->color = (guint32) g_ascii_strtoull (
+        json_object_get_string_member_with_default (entry, "color", "0"),
+        NULL, 16);
+  }
+
+  g_object_unref (parser);
+  return TRUE;
+}
+
+/**
+ * Label of an id.
+ *
+ * @param labels Labels.
+ * @param id Class or keypoint id.
+ * @return Label or NULL if the labels file has none for the id.
+ */
+static inline const gchar *
+ml_labels_get (const MLLabels * labels, gint id)
+{
+  if (id < 0 || id >= labels->n_entries)
+    return NULL;
+  return labels->entries[id].label;
+}
+
+/**
+ * Color of an id.
+ *
+ * @param labels Labels.
+ * @param id Class or keypoint id.
+ * @return RGBA color, 0 if the labels file has none for the id.
+ */
+static inline guint32
+ml_labels_color (const MLLabels * labels, gint id)
+{
+  if (id < 0 || id >= labels->n_entries)
+    return 0;
+  return labels->entries[id].color;
+}
+
+static inline gsize
+ml_constants_list (const gchar * str, const gchar * key, gfloat * values,
+    gsize max_values)
+{
+  const gchar *pos = strstr (str, key);
+  gchar *end = NULL;
+  gsize n = 0;
+
+  if (pos == NULL)
+    return 0;
+
+  for (pos += strlen (key); n < max_values; pos = end + 1) {
+    gdouble value = g_ascii_strtod (pos, &end);
+
+    if (end == pos)
+      break;
+
+    values[n++] = (gfloat) value;
+    while (g_ascii_isspace (*end))
+      end++;
+    if (*end != ',')
+      break;
+  }
+  return n;
+}
+
+/**
+ * Parses the q-offsets and q-scales of a constants string. Outputs beyond
+ * the given values keep their offsets and scales.
+ *
+ * @param constants Constants string.
+ * @param offsets Filled with the zero point of every output.
+ * @param scales Filled with the scale of every output.
+ * @param max_outputs Size of @offsets and @scales.
+ * @return Number of outputs, 0 if the string has no or different numbers
+ *         of offsets and scales.
+ */
+static inline gsize
+ml_constants_parse (const gchar * constants, gfloat * offsets,
+    gfloat * scales, gsize max_outputs)
+{
+  gfloat q_offsets[ML_MAX_CONSTANTS], q_scales[ML_MAX_CONSTANTS];
+  gsize n_offsets = 0, n_scales = 0;
+
+  max_outputs = MIN (max_outputs, ML_MAX_CONSTANTS);
+  n_offsets = ml_constants_list (constants, "q-offsets=<", q_offsets,
+      max_outputs);
+  n_scales = ml_constants_list (constants, "q-scales=<", q_scales,
+      max_outputs);
+
+  if (n_offsets == 0 || n_offsets != n_scales) {
+    g_printerr ("\n Invalid q-offsets/q-scales in constants '%s'!\n",
+        constants);
+    return 0;
+  }
+
+  memcpy (offsets, q_offsets, n_offsets * sizeof (gfloat));
+  memcpy (scales, q_scales, n_offsets * sizeof (gfloat));
+  return n_offsets;
+}
+
+#endif //ML_LABELS_H
@@ -0,0 +1,971 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides NV12 and RGB/BGR to tensor preprocessing for ML models.
+ *
+ * A camera frame in NV12 is resized (bilinear, optionally keeping the aspect
+ * ratio with letterbox padding like scripts/preprocess.py), converted to
+ * RGB or BGR, normalized and written as an NHWC or NCHW tensor of uint8 or
+ * float32 elements. All the work is done row by row in a single pass over
+ * the output, using NEON on ARM, SSE2/AVX on x86 and plain C otherwise.
+ * Every path produces bit identical results.
+ *
+ * Packed RGB or BGR frames, e.g. converted to the model input size by
+ * qtivtransform in ML preferred mode, take the same path without the color
+ * conversion. At the tensor size they are not resized either, only the
+ * channels are reordered and normalized into the tensor layout.
+ *
+ * All scratch memory is allocated once in ml_preprocess_init(), so
+ * ml_preprocess_nv12() and ml_preprocess_packed() do not allocate.
+ */
+
+#ifndef ML_PREPROCESS_H
+#define ML_PREPROCESS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ML_PREPROCESS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ML_PREPROCESS_SSE2 1
+#if defined(__AVX__)
+#include <immintrin.h>
+#define ML_PREPROCESS_AVX 1
+#endif
+#endif
+
+// Fixed point precision of the bilinear interpolation weights.
+#define ML_RESIZE_BITS  7
+#define ML_RESIZE_ONE   (1 << ML_RESIZE_BITS)
+
+// Alignment of the internal scratch rows.
+#define ML_PREPROCESS_ALIGN 64
+
+/**
+ * MLColorOrder:
+ * @ML_COLOR_RGB: Channels are stored in R, G, B order.
+ * @ML_COLOR_BGR: Channels are stored in B, G, R order.
+ *
+ * Channel order of the output tensor.
+ */
+typedef enum {
+  ML_COLOR_RGB,
+  ML_COLOR_BGR
+} MLColorOrder;
+
+/**
+ * MLFrameFormat:
+ * @ML_FRAME_NV12: Luma plane and interleaved chroma plane.
+ * @ML_FRAME_RGB : Packed 8 bit R, G, B pixels.
+ * @ML_FRAME_BGR : Packed 8 bit B, G, R pixels.
+ *
+ * Pixel format of the frames given to the preprocessor.
+ */
+typedef enum {
+  ML_FRAME_NV12,
+  ML_FRAME_RGB,
+  ML_FRAME_BGR
+} MLFrameFormat;
+
+/**
+ * MLTensorLayout:
+ * @ML_LAYOUT_NHWC: Interleaved channels, one pixel after another.
+ * @ML_LAYOUT_NCHW: One plane per channel.
+ *
+ * Memory layout of the output tensor.
+ */
+typedef enum {
+  ML_LAYOUT_NHWC,
+  ML_LAYOUT_NCHW
+} MLTensorLayout;
+
+/**
+ * MLTensorType:
+ * @ML_TYPE_UINT8  : 8 bit unsigned elements, not normalized.
+ * @ML_TYPE_FLOAT32: 32 bit float elements, (value - mean) * scale.
+ *
+ * Element type of the output tensor.
+ */
+typedef enum {
+  ML_TYPE_UINT8,
+  ML_TYPE_FLOAT32
+} MLTensorType;
+
+/**
+ * MLPreprocessConfig:
+ * @src_format: Pixel format of the frame.
+ * @src_width : Width of the frame.
+ * @src_height: Height of the frame.
+ * @dst_width : Width of the output tensor.
+ * @dst_height: Height of the output tensor.
+ * @color     : Channel order of the output tensor.
+ * @layout    : Memory layout of the output tensor.
+ * @type      : Element type of the output tensor.
+ * @letterbox : Keep the aspect ratio and pad, otherwise stretch.
+ * @pad_value : Value of the letterbox padding for every channel.
+ * @mean      : Per channel mean subtracted for float output (RGB order).
+ * @scale     : Per channel scale applied for float output (RGB order).
+ *
+ * Configuration of the preprocessing, see ml_preprocess_config_init().
+ */
+typedef struct {
+  MLFrameFormat  src_format;
+  gint           src_width;
+  gint           src_height;
+  gint           dst_width;
+  gint           dst_height;
+  MLColorOrder   color;
+  MLTensorLayout layout;
+  MLTensorType   type;
+  gboolean       letterbox;
+  guint8         pad_value;
+  gfloat         mean[3];
+  gfloat         scale[3];
+} MLPreprocessConfig;
+
+/**
+ * MLResizer:
+ *
+ * Tables and row cache of a bilinear resize of an interleaved uint8 plane
+ * with 1 to 3 channels. For internal use by MLPreprocessor.
+ */
+typedef struct {
+  gint     src_width;
+  gint     src_height;
+  gint     dst_width;
+  gint     dst_height;
+  gint     channels;
+  gint     *xofs;
+  guint16  *xalpha;
+  gint     *yofs;
+  guint16  *yalpha;
+  guint16  *hrows[2];
+  gint     hrow_idx[2];
+} MLResizer;
+
+/**
+ * MLPreprocessor:
+ * @config   : Configuration given to ml_preprocess_init().
+ * @width    : Width of the resized image inside the tensor.
+ * @height   : Height of the resized image inside the tensor.
+ * @left     : Horizontal offset of the resized image inside the tensor.
+ * @top      : Vertical offset of the resized image inside the tensor.
+ * @ratio_x  : Horizontal scale factor from frame to tensor coordinates.
+ * @ratio_y  : Vertical scale factor from frame to tensor coordinates.
+ *
+ * Preprocessing state. The letterbox geometry can be used to map model
+ * results back to frame coordinates: x = (tx - left) / ratio_x.
+ */
+typedef struct {
+  MLPreprocessConfig config;
+  gint      width;
+  gint      height;
+  gint      left;
+  gint      top;
+  gfloat    ratio_x;
+  gfloat    ratio_y;
+
+  // Private
+  MLResizer luma;
+  MLResizer chroma;
+  MLResizer packed;
+  guint8    *yrow;
+  guint8    *uvrow;
+  guint8    *prow;
+  gint      uvrow_idx;
+  guint8    *rgb[3];
+  gfloat    mean[3];
+  gfloat    scale[3];
+  gfloat    lut[3][256];
+} MLPreprocessor;
+
+/**
+ * Fills a configuration with the defaults of scripts/preprocess.py:
+ * NV12 frames, RGB, NHWC, letterbox padded with 114 and float values
+ * scaled to [0, 1].
+ *
+ * @param config Configuration to fill.
+ * @param src_width Width of the frame.
+ * @param src_height Height of the frame.
+ * @param dst_width Width of the output tensor.
+ * @param dst_height Height of the output tensor.
+ */
+static inline void
+ml_preprocess_config_init (MLPreprocessConfig * config, gint src_width,
+    gint src_height, gint dst_width, gint dst_height)
+{
+  config->src_format = ML_FRAME_NV12;
+  config->src_width = src_width;
+  config->src_height = src_height;
+  config->dst_width = dst_width;
+  config->dst_height = dst_height;
+  config->color = ML_COLOR_RGB;
+  config->layout = ML_LAYOUT_NHWC;
+  config->type = ML_TYPE_FLOAT32;
+  config->letterbox = TRUE;
+  config->pad_value = 114;
+
+  for (gint c = 0; c < 3; c++) {
+    config->mean[c] = 0.0F;
+    config->scale[c] = 1.0F / 255.0F;
+  }
+}
+
+static inline gpointer
+ml_preprocess_alloc (gsize size)
+{
+  gpointer ptr = NULL;
+
+  // Round up so SIMD loops may safely touch the tail of every row
+  size = (size + ML_PREPROCESS_ALIGN - 1) & ~((gsize) ML_PREPROCESS_ALIGN - 1);
+  if (posix_memalign (&ptr, ML_PREPROCESS_ALIGN, size) != 0)
+    return NULL;
+
+  memset (ptr, 0, size);
+  return ptr;
+}
+
+/**
+ * Computes the interpolation table of one axis with the same pixel center
+ * convention as cv2.resize with INTER_LINEAR.
+ */
+static inline void
+ml_resize_axis_table (gint src_size, gint dst_size, gint * ofs, guint16 * alpha)
+{
+  gdouble scale = (gdouble) src_size / dst_size;
+
+  for (gint d = 0; d < dst_size; d++) {
+    gdouble fs = (d + 0.5) * scale - 0.5;
+    gint s = (gint) floor (fs);
+    gint a = (gint) lrint ((fs - s) * ML_RESIZE_ONE);
+
+    if (s < 0) {
+      s = 0;
+      a = 0;
+    }
+
+    if (a >= ML_RESIZE_ONE) {
+      s++;
+      a = 0;
+    }
+
+    // Never read past the last sample, interpolate fully towards it instead
+    if (s >= src_size - 1) {
+      s = src_size - 2;
+      a = ML_RESIZE_ONE;
+    }
+
+    ofs[d] = s;
+    alpha[d] = (guint16) a;
+  }
+}
+
+static inline void
+ml_resizer_deinit (MLResizer * rs)
+{
+  free (rs->xofs);
+  free (rs->xalpha);
+  free (rs->yofs);
+  free (rs->yalpha);
+  free (rs->hrows[0]);
+  free (rs->hrows[1]);
+  memset (rs, 0, sizeof (*rs));
+}
+
+static inline gboolean
+ml_resizer_init (MLResizer * rs, gint src_width, gint src_height,
+    gint dst_width, gint dst_height, gint channels)
+{
+  gsize row_size = (gsize) dst_width * channels;
+
+  memset (rs, 0, sizeof (*rs));
+
+  if (src_width < 2 || src_height < 2 || dst_width < 1 || dst_height < 1)
+    return FALSE;
+
+  rs->src_width = src_width;
+  rs->src_height = src_height;
+  rs->dst_width = dst_width;
+  rs->dst_height = dst_height;
+  rs->channels = channels;
+
+  rs->xofs = (gint *) ml_preprocess_alloc (dst_width * sizeof (gint));
+  rs->xalpha = (guint16 *) ml_preprocess_alloc (dst_width * sizeof (guint16));
+  rs->yofs = (gint *) ml_preprocess_alloc (dst_height * sizeof (gint));
+  rs->yalpha = (guint16 *) ml_preprocess_alloc (dst_height * sizeof (guint16));
+  rs->hrows[0] = (guint16 *) ml_preprocess_alloc (row_size * sizeof (guint16));
+  rs->hrows[1] = (guint16 *) ml_preprocess_alloc (row_size * sizeof (guint16));
+
+  if (!rs->xofs || !rs->xalpha || !rs->yofs || !rs->yalpha ||
+      !rs->hrows[0] || !rs->hrows[1]) {
+    ml_resizer_deinit (rs);
+    return FALSE;
+  }
+
+  ml_resize_axis_table (src_width, dst_width, rs->xofs, rs->xalpha);
+  ml_resize_axis_table (src_height, dst_height, rs->yofs, rs->yalpha);
+
+  for (gint dx = 0; dx < dst_width; dx++)
+    rs->xofs[dx] *= channels;
+
+  rs->hrow_idx[0] = rs->hrow_idx[1] = -1;
+  return TRUE;
+}
+
+/**
+ * Horizontal pass of one source row into 16 bit intermediate values
+ * scaled by ML_RESIZE_ONE.
+ */
+static inline void
+ml_resizer_hrow (const MLResizer * rs, const guint8 * src, guint16 * dst)
+{
+  const gint *xofs = rs->xofs;
+  const guint16 *xalpha = rs->xalpha;
+  gint dx;
+
+  if (rs->channels == 1) {
+    for (dx = 0; dx < rs->dst_width; dx++) {
+      const guint8 *s = src + xofs[dx];
+      guint a = xalpha[dx];
+
+      dst[dx] = (guint16) (s[0] * (ML_RESIZE_ONE - a) + s[1] * a);
+    }
+  } else if (rs->channels == 3) {
+    for (dx = 0; dx < rs->dst_width; dx++) {
+      const guint8 *s = src + xofs[dx];
+      guint a = xalpha[dx];
+
+      dst[3 * dx] = (guint16) (s[0] * (ML_RESIZE_ONE - a) + s[3] * a);
+      dst[3 * dx + 1] = (guint16) (s[1] * (ML_RESIZE_ONE - a) + s[4] * a);
+      dst[3 * dx + 2] = (guint16) (s[2] * (ML_RESIZE_ONE - a) + s[5] * a);
+    }
+  } else {
+    for (dx = 0; dx < rs->dst_width; dx++) {
+      const guint8 *s = src + xofs[dx];
+      guint a = xalpha[dx];
+
+      dst[2 * dx] = (guint16) (s[0] * (ML_RESIZE_ONE - a) + s[2] * a);
+      dst[2 * dx + 1] = (guint16) (s[1] * (ML_RESIZE_ONE - a) + s[3] * a);
+    }
+  }
+}
+
+/**
+ * Vertical pass blending two horizontal rows into the final uint8 row.
+ */
+static inline void
+ml_resizer_vrow (const guint16 * h0, const guint16 * h1, guint a,
+    guint8 * dst, gint n)
+{
+  guint b = ML_RESIZE_ONE - a;
+  gint i = 0;
+
+#if defined(ML_PREPROCESS_NEON)
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t v0 = vld1q_u16 (h0 + i);
+    uint16x8_t v1 = vld1q_u16 (h1 + i);
+    uint32x4_t lo = vmull_n_u16 (vget_low_u16 (v0), b);
+    uint32x4_t hi = vmull_n_u16 (vget_high_u16 (v0), b);
+
+    lo = vmlal_n_u16 (lo, vget_low_u16 (v1), a);
+    hi = vmlal_n_u16 (hi, vget_high_u16 (v1), a);
+
+    uint16x8_t r = vcombine_u16 (vrshrn_n_u32 (lo, 2 * ML_RESIZE_BITS),
+        vrshrn_n_u32 (hi, 2 * ML_RESIZE_BITS));
+    vst1_u8 (dst + i, vqmovn_u16 (r));
+  }
+#elif defined(ML_PREPROCESS_SSE2)
+  // Interleave both rows so a single madd yields h0 * b + h1 * a
+  const __m128i w = _mm_set1_epi32 ((gint) ((a << 16) | b));
+  const __m128i round = _mm_set1_epi32 (1 << (2 * ML_RESIZE_BITS - 1));
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v0 = _mm_loadu_si128 ((const __m128i *) (h0 + i));
+    __m128i v1 = _mm_loadu_si128 ((const __m128i *) (h1 + i));
+    __m128i lo = _mm_madd_epi16 (_mm_unpacklo_epi16 (v0, v1), w);
+    __m128i hi = _mm_madd_epi16 (_mm_unpackhi_epi16 (v0, v1), w);
+
+    lo = _mm_srai_epi32 (_mm_add_epi32 (lo, round), 2 * ML_RESIZE_BITS);
+    hi = _mm_srai_epi32 (_mm_add_epi32 (hi, round), 2 * ML_RESIZE_BITS);
+
+    __m128i r = _mm_packs_epi32 (lo, hi);
+    _mm_storel_epi64 ((__m128i *) (dst + i), _mm_packus_epi16 (r, r));
+  }
+#endif
+
+  for (; i < n; i++) {
+    guint v = (h0[i] * b + h1[i] * a + (1 << (2 * ML_RESIZE_BITS - 1)))
+        >> (2 * ML_RESIZE_BITS);
+    dst[i] = (guint8) MIN (v, 255);
+  }
+}
+
+/**
+ * Produces output row @dy of a resize. Horizontal rows are cached, so
+ * consecutive output rows sharing source rows are cheap.
+ */
+static inline void
+ml_resizer_row (MLResizer * rs, const guint8 * src, gint stride, gint dy,
+    guint8 * dst)
+{
+  gint sy = rs->yofs[dy];
+  guint16 *rows[2];
+
+  for (gint k = 0; k < 2; k++) {
+    gint idx = sy + k;
+    gint slot = idx & 1;
+
+    if (rs->hrow_idx[slot] != idx) {
+      ml_resizer_hrow (rs, src + (gsize) idx * stride, rs->hrows[slot]);
+      rs->hrow_idx[slot] = idx;
+    }
+    rows[k] = rs->hrows[slot];
+  }
+
+  ml_resizer_vrow (rows[0], rows[1], rs->yalpha[dy], dst,
+      rs->dst_width * rs->channels);
+}
+
+/**
+ * BT.601 limited range YUV to RGB in 6 bit fixed point:
+ *   R = (74 * (Y - 16) + 102 * (V - 128)) >> 6
+ *   G = (74 * (Y - 16) -  25 * (U - 128) - 52 * (V - 128)) >> 6
+ *   B = (74 * (Y - 16) + 129 * (U - 128)) >> 6
+ * Intermediate sums saturate at 16 bits, which only affects values that are
+ * clamped to 255 anyway.
+ */
+static inline gint
+ml_sat16 (gint v)
+{
+  return CLAMP (v, G_MININT16, G_MAXINT16);
+}
+
+static inline guint8
+ml_clamp_u8 (gint v)
+{
+  return (guint8) CLAMP (v, 0, 255);
+}
+
+static inline void
+ml_nv12_to_rgb_row (const guint8 * y, const guint8 * uv, guint8 * r,
+    guint8 * g, guint8 * b, gint width)
+{
+  gint x = 0;
+
+#if defined(ML_PREPROCESS_NEON)
+  const int16x8_t c16 = vdupq_n_s16 (16);
+  const int16x8_t c128 = vdupq_n_s16 (128);
+
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t yv = vld1q_u8 (y + x);
+    uint8x8x2_t uvv = vld2_u8 (uv + x);
+    uint8x8x2_t uu = vzip_u8 (uvv.val[0], uvv.val[0]);
+    uint8x8x2_t vv = vzip_u8 (uvv.val[1], uvv.val[1]);
+
+    for (gint h = 0; h < 2; h++) {
+      uint8x8_t y8 = h ? vget_high_u8 (yv) : vget_low_u8 (yv);
+      int16x8_t ys = vmulq_n_s16 (
+          vsubq_s16 (vreinterpretq_s16_u16 (vmovl_u8 (y8)), c16), 74);
+      int16x8_t us = vsubq_s16 (vreinterpretq_s16_u16 (
+          vmovl_u8 (uu.val[h])), c128);
+      int16x8_t vs = vsubq_s16 (vreinterpretq_s16_u16 (
+          vmovl_u8 (vv.val[h])), c128);
+
+      int16x8_t rs = vqaddq_s16 (ys, vmulq_n_s16 (vs, 102));
+      int16x8_t gs = vqsubq_s16 (vqsubq_s16 (ys, vmulq_n_s16 (us, 25)),
+          vmulq_n_s16 (vs, 52));
+      int16x8_t bs = vqaddq_s16 (ys, vmulq_n_s16 (us, 129));
+
+      vst1_u8 (r + x + 8 * h, vqmovun_s16 (vshrq_n_s16 (rs, 6)));
+      vst1_u8 (g + x + 8 * h, vqmovun_s16 (vshrq_n_s16 (gs, 6)));
+      vst1_u8 (b + x + 8 * h, vqmovun_s16 (vshrq_n_s16 (bs, 6)));
+    }
+  }
+#elif defined(ML_PREPROCESS_SSE2)
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i c16 = _mm_set1_epi16 (16);
+  const __m128i c128 = _mm_set1_epi16 (128);
+  const __m128i cy = _mm_set1_epi16 (74);
+  const __m128i crv = _mm_set1_epi16 (102);
+  const __m128i cgu = _mm_set1_epi16 (25);
+  const __m128i cgv = _mm_set1_epi16 (52);
+  const __m128i cbu = _mm_set1_epi16 (129);
+  const __m128i lomask = _mm_set1_epi16 (0x00FF);
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i yv = _mm_loadu_si128 ((const __m128i *) (y + x));
+    __m128i uvv = _mm_loadu_si128 ((const __m128i *) (uv + x));
+    __m128i u = _mm_sub_epi16 (_mm_and_si128 (uvv, lomask), c128);
+    __m128i v = _mm_sub_epi16 (_mm_srli_epi16 (uvv, 8), c128);
+    __m128i rr[2], gg[2], bb[2];
+
+    for (gint h = 0; h < 2; h++) {
+      __m128i y16 = h ? _mm_unpackhi_epi8 (yv, zero) :
+          _mm_unpacklo_epi8 (yv, zero);
+      __m128i u16 = h ? _mm_unpackhi_epi16 (u, u) : _mm_unpacklo_epi16 (u, u);
+      __m128i v16 = h ? _mm_unpackhi_epi16 (v, v) : _mm_unpacklo_epi16 (v, v);
+      __m128i ys = _mm_mullo_epi16 (_mm_sub_epi16 (y16, c16), cy);
+
+      rr[h] = _mm_srai_epi16 (
+          _mm_adds_epi16 (ys, _mm_mullo_epi16 (v16, crv)), 6);
+      gg[h] = _mm_srai_epi16 (_mm_subs_epi16 (_mm_subs_epi16 (ys,
+          _mm_mullo_epi16 (u16, cgu)), _mm_mullo_epi16 (v16, cgv)), 6);
+      bb[h] = _mm_srai_epi16 (
+          _mm_adds_epi16 (ys, _mm_mullo_epi16 (u16, cbu)), 6);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (r + x), _mm_packus_epi16 (rr[0], rr[1]));
+    _mm_storeu_si128 ((__m128i *) (g + x), _mm_packus_epi16 (gg[0], gg[1]));
+    _mm_storeu_si128 ((__m128i *) (b + x), _mm_packus_epi16 (bb[0], bb[1]));
+  }
+#endif
+
+  for (; x < width; x++) {
+    gint ys = (y[x] - 16) * 74;
+    gint us = uv[(x & ~1)] - 128;
+    gint vs = uv[(x & ~1) + 1] - 128;
+
+    r[x] = ml_clamp_u8 (ml_sat16 (ys + vs * 102) >> 6);
+    g[x] = ml_clamp_u8 (ml_sat16 (ml_sat16 (ys - us * 25) - vs * 52) >> 6);
+    b[x] = ml_clamp_u8 (ml_sat16 (ys + us * 129) >> 6);
+  }
+}
+
+/**
+ * Splits a row of packed pixels into R, G and B rows. @swap marks BGR
+ * pixels.
+ */
+static inline void
+ml_packed_to_rgb_row (const guint8 * src, gboolean swap, guint8 * r,
+    guint8 * g, guint8 * b, gint width)
+{
+  guint8 *first = swap ? b : r, *last = swap ? r : b;
+  gint x = 0;
+
+#if defined(ML_PREPROCESS_NEON)
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x3_t v = vld3q_u8 (src + 3 * x);
+
+    vst1q_u8 (first + x, v.val[0]);
+    vst1q_u8 (g + x, v.val[1]);
+    vst1q_u8 (last + x, v.val[2]);
+  }
+#endif
+
+  for (; x < width; x++) {
+    first[x] = src[3 * x];
+    g[x] = src[3 * x + 1];
+    last[x] = src[3 * x + 2];
+  }
+}
+
+/**
+ * Normalizes one uint8 channel row into floats: (v - mean) * scale.
+ * The SIMD paths compute exactly the same single precision expression.
+ */
+static inline void
+ml_normalize_row (const guint8 * src, gfloat * dst, gint n, gfloat mean,
+    gfloat scale)
+{
+  gint i = 0;
+
+#if defined(ML_PREPROCESS_NEON)
+  const float32x4_t vmean = vdupq_n_f32 (mean);
+  const float32x4_t vscale = vdupq_n_f32 (scale);
+
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t v16 = vmovl_u8 (vld1_u8 (src + i));
+    float32x4_t lo = vcvtq_f32_u32 (vmovl_u16 (vget_low_u16 (v16)));
+    float32x4_t hi = vcvtq_f32_u32 (vmovl_u16 (vget_high_u16 (v16)));
+
+    vst1q_f32 (dst + i, vmulq_f32 (vsubq_f32 (lo, vmean), vscale));
+    vst1q_f32 (dst + i + 4, vmulq_f32 (vsubq_f32 (hi, vmean), vscale));
+  }
+#elif defined(ML_PREPROCESS_AVX)
+  const __m256 vmean = _mm256_set1_ps (mean);
+  const __m256 vscale = _mm256_set1_ps (scale);
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v16 = _mm_unpacklo_epi8 (
+        _mm_loadl_epi64 ((const __m128i *) (src + i)), zero);
+    __m256i v32 = _mm256_insertf128_si256 (_mm256_castsi128_si256 (
+        _mm_unpacklo_epi16 (v16, zero)), _mm_unpackhi_epi16 (v16, zero), 1);
+    __m256 f = _mm256_cvtepi32_ps (v32);
+
+    _mm256_storeu_ps (dst + i, _mm256_mul_ps (_mm256_sub_ps (f, vmean), vscale));
+  }
+#elif defined(ML_PREPROCESS_SSE2)
+  const __m128 vmean = _mm_set1_ps (mean);
+  const __m128 vscale = _mm_set1_ps (scale);
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v16 = _mm_unpacklo_epi8 (
+        _mm_loadl_epi64 ((const __m128i *) (src + i)), zero);
+    __m128 lo = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (v16, zero));
+    __m128 hi = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (v16, zero));
+
+    _mm_storeu_ps (dst + i, _mm_mul_ps (_mm_sub_ps (lo, vmean), vscale));
+    _mm_storeu_ps (dst + i + 4, _mm_mul_ps (_mm_sub_ps (hi, vmean), vscale));
+  }
+#endif
+
+  for (; i < n; i++)
+    dst[i] = ((gfloat) src[i] - mean) * scale;
+}
+
+/**
+ * Writes the three channel rows into one tensor row at pixel offset @left.
+ */
+static inline void
+ml_store_row (const MLPreprocessor * pp, guint8 * const ch[3], gpointer out,
+    gint row, gint left, gint n)
+{
+  const MLPreprocessConfig *cfg = &pp->config;
+  gsize plane = (gsize) cfg->dst_width * cfg->dst_height;
+  gsize pos = (gsize) row * cfg->dst_width + left;
+  gint c, x;
+
+  if (cfg->layout == ML_LAYOUT_NCHW) {
+    for (c = 0; c < 3; c++) {
+      if (cfg->type == ML_TYPE_UINT8)
+        memcpy ((guint8 *) out + c * plane + pos, ch[c], n);
+      else
+        ml_normalize_row (ch[c], (gfloat *) out + c * plane + pos, n,
+            pp->mean[c], pp->scale[c]);
+    }
+    return;
+  }
+
+  if (cfg->type == ML_TYPE_UINT8) {
+    guint8 *dst = (guint8 *) out + pos * 3;
+
+    x = 0;
+#if defined(ML_PREPROCESS_NEON)
+    for (; x + 16 <= n; x += 16) {
+      uint8x16x3_t v;
+      v.val[0] = vld1q_u8 (ch[0] + x);
+      v.val[1] = vld1q_u8 (ch[1] + x);
+      v.val[2] = vld1q_u8 (ch[2] + x);
+      vst3q_u8 (dst + 3 * x, v);
+    }
+#endif
+    for (; x < n; x++) {
+      dst[3 * x] = ch[0][x];
+      dst[3 * x + 1] = ch[1][x];
+      dst[3 * x + 2] = ch[2][x];
+    }
+  } else {
+    gfloat *dst = (gfloat *) out + pos * 3;
+
+    // A lookup table is cheaper than arithmetic when interleaving floats
+    for (x = 0; x < n; x++) {
+      dst[3 * x] = pp->lut[0][ch[0][x]];
+      dst[3 * x + 1] = pp->lut[1][ch[1][x]];
+      dst[3 * x + 2] = pp->lut[2][ch[2][x]];
+    }
+  }
+}
+
+/**
+ * Fills @n pixels of tensor row @row starting at @left with the padding.
+ */
+static inline void
+ml_fill_pad (const MLPreprocessor * pp, gpointer out, gint row, gint left,
+    gint n)
+{
+  const MLPreprocessConfig *cfg = &pp->config;
+  gsize plane = (gsize) cfg->dst_width * cfg->dst_height;
+  gsize pos = (gsize) row * cfg->dst_width + left;
+  gint c, x;
+
+  if (n <= 0)
+    return;
+
+  if (cfg->type == ML_TYPE_UINT8) {
+    if (cfg->layout == ML_LAYOUT_NCHW) {
+      for (c = 0; c < 3; c++)
+        memset ((guint8 *) out + c * plane + pos, cfg->pad_value, n);
+    } else {
+      memset ((guint8 *) out + pos * 3, cfg->pad_value, (gsize) n * 3);
+    }
+    return;
+  }
+
+  if (cfg->layout == ML_LAYOUT_NCHW) {
+    for (c = 0; c < 3; c++) {
+      gfloat *dst = (gfloat *) out + c * plane + pos;
+      gfloat v = pp->lut[c][cfg->pad_value];
+
+      for (x = 0; x < n; x++)
+        dst[x] = v;
+    }
+  } else {
+    gfloat *dst = (gfloat *) out + pos * 3;
+
+    for (x = 0; x < n; x++)
+      for (c = 0; c < 3; c++)
+        dst[3 * x + c] = pp->lut[c][cfg->pad_value];
+  }
+}
+
+/**
+ * Releases the scratch memory of a preprocessor.
+ *
+ * @param pp Preprocessor initialized with ml_preprocess_init().
+ */
+static inline void
+ml_preprocess_deinit (MLPreprocessor * pp)
+{
+  ml_resizer_deinit (&pp->luma);
+  ml_resizer_deinit (&pp->chroma);
+  ml_resizer_deinit (&pp->packed);
+  free (pp->yrow);
+  free (pp->uvrow);
+  free (pp->prow);
+  for (gint c = 0; c < 3; c++)
+    free (pp->rgb[c]);
+  memset (pp, 0, sizeof (*pp));
+}
+
+/**
+ * Computes the region of a letterboxed frame inside the tensor, rounded
+ * like scripts/preprocess.py.
+ *
+ * @param src_width Width of the frame.
+ * @param src_height Height of the frame.
+ * @param dst_width Width of the tensor.
+ * @param dst_height Height of the tensor.
+ * @param left Filled with the horizontal offset of the resized frame.
+ * @param top Filled with the vertical offset of the resized frame.
+ * @param width Filled with the width of the resized frame.
+ * @param height Filled with the height of the resized frame.
+ * @return Scale factor from frame to tensor coordinates.
+ */
+static inline gdouble
+ml_preprocess_letterbox (gint src_width, gint src_height, gint dst_width,
+    gint dst_height, gint * left, gint * top, gint * width, gint * height)
+{
+  gdouble r = MIN ((gdouble) dst_height / src_height,
+      (gdouble) dst_width / src_width);
+
+  *width = (gint) lrint (src_width * r);
+  *height = (gint) lrint (src_height * r);
+  *left = (gint) lrint ((dst_width - *width) / 2.0 - 0.1);
+  *top = (gint) lrint ((dst_height - *height) / 2.0 - 0.1);
+  return r;
+}
+
+/**
+ * Initializes a preprocessor. The letterbox geometry matches letterbox()
+ * of scripts/preprocess.py with auto=False.
+ *
+ * @param pp Preprocessor to initialize.
+ * @param config Preprocessing configuration.
+ * @return TRUE on success, FALSE on invalid configuration or no memory.
+ */
+static inline gboolean
+ml_preprocess_init (MLPreprocessor * pp, const MLPreprocessConfig * config)
+{
+  gint sw = config->src_width, sh = config->src_height;
+  gint dw = config->dst_width, dh = config->dst_height;
+
+  memset (pp, 0, sizeof (*pp));
+  pp->config = *config;
+
+  if (sw < 4 || sh < 4 || dw < 2 || dh < 2)
+    return FALSE;
+
+  if (config->letterbox) {
+    pp->ratio_x = pp->ratio_y = (gfloat) ml_preprocess_letterbox (sw, sh,
+        dw, dh, &pp->left, &pp->top, &pp->width, &pp->height);
+  } else {
+    pp->width = dw;
+    pp->height = dh;
+    pp->ratio_x = (gfloat) dw / sw;
+    pp->ratio_y = (gfloat) dh / sh;
+  }
+
+  pp->width = CLAMP (pp->width, 2, dw);
+  pp->height = CLAMP (pp->height, 2, dh);
+
+  if (config->src_format != ML_FRAME_NV12) {
+    // Packed frames of the resized size are read without a resize
+    if ((pp->width != sw || pp->height != sh) &&
+        !ml_resizer_init (&pp->packed, sw, sh, pp->width, pp->height, 3)) {
+      ml_preprocess_deinit (pp);
+      return FALSE;
+    }
+
+    pp->prow = (guint8 *) ml_preprocess_alloc ((gsize) pp->width * 3 + 48);
+  } else {
+    if (!ml_resizer_init (&pp->luma, sw, sh, pp->width, pp->height, 1) ||
+        !ml_resizer_init (&pp->chroma, sw / 2, sh / 2, (pp->width + 1) / 2,
+            (pp->height + 1) / 2, 2)) {
+      ml_preprocess_deinit (pp);
+      return FALSE;
+    }
+
+    // Extra room lets the 16 pixel SIMD loops read whole chroma pairs
+    pp->yrow = (guint8 *) ml_preprocess_alloc (pp->width + 16);
+    pp->uvrow = (guint8 *) ml_preprocess_alloc (pp->width + 32);
+  }
+
+  for (gint c = 0; c < 3; c++)
+    pp->rgb[c] = (guint8 *) ml_preprocess_alloc (pp->width + 16);
+
+  if (((config->src_format == ML_FRAME_NV12) ? (!pp->yrow || !pp->uvrow) :
+          !pp->prow) || !pp->rgb[0] || !pp->rgb[1] || !pp->rgb[2]) {
+    ml_preprocess_deinit (pp);
+    return FALSE;
+  }
+
+  pp->uvrow_idx = -1;
+
+  // Normalization is applied per output channel, the config is RGB ordered
+  for (gint c = 0; c < 3; c++) {
+    gint src_c = (config->color == ML_COLOR_BGR) ? 2 - c : c;
+
+    pp->mean[c] = config->mean[src_c];
+    pp->scale[c] = config->scale[src_c];
+
+    for (gint v = 0; v < 256; v++)
+      pp->lut[c][v] = ((gfloat) v - pp->mean[c]) * pp->scale[c];
+  }
+
+  return TRUE;
+}
+
+/**
+ * Returns the size in bytes of the output tensor.
+ *
+ * @param pp Initialized preprocessor.
+ */
+static inline gsize
+ml_preprocess_output_size (const MLPreprocessor * pp)
+{
+  gsize elem = (pp->config.type == ML_TYPE_UINT8) ? 1 : sizeof (gfloat);
+  return (gsize) pp->config.dst_width * pp->config.dst_height * 3 * elem;
+}
+
+/**
+ * Sets the tensor channel order of the RGB rows.
+ */
+static inline void
+ml_preprocess_channels (MLPreprocessor * pp, guint8 * ch[3])
+{
+  gboolean bgr = pp->config.color == ML_COLOR_BGR;
+
+  ch[0] = bgr ? pp->rgb[2] : pp->rgb[0];
+  ch[1] = pp->rgb[1];
+  ch[2] = bgr ? pp->rgb[0] : pp->rgb[2];
+}
+
+/**
+ * Converts one NV12 frame into the output tensor.
+ *
+ * @param pp Preprocessor initialized for NV12 frames.
+ * @param y Pointer to the luma plane.
+ * @param y_stride Stride of the luma plane in bytes.
+ * @param uv Pointer to the interleaved chroma plane.
+ * @param uv_stride Stride of the chroma plane in bytes.
+ * @param out Tensor of ml_preprocess_output_size() bytes.
+ */
+static inline void
+ml_preprocess_nv12 (MLPreprocessor * pp, const guint8 * y, gint y_stride,
+    const guint8 * uv, gint uv_stride, gpointer out)
+{
+  const MLPreprocessConfig *cfg = &pp->config;
+  guint8 *ch[3];
+  gint row;
+
+  ml_preprocess_channels (pp, ch);
+
+  // Cached horizontal rows belong to the previous frame
+  pp->luma.hrow_idx[0] = pp->luma.hrow_idx[1] = -1;
+  pp->chroma.hrow_idx[0] = pp->chroma.hrow_idx[1] = -1;
+  pp->uvrow_idx = -1;
+
+  for (row = 0; row < pp->top; row++)
+    ml_fill_pad (pp, out, row, 0, cfg->dst_width);
+
+  for (row = 0; row < pp->height; row++) {
+    gint trow = pp->top + row;
+
+    ml_resizer_row (&pp->luma, y, y_stride, row, pp->yrow);
+
+    if (pp->uvrow_idx != row / 2) {
+      ml_resizer_row (&pp->chroma, uv, uv_stride, row / 2, pp->uvrow);
+      pp->uvrow_idx = row / 2;
+    }
+
+    ml_nv12_to_rgb_row (pp->yrow, pp->uvrow, pp->rgb[0], pp->rgb[1],
+        pp->rgb[2], pp->width);
+
+    ml_fill_pad (pp, out, trow, 0, pp->left);
+    ml_store_row (pp, ch, out, trow, pp->left, pp->width);
+    ml_fill_pad (pp, out, trow, pp->left + pp->width,
+        cfg->dst_width - pp->left - pp->width);
+  }
+
+  for (row = pp->top + pp->height; row < cfg->dst_height; row++)
+    ml_fill_pad (pp, out, row, 0, cfg->dst_width);
+}
+
+/**
+ * Converts one packed RGB or BGR frame into the output tensor.
+ *
+ * @param pp Preprocessor initialized for ML_FRAME_RGB or ML_FRAME_BGR
+ *           frames.
+ * @param data Pointer to the first row of pixels.
+ * @param stride Stride of the frame in bytes.
+ * @param out Tensor of ml_preprocess_output_size() bytes.
+ */
+static inline void
+ml_preprocess_packed (MLPreprocessor * pp, const guint8 * data, gint stride,
+    gpointer out)
+{
+  const MLPreprocessConfig *cfg = &pp->config;
+  gboolean resize = pp->packed.xofs != NULL;
+  guint8 *ch[3];
+  gint row;
+
+  ml_preprocess_channels (pp, ch);
+  pp->packed.hrow_idx[0] = pp->packed.hrow_idx[1] = -1;
+
+  for (row = 0; row < pp->top; row++)
+    ml_fill_pad (pp, out, row, 0, cfg->dst_width);
+
+  for (row = 0; row < pp->height; row++) {
+    const guint8 *src = data + (gsize) row * stride;
+    gint trow = pp->top + row;
+
+    if (resize) {
+      ml_resizer_row (&pp->packed, data, stride, row, pp->prow);
+      src = pp->prow;
+    }
+
+    ml_packed_to_rgb_row (src, cfg->src_format == ML_FRAME_BGR, pp->rgb[0],
+        pp->rgb[1], pp->rgb[2], pp->width);
+
+    ml_fill_pad (pp, out, trow, 0, pp->left);
+    ml_store_row (pp, ch, out, trow, pp->left, pp->width);
+    ml_fill_pad (pp, out, trow, pp->left + pp->width,
+        cfg->dst_width - pp->left - pp->width);
+  }
+
+  for (row = pp->top + pp->height; row < cfg->dst_height; row++)
+    ml_fill_pad (pp, out, row, 0, cfg->dst_width);
+}
+
+#endif //ML_PREPROCESS_H
@@ -0,0 +1,554 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides a decoder for the heatmaps of HRNet like pose models.
+ *
+ * The model output holds one heatmap per keypoint, [1, K, H, W] or
+ * [1, H, W, K], as float or uint8. The peak of every heatmap is found with
+ * NEON on ARM, SSE2 on x86 and plain C otherwise: for [1, K, H, W] every
+ * plane is reduced on its own, for [1, H, W, K] the keypoints of a pixel
+ * are compared side by side. The peak is refined to sub-pixel precision
+ * with a parabola through its neighbors and scaled to the model input.
+ *
+ * The skeleton is taken from a pose settings file like
+ * artifacts/json_labels/hrnet_pose_settings.json: the "confidence" in
+ * percent, the "connections" and the "posenet" links are turned once into
+ * a flat list of unique keypoint pairs. Every frame reports the links
+ * whose keypoints both reach the confidence.
+ *
+ * Scratch memory grows to the size of the model output on the first frame,
+ * later frames do not allocate.
+ */
+
+#ifndef POSE_DECODER_H
+#define POSE_DECODER_H
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "ml_labels.h"
+#include "ml_preprocess.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define POSE_DECODER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define POSE_DECODER_SSE2 1
+#endif
+
+#define POSE_DEFAULT_THRESHOLD 0.5F
+
+/**
+ * PoseKeypoint:
+ * @x      : Horizontal position in model input pixels.
+ * @y      : Vertical position in model input pixels.
+ * @score  : Peak value of the heatmap.
+ * @visible: Whether the score reaches the threshold.
+ *
+ * Keypoint of the last frame.
+ */
+typedef struct {
+  gfloat   x;
+  gfloat   y;
+  gfloat   score;
+  gboolean visible;
+} PoseKeypoint;
+
+/**
+ * PoseDecoder:
+ * @width          : Model input width.
+ * @height         : Model input height.
+ * @threshold      : Minimum score of a visible keypoint.
+ * @q_offset       : Zero point of a uint8 output.
+ * @q_scale        : Scale of a uint8 output.
+ * @labels         : Names and colors of the keypoints.
+ * @links          : Keypoint pairs of the skeleton, 2 entries per link.
+ * @n_links        : Number of links.
+ * @keypoints      : Keypoints of the last frame.
+ * @n_keypoints    : Number of keypoints, the heatmaps of the model.
+ * @visible_links  : Indices of the links with both keypoints visible.
+ * @n_visible_links: Number of visible links.
+ * @score          : Mean score of all keypoints.
+ *
+ * Decoder state and the results of the last frame.
+ */
+typedef struct {
+  gint         width;
+  gint         height;
+  gfloat       threshold;
+  gfloat       q_offset;
+  gfloat       q_scale;
+  MLLabels     labels;
+  gint         *links;
+  gint         n_links;
+  PoseKeypoint *keypoints;
+  gint         n_keypoints;
+  gint         *visible_links;
+  gint         n_visible_links;
+  gfloat       score;
+
+  // Private
+  gfloat       *peak;
+  guint8       *qpeak;
+  gint         max_keypoints;
+} PoseDecoder;
+
+/**
+ * Creates a decoder for a model with the given input size.
+ *
+ * @param width Model input width.
+ * @param height Model input height.
+ * @return New decoder, free with pose_decoder_free().
+ */
+static inline PoseDecoder *
+pose_decoder_new (gint width, gint height)
+{
+  PoseDecoder *dec = g_new0 (PoseDecoder, 1);
+
+  dec->width = width;
+  dec->height = height;
+  dec->threshold = POSE_DEFAULT_THRESHOLD;
+  dec->q_offset = 0.0F;
+  dec->q_scale = 1.0F;
+  return dec;
+}
+
+/**
+ * Frees a decoder, its labels and skeleton.
+ *
+ * @param dec Decoder created with pose_decoder_new().
+ */
+static inline void
+pose_decoder_free (PoseDecoder * dec)
+{
+  if (dec == NULL)
+    return;
+
+  ml_labels_clear (&dec->labels);
+  g_free (dec->links);
+  g_free (dec->keypoints);
+  g_free (dec->visible_links);
+  g_free (dec->peak);
+  g_free (dec->qpeak);
+  g_free (dec);
+}
+
+/**
+ * Sets the quantization parameters of a uint8 output from a constants
+ * string of the configs, e.g. "hrnet,q-offsets=<8.0>,q-scales=<0.004>;".
+ *
+ * @param dec Decoder.
+ * @param constants Constants string.
+ * @return FALSE if the string has no valid offset and scale.
+ */
+static inline gboolean
+pose_decoder_set_constants (PoseDecoder * dec, const gchar * constants)
+{
+  return ml_constants_parse (constants, &dec->q_offset, &dec->q_scale, 1) > 0;
+}
+
+/**
+ * Loads the names and colors of the keypoints from a json_labels file,
+ * e.g. artifacts/json_labels/hrnet_pose.json.
+ *
+ * @param dec Decoder.
+ * @param path Path of the labels file.
+ * @return FALSE if the file can not be parsed.
+ */
+static inline gboolean
+pose_decoder_load_labels (PoseDecoder * dec, const gchar * path)
+{
+  return ml_labels_load (&dec->labels, path);
+}
+
+static inline void
+pose_decoder_add_link (PoseDecoder * dec, gint64 a, gint64 b)
+{
+  gint from = (gint) MIN (a, b), to = (gint) MAX (a, b);
+
+  if (a < 0 || b < 0 || a == b || MAX (a, b) >= G_MAXINT16)
+    return;
+
+  // Both lists of the settings describe the same bones partly
+  for (gint i = 0; i < dec->n_links; i++)
+    if (dec->links[2 * i] == from && dec->links[2 * i + 1] == to)
+      return;
+
+  dec->links = g_renew (gint, dec->links, 2 * (dec->n_links + 1));
+  dec->links[2 * dec->n_links] = from;
+  dec->links[2 * dec->n_links + 1] = to;
+  dec->n_links++;
+}
+
+/**
+ * Loads the confidence and the skeleton from a pose settings file. The
+ * "connections" entries {"id": a, "connection": b} and the "posenet"
+ * entries {"id": a, "links": [b, ...]} are merged into unique links.
+ *
+ * @param dec Decoder.
+ * @param path Path of the settings file.
+ * @return FALSE if the file can not be parsed.
+ */
+static inline gboolean
+pose_decoder_load_settings (PoseDecoder * dec, const gchar * path)
+{
+  JsonParser *parser = json_parser_new ();
+  JsonObject *root = NULL;
+  GError *error = NULL;
+
+  if (!json_parser_load_from_file (parser, path, &error)) {
+    g_printerr ("\n Failed to parse pose settings %s: %s\n", path,
+        error->message);
+    g_clear_error (&error);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  if (!JSON_NODE_HOLDS_OBJECT (json_parser_get_root (parser))) {
+    g_printerr ("\n Pose settings %s is not a JSON object!\n", path);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  root = json_node_get_object (json_parser_get_root (parser));
+
+  if (json_object_has_member (root, "confidence"))
+    dec->threshold =
+        json_object_get_double_member (root, "confidence") / 100.0F;
+
+  g_free (dec->links);
+  dec->links = NULL;
+  dec->n_links = 0;
+
+  if (json_object_has_member (root, "connections")) {
+    JsonArray *array = json_object_get_array_member (root, "connections");
+
+    for (guint i = 0; array != NULL && i < json_array_get_length (array);
+        i++) {
+      JsonObject *entry = json_array_get_object_element (array, i);
+
+      if (entry != NULL && json_object_has_member (entry, "id") &&
+          json_object_has_member (entry, "connection"))
+        pose_decoder_add_link (dec, json_object_get_int_member (entry, "id"),
+            json_object_get_int_member (entry, "connection"));
+    }
+  }
+
+  if (json_object_has_member (root, "posenet")) {
+    JsonArray *array = json_object_get_array_member (root, "posenet");
+
+    for (guint i = 0; array != NULL && i < json_array_get_length (array);
+        i++) {
+      JsonObject *entry = json_array_get_object_element (array, i);
+      JsonArray *links = NULL;
+
+      if (entry == NULL || !json_object_has_member (entry, "id") ||
+          !json_object_has_member (entry, "links"))
+        continue;
+
+      links = json_object_get_array_member (entry, "links");
+      for (guint j = 0; links != NULL && j < json_array_get_length (links);
+          j++)
+        pose_decoder_add_link (dec, json_object_get_int_member (entry, "id"),
+            json_array_get_int_element (links, j));
+    }
+  }
+
+  g_object_unref (parser);
+
+  if (dec->n_links == 0) {
+    g_printerr ("\n Pose settings %s have no keypoint links!\n", path);
+    return FALSE;
+  }
+
+  // One visible link index per link at most
+  dec->visible_links = g_renew (gint, dec->visible_links, dec->n_links);
+  return TRUE;
+}
+
+/**
+ * Label of a keypoint.
+ *
+ * @param dec Decoder.
+ * @param keypoint Keypoint index.
+ * @return Label or NULL if the labels file has none for the keypoint.
+ */
+static inline const gchar *
+pose_decoder_label (const PoseDecoder * dec, gint keypoint)
+{
+  return ml_labels_get (&dec->labels, keypoint);
+}
+
+/**
+ * Largest float of a contiguous plane.
+ */
+static inline gfloat
+pose_plane_max_f32 (const gfloat * data, gsize n)
+{
+  gfloat max = data[0];
+  gsize i = 0;
+
+#if defined(POSE_DECODER_NEON)
+  if (n >= 8) {
+    float32x4_t m0 = vld1q_f32 (data), m1 = vld1q_f32 (data + 4);
+
+    for (i = 8; i + 8 <= n; i += 8) {
+      m0 = vmaxq_f32 (m0, vld1q_f32 (data + i));
+      m1 = vmaxq_f32 (m1, vld1q_f32 (data + i + 4));
+    }
+    max = vmaxvq_f32 (vmaxq_f32 (m0, m1));
+  }
+#elif defined(POSE_DECODER_SSE2)
+  if (n >= 8) {
+    __m128 m0 = _mm_loadu_ps (data), m1 = _mm_loadu_ps (data + 4);
+    gfloat lanes[4];
+
+    for (i = 8; i + 8 <= n; i += 8) {
+      m0 = _mm_max_ps (m0, _mm_loadu_ps (data + i));
+      m1 = _mm_max_ps (m1, _mm_loadu_ps (data + i + 4));
+    }
+    _mm_storeu_ps (lanes, _mm_max_ps (m0, m1));
+    max = MAX (MAX (lanes[0], lanes[1]), MAX (lanes[2], lanes[3]));
+  }
+#endif
+
+  for (; i < n; i++)
+    max = (data[i] > max) ? data[i] : max;
+  return max;
+}
+
+/**
+ * Largest uint8 of a contiguous plane.
+ */
+static inline guint8
+pose_plane_max_u8 (const guint8 * data, gsize n)
+{
+  guint8 max = 0;
+  gsize i = 0;
+
+#if defined(POSE_DECODER_NEON)
+  uint8x16_t m = vdupq_n_u8 (0);
+
+  for (; i + 16 <= n; i += 16)
+    m = vmaxq_u8 (m, vld1q_u8 (data + i));
+  max = vmaxvq_u8 (m);
+#elif defined(POSE_DECODER_SSE2)
+  __m128i m = _mm_setzero_si128 ();
+
+  for (; i + 16 <= n; i += 16)
+    m = _mm_max_epu8 (m, _mm_loadu_si128 ((const __m128i *) (data + i)));
+  m = _mm_max_epu8 (m, _mm_srli_si128 (m, 8));
+  m = _mm_max_epu8 (m, _mm_srli_si128 (m, 4));
+  m = _mm_max_epu8 (m, _mm_srli_si128 (m, 2));
+  m = _mm_max_epu8 (m, _mm_srli_si128 (m, 1));
+  max = (guint8) _mm_cvtsi128_si32 (m);
+#endif
+
+  for (; i < n; i++)
+    max = MAX (max, data[i]);
+  return max;
+}
+
+/**
+ * Largest float of every keypoint of [n_pixels, n_keypoints] heatmaps.
+ */
+static inline void
+pose_pixels_max_f32 (const gfloat * data, gsize n_pixels, gsize n_keypoints,
+    gfloat * peak)
+{
+  memcpy (peak, data, n_keypoints * sizeof (gfloat));
+
+  for (gsize p = 1; p < n_pixels; p++) {
+    const gfloat *px = data + p * n_keypoints;
+    gsize k = 0;
+
+#if defined(POSE_DECODER_NEON)
+    for (; k + 4 <= n_keypoints; k += 4)
+      vst1q_f32 (peak + k, vmaxq_f32 (vld1q_f32 (peak + k),
+              vld1q_f32 (px + k)));
+#elif defined(POSE_DECODER_SSE2)
+    for (; k + 4 <= n_keypoints; k += 4)
+      _mm_storeu_ps (peak + k, _mm_max_ps (_mm_loadu_ps (peak + k),
+              _mm_loadu_ps (px + k)));
+#endif
+
+    for (; k < n_keypoints; k++)
+      peak[k] = (px[k] > peak[k]) ? px[k] : peak[k];
+  }
+}
+
+/**
+ * Largest uint8 of every keypoint of [n_pixels, n_keypoints] heatmaps.
+ */
+static inline void
+pose_pixels_max_u8 (const guint8 * data, gsize n_pixels, gsize n_keypoints,
+    guint8 * peak)
+{
+  memcpy (peak, data, n_keypoints);
+
+  for (gsize p = 1; p < n_pixels; p++) {
+    const guint8 *px = data + p * n_keypoints;
+    gsize k = 0;
+
+#if defined(POSE_DECODER_NEON)
+    for (; k + 16 <= n_keypoints; k += 16)
+      vst1q_u8 (peak + k, vmaxq_u8 (vld1q_u8 (peak + k), vld1q_u8 (px + k)));
+#elif defined(POSE_DECODER_SSE2)
+    for (; k + 16 <= n_keypoints; k += 16)
+      _mm_storeu_si128 ((__m128i *) (peak + k), _mm_max_epu8 (
+              _mm_loadu_si128 ((const __m128i *) (peak + k)),
+              _mm_loadu_si128 ((const __m128i *) (px + k))));
+#endif
+
+    for (; k < n_keypoints; k++)
+      peak[k] = MAX (peak[k], px[k]);
+  }
+}
+
+/**
+ * Heatmap value without dequantization, enough to compare and refine.
+ */
+static inline gfloat
+pose_heatmap_value (gconstpointer data, MLTensorType type, gsize index)
+{
+  if (type == ML_TYPE_UINT8)
+    return ((const guint8 *) data)[index];
+  return ((const gfloat *) data)[index];
+}
+
+/**
+ * Offset of the vertex of the parabola through the peak and its two
+ * neighbors, in [-0.5, 0.5].
+ */
+static inline gfloat
+pose_refine (gfloat prev, gfloat peak, gfloat next)
+{
+  gfloat curvature = prev - 2.0F * peak + next;
+
+  if (!(curvature < 0.0F))
+    return 0.0F;
+  return CLAMP (0.5F * (prev - next) / curvature, -0.5F, 0.5F);
+}
+
+/**
+ * Decodes the heatmaps of a frame into dec->keypoints and the visible
+ * links into dec->visible_links.
+ *
+ * @param dec Decoder.
+ * @param data Heatmaps.
+ * @param type Element type of the heatmaps.
+ * @param dims Dimensions, [1, K, H, W] or [1, H, W, K]. Without labels the
+ *             smaller of the 2nd and 4th dimension is the keypoint one.
+ * @return Number of visible keypoints or -1 if the output is not supported.
+ */
+static inline gint
+pose_decoder_process (PoseDecoder * dec, gconstpointer data,
+    MLTensorType type, const gint64 * dims)
+{
+  MLTensorLayout layout = ML_LAYOUT_NCHW;
+  gint64 n_keypoints = 0, rows = 0, cols = 0;
+  gsize n_pixels = 0, plane = 0, step = 0;
+  gint n_visible = 0;
+  gfloat sum = 0.0F;
+
+  if (dims[0] != 1 || dims[1] <= 0 || dims[2] <= 0 || dims[3] <= 0) {
+    g_printerr ("\n Unsupported pose heatmap shape!\n");
+    return -1;
+  }
+
+  if (dec->labels.n_entries > 0)
+    layout = (dims[1] == dec->labels.n_entries) ?
+        ML_LAYOUT_NCHW : ML_LAYOUT_NHWC;
+  else
+    layout = (dims[1] <= dims[3]) ? ML_LAYOUT_NCHW : ML_LAYOUT_NHWC;
+
+  n_keypoints = (layout == ML_LAYOUT_NCHW) ? dims[1] : dims[3];
+  rows = (layout == ML_LAYOUT_NCHW) ? dims[2] : dims[1];
+  cols = (layout == ML_LAYOUT_NCHW) ? dims[3] : dims[2];
+  n_pixels = (gsize) (rows * cols);
+
+  if (n_keypoints > dec->max_keypoints) {
+    dec->keypoints = g_renew (PoseKeypoint, dec->keypoints, n_keypoints);
+    dec->peak = g_renew (gfloat, dec->peak, n_keypoints);
+    dec->qpeak = g_renew (guint8, dec->qpeak, n_keypoints);
+    dec->max_keypoints = n_keypoints;
+  }
+
+  // Find the peak values first, then their first position
+  if (layout == ML_LAYOUT_NHWC && type == ML_TYPE_UINT8) {
+    pose_pixels_max_u8 ((const guint8 *) data, n_pixels, n_keypoints,
+        dec->qpeak);
+  } else if (layout == ML_LAYOUT_NHWC) {
+    pose_pixels_max_f32 ((const gfloat *) data, n_pixels, n_keypoints,
+        dec->peak);
+  } else {
+    for (gint64 k = 0; k < n_keypoints; k++) {
+      if (type == ML_TYPE_UINT8)
+        dec->qpeak[k] = pose_plane_max_u8 ((const guint8 *) data +
+            k * n_pixels, n_pixels);
+      else
+        dec->peak[k] = pose_plane_max_f32 ((const gfloat *) data +
+            k * n_pixels, n_pixels);
+    }
+  }
+
+  // Element index of keypoint k at pixel p is k * plane + p * step
+  plane = (layout == ML_LAYOUT_NCHW) ? n_pixels : 1;
+  step = (layout == ML_LAYOUT_NCHW) ? 1 : (gsize) n_keypoints;
+
+  for (gint64 k = 0; k < n_keypoints; k++) {
+    PoseKeypoint *kp = &dec->keypoints[k];
+    gfloat peak = (type == ML_TYPE_UINT8) ? dec->qpeak[k] : dec->peak[k];
+    gsize base = k * plane, p = 0;
+    gint64 x = 0, y = 0;
+    gfloat dx = 0.0F, dy = 0.0F;
+
+    while (p + 1 < n_pixels &&
+        pose_heatmap_value (data, type, base + p * step) != peak)
+      p++;
+
+    x = p % cols;
+    y = p / cols;
+
+    if (x > 0 && x + 1 < cols)
+      dx = pose_refine (pose_heatmap_value (data, type, base + (p - 1) * step),
+          peak, pose_heatmap_value (data, type, base + (p + 1) * step));
+    if (y > 0 && y + 1 < rows)
+      dy = pose_refine (
+          pose_heatmap_value (data, type, base + (p - cols) * step), peak,
+          pose_heatmap_value (data, type, base + (p + cols) * step));
+
+    kp->x = (x + dx) * dec->width / cols;
+    kp->y = (y + dy) * dec->height / rows;
+    kp->score = (type == ML_TYPE_UINT8) ?
+        (peak - dec->q_offset) * dec->q_scale : peak;
+    kp->visible = (kp->score >= dec->threshold);
+
+    n_visible += kp->visible;
+    sum += kp->score;
+  }
+
+  dec->n_keypoints = n_keypoints;
+  dec->score = sum / n_keypoints;
+
+  // Assemble the skeleton from the links of visible keypoints
+  dec->n_visible_links = 0;
+  for (gint i = 0; i < dec->n_links; i++) {
+    gint a = dec->links[2 * i], b = dec->links[2 * i + 1];
+
+    if (b < n_keypoints && dec->keypoints[a].visible &&
+        dec->keypoints[b].visible)
+      dec->visible_links[dec->n_visible_links++] = i;
+  }
+
+  return n_visible;
+}
+
+#endif //POSE_DECODER_H
@@ -0,0 +1,869 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides a decoder for the outputs of semantic segmentation
+ * models like DeepLabv3.
+ *
+ * The model output holds either one score per class and pixel, [1, C, H, W]
+ * or [1, H, W, C] as float or uint8, or the class of every pixel when the
+ * model already includes the argmax, [1, H, W] of integers. The scores are
+ * reduced to a class mask with NEON on ARM, SSE2 on x86 and plain C
+ * otherwise: for [1, C, H, W] a block of pixels keeps its running maximum
+ * and class in registers while the class planes are visited, for
+ * [1, H, W, C] the classes of a pixel are compared side by side.
+ *
+ * The mask is colored with the classes of a labels file like
+ * artifacts/json_labels/deeplabv3_resnet50.json into an RGBA overlay of
+ * any size. Classes without a color, like the background, stay
+ * transparent. The overlay maps back to a region of the mask, e.g. the
+ * part not covered by the letterbox padding, with nearest neighbor
+ * sampling: every mask row is colored once at the overlay width and
+ * repeated output rows are copied. On ARM the palette lookup of up to 64
+ * classes is a NEON table lookup, SSE2 has no byte shuffle so x86 uses a
+ * plain lookup table.
+ *
+ * The mask is split into bands of rows, each band together with the
+ * overlay rows sampled from it is processed by one of a few persistent
+ * worker threads. All memory is allocated when the geometry changes,
+ * frames of the same geometry do not allocate.
+ */
+
+#ifndef SEG_DECODER_H
+#define SEG_DECODER_H
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "ml_labels.h"
+#include "ml_preprocess.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SEG_DECODER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SEG_DECODER_SSE2 1
+#endif
+
+// Classes of the mask, the class of a pixel is stored in one byte.
+#define SEG_MAX_CLASSES 256
+
+// Threads used by default, the other pipeline stages keep the rest.
+#define SEG_DEFAULT_THREADS 4
+
+// Bands per thread, so threads finishing early pick up remaining work.
+#define SEG_BANDS_PER_THREAD 4
+
+typedef struct _SegDecoder SegDecoder;
+
+typedef struct {
+  SegDecoder *dec;
+  gint       index;
+  GThread    *thread;
+} SegWorker;
+
+/**
+ * SegDecoder:
+ * @mask_width   : Width of the class mask, the model output width.
+ * @mask_height  : Height of the class mask.
+ * @mask         : Class of every mask pixel.
+ * @out_width    : Width of the overlay.
+ * @out_height   : Height of the overlay.
+ * @overlay      : RGBA overlay, 4 bytes per pixel without row padding.
+ * @src_x        : Left edge of the mask region shown in the overlay.
+ * @src_y        : Top edge of the mask region shown in the overlay.
+ * @src_width    : Width of the mask region shown in the overlay.
+ * @src_height   : Height of the mask region shown in the overlay.
+ * @class_pixels : Mask pixels of every class inside the shown region.
+ * @labels       : Classes, see seg_decoder_load_labels().
+ *
+ * Segmentation decoder. The mask, overlay and statistics are valid until
+ * the next call of seg_decoder_process() or seg_decoder_process_classes().
+ */
+struct _SegDecoder {
+  gint      mask_width;
+  gint      mask_height;
+  guint8    *mask;
+  gint      out_width;
+  gint      out_height;
+  guint8    *overlay;
+  gint      src_x;
+  gint      src_y;
+  gint      src_width;
+  gint      src_height;
+  guint32   class_pixels[SEG_MAX_CLASSES];
+  MLLabels  labels;
+
+  // Private
+  guint32   palette[SEG_MAX_CLASSES];
+  guint8    planes[4][64];
+  gboolean  small_palette;
+  gint      alpha;
+  gint      *xmap;
+  gint      *ymap;
+  gint      n_bands;
+  gint      *band_rows;
+  gint      *band_out;
+  guint32   *band_pixels;
+  guint8    *rows;
+
+  gconstpointer  data;
+  MLTensorType   type;
+  MLTensorLayout layout;
+  gint           channels;
+  gint           elem_size;
+
+  gint      n_threads;
+  SegWorker *workers;
+  GMutex    lock;
+  GCond     start;
+  GCond     done;
+  guint     generation;
+  gint      active;
+  gint      next_band;
+  gboolean  quit;
+};
+
+/**
+ * Stores the color of a class as R, G, B, A bytes, the memory order of the
+ * overlay.
+ */
+static inline guint32
+seg_color_pixel (guint32 color)
+{
+  guint8 rgba[4] = { (guint8) (color >> 24), (guint8) (color >> 16),
+    (guint8) (color >> 8), (guint8) color };
+  guint32 pixel = 0;
+
+  memcpy (&pixel, rgba, sizeof (pixel));
+  return pixel;
+}
+
+/**
+ * Rebuilds the palette from the labels, or from a fixed set of colors when
+ * no labels are loaded. Class 0 has no color then, as in most models it is
+ * the background.
+ */
+static inline void
+seg_decoder_update_palette (SegDecoder * dec)
+{
+  gint n_colors = 0;
+
+  for (gint id = 0; id < SEG_MAX_CLASSES; id++) {
+    guint32 color = 0;
+
+    if (dec->labels.n_entries > 0) {
+      color = ml_labels_color (&dec->labels, id);
+    } else if (id > 0) {
+      // Well spread hues from the golden ratio, opaque
+      color = ((guint32) id * 0x9E3779B1U) | 0xFF;
+    }
+
+    if (color != 0 && dec->alpha >= 0)
+      color = (color & 0xFFFFFF00U) | (guint32) dec->alpha;
+
+    dec->palette[id] = seg_color_pixel (color);
+    if (color != 0)
+      n_colors = id + 1;
+  }
+
+  // The table lookup returns 0, a transparent pixel, beyond 64 classes
+  dec->small_palette = n_colors <= 64;
+  for (gint id = 0; id < 64; id++)
+    for (gint c = 0; c < 4; c++)
+      dec->planes[c][id] = ((const guint8 *) &dec->palette[id])[c];
+}
+
+/**
+ * Class of the largest score of every pixel in a mask row of a
+ * [C, H, W] output.
+ */
+static inline void
+seg_argmax_planes_f32 (const gfloat * data, gsize plane, gint channels,
+    gint width, guint8 * mask)
+{
+  gint x = 0;
+
+#if defined(SEG_DECODER_NEON)
+  for (; x + 8 <= width; x += 8) {
+    const gfloat *p = data + x;
+    float32x4_t best0 = vld1q_f32 (p), best1 = vld1q_f32 (p + 4);
+    uint8x8_t cls = vdup_n_u8 (0);
+
+    for (gint c = 1; c < channels; c++) {
+      const gfloat *q = p + c * plane;
+      float32x4_t v0 = vld1q_f32 (q), v1 = vld1q_f32 (q + 4);
+      uint32x4_t gt0 = vcgtq_f32 (v0, best0), gt1 = vcgtq_f32 (v1, best1);
+      uint8x8_t gt = vmovn_u16 (vcombine_u16 (vmovn_u32 (gt0),
+              vmovn_u32 (gt1)));
+
+      best0 = vbslq_f32 (gt0, v0, best0);
+      best1 = vbslq_f32 (gt1, v1, best1);
+      cls = vbsl_u8 (gt, vdup_n_u8 ((guint8) c), cls);
+    }
+    vst1_u8 (mask + x, cls);
+  }
+#elif defined(SEG_DECODER_SSE2)
+  for (; x + 8 <= width; x += 8) {
+    const gfloat *p = data + x;
+    __m128 best0 = _mm_loadu_ps (p), best1 = _mm_loadu_ps (p + 4);
+    __m128i cls = _mm_setzero_si128 ();
+
+    for (gint c = 1; c < channels; c++) {
+      const gfloat *q = p + c * plane;
+      __m128 v0 = _mm_loadu_ps (q), v1 = _mm_loadu_ps (q + 4);
+      __m128 gt0 = _mm_cmpgt_ps (v0, best0), gt1 = _mm_cmpgt_ps (v1, best1);
+      __m128i gt = _mm_packs_epi32 (_mm_castps_si128 (gt0),
+          _mm_castps_si128 (gt1));
+
+      gt = _mm_packs_epi16 (gt, gt);
+      best0 = _mm_or_ps (_mm_and_ps (gt0, v0), _mm_andnot_ps (gt0, best0));
+      best1 = _mm_or_ps (_mm_and_ps (gt1, v1), _mm_andnot_ps (gt1, best1));
+      cls = _mm_or_si128 (_mm_and_si128 (gt, _mm_set1_epi8 ((gchar) c)),
+          _mm_andnot_si128 (gt, cls));
+    }
+    _mm_storel_epi64 ((__m128i *) (mask + x), cls);
+  }
+#endif
+
+  for (; x < width; x++) {
+    gfloat best = data[x];
+    gint cls = 0;
+
+    for (gint c = 1; c < channels; c++) {
+      if (data[x + c * plane] > best) {
+        best = data[x + c * plane];
+        cls = c;
+      }
+    }
+    mask[x] = (guint8) cls;
+  }
+}
+
+/**
+ * Class of the largest score of every pixel in a mask row of a uint8
+ * [C, H, W] output. The zero point and scale of the output do not change
+ * the order of the scores.
+ */
+static inline void
+seg_argmax_planes_u8 (const guint8 * data, gsize plane, gint channels,
+    gint width, guint8 * mask)
+{
+  gint x = 0;
+
+#if defined(SEG_DECODER_NEON)
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t best = vld1q_u8 (data + x);
+    uint8x16_t cls = vdupq_n_u8 (0);
+
+    for (gint c = 1; c < channels; c++) {
+      uint8x16_t v = vld1q_u8 (data + x + c * plane);
+      uint8x16_t gt = vcgtq_u8 (v, best);
+
+      best = vmaxq_u8 (best, v);
+      cls = vbslq_u8 (gt, vdupq_n_u8 ((guint8) c), cls);
+    }
+    vst1q_u8 (mask + x, cls);
+  }
+#elif defined(SEG_DECODER_SSE2)
+  for (; x + 16 <= width; x += 16) {
+    __m128i best = _mm_loadu_si128 ((const __m128i *) (data + x));
+    __m128i cls = _mm_setzero_si128 ();
+
+    for (gint c = 1; c < channels; c++) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (data + x + c * plane));
+      __m128i max = _mm_max_epu8 (best, v);
+      // Unsigned v > best where the maximum changes
+      __m128i keep = _mm_cmpeq_epi8 (max, best);
+
+      best = max;
+      cls = _mm_or_si128 (_mm_and_si128 (keep, cls),
+          _mm_andnot_si128 (keep, _mm_set1_epi8 ((gchar) c)));
+    }
+    _mm_storeu_si128 ((__m128i *) (mask + x), cls);
+  }
+#endif
+
+  for (; x < width; x++) {
+    guint8 best = data[x];
+    gint cls = 0;
+
+    for (gint c = 1; c < channels; c++) {
+      if (data[x + c * plane] > best) {
+        best = data[x + c * plane];
+        cls = c;
+      }
+    }
+    mask[x] = (guint8) cls;
+  }
+}
+
+/**
+ * Class of the largest score of every pixel in a mask row of a
+ * [H, W, C] output: the maximum over the classes of a pixel is found with
+ * vector compares, then its first class.
+ */
+static inline void
+seg_argmax_pixels_f32 (const gfloat * data, gint channels, gint width,
+    guint8 * mask)
+{
+  for (gint x = 0; x < width; x++, data += channels) {
+    gfloat best = data[0];
+    gint c = 0;
+
+#if defined(SEG_DECODER_NEON)
+    if (channels >= 4) {
+      float32x4_t max = vld1q_f32 (data);
+
+      for (c = 4; c + 4 <= channels; c += 4)
+        max = vmaxq_f32 (max, vld1q_f32 (data + c));
+      best = MAX (best, vmaxvq_f32 (max));
+    }
+#elif defined(SEG_DECODER_SSE2)
+    if (channels >= 4) {
+      __m128 max = _mm_loadu_ps (data);
+
+      for (c = 4; c + 4 <= channels; c += 4)
+        max = _mm_max_ps (max, _mm_loadu_ps (data + c));
+      max = _mm_max_ps (max, _mm_shuffle_ps (max, max, 0x4E));
+      max = _mm_max_ps (max, _mm_shuffle_ps (max, max, 0xB1));
+      best = MAX (best, _mm_cvtss_f32 (max));
+    }
+#endif
+
+    for (; c < channels; c++)
+      best = MAX (best, data[c]);
+
+    for (c = 0; c < channels - 1 && data[c] != best; c++);
+    mask[x] = (guint8) c;
+  }
+}
+
+/**
+ * Class of the largest score of every pixel in a mask row of a uint8
+ * [H, W, C] output.
+ */
+static inline void
+seg_argmax_pixels_u8 (const guint8 * data, gint channels, gint width,
+    guint8 * mask)
+{
+  for (gint x = 0; x < width; x++, data += channels) {
+    guint8 best = data[0];
+    gint c = 0;
+
+#if defined(SEG_DECODER_NEON)
+    if (channels >= 16) {
+      uint8x16_t max = vld1q_u8 (data);
+
+      for (c = 16; c + 16 <= channels; c += 16)
+        max = vmaxq_u8 (max, vld1q_u8 (data + c));
+      best = vmaxvq_u8 (max);
+    }
+#elif defined(SEG_DECODER_SSE2)
+    if (channels >= 16) {
+      __m128i max = _mm_loadu_si128 ((const __m128i *) data);
+
+      for (c = 16; c + 16 <= channels; c += 16)
+        max = _mm_max_epu8 (max, _mm_loadu_si128 ((const __m128i *) (data +
+                    c)));
+      max = _mm_max_epu8 (max, _mm_srli_si128 (max, 8));
+      max = _mm_max_epu8 (max, _mm_srli_si128 (max, 4));
+      max = _mm_max_epu8 (max, _mm_srli_si128 (max, 2));
+      max = _mm_max_epu8 (max, _mm_srli_si128 (max, 1));
+      best = (guint8) _mm_cvtsi128_si32 (max);
+    }
+#endif
+
+    for (; c < channels; c++)
+      best = MAX (best, data[c]);
+
+    mask[x] = (guint8) ((const guint8 *) memchr (data, best, channels) - data);
+  }
+}
+
+/**
+ * Copies a mask row from the classes of a model with argmax. Classes
+ * outside the mask range become class 0.
+ */
+static inline void
+seg_classes_row (gconstpointer data, gint elem_size, gint width,
+    guint8 * mask)
+{
+  if (elem_size == 1) {
+    memcpy (mask, data, width);
+  } else if (elem_size == 4) {
+    for (gint x = 0; x < width; x++) {
+      gint32 cls = ((const gint32 *) data)[x];
+      mask[x] = (cls >= 0 && cls < SEG_MAX_CLASSES) ? (guint8) cls : 0;
+    }
+  } else {
+    for (gint x = 0; x < width; x++) {
+      gint64 cls = ((const gint64 *) data)[x];
+      mask[x] = (cls >= 0 && cls < SEG_MAX_CLASSES) ? (guint8) cls : 0;
+    }
+  }
+}
+
+/**
+ * Colors one overlay row from a row of classes already sampled at the
+ * overlay width.
+ */
+static inline void
+seg_decoder_color_row (const SegDecoder * dec, const guint8 * classes,
+    guint8 * out)
+{
+  gint x = 0, width = dec->out_width;
+
+#if defined(SEG_DECODER_NEON)
+  if (dec->small_palette) {
+    uint8x16x4_t r = vld1q_u8_x4 (dec->planes[0]);
+    uint8x16x4_t g = vld1q_u8_x4 (dec->planes[1]);
+    uint8x16x4_t b = vld1q_u8_x4 (dec->planes[2]);
+    uint8x16x4_t a = vld1q_u8_x4 (dec->planes[3]);
+
+    for (; x + 16 <= width; x += 16) {
+      uint8x16_t cls = vld1q_u8 (classes + x);
+      uint8x16x4_t rgba;
+
+      rgba.val[0] = vqtbl4q_u8 (r, cls);
+      rgba.val[1] = vqtbl4q_u8 (g, cls);
+      rgba.val[2] = vqtbl4q_u8 (b, cls);
+      rgba.val[3] = vqtbl4q_u8 (a, cls);
+      vst4q_u8 (out + x * 4, rgba);
+    }
+  }
+#endif
+
+  for (; x < width; x++)
+    memcpy (out + x * 4, &dec->palette[classes[x]], 4);
+}
+
+/**
+ * Computes the mask rows of a band, counts their classes and fills the
+ * overlay rows sampled from them.
+ */
+static inline void
+seg_decoder_run_band (SegDecoder * dec, gint band, guint8 * classes)
+{
+  gint mw = dec->mask_width, mh = dec->mask_height;
+  gsize plane = (gsize) mw * mh;
+  guint32 *pixels = dec->band_pixels + (gsize) band * SEG_MAX_CLASSES;
+  gsize row_bytes = (gsize) dec->out_width * 4;
+
+  memset (pixels, 0, SEG_MAX_CLASSES * sizeof (guint32));
+
+  for (gint y = dec->band_rows[band]; y < dec->band_rows[band + 1]; y++) {
+    guint8 *mask = dec->mask + (gsize) y * mw;
+    gsize pos = (gsize) y * mw;
+
+    if (dec->channels == 0) {
+      seg_classes_row ((const guint8 *) dec->data + pos * dec->elem_size,
+          dec->elem_size, mw, mask);
+    } else if (dec->layout == ML_LAYOUT_NCHW) {
+      if (dec->type == ML_TYPE_FLOAT32)
+        seg_argmax_planes_f32 ((const gfloat *) dec->data + pos, plane,
+            dec->channels, mw, mask);
+      else
+        seg_argmax_planes_u8 ((const guint8 *) dec->data + pos, plane,
+            dec->channels, mw, mask);
+    } else {
+      pos *= dec->channels;
+      if (dec->type == ML_TYPE_FLOAT32)
+        seg_argmax_pixels_f32 ((const gfloat *) dec->data + pos,
+            dec->channels, mw, mask);
+      else
+        seg_argmax_pixels_u8 ((const guint8 *) dec->data + pos,
+            dec->channels, mw, mask);
+    }
+
+    if (y >= dec->src_y && y < dec->src_y + dec->src_height)
+      for (gint x = dec->src_x; x < dec->src_x + dec->src_width; x++)
+        pixels[mask[x]]++;
+  }
+
+  for (gint oy = dec->band_out[band]; oy < dec->band_out[band + 1]; oy++) {
+    guint8 *out = dec->overlay + oy * row_bytes;
+    const guint8 *mask = dec->mask + (gsize) dec->ymap[oy] * mw;
+
+    if (oy > dec->band_out[band] && dec->ymap[oy] == dec->ymap[oy - 1]) {
+      memcpy (out, out - row_bytes, row_bytes);
+      continue;
+    }
+
+    for (gint x = 0; x < dec->out_width; x++)
+      classes[x] = mask[dec->xmap[x]];
+    seg_decoder_color_row (dec, classes, out);
+  }
+}
+
+static inline void
+seg_decoder_run_bands (SegDecoder * dec, gint thread)
+{
+  guint8 *classes = dec->rows + (gsize) thread * dec->out_width;
+  gint band;
+
+  while ((band = g_atomic_int_add (&dec->next_band, 1)) < dec->n_bands)
+    seg_decoder_run_band (dec, band, classes);
+}
+
+static gpointer
+seg_decoder_worker (gpointer userdata)
+{
+  SegWorker *worker = (SegWorker *) userdata;
+  SegDecoder *dec = worker->dec;
+  guint generation = 0;
+
+  g_mutex_lock (&dec->lock);
+  while (TRUE) {
+    while (!dec->quit && dec->generation == generation)
+      g_cond_wait (&dec->start, &dec->lock);
+    if (dec->quit)
+      break;
+
+    generation = dec->generation;
+    g_mutex_unlock (&dec->lock);
+
+    seg_decoder_run_bands (dec, worker->index);
+
+    g_mutex_lock (&dec->lock);
+    if (--dec->active == 0)
+      g_cond_signal (&dec->done);
+  }
+  g_mutex_unlock (&dec->lock);
+
+  return NULL;
+}
+
+/**
+ * Processes all bands on the worker threads and the calling thread and
+ * sums the class statistics.
+ */
+static inline void
+seg_decoder_dispatch (SegDecoder * dec)
+{
+  g_mutex_lock (&dec->lock);
+  dec->next_band = 0;
+  dec->active = dec->n_threads - 1;
+  dec->generation++;
+  g_cond_broadcast (&dec->start);
+  g_mutex_unlock (&dec->lock);
+
+  seg_decoder_run_bands (dec, 0);
+
+  g_mutex_lock (&dec->lock);
+  while (dec->active > 0)
+    g_cond_wait (&dec->done, &dec->lock);
+  g_mutex_unlock (&dec->lock);
+
+  memset (dec->class_pixels, 0, sizeof (dec->class_pixels));
+  for (gint band = 0; band < dec->n_bands; band++)
+    for (gint id = 0; id < SEG_MAX_CLASSES; id++)
+      dec->class_pixels[id] +=
+          dec->band_pixels[(gsize) band * SEG_MAX_CLASSES + id];
+}
+
+/**
+ * Creates a decoder and its worker threads. The geometry must be set with
+ * seg_decoder_set_geometry() before the first frame.
+ *
+ * @param n_threads Number of threads including the calling thread, 0 for
+ *                  the default.
+ * @return New decoder, free with seg_decoder_free().
+ */
+static inline SegDecoder *
+seg_decoder_new (gint n_threads)
+{
+  SegDecoder *dec = g_new0 (SegDecoder, 1);
+
+  if (n_threads <= 0)
+    n_threads = MIN ((gint) g_get_num_processors (), SEG_DEFAULT_THREADS);
+
+  dec->alpha = -1;
+  dec->n_threads = MAX (n_threads, 1);
+  seg_decoder_update_palette (dec);
+
+  g_mutex_init (&dec->lock);
+  g_cond_init (&dec->start);
+  g_cond_init (&dec->done);
+
+  dec->workers = g_new0 (SegWorker, dec->n_threads);
+  for (gint i = 1; i < dec->n_threads; i++) {
+    dec->workers[i].dec = dec;
+    dec->workers[i].index = i;
+    dec->workers[i].thread = g_thread_new ("SegWorker", seg_decoder_worker,
+        &dec->workers[i]);
+  }
+
+  return dec;
+}
+
+static inline void
+seg_decoder_clear_geometry (SegDecoder * dec)
+{
+  g_free (dec->mask);
+  g_free (dec->overlay);
+  g_free (dec->xmap);
+  g_free (dec->ymap);
+  g_free (dec->band_rows);
+  g_free (dec->band_out);
+  g_free (dec->band_pixels);
+  g_free (dec->rows);
+
+  dec->mask = dec->overlay = dec->rows = NULL;
+  dec->xmap = dec->ymap = dec->band_rows = dec->band_out = NULL;
+  dec->band_pixels = NULL;
+  dec->mask_width = dec->mask_height = 0;
+  dec->out_width = dec->out_height = 0;
+  dec->n_bands = 0;
+}
+
+/**
+ * Stops the worker threads and frees a decoder.
+ *
+ * @param dec Decoder created with seg_decoder_new().
+ */
+static inline void
+seg_decoder_free (SegDecoder * dec)
+{
+  if (dec == NULL)
+    return;
+
+  g_mutex_lock (&dec->lock);
+  dec->quit = TRUE;
+  g_cond_broadcast (&dec->start);
+  g_mutex_unlock (&dec->lock);
+
+  for (gint i = 1; i < dec->n_threads; i++)
+    g_thread_join (dec->workers[i].thread);
+
+  g_cond_clear (&dec->done);
+  g_cond_clear (&dec->start);
+  g_mutex_clear (&dec->lock);
+
+  seg_decoder_clear_geometry (dec);
+  ml_labels_clear (&dec->labels);
+  g_free (dec->workers);
+  g_free (dec);
+}
+
+/**
+ * Loads the class labels and colors from a file of artifacts/json_labels.
+ *
+ * @param dec Decoder.
+ * @param path Path of the labels file.
+ * @return FALSE if the file can not be parsed.
+ */
+static inline gboolean
+seg_decoder_load_labels (SegDecoder * dec, const gchar * path)
+{
+  if (!ml_labels_load (&dec->labels, path))
+    return FALSE;
+
+  seg_decoder_update_palette (dec);
+  return TRUE;
+}
+
+/**
+ * Overrides the alpha of all colored classes, e.g. to blend the overlay
+ * with the frame.
+ *
+ * @param dec Decoder.
+ * @param alpha Alpha in [0, 255], or -1 for the alpha of the labels file.
+ */
+static inline void
+seg_decoder_set_alpha (SegDecoder * dec, gint alpha)
+{
+  dec->alpha = CLAMP (alpha, -1, 255);
+  seg_decoder_update_palette (dec);
+}
+
+/**
+ * Label of a class.
+ *
+ * @param dec Decoder.
+ * @param class_id Class index.
+ * @return Label or NULL if no labels are loaded.
+ */
+static inline const gchar *
+seg_decoder_label (const SegDecoder * dec, gint class_id)
+{
+  return ml_labels_get (&dec->labels, class_id);
+}
+
+/**
+ * Sets the size of the mask and the overlay, and the region of the mask
+ * the overlay shows. Does nothing if the geometry is unchanged.
+ *
+ * @param dec Decoder.
+ * @param mask_width Width of the model output.
+ * @param mask_height Height of the model output.
+ * @param src_x Left edge of the shown region.
+ * @param src_y Top edge of the shown region.
+ * @param src_width Width of the shown region.
+ * @param src_height Height of the shown region.
+ * @param out_width Width of the overlay.
+ * @param out_height Height of the overlay.
+ * @return FALSE if the region is not inside the mask.
+ */
+static inline gboolean
+seg_decoder_set_geometry (SegDecoder * dec, gint mask_width,
+    gint mask_height, gint src_x, gint src_y, gint src_width,
+    gint src_height, gint out_width, gint out_height)
+{
+  if (mask_width <= 0 || mask_height <= 0 || out_width <= 0 ||
+      out_height <= 0 || src_x < 0 || src_y < 0 || src_width <= 0 ||
+      src_height <= 0 || src_x + src_width > mask_width ||
+      src_y + src_height > mask_height) {
+    g_printerr ("\n Invalid segmentation geometry %dx%d, region %d,%d "
+        "%dx%d, overlay %dx%d!\n", mask_width, mask_height, src_x, src_y,
+        src_width, src_height, out_width, out_height);
+    return FALSE;
+  }
+
+  if (dec->mask_width == mask_width && dec->mask_height == mask_height &&
+      dec->src_x == src_x && dec->src_y == src_y &&
+      dec->src_width == src_width && dec->src_height == src_height &&
+      dec->out_width == out_width && dec->out_height == out_height)
+    return TRUE;
+
+  seg_decoder_clear_geometry (dec);
+  dec->mask_width = mask_width;
+  dec->mask_height = mask_height;
+  dec->src_x = src_x;
+  dec->src_y = src_y;
+  dec->src_width = src_width;
+  dec->src_height = src_height;
+  dec->out_width = out_width;
+  dec->out_height = out_height;
+
+  dec->mask = (guint8 *) g_malloc ((gsize) mask_width * mask_height);
+  dec->overlay = (guint8 *) g_malloc ((gsize) out_width * out_height * 4);
+  dec->rows = (guint8 *) g_malloc ((gsize) out_width * dec->n_threads);
+  dec->xmap = g_new (gint, out_width);
+  dec->ymap = g_new (gint, out_height);
+
+  // Nearest neighbor: the center of an overlay pixel in the region
+  for (gint x = 0; x < out_width; x++)
+    dec->xmap[x] = src_x + (gint) (((2 * (gint64) x + 1) * src_width) /
+        (2 * (gint64) out_width));
+  for (gint y = 0; y < out_height; y++)
+    dec->ymap[y] = src_y + (gint) (((2 * (gint64) y + 1) * src_height) /
+        (2 * (gint64) out_height));
+
+  dec->n_bands = MIN (mask_height, dec->n_threads * SEG_BANDS_PER_THREAD);
+  dec->band_rows = g_new (gint, dec->n_bands + 1);
+  dec->band_out = g_new (gint, dec->n_bands + 1);
+  dec->band_pixels = g_new (guint32, (gsize) dec->n_bands * SEG_MAX_CLASSES);
+
+  // The overlay rows of a band are those sampled from its mask rows, the
+  // sampling is monotonic so they are contiguous
+  for (gint band = 0, oy = 0; band <= dec->n_bands; band++) {
+    dec->band_rows[band] = (gint) ((gint64) band * mask_height / dec->n_bands);
+    while (band < dec->n_bands && oy < out_height &&
+        dec->ymap[oy] < dec->band_rows[band])
+      oy++;
+    dec->band_out[band] = (band < dec->n_bands) ? oy : out_height;
+  }
+
+  return TRUE;
+}
+
+static inline gboolean
+seg_decoder_check_geometry (const SegDecoder * dec)
+{
+  if (dec->mask == NULL) {
+    g_printerr ("\n Segmentation geometry is not set!\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Decodes the class scores of a frame into the mask and the overlay.
+ *
+ * @param dec Decoder with the geometry of the output set.
+ * @param data Scores, [C, H, W] or [H, W, C] of the mask size.
+ * @param type Element type of the scores.
+ * @param layout Layout of the scores.
+ * @param channels Number of classes C.
+ * @return FALSE if the classes do not fit the mask or no geometry is set.
+ */
+static inline gboolean
+seg_decoder_process (SegDecoder * dec, gconstpointer data, MLTensorType type,
+    MLTensorLayout layout, gint channels)
+{
+  if (!seg_decoder_check_geometry (dec))
+    return FALSE;
+
+  if (channels < 1 || channels > SEG_MAX_CLASSES) {
+    g_printerr ("\n Unsupported number of segmentation classes %d!\n",
+        channels);
+    return FALSE;
+  }
+
+  dec->data = data;
+  dec->type = type;
+  dec->layout = layout;
+  dec->channels = channels;
+  dec->elem_size = (type == ML_TYPE_FLOAT32) ? 4 : 1;
+
+  seg_decoder_dispatch (dec);
+  return TRUE;
+}
+
+/**
+ * Decodes the class of every pixel, the output of a model that includes
+ * the argmax, into the mask and the overlay.
+ *
+ * @param dec Decoder with the geometry of the output set.
+ * @param data Classes, [H, W] of the mask size.
+ * @param elem_size Size of a class in bytes, 1, 4 or 8.
+ * @return FALSE if the element size is not supported or no geometry is set.
+ */
+static inline gboolean
+seg_decoder_process_classes (SegDecoder * dec, gconstpointer data,
+    gint elem_size)
+{
+  if (!seg_decoder_check_geometry (dec))
+    return FALSE;
+
+  if (elem_size != 1 && elem_size != 4 && elem_size != 8) {
+    g_printerr ("\n Unsupported segmentation class size %d!\n", elem_size);
+    return FALSE;
+  }
+
+  dec->data = data;
+  dec->channels = 0;
+  dec->elem_size = elem_size;
+
+  seg_decoder_dispatch (dec);
+  return TRUE;
+}
+
+/**
+ * Class covering most of the shown region, apart from class 0.
+ *
+ * @param dec Decoder.
+ * @param coverage Filled with the covered fraction of the region.
+ * @return Class index, or -1 if only class 0 is present.
+ */
+static inline gint
+seg_decoder_largest_class (const SegDecoder * dec, gfloat * coverage)
+{
+  gint largest = -1;
+
+  for (gint id = 1; id < SEG_MAX_CLASSES; id++)
+    if (dec->class_pixels[id] > 0 && (largest < 0 ||
+            dec->class_pixels[id] > dec->class_pixels[largest]))
+      largest = id;
+
+  *coverage = (largest < 0) ? 0.0F : (gfloat) dec->class_pixels[largest] /
+      ((gfloat) dec->src_width * dec->src_height);
+  return largest;
+}
+
+#endif //SEG_DECODER_H
@@ -0,0 +1,1039 @@
+/**
+ * Copyright (c) 2026 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/**
+ * This file provides a decoder for the outputs of YOLO detection models.
+ *
+ * Supported are the single output tensors of YOLOv5/YOLOv7 ([N, 5 + C]),
+ * YOLOv8 ([4 + C, N] or [N, 4 + C]) and YOLOX ([N, 5 + C], raw grid
+ * offsets or already decoded), and the split boxes/scores/classes outputs
+ * of the quantized YOLOv8 models with the "q-offsets"/"q-scales" constants
+ * of the configs. Outputs are float or uint8, uint8 values are compared
+ * against the threshold without dequantizing them first.
+ *
+ * Boxes above the threshold are sorted by score and reduced with a class
+ * aware non-maximum suppression. Every kept box marks the cells of a coarse
+ * grid it covers in a per class bitmap, so candidates which do not share a
+ * cell with a kept box of their class are kept without computing any IoU.
+ * Otherwise the IoU against the kept boxes is computed 4 at a time with
+ * NEON on ARM, SSE2 on x86 and plain C otherwise. Class ids are mapped to
+ * the labels and colors of the artifacts/json_labels files.
+ *
+ * Scratch memory grows to the size of the model outputs on the first frame,
+ * later frames do not allocate.
+ */
+
+#ifndef YOLO_DECODER_H
+#define YOLO_DECODER_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ml_labels.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YOLO_DECODER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_DECODER_SSE2 1
+#endif
+
+#define YOLO_MAX_DIMS 4
+#define YOLO_MAX_OUTPUTS 3
+#define YOLO_DEFAULT_THRESHOLD 0.5F
+#define YOLO_DEFAULT_IOU_THRESHOLD 0.45F
+#define YOLO_DEFAULT_MAX_DETECTIONS 100
+
+// Anchors processed per pass over the class rows of a [4 + C, N] output,
+// so the running maximum stays in L1 while all class rows are visited.
+#define YOLO_ANCHOR_TILE 512
+
+// The NMS spatial pre-filter splits the input into GRID x GRID cells, one
+// bit each in a 64 bit mask.
+#define YOLO_GRID 8
+
+/**
+ * YoloVersion:
+ * @YOLO_V5: YOLOv5, [N, 5 + C] with objectness.
+ * @YOLO_V7: YOLOv7, same output as YOLOv5.
+ * @YOLO_V8: YOLOv8, [4 + C, N] without objectness, or split outputs.
+ * @YOLO_X : YOLOX, [N, 5 + C] with raw grid offsets at strides 8, 16, 32.
+ *
+ * Model family, selects how the output tensors are decoded.
+ */
+typedef enum {
+  YOLO_V5,
+  YOLO_V7,
+  YOLO_V8,
+  YOLO_X
+} YoloVersion;
+
+/**
+ * YoloTensorType:
+ *
+ * Element type of an output tensor. Only class ids may be integers.
+ */
+typedef enum {
+  YOLO_TENSOR_FLOAT,
+  YOLO_TENSOR_UINT8,
+  YOLO_TENSOR_INT32,
+  YOLO_TENSOR_INT64
+} YoloTensorType;
+
+/**
+ * YoloTensor:
+ * @data  : Tensor elements.
+ * @type  : Element type.
+ * @dims  : Dimensions, a leading batch dimension of 1 is allowed.
+ * @n_dims: Number of dimensions.
+ *
+ * Model output handed to the decoder.
+ */
+typedef struct {
+  gconstpointer  data;
+  YoloTensorType type;
+  gint64         dims[YOLO_MAX_DIMS];
+  gsize          n_dims;
+} YoloTensor;
+
+/**
+ * YoloDetection:
+ * @x0      : Left edge in model input pixels.
+ * @y0      : Top edge in model input pixels.
+ * @x1      : Right edge in model input pixels.
+ * @y1      : Bottom edge in model input pixels.
+ * @score   : Confidence in [0, 1].
+ * @class_id: Class index.
+ *
+ * Detected box, clipped to the model input.
+ */
+typedef struct {
+  gfloat x0;
+  gfloat y0;
+  gfloat x1;
+  gfloat y1;
+  gfloat score;
+  gint   class_id;
+} YoloDetection;
+
+typedef struct {
+  gfloat  x0;
+  gfloat  y0;
+  gfloat  x1;
+  gfloat  y1;
+  gfloat  score;
+  gint32  class_id;
+  guint32 index;
+} YoloCandidate;
+
+/**
+ * YoloDecoder:
+ * @version       : Model family.
+ * @width         : Model input width.
+ * @height        : Model input height.
+ * @threshold     : Minimum score of a detection.
+ * @iou_threshold : Boxes of a class overlapping a better one by more than
+ *                  this IoU are suppressed.
+ * @max_detections: Maximum number of detections per frame.
+ * @q_offsets     : Zero point of every uint8 output.
+ * @q_scales      : Scale of every uint8 output.
+ * @labels        : Labels and colors of the classes.
+ * @detections    : Detections of the last frame, best first.
+ * @n_detections  : Number of detections of the last frame.
+ *
+ * Decoder state and the results of the last frame.
+ */
+typedef struct {
+  YoloVersion   version;
+  gint          width;
+  gint          height;
+  gfloat        threshold;
+  gfloat        iou_threshold;
+  gint          max_detections;
+  gfloat        q_offsets[YOLO_MAX_OUTPUTS];
+  gfloat        q_scales[YOLO_MAX_OUTPUTS];
+  MLLabels      labels;
+  YoloDetection *detections;
+  gint          n_detections;
+
+  // Private
+  YoloCandidate *candidates;
+  gsize         n_candidates;
+  gsize         max_candidates;
+  gfloat        *best_score;
+  gint32        *best_class;
+  guint8        *best_qscore;
+  guint8        *best_qclass;
+  gsize         max_anchors;
+  gfloat        *kept;
+  gint32        *kept_class;
+  guint64       *class_cells;
+  gsize         max_classes;
+} YoloDecoder;
+
+/**
+ * Parses a model family name as used by the "yolo-model-type" entry of the
+ * configs, e.g. "yolov8" or "yolox".
+ *
+ * @param name Model family name, case insensitive.
+ * @param version Filled with the model family.
+ * @return FALSE if the name is unknown.
+ */
+static inline gboolean
+yolo_version_from_string (const gchar * name, YoloVersion * version)
+{
+  static const struct {
+    const gchar *name;
+    YoloVersion version;
+  } names[] = {
+    { "yolov5", YOLO_V5 }, { "yolov7", YOLO_V7 }, { "yolov8", YOLO_V8 },
+    { "yolox", YOLO_X }
+  };
+
+  for (gsize i = 0; name != NULL && i < G_N_ELEMENTS (names); i++) {
+    if (g_ascii_strcasecmp (name, names[i].name) == 0) {
+      *version = names[i].version;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Creates a decoder for a model with the given input size.
+ *
+ * @param version Model family.
+ * @param width Model input width.
+ * @param height Model input height.
+ * @return New decoder, free with yolo_decoder_free().
+ */
+static inline YoloDecoder *
+yolo_decoder_new (YoloVersion version, gint width, gint height)
+{
+  YoloDecoder *dec = g_new0 (YoloDecoder, 1);
+
+  dec->version = version;
+  dec->width = width;
+  dec->height = height;
+  dec->threshold = YOLO_DEFAULT_THRESHOLD;
+  dec->iou_threshold = YOLO_DEFAULT_IOU_THRESHOLD;
+  dec->max_detections = YOLO_DEFAULT_MAX_DETECTIONS;
+
+  for (gsize i = 0; i < YOLO_MAX_OUTPUTS; i++) {
+    dec->q_offsets[i] = 0.0F;
+    dec->q_scales[i] = 1.0F;
+  }
+
+  // Kept boxes are x0, y0, x1, y1 and area rows padded to 4 elements
+  dec->detections = g_new0 (YoloDetection, dec->max_detections);
+  dec->kept = g_new0 (gfloat, 5 * ((dec->max_detections + 3) & ~3));
+  dec->kept_class = g_new0 (gint32, (dec->max_detections + 3) & ~3);
+  return dec;
+}
+
+/**
+ * Frees a decoder and its labels.
+ *
+ * @param dec Decoder created with yolo_decoder_new().
+ */
+static inline void
+yolo_decoder_free (YoloDecoder * dec)
+{
+  if (dec == NULL)
+    return;
+
+  ml_labels_clear (&dec->labels);
+  g_free (dec->detections);
+  g_free (dec->candidates);
+  g_free (dec->best_score);
+  g_free (dec->best_class);
+  g_free (dec->best_qscore);
+  g_free (dec->best_qclass);
+  g_free (dec->kept);
+  g_free (dec->kept_class);
+  g_free (dec->class_cells);
+  g_free (dec);
+}
+
+/**
+ * Sets the maximum number of detections per frame.
+ *
+ * @param dec Decoder.
+ * @param max_detections Maximum number of detections, at least 1.
+ */
+static inline void
+yolo_decoder_set_max_detections (YoloDecoder * dec, gint max_detections)
+{
+  gint padded = (MAX (max_detections, 1) + 3) & ~3;
+
+  dec->max_detections = MAX (max_detections, 1);
+  dec->detections = g_renew (YoloDetection, dec->detections,
+      dec->max_detections);
+  dec->kept = g_renew (gfloat, dec->kept, 5 * padded);
+  dec->kept_class = g_renew (gint32, dec->kept_class, padded);
+}
+
+/**
+ * Sets the quantization parameters of the uint8 outputs from a constants
+ * string of the configs, e.g.
+ * "YOLOv8,q-offsets=<21.0, 0.0, 0.0>,q-scales=<3.05, 0.0038, 1.0>;".
+ * The values are given in the order of the model outputs and a uint8 value
+ * q stands for (q - offset) * scale.
+ *
+ * @param dec Decoder.
+ * @param constants Constants string.
+ * @return FALSE if the string has no valid offsets and scales.
+ */
+static inline gboolean
+yolo_decoder_set_constants (YoloDecoder * dec, const gchar * constants)
+{
+  return ml_constants_parse (constants, dec->q_offsets, dec->q_scales,
+      YOLO_MAX_OUTPUTS) > 0;
+}
+
+/**
+ * Loads the labels and colors of the classes from a json_labels file.
+ *
+ * @param dec Decoder.
+ * @param path Path of the labels file.
+ * @return FALSE if the file can not be parsed.
+ */
+static inline gboolean
+yolo_decoder_load_labels (YoloDecoder * dec, const gchar * path)
+{
+  return ml_labels_load (&dec->labels, path);
+}
+
+/**
+ * Label of a class.
+ *
+ * @param dec Decoder.
+ * @param class_id Class index.
+ * @return Label or NULL if the labels file has none for the class.
+ */
+static inline const gchar *
+yolo_decoder_label (const YoloDecoder * dec, gint class_id)
+{
+  return ml_labels_get (&dec->labels, class_id);
+}
+
+/**
+ * Value of a tensor element as float, uint8 elements are dequantized.
+ */
+static inline gfloat
+yolo_tensor_value (const YoloTensor * t, gsize index, gfloat offset,
+    gfloat scale)
+{
+  switch (t->type) {
+    case YOLO_TENSOR_UINT8:
+      return (((const guint8 *) t->data)[index] - offset) * scale;
+    case YOLO_TENSOR_INT32:
+      return (gfloat) ((const gint32 *) t->data)[index];
+    case YOLO_TENSOR_INT64:
+      return (gfloat) ((const gint64 *) t->data)[index];
+    default:
+      return ((const gfloat *) t->data)[index];
+  }
+}
+
+/**
+ * Smallest uint8 value which dequantizes to at least @threshold, 256 if
+ * there is none.
+ */
+static inline guint
+yolo_quantize_threshold (gfloat threshold, gfloat offset, gfloat scale)
+{
+  gfloat q = 0.0F;
+
+  if (scale <= 0.0F)
+    return 256;
+
+  q = ceilf (threshold / scale + offset);
+  return (guint) CLAMP (q, 0.0F, 256.0F);
+}
+
+/**
+ * Index of the first float in [start, n) which is at least @threshold, or
+ * @n. Blocks below the threshold are skipped with a single comparison.
+ */
+static inline gsize
+yolo_next_f32 (const gfloat * data, gsize start, gsize n, gfloat threshold)
+{
+  gsize i = start;
+
+#if defined(YOLO_DECODER_NEON)
+  const float32x4_t thr = vdupq_n_f32 (threshold);
+
+  for (; i + 8 <= n; i += 8) {
+    uint32x4_t ge = vorrq_u32 (vcgeq_f32 (vld1q_f32 (data + i), thr),
+        vcgeq_f32 (vld1q_f32 (data + i + 4), thr));
+    if (vmaxvq_u32 (ge) != 0)
+      break;
+  }
+#elif defined(YOLO_DECODER_SSE2)
+  const __m128 thr = _mm_set1_ps (threshold);
+
+  for (; i + 8 <= n; i += 8) {
+    __m128 ge = _mm_or_ps (_mm_cmpge_ps (_mm_loadu_ps (data + i), thr),
+        _mm_cmpge_ps (_mm_loadu_ps (data + i + 4), thr));
+    if (_mm_movemask_ps (ge) != 0)
+      break;
+  }
+#endif
+
+  for (; i < n; i++)
+    if (data[i] >= threshold)
+      return i;
+  return n;
+}
+
+/**
+ * Index of the first uint8 in [start, n) which is at least @threshold, or
+ * @n. Blocks below the threshold are skipped with a single comparison.
+ */
+static inline gsize
+yolo_next_u8 (const guint8 * data, gsize start, gsize n, guint threshold)
+{
+  gsize i = start;
+
+  if (threshold > 255)
+    return n;
+
+#if defined(YOLO_DECODER_NEON)
+  for (; i + 16 <= n; i += 16)
+    if (vmaxvq_u8 (vld1q_u8 (data + i)) >= threshold)
+      break;
+#elif defined(YOLO_DECODER_SSE2)
+  // Unsigned v >= thr is max (v, thr) == v
+  const __m128i thr = _mm_set1_epi8 ((gchar) threshold);
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (data + i));
+    if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_max_epu8 (v, thr), v)) != 0)
+      break;
+  }
+#endif
+
+  for (; i < n; i++)
+    if (data[i] >= threshold)
+      return i;
+  return n;
+}
+
+/**
+ * Running maximum over the class rows of a [rows, n] float tensor for the
+ * anchors in [begin, end). The first maximum wins on ties.
+ */
+static inline void
+yolo_max_rows_f32 (const gfloat * data, gsize n, gsize n_rows, gsize begin,
+    gsize end, gfloat * best, gint32 * best_row)
+{
+  memcpy (best + begin, data + begin, (end - begin) * sizeof (gfloat));
+  memset (best_row + begin, 0, (end - begin) * sizeof (gint32));
+
+  for (gsize row = 1; row < n_rows; row++) {
+    const gfloat *src = data + row * n;
+    gsize i = begin;
+
+#if defined(YOLO_DECODER_NEON)
+    const int32x4_t idx = vdupq_n_s32 ((gint32) row);
+
+    for (; i + 4 <= end; i += 4) {
+      float32x4_t v = vld1q_f32 (src + i);
+      float32x4_t b = vld1q_f32 (best + i);
+      uint32x4_t gt = vcgtq_f32 (v, b);
+
+      vst1q_f32 (best + i, vbslq_f32 (gt, v, b));
+      vst1q_s32 (best_row + i, vbslq_s32 (gt, idx, vld1q_s32 (best_row + i)));
+    }
+#elif defined(YOLO_DECODER_SSE2)
+    const __m128i idx = _mm_set1_epi32 ((gint32) row);
+
+    for (; i + 4 <= end; i += 4) {
+      __m128 v = _mm_loadu_ps (src + i);
+      __m128 b = _mm_loadu_ps (best + i);
+      __m128 gt = _mm_cmpgt_ps (v, b);
+      __m128i r = _mm_loadu_si128 ((const __m128i *) (best_row + i));
+      __m128i m = _mm_castps_si128 (gt);
+
+      _mm_storeu_ps (best + i, _mm_or_ps (_mm_and_ps (gt, v),
+              _mm_andnot_ps (gt, b)));
+      _mm_storeu_si128 ((__m128i *) (best_row + i),
+          _mm_or_si128 (_mm_and_si128 (m, idx), _mm_andnot_si128 (m, r)));
+    }
+#endif
+
+    for (; i < end; i++) {
+      if (src[i] > best[i]) {
+        best[i] = src[i];
+        best_row[i] = (gint32) row;
+      }
+    }
+  }
+}
+
+/**
+ * Running maximum over the class rows of a [rows, n] uint8 tensor for the
+ * anchors in [begin, end), at most 256 rows. The first maximum wins on
+ * ties.
+ */
+static inline void
+yolo_max_rows_u8 (const guint8 * data, gsize n, gsize n_rows, gsize begin,
+    gsize end, guint8 * best, guint8 * best_row)
+{
+  memcpy (best + begin, data + begin, end - begin);
+  memset (best_row + begin, 0, end - begin);
+
+  for (gsize row = 1; row < n_rows; row++) {
+    const guint8 *src = data + row * n;
+    gsize i = begin;
+
+#if defined(YOLO_DECODER_NEON)
+    const uint8x16_t idx = vdupq_n_u8 ((guint8) row);
+
+    for (; i + 16 <= end; i += 16) {
+      uint8x16_t v = vld1q_u8 (src + i);
+      uint8x16_t b = vld1q_u8 (best + i);
+      uint8x16_t gt = vcgtq_u8 (v, b);
+
+      vst1q_u8 (best + i, vmaxq_u8 (v, b));
+      vst1q_u8 (best_row + i, vbslq_u8 (gt, idx, vld1q_u8 (best_row + i)));
+    }
+#elif defined(YOLO_DECODER_SSE2)
+    const __m128i idx = _mm_set1_epi8 ((gchar) row);
+
+    for (; i + 16 <= end; i += 16) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (best + i));
+      __m128i r = _mm_loadu_si128 ((const __m128i *) (best_row + i));
+      __m128i mx = _mm_max_epu8 (v, b);
+      // Unsigned v > b is max (v, b) != b
+      __m128i le = _mm_cmpeq_epi8 (mx, b);
+
+      _mm_storeu_si128 ((__m128i *) (best + i), mx);
+      _mm_storeu_si128 ((__m128i *) (best_row + i),
+          _mm_or_si128 (_mm_and_si128 (le, r), _mm_andnot_si128 (le, idx)));
+    }
+#endif
+
+    for (; i < end; i++) {
+      if (src[i] > best[i]) {
+        best[i] = src[i];
+        best_row[i] = (guint8) row;
+      }
+    }
+  }
+}
+
+/**
+ * Grows the scratch memory for @n_anchors boxes and @n_classes classes.
+ * Only the first frame of a model allocates.
+ */
+static inline void
+yolo_decoder_reserve (YoloDecoder * dec, gsize n_anchors, gsize n_classes)
+{
+  if (n_anchors > dec->max_anchors) {
+    dec->candidates = g_renew (YoloCandidate, dec->candidates, n_anchors);
+    dec->max_candidates = n_anchors;
+    dec->best_score = g_renew (gfloat, dec->best_score, n_anchors);
+    dec->best_class = g_renew (gint32, dec->best_class, n_anchors);
+    dec->best_qscore = g_renew (guint8, dec->best_qscore, n_anchors);
+    dec->best_qclass = g_renew (guint8, dec->best_qclass, n_anchors);
+    dec->max_anchors = n_anchors;
+  }
+
+  if (n_classes > dec->max_classes) {
+    dec->class_cells = g_renew (guint64, dec->class_cells, n_classes);
+    dec->max_classes = n_classes;
+  }
+}
+
+/**
+ * Adds a candidate given by its center and size, clipped to the input.
+ */
+static inline void
+yolo_decoder_add (YoloDecoder * dec, gfloat cx, gfloat cy, gfloat w,
+    gfloat h, gfloat score, gint32 class_id, gsize index)
+{
+  YoloCandidate *c = &dec->candidates[dec->n_candidates++];
+
+  c->x0 = CLAMP (cx - w * 0.5F, 0.0F, (gfloat) dec->width);
+  c->y0 = CLAMP (cy - h * 0.5F, 0.0F, (gfloat) dec->height);
+  c->x1 = CLAMP (cx + w * 0.5F, 0.0F, (gfloat) dec->width);
+  c->y1 = CLAMP (cy + h * 0.5F, 0.0F, (gfloat) dec->height);
+  c->score = score;
+  c->class_id = class_id;
+  c->index = (guint32) index;
+}
+
+/**
+ * Converts raw YOLOX box offsets of anchor @index to center and size. The
+ * anchors are the cells of the stride 8, 16 and 32 grids, row by row.
+ * Returns FALSE if the output does not match the grids.
+ */
+static inline gboolean
+yolo_decoder_yolox_box (YoloDecoder * dec, gsize index, gfloat * cx,
+    gfloat * cy, gfloat * w, gfloat * h)
+{
+  static const gint strides[] = { 8, 16, 32 };
+
+  for (gsize s = 0; s < G_N_ELEMENTS (strides); s++) {
+    gsize grid_w = dec->width / strides[s];
+    gsize cells = grid_w * (dec->height / strides[s]);
+
+    if (index < cells) {
+      *cx = (*cx + (gfloat) (index % grid_w)) * strides[s];
+      *cy = (*cy + (gfloat) (index / grid_w)) * strides[s];
+      *w = expf (*w) * strides[s];
+      *h = expf (*h) * strides[s];
+      return TRUE;
+    }
+    index -= cells;
+  }
+  return FALSE;
+}
+
+/**
+ * Collects the candidates of a [N, 5 + C] output with objectness.
+ */
+static inline void
+yolo_decoder_rows (YoloDecoder * dec, const YoloTensor * t, gsize n_anchors,
+    gsize n_classes)
+{
+  gsize stride = 5 + n_classes;
+  gfloat offset = dec->q_offsets[0], scale = dec->q_scales[0];
+  guint qthr = yolo_quantize_threshold (dec->threshold, offset, scale);
+  gboolean raw_grid = FALSE;
+
+  // YOLOX exported without decoding has one row per grid cell
+  if (dec->version == YOLO_X) {
+    gsize cells = 0;
+
+    for (gint s = 8; s <= 32; s *= 2)
+      cells += (gsize) (dec->width / s) * (dec->height / s);
+    raw_grid = (cells == n_anchors);
+  }
+
+  for (gsize i = 0; i < n_anchors; i++) {
+    gsize base = i * stride, best = 0;
+    gfloat obj = 0.0F, score = 0.0F, cx, cy, w, h;
+
+    // Class scores are at most 1, so most rows are rejected on objectness
+    // alone without looking at the classes
+    if (t->type == YOLO_TENSOR_UINT8) {
+      const guint8 *row = (const guint8 *) t->data + base;
+
+      if (row[4] < qthr)
+        continue;
+
+      for (gsize c = 1; c < n_classes; c++)
+        best = (row[5 + c] > row[5 + best]) ? c : best;
+    } else {
+      const gfloat *row = (const gfloat *) t->data + base;
+
+      if (!(row[4] >= dec->threshold))
+        continue;
+
+      for (gsize c = 1; c < n_classes; c++)
+        best = (row[5 + c] > row[5 + best]) ? c : best;
+    }
+
+    obj = yolo_tensor_value (t, base + 4, offset, scale);
+    score = obj * yolo_tensor_value (t, base + 5 + best, offset, scale);
+    if (score < dec->threshold)
+      continue;
+
+    cx = yolo_tensor_value (t, base, offset, scale);
+    cy = yolo_tensor_value (t, base + 1, offset, scale);
+    w = yolo_tensor_value (t, base + 2, offset, scale);
+    h = yolo_tensor_value (t, base + 3, offset, scale);
+
+    if (raw_grid && !yolo_decoder_yolox_box (dec, i, &cx, &cy, &w, &h))
+      continue;
+
+    yolo_decoder_add (dec, cx, cy, w, h, score, (gint32) best, i);
+  }
+}
+
+/**
+ * Collects the candidates of a [4 + C, N] output without objectness. The
+ * best class of every anchor is found row by row over tiles of anchors,
+ * then only anchors above the threshold are looked at.
+ */
+static inline void
+yolo_decoder_columns (YoloDecoder * dec, const YoloTensor * t,
+    gsize n_anchors, gsize n_classes)
+{
+  gfloat offset = dec->q_offsets[0], scale = dec->q_scales[0];
+
+  for (gsize begin = 0; begin < n_anchors; begin += YOLO_ANCHOR_TILE) {
+    gsize end = MIN (begin + YOLO_ANCHOR_TILE, n_anchors), i = begin;
+
+    if (t->type == YOLO_TENSOR_UINT8) {
+      const guint8 *data = (const guint8 *) t->data;
+      guint qthr = yolo_quantize_threshold (dec->threshold, offset, scale);
+
+      yolo_max_rows_u8 (data + 4 * n_anchors, n_anchors, n_classes, begin,
+          end, dec->best_qscore, dec->best_qclass);
+
+      while ((i = yolo_next_u8 (dec->best_qscore, i, end, qthr)) < end) {
+        yolo_decoder_add (dec,
+            (data[i] - offset) * scale,
+            (data[n_anchors + i] - offset) * scale,
+            (data[2 * n_anchors + i] - offset) * scale,
+            (data[3 * n_anchors + i] - offset) * scale,
+            (dec->best_qscore[i] - offset) * scale, dec->best_qclass[i], i);
+        i++;
+      }
+    } else {
+      const gfloat *data = (const gfloat *) t->data;
+
+      yolo_max_rows_f32 (data + 4 * n_anchors, n_anchors, n_classes, begin,
+          end, dec->best_score, dec->best_class);
+
+      while ((i = yolo_next_f32 (dec->best_score, i, end,
+                  dec->threshold)) < end) {
+        yolo_decoder_add (dec, data[i], data[n_anchors + i],
+            data[2 * n_anchors + i], data[3 * n_anchors + i],
+            dec->best_score[i], dec->best_class[i], i);
+        i++;
+      }
+    }
+  }
+}
+
+/**
+ * Collects the candidates of a [N, 4 + C] output without objectness.
+ */
+static inline void
+yolo_decoder_rows_no_objectness (YoloDecoder * dec, const YoloTensor * t,
+    gsize n_anchors, gsize n_classes)
+{
+  gsize stride = 4 + n_classes;
+  gfloat offset = dec->q_offsets[0], scale = dec->q_scales[0];
+
+  for (gsize i = 0; i < n_anchors; i++) {
+    gsize base = i * stride, best = 0;
+    gfloat score = 0.0F;
+
+    if (t->type == YOLO_TENSOR_UINT8) {
+      const guint8 *row = (const guint8 *) t->data + base + 4;
+      for (gsize c = 1; c < n_classes; c++)
+        best = (row[c] > row[best]) ? c : best;
+    } else {
+      const gfloat *row = (const gfloat *) t->data + base + 4;
+      for (gsize c = 1; c < n_classes; c++)
+        best = (row[c] > row[best]) ? c : best;
+    }
+
+    score = yolo_tensor_value (t, base + 4 + best, offset, scale);
+    if (score < dec->threshold)
+      continue;
+
+    yolo_decoder_add (dec, yolo_tensor_value (t, base, offset, scale),
+        yolo_tensor_value (t, base + 1, offset, scale),
+        yolo_tensor_value (t, base + 2, offset, scale),
+        yolo_tensor_value (t, base + 3, offset, scale), score,
+        (gint32) best, i);
+  }
+}
+
+/**
+ * Collects the candidates of split outputs: boxes [N, 4] as x0, y0, x1, y1,
+ * scores [N] and class ids [N].
+ */
+static inline void
+yolo_decoder_split (YoloDecoder * dec, const YoloTensor * boxes,
+    const YoloTensor * scores, const YoloTensor * classes, gsize n_anchors)
+{
+  gsize i = 0;
+
+  while (TRUE) {
+    gfloat x0, y0, x1, y1;
+
+    if (scores->type == YOLO_TENSOR_UINT8)
+      i = yolo_next_u8 ((const guint8 *) scores->data, i, n_anchors,
+          yolo_quantize_threshold (dec->threshold, dec->q_offsets[1],
+              dec->q_scales[1]));
+    else
+      i = yolo_next_f32 ((const gfloat *) scores->data, i, n_anchors,
+          dec->threshold);
+
+    if (i >= n_anchors)
+      break;
+
+    x0 = yolo_tensor_value (boxes, 4 * i, dec->q_offsets[0], dec->q_scales[0]);
+    y0 = yolo_tensor_value (boxes, 4 * i + 1, dec->q_offsets[0],
+        dec->q_scales[0]);
+    x1 = yolo_tensor_value (boxes, 4 * i + 2, dec->q_offsets[0],
+        dec->q_scales[0]);
+    y1 = yolo_tensor_value (boxes, 4 * i + 3, dec->q_offsets[0],
+        dec->q_scales[0]);
+
+    yolo_decoder_add (dec, (x0 + x1) * 0.5F, (y0 + y1) * 0.5F, x1 - x0,
+        y1 - y0,
+        yolo_tensor_value (scores, i, dec->q_offsets[1], dec->q_scales[1]),
+        (gint32) yolo_tensor_value (classes, i, dec->q_offsets[2],
+            dec->q_scales[2]), i);
+    i++;
+  }
+}
+
+static inline gint
+yolo_candidate_compare (gconstpointer a, gconstpointer b)
+{
+  const YoloCandidate *ca = (const YoloCandidate *) a;
+  const YoloCandidate *cb = (const YoloCandidate *) b;
+
+  if (ca->score != cb->score)
+    return (ca->score > cb->score) ? -1 : 1;
+  return (ca->index < cb->index) ? -1 : (ca->index > cb->index);
+}
+
+/**
+ * Cells of the spatial pre-filter grid a box covers, one bit per cell.
+ * Boxes with a non-empty intersection always share a cell.
+ */
+static inline guint64
+yolo_decoder_cells (const YoloDecoder * dec, const YoloCandidate * c)
+{
+  gfloat sx = (gfloat) YOLO_GRID / dec->width;
+  gfloat sy = (gfloat) YOLO_GRID / dec->height;
+  gint c0 = CLAMP ((gint) (c->x0 * sx), 0, YOLO_GRID - 1);
+  gint c1 = CLAMP ((gint) (c->x1 * sx), 0, YOLO_GRID - 1);
+  gint r0 = CLAMP ((gint) (c->y0 * sy), 0, YOLO_GRID - 1);
+  gint r1 = CLAMP ((gint) (c->y1 * sy), 0, YOLO_GRID - 1);
+  guint64 row = ((G_GUINT64_CONSTANT (1) << (c1 - c0 + 1)) - 1) << c0;
+  guint64 cells = 0;
+
+  for (gint r = r0; r <= r1; r++)
+    cells |= row << (r * YOLO_GRID);
+  return cells;
+}
+
+/**
+ * Whether a candidate overlaps a kept box of the same class by more than
+ * the IoU threshold. IoU > t is tested as inter > t * union, which needs
+ * no division.
+ */
+static inline gboolean
+yolo_decoder_suppressed (const YoloDecoder * dec, const YoloCandidate * c,
+    gint n_kept)
+{
+  gint stride = (dec->max_detections + 3) & ~3;
+  const gfloat *kx0 = dec->kept, *ky0 = kx0 + stride, *kx1 = ky0 + stride;
+  const gfloat *ky1 = kx1 + stride, *karea = ky1 + stride;
+  gfloat area = (c->x1 - c->x0) * (c->y1 - c->y0);
+  gfloat thr = dec->iou_threshold;
+  gint i = 0;
+
+#if defined(YOLO_DECODER_NEON)
+  const float32x4_t x0 = vdupq_n_f32 (c->x0), y0 = vdupq_n_f32 (c->y0);
+  const float32x4_t x1 = vdupq_n_f32 (c->x1), y1 = vdupq_n_f32 (c->y1);
+  const float32x4_t a = vdupq_n_f32 (area), zero = vdupq_n_f32 (0.0F);
+  const int32x4_t cls = vdupq_n_s32 (c->class_id);
+
+  for (; i + 4 <= n_kept; i += 4) {
+    float32x4_t w = vmaxq_f32 (vsubq_f32 (vminq_f32 (x1, vld1q_f32 (kx1 + i)),
+            vmaxq_f32 (x0, vld1q_f32 (kx0 + i))), zero);
+    float32x4_t h = vmaxq_f32 (vsubq_f32 (vminq_f32 (y1, vld1q_f32 (ky1 + i)),
+            vmaxq_f32 (y0, vld1q_f32 (ky0 + i))), zero);
+    float32x4_t inter = vmulq_f32 (w, h);
+    float32x4_t uni = vsubq_f32 (vaddq_f32 (a, vld1q_f32 (karea + i)), inter);
+    uint32x4_t hit = vandq_u32 (vcgtq_f32 (inter, vmulq_n_f32 (uni, thr)),
+        vceqq_s32 (cls, vld1q_s32 (dec->kept_class + i)));
+
+    if (vmaxvq_u32 (hit) != 0)
+      return TRUE;
+  }
+#elif defined(YOLO_DECODER_SSE2)
+  const __m128 x0 = _mm_set1_ps (c->x0), y0 = _mm_set1_ps (c->y0);
+  const __m128 x1 = _mm_set1_ps (c->x1), y1 = _mm_set1_ps (c->y1);
+  const __m128 a = _mm_set1_ps (area), t = _mm_set1_ps (thr);
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128i cls = _mm_set1_epi32 (c->class_id);
+
+  for (; i + 4 <= n_kept; i += 4) {
+    __m128 w = _mm_max_ps (_mm_sub_ps (_mm_min_ps (x1, _mm_loadu_ps (kx1 + i)),
+            _mm_max_ps (x0, _mm_loadu_ps (kx0 + i))), zero);
+    __m128 h = _mm_max_ps (_mm_sub_ps (_mm_min_ps (y1, _mm_loadu_ps (ky1 + i)),
+            _mm_max_ps (y0, _mm_loadu_ps (ky0 + i))), zero);
+    __m128 inter = _mm_mul_ps (w, h);
+    __m128 uni = _mm_sub_ps (_mm_add_ps (a, _mm_loadu_ps (karea + i)), inter);
+    __m128 same = _mm_castsi128_ps (_mm_cmpeq_epi32 (cls,
+            _mm_loadu_si128 ((const __m128i *) (dec->kept_class + i))));
+
+    if (_mm_movemask_ps (_mm_and_ps (_mm_cmpgt_ps (inter,
+                    _mm_mul_ps (uni, t)), same)) != 0)
+      return TRUE;
+  }
+#endif
+
+  for (; i < n_kept; i++) {
+    gfloat w = MIN (c->x1, kx1[i]) - MAX (c->x0, kx0[i]);
+    gfloat h = MIN (c->y1, ky1[i]) - MAX (c->y0, ky0[i]);
+    gfloat inter = MAX (w, 0.0F) * MAX (h, 0.0F);
+
+    if (dec->kept_class[i] == c->class_id &&
+        inter > thr * (area + karea[i] - inter))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * Greedy class aware NMS over the collected candidates, best first.
+ */
+static inline void
+yolo_decoder_nms (YoloDecoder * dec, gsize n_classes)
+{
+  gint stride = (dec->max_detections + 3) & ~3;
+  gfloat *kx0 = dec->kept, *ky0 = kx0 + stride, *kx1 = ky0 + stride;
+  gfloat *ky1 = kx1 + stride, *karea = ky1 + stride;
+  gint n_kept = 0;
+
+  qsort (dec->candidates, dec->n_candidates, sizeof (YoloCandidate),
+      yolo_candidate_compare);
+  memset (dec->class_cells, 0, n_classes * sizeof (guint64));
+
+  for (gsize i = 0; i < dec->n_candidates && n_kept < dec->max_detections;
+      i++) {
+    const YoloCandidate *c = &dec->candidates[i];
+    YoloDetection *det = &dec->detections[n_kept];
+    guint64 cells = 0;
+
+    if (c->class_id < 0 || (gsize) c->class_id >= n_classes ||
+        c->x1 <= c->x0 || c->y1 <= c->y0)
+      continue;
+
+    // Only boxes sharing a grid cell with a kept box of the class can
+    // overlap it
+    cells = yolo_decoder_cells (dec, c);
+    if ((dec->class_cells[c->class_id] & cells) != 0 &&
+        yolo_decoder_suppressed (dec, c, n_kept))
+      continue;
+
+    dec->class_cells[c->class_id] |= cells;
+    kx0[n_kept] = c->x0;
+    ky0[n_kept] = c->y0;
+    kx1[n_kept] = c->x1;
+    ky1[n_kept] = c->y1;
+    karea[n_kept] = (c->x1 - c->x0) * (c->y1 - c->y0);
+    dec->kept_class[n_kept] = c->class_id;
+
+    det->x0 = c->x0;
+    det->y0 = c->y0;
+    det->x1 = c->x1;
+    det->y1 = c->y1;
+    det->score = c->score;
+    det->class_id = c->class_id;
+    n_kept++;
+  }
+
+  dec->n_detections = n_kept;
+}
+
+/**
+ * Number of elements of a tensor without the leading batch dimension of 1,
+ * and its remaining dimensions.
+ */
+static inline gboolean
+yolo_tensor_shape (const YoloTensor * t, gint64 * rows, gint64 * cols)
+{
+  gsize first = (t->n_dims > 1 && t->dims[0] == 1) ? 1 : 0;
+
+  *rows = (first < t->n_dims) ? t->dims[first] : 1;
+  *cols = 1;
+  for (gsize i = first + 1; i < t->n_dims; i++)
+    *cols *= t->dims[i];
+
+  return t->n_dims >= 1 && t->n_dims <= YOLO_MAX_DIMS && *rows > 0 &&
+      *cols > 0;
+}
+
+/**
+ * Decodes the outputs of a frame into dec->detections.
+ *
+ * @param dec Decoder.
+ * @param tensors Model outputs in model order: a single detection tensor,
+ *                or boxes, scores and class ids.
+ * @param n_tensors Number of outputs.
+ * @return Number of detections or -1 if the outputs are not supported.
+ */
+static inline gint
+yolo_decoder_process (YoloDecoder * dec, const YoloTensor * tensors,
+    gsize n_tensors)
+{
+  gint64 rows = 0, cols = 0;
+  gsize n_anchors = 0, n_classes = 0;
+
+  dec->n_candidates = 0;
+  dec->n_detections = 0;
+
+  if (n_tensors == 0 || !yolo_tensor_shape (&tensors[0], &rows, &cols))
+    goto unsupported;
+
+  if (n_tensors >= 3) {
+    gint64 score_rows = 0, score_cols = 0, class_rows = 0, class_cols = 0;
+
+    // One score and one class id per box
+    if (cols != 4 || !yolo_tensor_shape (&tensors[1], &score_rows,
+            &score_cols) || score_rows * score_cols != rows ||
+        !yolo_tensor_shape (&tensors[2], &class_rows, &class_cols) ||
+        class_rows * class_cols != rows ||
+        tensors[0].type == YOLO_TENSOR_INT32 ||
+        tensors[0].type == YOLO_TENSOR_INT64 ||
+        tensors[1].type == YOLO_TENSOR_INT32 ||
+        tensors[1].type == YOLO_TENSOR_INT64)
+      goto unsupported;
+
+    // Class ids are only known while decoding, labels give the range
+    n_anchors = rows;
+    n_classes = (dec->labels.n_entries > 0) ? dec->labels.n_entries : 256;
+    yolo_decoder_reserve (dec, n_anchors, n_classes);
+    yolo_decoder_split (dec, &tensors[0], &tensors[1], &tensors[2],
+        n_anchors);
+  } else if (tensors[0].type != YOLO_TENSOR_FLOAT &&
+      tensors[0].type != YOLO_TENSOR_UINT8) {
+    goto unsupported;
+  } else if (dec->version == YOLO_V8) {
+    // Outputs are [4 + C, N] unless transposed in the export
+    gboolean columns = (rows < cols);
+
+    n_anchors = columns ? cols : rows;
+    n_classes = (columns ? rows : cols) - 4;
+    if ((columns ? rows : cols) <= 4 ||
+        (columns && tensors[0].type == YOLO_TENSOR_UINT8 && n_classes > 256))
+      goto unsupported;
+
+    yolo_decoder_reserve (dec, n_anchors, n_classes);
+    if (columns)
+      yolo_decoder_columns (dec, &tensors[0], n_anchors, n_classes);
+    else
+      yolo_decoder_rows_no_objectness (dec, &tensors[0], n_anchors,
+          n_classes);
+  } else {
+    if (cols <= 5)
+      goto unsupported;
+
+    n_anchors = rows;
+    n_classes = cols - 5;
+    yolo_decoder_reserve (dec, n_anchors, n_classes);
+    yolo_decoder_rows (dec, &tensors[0], n_anchors, n_classes);
+  }
+
+  yolo_decoder_nms (dec, n_classes);
+  return dec->n_detections;
+
+unsupported:
+  g_printerr ("\n Unsupported YOLO output tensors!\n");
+  return -1;
+}
+
+#endif //YOLO_DECODER_H
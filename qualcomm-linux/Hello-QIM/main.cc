@@ -14,24 +14,107 @@
  *
  * Usage:
  * gst-appsink-example --width=1920 --height=1080
+ * gst-appsink-example --format=NV12 --framerate=60
+ * gst-appsink-example --max-buffers=1 --queue-size=2 --sync --qos
+ * gst-appsink-example --config-file=config/config-hello-qim.json
+ * gst-appsink-example --stall-timeout=2000
+ * gst-appsink-example --live-control   (then type e.g. 1920x1080 + Enter)
+ * gst-appsink-example --model=model.onnx --qnn-backend=libQnnHtp.so
+ * gst-appsink-example --model=yolov8_det.onnx --yolo-model-type=yolov8 \
+ *     --json-labels=yolov8.json --threshold=40 \
+ *     --constants="YOLOv8,q-offsets=<21.0, 0.0, 0.0>,q-scales=<3.05, 0.0038, 1.0>;"
+ * gst-appsink-example --model=hrnet_pose.onnx \
+ *     --pose-settings=hrnet_pose_settings.json --json-labels=hrnet_pose.json
+ * gst-appsink-example --model=deeplabv3_resnet50.onnx --segmentation \
+ *     --json-labels=deeplabv3_resnet50.json --seg-alpha=128
+ * gst-appsink-example --dump-file=frames.cap --dump-frames=300
+ * gst-appsink-example --replay=frames.cap --replay-max-speed --preprocess
+ * gst-appsink-example --pipeline="qtiqmmfsrc ! video/x-raw,format=NV12 ! \
+ *     appsink name=sink max-buffers=1 drop=true"
+ * gst-appsink-example --ml-preferred --ml-width=640 --ml-height=640 --ml-format=RGB
+ * gst-appsink-example --preprocess --ml-width=640 --ml-height=640 \
+ *     --tensor-layout=nchw --tensor-type=float --pool-size=4 --dmabuf-pool
  *
  * Help:
  * gst-appsink-example --help
  *
  * *********************************************************
- * Pipeline for appsink: qtiqmmfsrc->capsfilter->appsink
+ * Pipeline for appsink: qtiqmmfsrc->capsfilter->queue->appsink
+ *
+ * Pipeline for appsink with --ml-preferred:
+ * qtiqmmfsrc->capsfilter->qtivtransform->capsfilter->queue->appsink
+ *
+ * The RGB or BGR frames of --ml-preferred are preprocessed into the tensor
+ * like with --preprocess, only copied into the tensor layout and type, so
+ * --model runs on them without any CPU color conversion.
+ *
+ * The queue is leaky and is left out with --queue-size=0.
+ *
+ * With --pipeline or a "pipeline" entry in --config-file the pipeline is
+ * built from the gst-launch description instead, and the appsink is found
+ * by its name ("sink" unless "appsink-name" is given in the config file).
+ * Options given on the command line override the entries of the config
+ * file.
+ *
+ * --model needs a build with ONNX Runtime, make WITH_ORT=1. Then every
+ * frame passes through four threads working on different frames at the
+ * same time:
+ * appsink (capture) -> preprocess -> ONNX Runtime inference -> postprocess
+ *
+ * With --yolo-model-type the postprocess thread decodes the outputs as YOLO
+ * detections, see include/yolo_decoder.h, with --pose-settings as pose
+ * keypoint heatmaps, see include/pose_decoder.h, and with --segmentation
+ * as a class mask and RGBA overlay of the frame, see
+ * include/seg_decoder.h. --json-labels takes a json_labels file and
+ * --constants the q-offsets/q-scales of uint8 outputs like the configs.
+ *
+ * Pipeline for appsink with --replay: appsrc->queue->appsink
+ *
+ * --dump-file records the frames received in new_sample into a capture
+ * file, see include/frame_capture.h. --replay feeds such a file back
+ * instead of the camera, paced by the recorded timestamps, or as fast as
+ * the processing allows without dropping frames with --replay-max-speed.
+ * This gives repeatable benchmarks of the processing without a camera.
  * *********************************************************
  */
 
 #include <glib-unix.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
+#include <json-glib/json-glib.h>
 
 #include "include/gst_sample_apps_utils.h"
+#include "include/frame_capture.h"
+#include "include/frame_pool.h"
+#include "include/ml_preprocess.h"
+#ifdef HELLO_QIM_WITH_ORT
+#include "include/ml_inference.h"
+#endif
 
 #define DEFAULT_WIDTH 1280
 #define DEFAULT_HEIGHT 720
+#define DEFAULT_FORMAT "NV12"
+#define DEFAULT_FRAMERATE 30
+#define DEFAULT_ML_WIDTH 640
+#define DEFAULT_ML_HEIGHT 640
+#define DEFAULT_ML_FORMAT "RGB"
+#define PREPROCESS_STATS_INTERVAL 100
+#define DEFAULT_POOL_SIZE 4
+#define DEFAULT_MAX_BUFFERS 1
+#define DEFAULT_QUEUE_SIZE 2
+#define LATENCY_STATS_INTERVAL 100
+#define DEFAULT_APPSINK_NAME "sink"
+#define DEFAULT_STALL_TIMEOUT 0
+#define RESOLUTION_SWITCH_TIMEOUT 3000
+#define MAX_PENDING_PREPROCESS 2
+#define DEFAULT_DUMP_FRAMES 300
+#define DEFAULT_THRESHOLD 50
+#define DEFAULT_NMS_THRESHOLD 45
+#define DEFAULT_SEG_ALPHA -1
+#define DEFAULT_SEG_THREADS 0
 
 #define GST_APP_SUMMARY                                \
   "when new sample is available in the pipeline then " \
@@ -41,6 +124,77 @@
 struct GstAppSinkContext : GstAppContext {
   gint width;
   gint height;
+  gchar *format;
+  gint framerate;
+  gboolean ml_preferred;
+  gint ml_width;
+  gint ml_height;
+  gchar *ml_format;
+  gboolean caps_reported;
+  gboolean preprocess;
+  gchar *tensor_layout;
+  gchar *tensor_type;
+  MLPreprocessor preprocessor;
+  gboolean preprocessor_ready;
+  FramePool *tensor_pool;
+  gint pool_size;
+  gboolean dmabuf_pool;
+  guint64 preprocess_frames;
+  gint64 preprocess_time_us;
+  gint max_buffers;
+  gboolean drop;
+  gboolean sync;
+  gboolean qos;
+  gint queue_size;
+  guint64 latency_frames;
+  GstClockTime latency_sum;
+  GstClockTime latency_max;
+  gchar *config_file;
+  gchar *pipeline_desc;
+  gchar *appsink_name;
+  gint stall_timeout;
+  GstPipelineWatchdog *watchdog;
+  gboolean live_control;
+  guint stdin_watch_id;
+  gint switch_pending;
+  gint switch_width;
+  gint switch_height;
+  gint64 switch_start;
+  guint switch_frames;
+  gboolean switch_caps_seen;
+  gint64 switch_caps_time;
+  GstClockTime switch_pts;
+  GstPad *switch_pad;
+  gulong switch_probe_id;
+  guint switch_timeout_id;
+  gchar *model;
+  gchar *qnn_backend;
+  gchar *yolo_model_type;
+  gchar *pose_settings;
+  gboolean segmentation;
+  gint seg_alpha;
+  gint seg_threads;
+  gchar *labels;
+  gchar *constants;
+  gint threshold;
+  gint nms_threshold;
+#ifdef HELLO_QIM_WITH_ORT
+  MLInference *inference;
+#endif
+  GAsyncQueue *preprocess_queue;
+  GThread *preprocess_thread;
+  gint preprocess_dropped;
+  gchar *dump_file;
+  gint dump_frames;
+  FrameCapture *dump;
+  gchar *replay_file;
+  gboolean replay_max_speed;
+  FrameCapture *replay;
+  guint64 replay_index;
+  guint64 replay_base;
+  guint64 frames_received;
+  gint64 first_frame_time;
+  gint64 last_frame_time;
 };
 
 // Function to get gst sample release buffer
@@ -72,13 +226,454 @@ gst_app_context_new ()
   ctx->plugins = NULL;
   ctx->width = DEFAULT_WIDTH;
   ctx->height = DEFAULT_HEIGHT;
+  ctx->format = NULL;
+  ctx->framerate = DEFAULT_FRAMERATE;
+  ctx->ml_preferred = FALSE;
+  ctx->ml_width = DEFAULT_ML_WIDTH;
+  ctx->ml_height = DEFAULT_ML_HEIGHT;
+  ctx->ml_format = NULL;
+  ctx->caps_reported = FALSE;
+  ctx->preprocess = FALSE;
+  ctx->tensor_layout = NULL;
+  ctx->tensor_type = NULL;
+  ctx->preprocessor_ready = FALSE;
+  ctx->tensor_pool = NULL;
+  ctx->pool_size = DEFAULT_POOL_SIZE;
+  ctx->dmabuf_pool = FALSE;
+  ctx->preprocess_frames = 0;
+  ctx->preprocess_time_us = 0;
+  ctx->max_buffers = DEFAULT_MAX_BUFFERS;
+  ctx->drop = TRUE;
+  ctx->sync = FALSE;
+  ctx->qos = FALSE;
+  ctx->queue_size = DEFAULT_QUEUE_SIZE;
+  ctx->latency_frames = 0;
+  ctx->latency_sum = 0;
+  ctx->latency_max = 0;
+  ctx->config_file = NULL;
+  ctx->pipeline_desc = NULL;
+  ctx->appsink_name = NULL;
+  ctx->stall_timeout = DEFAULT_STALL_TIMEOUT;
+  ctx->watchdog = NULL;
+  ctx->live_control = FALSE;
+  ctx->stdin_watch_id = 0;
+  ctx->switch_pending = 0;
+  ctx->switch_width = 0;
+  ctx->switch_height = 0;
+  ctx->switch_start = 0;
+  ctx->switch_frames = 0;
+  ctx->switch_caps_seen = FALSE;
+  ctx->switch_caps_time = 0;
+  ctx->switch_pts = GST_CLOCK_TIME_NONE;
+  ctx->switch_pad = NULL;
+  ctx->switch_probe_id = 0;
+  ctx->switch_timeout_id = 0;
+  ctx->model = NULL;
+  ctx->qnn_backend = NULL;
+  ctx->yolo_model_type = NULL;
+  ctx->pose_settings = NULL;
+  ctx->segmentation = FALSE;
+  ctx->seg_alpha = DEFAULT_SEG_ALPHA;
+  ctx->seg_threads = DEFAULT_SEG_THREADS;
+  ctx->labels = NULL;
+  ctx->constants = NULL;
+  ctx->threshold = DEFAULT_THRESHOLD;
+  ctx->nms_threshold = DEFAULT_NMS_THRESHOLD;
+#ifdef HELLO_QIM_WITH_ORT
+  ctx->inference = NULL;
+#endif
+  ctx->preprocess_queue = NULL;
+  ctx->preprocess_thread = NULL;
+  ctx->preprocess_dropped = 0;
+  ctx->dump_file = NULL;
+  ctx->dump_frames = DEFAULT_DUMP_FRAMES;
+  ctx->dump = NULL;
+  ctx->replay_file = NULL;
+  ctx->replay_max_speed = FALSE;
+  ctx->replay = NULL;
+  ctx->replay_index = 0;
+  ctx->replay_base = GST_CLOCK_TIME_NONE;
+  ctx->frames_received = 0;
+  ctx->first_frame_time = 0;
+  ctx->last_frame_time = 0;
   return ctx;
 }
 
+// Function to print the negotiated caps and plane layout of the first frame,
+// so that downstream processing can be written against the real strides
+static void
+report_negotiated_layout (GstSample * sample, GstBuffer * buffer)
+{
+  GstCaps *caps = gst_sample_get_caps (sample);
+  GstVideoMeta *vmeta = gst_buffer_get_video_meta (buffer);
+  GstVideoInfo vinfo;
+  gchar *str = NULL;
+
+  if (caps == NULL)
+    return;
+
+  str = gst_caps_to_string (caps);
+  g_print ("\n Negotiated caps: %s\n", str);
+  g_free (str);
+
+  if (vmeta != NULL) {
+    for (guint i = 0; i < vmeta->n_planes; i++)
+      g_print (" Plane %u: offset=%" G_GSIZE_FORMAT " stride=%d\n", i,
+          vmeta->offset[i], vmeta->stride[i]);
+  } else if (gst_video_info_from_caps (&vinfo, caps)) {
+    for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES (&vinfo); i++)
+      g_print (" Plane %u: offset=%" G_GSIZE_FORMAT " stride=%d\n", i,
+          GST_VIDEO_INFO_PLANE_OFFSET (&vinfo, i),
+          GST_VIDEO_INFO_PLANE_STRIDE (&vinfo, i));
+  }
+}
+
+// Function to get the monotonic time in us at which a frame was captured.
+// The pipeline runs on the monotonic system clock, so this is the base time
+// plus the running time of the buffer. Falls back to the current time.
+static gint64
+get_capture_time (GstAppSinkContext * appctx, GstSample * sample,
+    GstBuffer * buffer)
+{
+  GstSegment *segment = gst_sample_get_segment (sample);
+  GstClockTime running = GST_CLOCK_TIME_NONE;
+  gint64 now = g_get_monotonic_time (), time;
+
+  if (segment != NULL && GST_BUFFER_PTS_IS_VALID (buffer))
+    running = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer));
+
+  if (!GST_CLOCK_TIME_IS_VALID (running))
+    return now;
+
+  time = (gint64) ((gst_element_get_base_time (appctx->pipeline) + running) /
+      GST_USECOND);
+
+  // Guard against a pipeline clock which is not the monotonic clock
+  return (time > now || now - time > G_USEC_PER_SEC * 10) ? now : time;
+}
+
+// Function to convert an NV12 frame, or an RGB/BGR frame of the ML
+// preferred mode, into a model input tensor taken from the tensor pool. The
+// preprocessor and the pool are set up on the first frame, once the
+// negotiated resolution is known, so the steady state does not allocate.
+// Returns NULL on error and sets @dropped if no tensor buffer was free; the
+// caller releases the returned buffer when done with it.
+static FramePoolBuffer *
+preprocess_frame (GstAppSinkContext * appctx, GstSample * sample,
+    GstBuffer * buffer, gboolean * dropped)
+{
+  GstVideoInfo vinfo;
+  GstVideoFrame frame;
+  FramePoolBuffer *tensor = NULL;
+  MLFrameFormat format = ML_FRAME_NV12;
+  gint64 start;
+
+  *dropped = FALSE;
+
+  if (!gst_video_info_from_caps (&vinfo, gst_sample_get_caps (sample))) {
+    g_printerr ("\n Failed to parse the sample caps!\n");
+    return NULL;
+  }
+
+  switch (GST_VIDEO_INFO_FORMAT (&vinfo)) {
+    case GST_VIDEO_FORMAT_NV12:
+      format = ML_FRAME_NV12;
+      break;
+    case GST_VIDEO_FORMAT_RGB:
+      format = ML_FRAME_RGB;
+      break;
+    case GST_VIDEO_FORMAT_BGR:
+      format = ML_FRAME_BGR;
+      break;
+    default:
+      g_printerr ("\n Preprocessing supports only NV12, RGB and BGR frames!\n");
+      return NULL;
+  }
+
+  // The camera resolution can change at runtime, see change_resolution()
+  if (appctx->preprocessor_ready &&
+      (appctx->preprocessor.config.src_format != format ||
+       appctx->preprocessor.config.src_width != GST_VIDEO_INFO_WIDTH (&vinfo) ||
+       appctx->preprocessor.config.src_height != GST_VIDEO_INFO_HEIGHT (&vinfo))) {
+    ml_preprocess_deinit (&appctx->preprocessor);
+    appctx->preprocessor_ready = FALSE;
+  }
+
+  if (!appctx->preprocessor_ready) {
+    MLPreprocessConfig config;
+
+    ml_preprocess_config_init (&config, GST_VIDEO_INFO_WIDTH (&vinfo),
+        GST_VIDEO_INFO_HEIGHT (&vinfo), appctx->ml_width, appctx->ml_height);
+    config.src_format = format;
+    config.color = g_ascii_strcasecmp (appctx->ml_format, "BGR") == 0 ?
+        ML_COLOR_BGR : ML_COLOR_RGB;
+    config.layout = g_ascii_strcasecmp (appctx->tensor_layout, "nchw") == 0 ?
+        ML_LAYOUT_NCHW : ML_LAYOUT_NHWC;
+    config.type = g_ascii_strcasecmp (appctx->tensor_type, "uint8") == 0 ?
+        ML_TYPE_UINT8 : ML_TYPE_FLOAT32;
+
+    if (!ml_preprocess_init (&appctx->preprocessor, &config)) {
+      g_printerr ("\n Failed to initialize the preprocessor!\n");
+      return NULL;
+    }
+
+    // The tensor size does not depend on the frame size, keep the pool
+    if (appctx->tensor_pool == NULL)
+      appctx->tensor_pool = frame_pool_new (
+          ml_preprocess_output_size (&appctx->preprocessor),
+          appctx->pool_size, appctx->dmabuf_pool);
+
+    if (appctx->tensor_pool == NULL) {
+      g_printerr ("\n Failed to allocate the tensor pool!\n");
+      ml_preprocess_deinit (&appctx->preprocessor);
+      return NULL;
+    }
+
+    appctx->preprocessor_ready = TRUE;
+    g_print ("\n Preprocessing %dx%d %s into %dx%d %s %s tensor\n",
+        config.src_width, config.src_height,
+        GST_VIDEO_INFO_NAME (&vinfo), config.dst_width,
+        config.dst_height, appctx->tensor_layout, appctx->tensor_type);
+  }
+
+  // Never block the streaming thread, drop the frame if all tensors are
+  // busy. Replay at max speed waits instead, so every frame is processed.
+  if ((tensor = frame_pool_acquire (appctx->tensor_pool,
+      appctx->replay_max_speed ? -1 : 0)) == NULL) {
+    *dropped = TRUE;
+    return NULL;
+  }
+
+  if (!gst_video_frame_map (&frame, &vinfo, buffer, GST_MAP_READ)) {
+    g_printerr ("\n Failed to map the video frame!\n");
+    frame_pool_release (tensor);
+    return NULL;
+  }
+
+  start = g_get_monotonic_time ();
+  frame_pool_buffer_sync (tensor, TRUE, TRUE);
+  if (format == ML_FRAME_NV12)
+    ml_preprocess_nv12 (&appctx->preprocessor,
+        (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+        (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 1),
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1), tensor->data);
+  else
+    ml_preprocess_packed (&appctx->preprocessor,
+        (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0), tensor->data);
+  frame_pool_buffer_sync (tensor, FALSE, TRUE);
+  appctx->preprocess_time_us += g_get_monotonic_time () - start;
+
+  tensor->pts = GST_BUFFER_PTS (buffer);
+  tensor->time = get_capture_time (appctx, sample, buffer);
+  tensor->width = GST_VIDEO_INFO_WIDTH (&vinfo);
+  tensor->height = GST_VIDEO_INFO_HEIGHT (&vinfo);
+  gst_video_frame_unmap (&frame);
+
+  if (++appctx->preprocess_frames % PREPROCESS_STATS_INTERVAL == 0) {
+    g_print ("\n Preprocess: %" G_GUINT64_FORMAT " frames, average %.3f ms\n",
+        appctx->preprocess_frames, appctx->preprocess_time_us / 1000.0 /
+        appctx->preprocess_frames);
+    frame_pool_print_stats (appctx->tensor_pool, "Tensor");
+  }
+
+  return tensor;
+}
+
+// Function to measure how long ago the frame was captured, as the
+// difference between the current running time and the buffer running time
+static void
+update_frame_latency (GstAppSinkContext * appctx, GstElement * sink,
+    GstSample * sample, GstBuffer * buffer)
+{
+  GstSegment *segment = gst_sample_get_segment (sample);
+  GstClock *clock = NULL;
+  GstClockTime now, running, latency;
+
+  if (segment == NULL || !GST_BUFFER_PTS_IS_VALID (buffer))
+    return;
+
+  if ((clock = gst_element_get_clock (sink)) == NULL)
+    return;
+
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (sink);
+  gst_object_unref (clock);
+
+  running = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running) || now < running)
+    return;
+
+  latency = now - running;
+  appctx->latency_sum += latency;
+  appctx->latency_max = MAX (appctx->latency_max, latency);
+
+  if (++appctx->latency_frames % LATENCY_STATS_INTERVAL == 0) {
+    g_print ("\n End-to-end latency: last %.2f ms, average %.2f ms, "
+        "max %.2f ms\n", latency / 1e6,
+        appctx->latency_sum / 1e6 / LATENCY_STATS_INTERVAL,
+        appctx->latency_max / 1e6);
+    appctx->latency_sum = 0;
+    appctx->latency_max = 0;
+  }
+}
+
+// Function to report the switchover time once the first frame negotiated
+// with the resolution requested by change_resolution() arrives. Frames
+// older than the first buffer behind the new caps on the capsfilter are
+// counted as frames with the old resolution, which also holds in ML
+// preferred mode where the appsink size does not change.
+static void
+check_resolution_switch (GstAppSinkContext * appctx, GstSample * sample)
+{
+  GstClockTime pts = GST_BUFFER_PTS (gst_sample_get_buffer (sample));
+  gint pending = g_atomic_int_get (&appctx->switch_pending);
+
+  if (pending == 0)
+    return;
+
+  if (pending == 1 || (GST_CLOCK_TIME_IS_VALID (appctx->switch_pts) &&
+      GST_CLOCK_TIME_IS_VALID (pts) && pts < appctx->switch_pts)) {
+    appctx->switch_frames++;
+    return;
+  }
+
+  // The switch timed out or failed meanwhile
+  if (!g_atomic_int_compare_and_exchange (&appctx->switch_pending, 2, 0))
+    return;
+
+  g_print ("\n Resolution switched to %dx%d in %.1f ms, negotiated after "
+      "%.1f ms, %u frames with the old resolution received meanwhile\n",
+      appctx->switch_width, appctx->switch_height,
+      (g_get_monotonic_time () - appctx->switch_start) / 1000.0,
+      (appctx->switch_caps_time - appctx->switch_start) / 1000.0,
+      appctx->switch_frames);
+
+  appctx->caps_reported = FALSE;
+}
+
+// Function to close the frame dump and stop dumping further frames
+static void
+finish_frame_dump (GstAppSinkContext * appctx)
+{
+  FrameCaptureHeader *header = appctx->dump->header;
+
+  g_print ("\n Dumped %" G_GUINT64_FORMAT " %ux%u frames to %s\n",
+      header->n_frames, header->width, header->height, appctx->dump_file);
+
+  frame_capture_close (appctx->dump);
+  appctx->dump = NULL;
+  appctx->dump_frames = 0;
+}
+
+// Function to record an NV12 frame into the dump file. The file is created
+// on the first frame, once the negotiated resolution is known.
+static void
+dump_frame (GstAppSinkContext * appctx, GstSample * sample, GstBuffer * buffer)
+{
+  GstVideoInfo vinfo;
+  GstVideoFrame frame;
+
+  if (!gst_video_info_from_caps (&vinfo, gst_sample_get_caps (sample)) ||
+      GST_VIDEO_INFO_FORMAT (&vinfo) != GST_VIDEO_FORMAT_NV12) {
+    g_printerr ("\n Frame dump supports only NV12 frames, dump disabled!\n");
+    appctx->dump_frames = 0;
+    return;
+  }
+
+  if (appctx->dump == NULL) {
+    appctx->dump = frame_capture_create (appctx->dump_file,
+        GST_VIDEO_INFO_WIDTH (&vinfo), GST_VIDEO_INFO_HEIGHT (&vinfo),
+        GST_VIDEO_INFO_FPS_N (&vinfo), GST_VIDEO_INFO_FPS_D (&vinfo),
+        appctx->dump_frames);
+
+    if (appctx->dump == NULL) {
+      g_printerr ("\n Failed to create dump file %s, dump disabled!\n",
+          appctx->dump_file);
+      appctx->dump_frames = 0;
+      return;
+    }
+
+    g_print ("\n Dumping up to %d frames to %s\n", appctx->dump_frames,
+        appctx->dump_file);
+  }
+
+  // A capture file holds frames of a single resolution
+  if ((guint) GST_VIDEO_INFO_WIDTH (&vinfo) != appctx->dump->header->width ||
+      (guint) GST_VIDEO_INFO_HEIGHT (&vinfo) != appctx->dump->header->height) {
+    g_print ("\n Resolution changed, frame dump stopped\n");
+    finish_frame_dump (appctx);
+    return;
+  }
+
+  if (!gst_video_frame_map (&frame, &vinfo, buffer, GST_MAP_READ)) {
+    g_printerr ("\n Failed to map the video frame for the dump!\n");
+    return;
+  }
+
+  frame_capture_write_nv12 (appctx->dump,
+      (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+      (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 1),
+      GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1), GST_BUFFER_PTS (buffer));
+  gst_video_frame_unmap (&frame);
+
+  if (appctx->dump->header->n_frames == appctx->dump->max_frames)
+    finish_frame_dump (appctx);
+}
+
+// Function to hand a preprocessed tensor to the inference stage, or to
+// return it to the pool when no model runs
+static void
+consume_tensor (GstAppSinkContext * appctx, FramePoolBuffer * tensor)
+{
+#ifdef HELLO_QIM_WITH_ORT
+  if (appctx->inference != NULL) {
+    ml_inference_push (appctx->inference, tensor);
+    return;
+  }
+#endif
+
+  frame_pool_release (tensor);
+}
+
+#ifdef HELLO_QIM_WITH_ORT
+// Function running the preprocessing of queued samples on its own thread,
+// so the appsink thread only hands over frames and inference runs in
+// parallel on the previous ones
+static gpointer
+preprocess_thread_func (gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+  gpointer item = NULL;
+
+  while ((item = g_async_queue_pop (appctx->preprocess_queue)) !=
+      ML_INFERENCE_EOS) {
+    GstSample *sample = (GstSample *) item;
+    FramePoolBuffer *tensor = NULL;
+    gboolean dropped = FALSE;
+
+    tensor = preprocess_frame (appctx, sample, gst_sample_get_buffer (sample),
+        &dropped);
+    gst_sample_unref (sample);
+
+    if (tensor != NULL)
+      consume_tensor (appctx, tensor);
+    else if (dropped)
+      g_atomic_int_inc (&appctx->preprocess_dropped);
+  }
+
+  return NULL;
+}
+#endif
+
 // Function to emit the signal and sample
 static GstFlowReturn
 new_sample (GstElement * sink, gpointer userdata)
 {
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
   GstSample *sample = NULL;
   GstBuffer *buffer = NULL;
   GstMapInfo info;
@@ -105,7 +700,47 @@ new_sample (GstElement * sink, gpointer userdata)
     return GST_FLOW_ERROR;
   }
 
-  g_print ("\n Hello-QIM: Success creating pipeline and received camera frame ...\n\n");
+  check_resolution_switch (appctx, sample);
+
+  if (!appctx->caps_reported) {
+    report_negotiated_layout (sample, buffer);
+    appctx->caps_reported = TRUE;
+  }
+
+  update_frame_latency (appctx, sink, sample, buffer);
+
+  appctx->last_frame_time = g_get_monotonic_time ();
+  if (appctx->frames_received++ == 0)
+    appctx->first_frame_time = appctx->last_frame_time;
+
+  if (appctx->dump_file != NULL && appctx->dump_frames > 0)
+    dump_frame (appctx, sample, buffer);
+
+  if (appctx->preprocess_thread != NULL) {
+    // Hand the frame to the preprocess thread, drop it if that fell behind
+    if (g_async_queue_length (appctx->preprocess_queue) <
+        MAX_PENDING_PREPROCESS)
+      g_async_queue_push (appctx->preprocess_queue, gst_sample_ref (sample));
+    else
+      g_atomic_int_inc (&appctx->preprocess_dropped);
+  } else if (appctx->preprocess) {
+    gboolean dropped = FALSE;
+    FramePoolBuffer *tensor = preprocess_frame (appctx, sample, buffer,
+        &dropped);
+
+    if (tensor == NULL && !dropped) {
+      gst_buffer_unmap (buffer, &info);
+      gst_sample_release (sample);
+      return GST_FLOW_ERROR;
+    }
+
+    // The tensor is ready for the application
+    if (tensor != NULL)
+      consume_tensor (appctx, tensor);
+  }
+
+  if (appctx->model == NULL)
+    g_print ("\n Hello-QIM: Success creating pipeline and received camera frame ...\n\n");
 
   // after use unmap buffer
   gst_buffer_unmap (buffer, &info);
@@ -118,6 +753,25 @@ new_sample (GstElement * sink, gpointer userdata)
 static void
 gst_app_context_free (GstAppSinkContext * appctx)
 {
+  // Drain the preprocess thread and the inference stage first, the
+  // queued frames still reference the pipeline and the pool
+#ifdef HELLO_QIM_WITH_ORT
+  if (appctx->preprocess_thread != NULL) {
+    g_async_queue_push (appctx->preprocess_queue, ML_INFERENCE_EOS);
+    g_thread_join (appctx->preprocess_thread);
+    g_print ("\n Frames dropped before inference: %d\n",
+        g_atomic_int_get (&appctx->preprocess_dropped));
+  }
+
+  if (appctx->preprocess_queue != NULL)
+    g_async_queue_unref (appctx->preprocess_queue);
+
+  ml_inference_free (appctx->inference);
+#endif
+
+  if (appctx->dump != NULL)
+    finish_frame_dump (appctx);
+
   // If the plugins list is not empty, unlink and remove all elements
    if (appctx->plugins != NULL) {
     GstElement *element_curr = (GstElement *) appctx->plugins->data;
@@ -148,47 +802,438 @@ gst_app_context_free (GstAppSinkContext * appctx)
     appctx->pipeline = NULL;
   }
 
+  g_free (appctx->format);
+  g_free (appctx->ml_format);
+  g_free (appctx->tensor_layout);
+  g_free (appctx->tensor_type);
+  g_free (appctx->config_file);
+  g_free (appctx->pipeline_desc);
+  g_free (appctx->appsink_name);
+  g_free (appctx->model);
+  g_free (appctx->qnn_backend);
+  g_free (appctx->yolo_model_type);
+  g_free (appctx->pose_settings);
+  g_free (appctx->labels);
+  g_free (appctx->constants);
+  g_free (appctx->dump_file);
+  g_free (appctx->replay_file);
+
+  // Replayed buffers point into the mapping, the pipeline is gone by now
+  frame_capture_close (appctx->replay);
+
+  if (appctx->switch_pad != NULL)
+    gst_object_unref (appctx->switch_pad);
+
+  if (appctx->tensor_pool != NULL) {
+    frame_pool_print_stats (appctx->tensor_pool, "Tensor");
+    frame_pool_free (appctx->tensor_pool);
+  }
+
+  if (appctx->preprocessor_ready)
+    ml_preprocess_deinit (&appctx->preprocessor);
+
   if (appctx != NULL)
     g_free (appctx);
 }
 
+// Function to get a config file entry of the given value type. Returns
+// FALSE and reports the key if the entry has another type, the node is
+// left NULL if the entry is not set.
+static gboolean
+config_get_value (JsonObject * root, const gchar * key, GType type,
+    JsonNode ** node)
+{
+  *node = json_object_get_member (root, key);
+
+  if (*node == NULL)
+    return TRUE;
+
+  if (JSON_NODE_HOLDS_VALUE (*node) &&
+      json_node_get_value_type (*node) == type)
+    return TRUE;
+
+  g_printerr ("\n Config entry \"%s\" is not %s!\n", key,
+      (type == G_TYPE_STRING) ? "a string" : "an integer");
+  return FALSE;
+}
+
+// Function to replace a string setting with a config file entry
+static gboolean
+config_get_string (JsonObject * root, const gchar * key, gchar ** value)
+{
+  JsonNode *node = NULL;
+
+  if (!config_get_value (root, key, G_TYPE_STRING, &node))
+    return FALSE;
+
+  if (node != NULL) {
+    g_free (*value);
+    *value = g_strdup (json_node_get_string (node));
+  }
+  return TRUE;
+}
+
+// Function to replace an integer setting with a config file entry
+static gboolean
+config_get_int (JsonObject * root, const gchar * key, gint * value)
+{
+  JsonNode *node = NULL;
+  gint64 number = 0;
+
+  if (!config_get_value (root, key, G_TYPE_INT64, &node))
+    return FALSE;
+
+  if (node == NULL)
+    return TRUE;
+
+  number = json_node_get_int (node);
+  if (number < G_MININT || number > G_MAXINT) {
+    g_printerr ("\n Config entry \"%s\" is out of range!\n", key);
+    return FALSE;
+  }
+
+  *value = (gint) number;
+  return TRUE;
+}
+
+// Function to replace a boolean setting with a config file entry, which
+// can be a JSON boolean or a "TRUE"/"FALSE" string like in other configs
+static gboolean
+config_get_boolean (JsonObject * root, const gchar * key, gboolean * value)
+{
+  JsonNode *node = json_object_get_member (root, key);
+  const gchar *string = NULL;
+
+  if (node == NULL)
+    return TRUE;
+
+  if (JSON_NODE_HOLDS_VALUE (node) &&
+      json_node_get_value_type (node) == G_TYPE_BOOLEAN) {
+    *value = json_node_get_boolean (node);
+    return TRUE;
+  }
+
+  if (JSON_NODE_HOLDS_VALUE (node) &&
+      json_node_get_value_type (node) == G_TYPE_STRING) {
+    string = json_node_get_string (node);
+
+    if (g_ascii_strcasecmp (string, "TRUE") == 0 ||
+        g_ascii_strcasecmp (string, "FALSE") == 0) {
+      *value = g_ascii_strcasecmp (string, "TRUE") == 0;
+      return TRUE;
+    }
+  }
+
+  g_printerr ("\n Config entry \"%s\" is not a boolean!\n", key);
+  return FALSE;
+}
+
+// Function to read the application settings from a JSON config file.
+// Entries use the same names as the command line options. The file is
+// read before the command line is parsed, so options given on the
+// command line override its entries.
+static gboolean
+parse_config_file (GstAppSinkContext * appctx, const gchar * path)
+{
+  JsonParser *parser = json_parser_new ();
+  JsonObject *root = NULL;
+  GError *error = NULL;
+  gboolean valid = TRUE;
+
+  if (!json_parser_load_from_file (parser, path, &error)) {
+    g_printerr ("\n Failed to parse config file %s: %s\n", path,
+        GST_STR_NULL (error->message));
+    g_clear_error (&error);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  if (!JSON_NODE_HOLDS_OBJECT (json_parser_get_root (parser))) {
+    g_printerr ("\n Config file %s is not a JSON object!\n", path);
+    g_object_unref (parser);
+    return FALSE;
+  }
+
+  root = json_node_get_object (json_parser_get_root (parser));
+
+  valid &= config_get_string (root, "pipeline", &appctx->pipeline_desc);
+  valid &= config_get_string (root, "appsink-name", &appctx->appsink_name);
+  valid &= config_get_int (root, "width", &appctx->width);
+  valid &= config_get_int (root, "height", &appctx->height);
+  valid &= config_get_string (root, "format", &appctx->format);
+  valid &= config_get_int (root, "framerate", &appctx->framerate);
+  valid &= config_get_boolean (root, "ml-preferred", &appctx->ml_preferred);
+  valid &= config_get_int (root, "ml-width", &appctx->ml_width);
+  valid &= config_get_int (root, "ml-height", &appctx->ml_height);
+  valid &= config_get_string (root, "ml-format", &appctx->ml_format);
+  valid &= config_get_boolean (root, "preprocess", &appctx->preprocess);
+  valid &= config_get_string (root, "tensor-layout", &appctx->tensor_layout);
+  valid &= config_get_string (root, "tensor-type", &appctx->tensor_type);
+  valid &= config_get_int (root, "pool-size", &appctx->pool_size);
+  valid &= config_get_boolean (root, "dmabuf-pool", &appctx->dmabuf_pool);
+  valid &= config_get_int (root, "max-buffers", &appctx->max_buffers);
+  valid &= config_get_boolean (root, "drop", &appctx->drop);
+  valid &= config_get_boolean (root, "sync", &appctx->sync);
+  valid &= config_get_boolean (root, "qos", &appctx->qos);
+  valid &= config_get_int (root, "queue-size", &appctx->queue_size);
+  valid &= config_get_int (root, "stall-timeout", &appctx->stall_timeout);
+  valid &= config_get_string (root, "model", &appctx->model);
+  valid &= config_get_string (root, "qnn-backend", &appctx->qnn_backend);
+  valid &= config_get_string (root, "yolo-model-type",
+      &appctx->yolo_model_type);
+  valid &= config_get_string (root, "pose-settings", &appctx->pose_settings);
+  valid &= config_get_boolean (root, "segmentation", &appctx->segmentation);
+  valid &= config_get_int (root, "seg-alpha", &appctx->seg_alpha);
+  valid &= config_get_int (root, "seg-threads", &appctx->seg_threads);
+  valid &= config_get_string (root, "json-labels", &appctx->labels);
+  valid &= config_get_string (root, "constants", &appctx->constants);
+  valid &= config_get_int (root, "threshold", &appctx->threshold);
+  valid &= config_get_int (root, "nms-threshold", &appctx->nms_threshold);
+  valid &= config_get_string (root, "dump-file", &appctx->dump_file);
+  valid &= config_get_int (root, "dump-frames", &appctx->dump_frames);
+  valid &= config_get_string (root, "replay", &appctx->replay_file);
+  valid &= config_get_boolean (root, "replay-max-speed",
+      &appctx->replay_max_speed);
+
+  g_object_unref (parser);
+
+  if (!valid)
+    g_printerr ("\n Invalid config file %s\n", path);
+
+  return valid;
+}
+
+// Function to create the pipeline from a gst-launch description and
+// connect to the appsink found by name
+static gboolean
+create_pipe_from_description (GstAppSinkContext * appctx)
+{
+  GstElement *pipeline = NULL, *appsink = NULL;
+  GError *error = NULL;
+
+  g_print ("\n Creating pipeline: %s\n", appctx->pipeline_desc);
+
+  pipeline = gst_parse_launch (appctx->pipeline_desc, &error);
+  if (pipeline == NULL || error != NULL) {
+    g_printerr ("\n Failed to create pipeline from description: %s\n",
+        (error != NULL) ? GST_STR_NULL (error->message) : "unknown error");
+    g_clear_error (&error);
+    if (pipeline != NULL)
+      gst_object_unref (pipeline);
+    return FALSE;
+  }
+
+  // A description with a single element is not wrapped in a pipeline
+  if (!GST_IS_PIPELINE (pipeline)) {
+    g_printerr ("\n Pipeline description must contain more than one element!\n");
+    gst_object_unref (pipeline);
+    return FALSE;
+  }
+
+  appsink = gst_bin_get_by_name (GST_BIN (pipeline), appctx->appsink_name);
+  if (appsink == NULL) {
+    g_printerr ("\n No element named '%s' in the pipeline description!\n",
+        appctx->appsink_name);
+    gst_object_unref (pipeline);
+    return FALSE;
+  }
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (appsink),
+      "emit-signals") == NULL) {
+    g_printerr ("\n Element '%s' is not an appsink!\n", appctx->appsink_name);
+    gst_object_unref (appsink);
+    gst_object_unref (pipeline);
+    return FALSE;
+  }
+
+  // Queueing properties are taken from the description as written
+  g_object_set (G_OBJECT (appsink), "emit-signals", true, NULL);
+  g_signal_connect (appsink, "new-sample", G_CALLBACK (new_sample), appctx);
+  gst_object_unref (appsink);
+
+  // The elements are owned by the parsed pipeline, nothing to unlink later
+  appctx->plugins = NULL;
+  appctx->pipeline = pipeline;
+
+  g_print ("\n Pipeline created from description successfully\n");
+  return TRUE;
+}
+
+// Function to feed the next frame of the replayed capture file into
+// appsrc. Frames are wrapped without a copy, the file stays mapped until
+// the application context is freed.
+static void
+replay_need_data (GstElement * appsrc, guint length, gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+  FrameCaptureHeader *header = appctx->replay->header;
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, (gsize) header->width *
+      header->height };
+  gint stride[GST_VIDEO_MAX_PLANES] = { (gint) header->width,
+      (gint) header->width };
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *buffer = NULL;
+  const guint8 *data = NULL;
+  guint64 pts = 0;
+
+  data = frame_capture_get_frame (appctx->replay, appctx->replay_index, &pts);
+  if (data == NULL) {
+    g_signal_emit_by_name (appsrc, "end-of-stream", &ret);
+    return;
+  }
+
+  buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+      (gpointer) data, header->frame_size, 0, header->frame_size, NULL, NULL);
+  gst_buffer_add_video_meta_full (buffer, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_FORMAT_NV12, header->width, header->height, 2, offset, stride);
+
+  // Timestamps restart at zero and keep the recorded frame intervals
+  if (!GST_CLOCK_TIME_IS_VALID (appctx->replay_base))
+    appctx->replay_base = pts;
+
+  if (GST_CLOCK_TIME_IS_VALID (pts) && pts >= appctx->replay_base)
+    GST_BUFFER_PTS (buffer) = pts - appctx->replay_base;
+  else if (header->fps_n > 0)
+    GST_BUFFER_PTS (buffer) = gst_util_uint64_scale (appctx->replay_index,
+        header->fps_d * GST_SECOND, header->fps_n);
+
+  if (header->fps_n > 0)
+    GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (GST_SECOND,
+        header->fps_d, header->fps_n);
+
+  appctx->replay_index++;
+  g_signal_emit_by_name (appsrc, "push-buffer", buffer, &ret);
+  gst_buffer_unref (buffer);
+}
+
+// Function to create the appsrc replaying the capture file
+static GstElement *
+create_replay_source (GstAppSinkContext * appctx)
+{
+  FrameCaptureHeader *header = appctx->replay->header;
+  GstElement *appsrc = NULL;
+  GstCaps *caps = NULL;
+
+  if ((appsrc = gst_element_factory_make ("appsrc", "replaysrc")) == NULL)
+    return NULL;
+
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "NV12",
+      "width", G_TYPE_INT, (gint) header->width,
+      "height", G_TYPE_INT, (gint) header->height,
+      "framerate", GST_TYPE_FRACTION, (gint) header->fps_n,
+      (gint) MAX (header->fps_d, 1), NULL);
+
+  g_object_set (G_OBJECT (appsrc), "caps", caps, "format", GST_FORMAT_TIME,
+      "is-live", FALSE, NULL);
+  gst_caps_unref (caps);
+
+  g_signal_connect (appsrc, "need-data", G_CALLBACK (replay_need_data),
+      appctx);
+  return appsrc;
+}
+
 // Function to create the pipeline and link all elements
 static gboolean
 create_pipe (GstAppSinkContext * appctx)
 {
   // Declare the elements of the pipeline
   GstElement *qtiqmmfsrc, *capsfilter, *appsink;
+  GstElement *vtransform = NULL, *ml_capsfilter = NULL, *queue = NULL;
   GstCaps *filtercaps;
+  GList *list = NULL;
   gboolean ret = FALSE;
   appctx->plugins = NULL;
 
-  // Create camera source and the element capability
-  qtiqmmfsrc = gst_element_factory_make ("qtiqmmfsrc", "qtiqmmfsrc");
-  capsfilter = gst_element_factory_make ("capsfilter", "capsfilter");
+  if (appctx->replay != NULL) {
+    // Frames come from the capture file instead of the camera
+    list = g_list_append (list, create_replay_source (appctx));
+  } else {
+    // Create camera source and the element capability
+    qtiqmmfsrc = gst_element_factory_make ("qtiqmmfsrc", "qtiqmmfsrc");
+    capsfilter = gst_element_factory_make ("capsfilter", "capsfilter");
+
+    filtercaps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        appctx->format, "width", G_TYPE_INT, appctx->width,
+        "height", G_TYPE_INT, appctx->height,
+        "framerate", GST_TYPE_FRACTION, appctx->framerate, 1, NULL);
+
+    if (capsfilter != NULL)
+      g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
+    gst_caps_unref (filtercaps);
+
+    list = g_list_append (list, qtiqmmfsrc);
+    list = g_list_append (list, capsfilter);
+  }
+
+  // In ML preferred mode the hardware converter delivers frames in the
+  // model input format and size, which preprocess_frame() only copies into
+  // the tensor layout and type instead of converting them on the CPU
+  if (appctx->ml_preferred) {
+    vtransform = gst_element_factory_make ("qtivtransform", "qtivtransform");
+    ml_capsfilter = gst_element_factory_make ("capsfilter", "ml_capsfilter");
 
-  filtercaps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "NV12",
-      "width", G_TYPE_INT, appctx->width, "height", G_TYPE_INT, appctx->height,
-      "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+    filtercaps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        appctx->ml_format, "width", G_TYPE_INT, appctx->ml_width,
+        "height", G_TYPE_INT, appctx->ml_height, NULL);
 
-     
-  g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
-  gst_caps_unref (filtercaps);
+    if (ml_capsfilter != NULL)
+      g_object_set (G_OBJECT (ml_capsfilter), "caps", filtercaps, NULL);
+    gst_caps_unref (filtercaps);
+
+    list = g_list_append (list, vtransform);
+    list = g_list_append (list, ml_capsfilter);
+  }
+
+  // Leaky queue decouples the camera from the processing in new_sample and
+  // drops the oldest frames instead of building up latency
+  if (appctx->queue_size > 0) {
+    queue = gst_element_factory_make ("queue", "queue");
+
+    if (queue != NULL)
+      g_object_set (G_OBJECT (queue), "max-size-buffers", appctx->queue_size,
+          "max-size-bytes", 0, "max-size-time", (guint64) 0,
+          "leaky", 2 /* downstream */, NULL);
+
+    list = g_list_append (list, queue);
+  }
 
   // creating the appsink element and setting the properties
   appsink = gst_element_factory_make ("appsink", "appsink");
-  g_object_set (G_OBJECT (appsink), "name", "sink", NULL);
-  g_object_set (G_OBJECT (appsink), "emit-signals", true, NULL);
+  if (appsink != NULL) {
+    g_object_set (G_OBJECT (appsink), "name", "sink", NULL);
+    g_object_set (G_OBJECT (appsink), "emit-signals", true, NULL);
+    g_object_set (G_OBJECT (appsink), "max-buffers", appctx->max_buffers,
+        "drop", appctx->drop, "sync", appctx->sync, "qos", appctx->qos, NULL);
+  }
+
+  list = g_list_append (list, appsink);
+
+  // Check that all elements could be created
+  for (GList *l = list; l != NULL; l = l->next) {
+    if (l->data == NULL) {
+      g_printerr ("\n One or more elements could not be created. Exiting.\n");
+      for (l = list; l != NULL; l = l->next)
+        if (l->data != NULL)
+          gst_object_unref (GST_OBJECT (l->data));
+      g_list_free (list);
+      return FALSE;
+    }
+  }
 
-  gst_bin_add_many (GST_BIN (appctx->pipeline), qtiqmmfsrc, capsfilter,
-      appsink, NULL);
+  for (GList *l = list; l != NULL; l = l->next)
+    gst_bin_add (GST_BIN (appctx->pipeline), GST_ELEMENT (l->data));
 
   g_print ("\n Linking appsink elements ..\n");
 
-  ret = gst_element_link_many (qtiqmmfsrc, capsfilter, appsink, NULL);
+  ret = TRUE;
+  for (GList *l = list; ret && l->next != NULL; l = l->next)
+    ret = gst_element_link (GST_ELEMENT (l->data), GST_ELEMENT (l->next->data));
+
   if (!ret) {
     g_printerr ("\n Pipeline elements cannot be linked. Exiting.\n");
-    gst_bin_remove_many (GST_BIN (appctx->pipeline), qtiqmmfsrc,
-        capsfilter, appsink, NULL);
+    for (GList *l = list; l != NULL; l = l->next)
+      gst_bin_remove (GST_BIN (appctx->pipeline), GST_ELEMENT (l->data));
+    g_list_free (list);
     return FALSE;
   }
 
@@ -196,12 +1241,11 @@ create_pipe (GstAppSinkContext * appctx)
   GstElement *element = gst_bin_get_by_name (GST_BIN (appctx->pipeline), "sink");
 
   // signal connect for the new_sample
-  g_signal_connect (element, "new-sample", G_CALLBACK (new_sample), NULL);
+  g_signal_connect (element, "new-sample", G_CALLBACK (new_sample), appctx);
+  gst_object_unref (element);
 
-  // Append all elements to the plugins list
-  appctx->plugins = g_list_append (appctx->plugins, qtiqmmfsrc);
-  appctx->plugins = g_list_append (appctx->plugins, capsfilter);
-  appctx->plugins = g_list_append (appctx->plugins, appsink);
+  // Keep all elements in the plugins list
+  appctx->plugins = list;
 
   g_print ("\n All elements are linked successfully\n");
 
@@ -209,6 +1253,209 @@ create_pipe (GstAppSinkContext * appctx)
   return TRUE;
 }
 
+// Probe on the capsfilter src pad detecting the switch point of a
+// resolution change: the CAPS event with the requested size, then the
+// timestamp of the first buffer behind it
+static GstPadProbeReturn
+resolution_switch_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    if (!appctx->switch_caps_seen)
+      return GST_PAD_PROBE_OK;
+
+    // After a timeout the probe is removed by abort_resolution_switch()
+    appctx->switch_pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+    if (!g_atomic_int_compare_and_exchange (&appctx->switch_pending, 1, 2))
+      return GST_PAD_PROBE_OK;
+
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_CAPS) {
+    GstCaps *caps = NULL;
+    GstStructure *structure = NULL;
+    gint width = 0, height = 0;
+
+    gst_event_parse_caps (GST_PAD_PROBE_INFO_EVENT (info), &caps);
+    structure = gst_caps_get_structure (caps, 0);
+    gst_structure_get_int (structure, "width", &width);
+    gst_structure_get_int (structure, "height", &height);
+
+    if (width == appctx->switch_width && height == appctx->switch_height) {
+      appctx->switch_caps_time = g_get_monotonic_time ();
+      appctx->switch_caps_seen = TRUE;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+// Function to give up a resolution switch that cannot complete, e.g. when
+// the source rounds or rejects the requested size, so the next switch can
+// be requested. Runs on the main loop like change_resolution().
+static void
+abort_resolution_switch (GstAppSinkContext * appctx, const gchar * reason)
+{
+  if (appctx->switch_timeout_id != 0) {
+    g_source_remove (appctx->switch_timeout_id);
+    appctx->switch_timeout_id = 0;
+  }
+
+  // Before the new caps the probe is still installed
+  if (g_atomic_int_compare_and_exchange (&appctx->switch_pending, 1, 0))
+    gst_pad_remove_probe (appctx->switch_pad, appctx->switch_probe_id);
+  else if (!g_atomic_int_compare_and_exchange (&appctx->switch_pending, 2, 0))
+    return;
+
+  g_printerr ("\n Resolution switch to %dx%d failed: %s!\n",
+      appctx->switch_width, appctx->switch_height, reason);
+}
+
+// Function to abort a resolution switch that did not complete in time
+static gboolean
+resolution_switch_timeout (gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+
+  appctx->switch_timeout_id = 0;
+  abort_resolution_switch (appctx, "no frame with the requested size "
+      "arrived in time");
+  return G_SOURCE_REMOVE;
+}
+
+// Function to abort a resolution switch when the new caps could not be
+// negotiated. The error itself is reported by error_cb().
+static void
+resolution_switch_error_cb (GstBus * bus, GstMessage * message,
+    gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+  const GstStructure *details = NULL;
+  GError *error = NULL;
+  gint flow = GST_FLOW_OK;
+
+  gst_message_parse_error (message, &error, NULL);
+  gst_message_parse_error_details (message, &details);
+
+  if (g_error_matches (error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION) ||
+      (details != NULL &&
+          gst_structure_get_int (details, "flow-return", &flow) &&
+          flow == GST_FLOW_NOT_NEGOTIATED))
+    abort_resolution_switch (appctx, "caps not negotiated");
+
+  g_error_free (error);
+}
+
+// Function to change the camera resolution while the pipeline is playing.
+// Updating the capsfilter caps makes the camera renegotiate its output
+// without tearing down the pipeline. Requesting the current size is a
+// no-op, a switch without a frame of the new size in time is aborted.
+static gboolean
+change_resolution (GstAppSinkContext * appctx, gint width, gint height)
+{
+  GstElement *capsfilter = NULL;
+  GstCaps *caps = NULL;
+  GstPad *pad = NULL;
+  gint current_width = 0, current_height = 0;
+
+  if (g_atomic_int_get (&appctx->switch_pending)) {
+    g_printerr ("\n A resolution switch is still in progress!\n");
+    return FALSE;
+  }
+
+  capsfilter = gst_bin_get_by_name (GST_BIN (appctx->pipeline), "capsfilter");
+  if (capsfilter == NULL) {
+    g_printerr ("\n No element named 'capsfilter' in the pipeline!\n");
+    return FALSE;
+  }
+
+  // Same caps do not send a new CAPS event, the probe would never fire
+  pad = gst_element_get_static_pad (capsfilter, "src");
+  if ((caps = gst_pad_get_current_caps (pad)) != NULL) {
+    GstStructure *structure = gst_caps_get_structure (caps, 0);
+
+    gst_structure_get_int (structure, "width", &current_width);
+    gst_structure_get_int (structure, "height", &current_height);
+    gst_caps_unref (caps);
+  }
+
+  if (current_width == width && current_height == height) {
+    g_print ("\n Resolution is already %dx%d\n", width, height);
+    gst_object_unref (pad);
+    gst_object_unref (capsfilter);
+    return TRUE;
+  }
+
+  // A finished switch leaves its timeout behind
+  if (appctx->switch_timeout_id != 0) {
+    g_source_remove (appctx->switch_timeout_id);
+    appctx->switch_timeout_id = 0;
+  }
+
+  g_object_get (G_OBJECT (capsfilter), "caps", &caps, NULL);
+  caps = (caps != NULL) ? gst_caps_make_writable (caps) :
+      gst_caps_new_empty_simple ("video/x-raw");
+  gst_caps_set_simple (caps, "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height, NULL);
+
+  appctx->switch_width = width;
+  appctx->switch_height = height;
+  appctx->switch_frames = 0;
+  appctx->switch_caps_seen = FALSE;
+  appctx->switch_pts = GST_CLOCK_TIME_NONE;
+  appctx->switch_start = g_get_monotonic_time ();
+  g_atomic_int_set (&appctx->switch_pending, 1);
+
+  // Removes itself after the first buffer with the new caps, otherwise
+  // resolution_switch_timeout() removes it
+  if (appctx->switch_pad != NULL)
+    gst_object_unref (appctx->switch_pad);
+  appctx->switch_pad = pad;
+  appctx->switch_probe_id = gst_pad_add_probe (pad,
+      (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER |
+          GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM), resolution_switch_probe,
+      appctx, NULL);
+  appctx->switch_timeout_id = g_timeout_add (RESOLUTION_SWITCH_TIMEOUT,
+      resolution_switch_timeout, appctx);
+
+  g_print ("\n Switching resolution to %dx%d ...\n", width, height);
+  g_object_set (G_OBJECT (capsfilter), "caps", caps, NULL);
+
+  gst_caps_unref (caps);
+  gst_object_unref (capsfilter);
+  return TRUE;
+}
+
+// Function to handle runtime commands typed on stdin
+static gboolean
+handle_stdin_command (GIOChannel * source, GIOCondition condition,
+    gpointer userdata)
+{
+  GstAppSinkContext *appctx = (GstAppSinkContext *) userdata;
+  gchar *line = NULL;
+  gint width = 0, height = 0;
+  GIOStatus status;
+
+  status = g_io_channel_read_line (source, &line, NULL, NULL, NULL);
+  if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR) {
+    appctx->stdin_watch_id = 0;
+    return FALSE;
+  }
+
+  if (line != NULL && sscanf (line, "%dx%d", &width, &height) == 2 &&
+      width > 0 && height > 0)
+    change_resolution (appctx, width, height);
+  else if (line != NULL && g_strstrip (line)[0] != '\0')
+    g_print ("\n Unknown command, enter <width>x<height> to switch the "
+        "camera resolution\n");
+
+  g_free (line);
+  return TRUE;
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -233,9 +1480,150 @@ main (gint argc, gchar *argv[])
        "image width"},
       {"height", 'h', 0, G_OPTION_ARG_INT, &appctx->height, "height",
        "image height"},
+      {"format", 'f', 0, G_OPTION_ARG_STRING, &appctx->format,
+       "camera output pixel format (default: " DEFAULT_FORMAT ")", "format"},
+      {"framerate", 'r', 0, G_OPTION_ARG_INT, &appctx->framerate,
+       "camera framerate in frames per second", "fps"},
+      {"ml-preferred", 'm', 0, G_OPTION_ARG_NONE, &appctx->ml_preferred,
+       "convert frames in hardware to the ML model input format and size, "
+       "then into the --preprocess tensor without a CPU color conversion",
+       NULL},
+      {"ml-width", 0, 0, G_OPTION_ARG_INT, &appctx->ml_width,
+       "model input width used with --ml-preferred and --preprocess", "width"},
+      {"ml-height", 0, 0, G_OPTION_ARG_INT, &appctx->ml_height,
+       "model input height used with --ml-preferred and --preprocess",
+       "height"},
+      {"ml-format", 0, 0, G_OPTION_ARG_STRING, &appctx->ml_format,
+       "model input pixel format, RGB or BGR (default: " DEFAULT_ML_FORMAT
+       ")", "format"},
+      {"preprocess", 'p', 0, G_OPTION_ARG_NONE, &appctx->preprocess,
+       "convert NV12 frames, or the RGB/BGR frames of --ml-preferred, on the "
+       "CPU into a --ml-width x --ml-height tensor in --ml-format (RGB or "
+       "BGR) order", NULL},
+      {"tensor-layout", 0, 0, G_OPTION_ARG_STRING, &appctx->tensor_layout,
+       "tensor layout used with --preprocess: nhwc or nchw (default: nhwc)",
+       "layout"},
+      {"tensor-type", 0, 0, G_OPTION_ARG_STRING, &appctx->tensor_type,
+       "tensor element type used with --preprocess: uint8 or float "
+       "(default: float)", "type"},
+      {"pool-size", 0, 0, G_OPTION_ARG_INT, &appctx->pool_size,
+       "number of pre-allocated tensor buffers used with --preprocess",
+       "count"},
+      {"dmabuf-pool", 0, 0, G_OPTION_ARG_NONE, &appctx->dmabuf_pool,
+       "allocate the tensor buffers from a DMA-BUF heap", NULL},
+      {"max-buffers", 0, 0, G_OPTION_ARG_INT, &appctx->max_buffers,
+       "maximum frames queued in appsink, 0 for unlimited (default: 1)",
+       "count"},
+      {"no-drop", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &appctx->drop,
+       "block upstream instead of dropping old frames when appsink is full",
+       NULL},
+      {"sync", 0, 0, G_OPTION_ARG_NONE, &appctx->sync,
+       "synchronize frames on the pipeline clock in appsink", NULL},
+      {"qos", 0, 0, G_OPTION_ARG_NONE, &appctx->qos,
+       "send QoS events upstream for late frames, requires --sync", NULL},
+      {"queue-size", 0, 0, G_OPTION_ARG_INT, &appctx->queue_size,
+       "frames held by the leaky queue before appsink, 0 to disable "
+       "(default: 2)", "count"},
+      {"config-file", 'c', 0, G_OPTION_ARG_FILENAME, &appctx->config_file,
+       "JSON config file with the options and/or a \"pipeline\" description, "
+       "options on the command line override its entries", "path"},
+      {"pipeline", 0, 0, G_OPTION_ARG_STRING, &appctx->pipeline_desc,
+       "gst-launch pipeline description with an appsink named \"sink\"",
+       "description"},
+      {"stall-timeout", 0, 0, G_OPTION_ARG_INT, &appctx->stall_timeout,
+       "report elements without buffers for this many ms and dump the "
+       "pipeline graph to $GST_DEBUG_DUMP_DOT_DIR, 0 to disable "
+       "(default: 0)", "ms"},
+      {"live-control", 'l', 0, G_OPTION_ARG_NONE, &appctx->live_control,
+       "read <width>x<height> commands from stdin to switch the camera "
+       "resolution while running", NULL},
+      {"model", 0, 0, G_OPTION_ARG_FILENAME, &appctx->model,
+       "run the ONNX model on every preprocessed frame, the tensor size, "
+       "layout and type are taken from the model input", "path"},
+      {"qnn-backend", 0, 0, G_OPTION_ARG_STRING, &appctx->qnn_backend,
+       "run the model with the QNN execution provider and this backend, "
+       "e.g. libQnnHtp.so (default: CPU execution provider)", "library"},
+      {"yolo-model-type", 0, 0, G_OPTION_ARG_STRING, &appctx->yolo_model_type,
+       "decode the --model outputs as detections of yolov5, yolov7, yolov8 "
+       "or yolox", "type"},
+      {"pose-settings", 0, 0, G_OPTION_ARG_FILENAME, &appctx->pose_settings,
+       "decode the --model output as pose keypoint heatmaps with the "
+       "confidence and skeleton of this settings file, e.g. "
+       "artifacts/json_labels/hrnet_pose_settings.json", "path"},
+      {"segmentation", 0, 0, G_OPTION_ARG_NONE, &appctx->segmentation,
+       "decode the --model output as semantic segmentation into a class "
+       "mask and an RGBA overlay of the frame", NULL},
+      {"seg-alpha", 0, 0, G_OPTION_ARG_INT, &appctx->seg_alpha,
+       "alpha of the segmentation overlay colors, -1 for the alpha of "
+       "--json-labels (default: -1)", "alpha"},
+      {"seg-threads", 0, 0, G_OPTION_ARG_INT, &appctx->seg_threads,
+       "threads decoding the segmentation output, 0 for up to 4 "
+       "(default: 0)", "count"},
+      {"json-labels", 0, 0, G_OPTION_ARG_FILENAME, &appctx->labels,
+       "JSON labels file with the id, color and label of every class, "
+       "e.g. artifacts/json_labels/yolov8.json", "path"},
+      {"constants", 0, 0, G_OPTION_ARG_STRING, &appctx->constants,
+       "q-offsets and q-scales of uint8 model outputs, e.g. "
+       "\"YOLOv8,q-offsets=<21.0, 0.0, 0.0>,q-scales=<3.05, 0.0038, 1.0>;\"",
+       "constants"},
+      {"threshold", 0, 0, G_OPTION_ARG_INT, &appctx->threshold,
+       "minimum detection confidence in percent, pose keypoints use the "
+       "confidence of --pose-settings (default: 50)", "percent"},
+      {"nms-threshold", 0, 0, G_OPTION_ARG_INT, &appctx->nms_threshold,
+       "IoU in percent above which overlapping detections of a class are "
+       "suppressed (default: 45)", "percent"},
+      {"dump-file", 0, 0, G_OPTION_ARG_FILENAME, &appctx->dump_file,
+       "record the received NV12 frames into a capture file for --replay",
+       "path"},
+      {"dump-frames", 0, 0, G_OPTION_ARG_INT, &appctx->dump_frames,
+       "maximum number of frames recorded with --dump-file (default: 300)",
+       "count"},
+      {"replay", 0, 0, G_OPTION_ARG_FILENAME, &appctx->replay_file,
+       "feed the frames of a capture file instead of the camera at the "
+       "recorded pace", "path"},
+      {"replay-max-speed", 0, 0, G_OPTION_ARG_NONE, &appctx->replay_max_speed,
+       "replay as fast as possible and process every frame", NULL},
       {NULL}
   };
 
+  // Load the config file first, so the command line options parsed below
+  // override its entries
+  if ((ctx = g_option_context_new (NULL)) != NULL) {
+    gchar *config_file = NULL;
+    GOptionEntry config_entries[] = {
+        {"config-file", 'c', 0, G_OPTION_ARG_FILENAME, &config_file, NULL,
+         NULL},
+        {NULL}
+    };
+    gchar **args = g_strdupv (argv);
+    gboolean success = FALSE;
+    GError *error = NULL;
+
+    g_option_context_set_help_enabled (ctx, FALSE);
+    g_option_context_set_ignore_unknown_options (ctx, TRUE);
+    g_option_context_add_main_entries (ctx, config_entries, NULL);
+
+    success = g_option_context_parse_strv (ctx, &args, &error);
+    g_option_context_free (ctx);
+    g_strfreev (args);
+
+    if (!success) {
+      g_printerr ("\n Failed to parse command line options: %s!\n",
+          (error != NULL) ? GST_STR_NULL (error->message) : "unknown error");
+      g_clear_error (&error);
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    success = config_file == NULL || parse_config_file (appctx, config_file);
+    g_free (config_file);
+
+    if (!success) {
+      gst_app_context_free (appctx);
+      return -1;
+    }
+  }
+
   // Parse command line entries.
   if ((ctx = g_option_context_new ("gst-appsink-example")) != NULL) {
     g_option_context_set_summary (ctx, GST_APP_SUMMARY);
@@ -262,22 +1650,216 @@ main (gint argc, gchar *argv[])
     return -1;
   }
 
+  // Fall back to the defaults for options which were not provided
+  if (appctx->appsink_name == NULL)
+    appctx->appsink_name = g_strdup (DEFAULT_APPSINK_NAME);
+  if (appctx->format == NULL)
+    appctx->format = g_strdup (DEFAULT_FORMAT);
+  if (appctx->ml_format == NULL)
+    appctx->ml_format = g_strdup (DEFAULT_ML_FORMAT);
+  if (appctx->tensor_layout == NULL)
+    appctx->tensor_layout = g_strdup ("nhwc");
+  if (appctx->tensor_type == NULL)
+    appctx->tensor_type = g_strdup ("float");
+
+  if (appctx->replay_file != NULL) {
+    if (appctx->pipeline_desc != NULL || appctx->ml_preferred) {
+      g_printerr ("\n --replay can not be used with --pipeline or "
+          "--ml-preferred!\n");
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    if ((appctx->replay = frame_capture_open (appctx->replay_file)) == NULL) {
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    g_print ("\n Replaying %" G_GUINT64_FORMAT " %ux%u frames from %s\n",
+        appctx->replay->header->n_frames, appctx->replay->header->width,
+        appctx->replay->header->height, appctx->replay_file);
+
+    // Max speed blocks upstream instead of dropping frames, so every run
+    // processes the same frames. Otherwise appsink keeps the recorded pace.
+    if (appctx->replay_max_speed) {
+      appctx->sync = FALSE;
+      appctx->drop = FALSE;
+      appctx->queue_size = 0;
+    } else {
+      appctx->sync = TRUE;
+    }
+  } else {
+    appctx->replay_max_speed = FALSE;
+  }
+
+  // The model input defines the tensor the frames are preprocessed into
+#ifndef HELLO_QIM_WITH_ORT
+  if (appctx->model != NULL) {
+    g_printerr ("\n --model needs ONNX Runtime, rebuild with WITH_ORT=1!\n");
+    gst_app_context_free (appctx);
+    return -1;
+  }
+#else
+  if (appctx->model != NULL) {
+    MLInference *inf = ml_inference_new (appctx->model, appctx->qnn_backend);
+
+    if (inf == NULL) {
+      g_printerr ("\n Failed to create the inference stage!\n");
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    appctx->inference = inf;
+
+    if ((appctx->yolo_model_type != NULL) + (appctx->pose_settings != NULL) +
+        (appctx->segmentation != FALSE) > 1) {
+      g_printerr ("\n --yolo-model-type, --pose-settings and --segmentation "
+          "are mutually exclusive!\n");
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    if (appctx->yolo_model_type != NULL) {
+      YoloVersion version;
+      YoloDecoder *dec = NULL;
+
+      if (!yolo_version_from_string (appctx->yolo_model_type, &version)) {
+        g_printerr ("\n Unknown YOLO model type %s!\n",
+            appctx->yolo_model_type);
+        gst_app_context_free (appctx);
+        return -1;
+      }
+
+      dec = yolo_decoder_new (version, inf->width, inf->height);
+      dec->threshold = CLAMP (appctx->threshold, 0, 100) / 100.0F;
+      dec->iou_threshold = CLAMP (appctx->nms_threshold, 0, 100) / 100.0F;
+
+      if ((appctx->labels != NULL &&
+              !yolo_decoder_load_labels (dec, appctx->labels)) ||
+          (appctx->constants != NULL &&
+              !yolo_decoder_set_constants (dec, appctx->constants))) {
+        yolo_decoder_free (dec);
+        gst_app_context_free (appctx);
+        return -1;
+      }
+
+      ml_inference_set_yolo_decoder (inf, dec);
+    }
+
+    if (appctx->pose_settings != NULL) {
+      PoseDecoder *dec = pose_decoder_new (inf->width, inf->height);
+
+      if (!pose_decoder_load_settings (dec, appctx->pose_settings) ||
+          (appctx->labels != NULL &&
+              !pose_decoder_load_labels (dec, appctx->labels)) ||
+          (appctx->constants != NULL &&
+              !pose_decoder_set_constants (dec, appctx->constants))) {
+        pose_decoder_free (dec);
+        gst_app_context_free (appctx);
+        return -1;
+      }
+
+      g_print ("\n Pose skeleton with %d links, confidence %.2f\n",
+          dec->n_links, dec->threshold);
+      ml_inference_set_pose_decoder (inf, dec);
+    }
+
+    if (appctx->segmentation) {
+      SegDecoder *dec = seg_decoder_new (appctx->seg_threads);
+
+      if (appctx->labels != NULL &&
+          !seg_decoder_load_labels (dec, appctx->labels)) {
+        seg_decoder_free (dec);
+        gst_app_context_free (appctx);
+        return -1;
+      }
+
+      seg_decoder_set_alpha (dec, appctx->seg_alpha);
+      g_print ("\n Segmentation on %d threads\n", dec->n_threads);
+      ml_inference_set_seg_decoder (inf, dec);
+    }
+
+    appctx->preprocess = TRUE;
+    appctx->ml_width = inf->width;
+    appctx->ml_height = inf->height;
+    g_free (appctx->tensor_layout);
+    appctx->tensor_layout = g_strdup (
+        (inf->layout == ML_LAYOUT_NCHW) ? "nchw" : "nhwc");
+    g_free (appctx->tensor_type);
+    appctx->tensor_type = g_strdup (
+        (inf->type == ML_TYPE_UINT8) ? "uint8" : "float");
+
+    // The stage wraps every tensor of the pool in an input value once
+    if (appctx->pool_size <= 0) {
+      g_printerr ("\n Invalid pool size %d!\n", appctx->pool_size);
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    appctx->tensor_pool = frame_pool_new (inf->input_size, appctx->pool_size,
+        appctx->dmabuf_pool);
+    if (appctx->tensor_pool == NULL ||
+        !ml_inference_set_pool (inf, appctx->tensor_pool)) {
+      g_printerr ("\n Failed to allocate the tensor pool!\n");
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    // Replay at max speed preprocesses on the streaming thread, which
+    // blocks on the tensor pool and so never drops a frame
+    if (!appctx->replay_max_speed) {
+      appctx->preprocess_queue = g_async_queue_new ();
+      appctx->preprocess_thread = g_thread_new ("preprocess",
+          preprocess_thread_func, appctx);
+    }
+  }
+#endif
+
+  // The hardware converted frames are made into tensors without a CPU
+  // color conversion, which needs packed RGB or BGR frames
+  if (appctx->ml_preferred) {
+    if (g_ascii_strcasecmp (appctx->ml_format, "RGB") != 0 &&
+        g_ascii_strcasecmp (appctx->ml_format, "BGR") != 0) {
+      g_printerr ("\n --ml-preferred needs --ml-format RGB or BGR!\n");
+      gst_app_context_free (appctx);
+      return -1;
+    }
+
+    appctx->preprocess = TRUE;
+  }
+
+  if (appctx->framerate <= 0 || appctx->ml_width <= 0 ||
+      appctx->ml_height <= 0 || appctx->pool_size <= 0 ||
+      appctx->max_buffers < 0 || appctx->queue_size < 0 ||
+      appctx->stall_timeout < 0 || appctx->dump_frames < 0) {
+    g_printerr ("\n Invalid framerate, ML input resolution or queue sizes!\n");
+    gst_app_context_free (appctx);
+    return -1;
+  }
+
   // Initialize GST library.
   gst_init (&argc, &argv);
 
   g_set_prgname ("gst-appsink-example");
 
-  // Create the pipeline
-  pipeline = gst_pipeline_new ("pipeline");
-  if (!pipeline) {
-    g_printerr ("\n failed to create pipeline.\n");
-    return -1;
-  }
+  if (appctx->pipeline_desc != NULL) {
+    // Build the pipeline from the description
+    ret = create_pipe_from_description (appctx);
+    pipeline = appctx->pipeline;
+  } else {
+    // Create the pipeline
+    pipeline = gst_pipeline_new ("pipeline");
+    if (!pipeline) {
+      g_printerr ("\n failed to create pipeline.\n");
+      return -1;
+    }
 
-  appctx->pipeline = pipeline;
+    appctx->pipeline = pipeline;
+
+    // Build the pipeline
+    ret = create_pipe (appctx);
+  }
 
-  // Build the pipeline
-  ret = create_pipe (appctx);
   if (!ret) {
     g_printerr ("\n failed to create GST pipe.\n");
     gst_app_context_free (appctx);
@@ -306,9 +1888,30 @@ main (gint argc, gchar *argv[])
       pipeline);
   g_signal_connect (bus, "message::warning", G_CALLBACK (warning_cb), NULL);
   g_signal_connect (bus, "message::error", G_CALLBACK (error_cb), mloop);
+  g_signal_connect (bus, "message::error",
+      G_CALLBACK (resolution_switch_error_cb), appctx);
   g_signal_connect (bus, "message::eos", G_CALLBACK (eos_cb), mloop);
+  g_signal_connect (bus, "message::latency", G_CALLBACK (latency_cb),
+      pipeline);
+  g_signal_connect (bus, "message::qos", G_CALLBACK (qos_cb), NULL);
   gst_object_unref (bus);
 
+  // Watch the buffer flow of all elements for silent stalls
+  if (appctx->stall_timeout > 0)
+    appctx->watchdog = gst_pipeline_watchdog_new (pipeline,
+        appctx->stall_timeout);
+
+  // Accept resolution switch commands while the pipeline is running
+  if (appctx->live_control) {
+    GIOChannel *channel = g_io_channel_unix_new (STDIN_FILENO);
+
+    appctx->stdin_watch_id = g_io_add_watch (channel,
+        (GIOCondition) (G_IO_IN | G_IO_HUP | G_IO_ERR), handle_stdin_command,
+        appctx);
+    g_io_channel_unref (channel);
+    g_print ("\n Enter <width>x<height> to switch the camera resolution\n");
+  }
+
   // Register function for handling interrupt signals with the main loop
   intrpt_watch_id = g_unix_signal_add (SIGINT, handle_interrupt_signal, appctx);
 
@@ -337,10 +1940,29 @@ main (gint argc, gchar *argv[])
   // Remove the Interrupt signal Handler
   g_source_remove (intrpt_watch_id);
 
+  if (appctx->stdin_watch_id != 0)
+    g_source_remove (appctx->stdin_watch_id);
+
+  if (appctx->switch_timeout_id != 0)
+    g_source_remove (appctx->switch_timeout_id);
+
   // set the pipeline to the NULL state
   g_print ("\n Setting pipeline to NULL state ...\n");
   gst_element_set_state (appctx->pipeline, GST_STATE_NULL);
 
+  if (appctx->replay != NULL && appctx->frames_received > 1)
+    g_print ("\n Replay: %" G_GUINT64_FORMAT " frames received in %.2f s, "
+        "%.2f fps\n", appctx->frames_received,
+        (appctx->last_frame_time - appctx->first_frame_time) / 1e6,
+        (appctx->frames_received - 1) * 1e6 /
+        MAX (appctx->last_frame_time - appctx->first_frame_time, 1));
+
+  if (appctx->watchdog != NULL) {
+    gst_pipeline_watchdog_print_stats (appctx->watchdog);
+    gst_pipeline_watchdog_free (appctx->watchdog);
+    appctx->watchdog = NULL;
+  }
+
   // free the application context
   g_print ("\n Free the Application context\n");
   gst_app_context_free (appctx);
@@ -0,0 +1,125 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Helpers shared by the command line tools of the applications: timing,
+// tensor binaries, synthetic data and option parsing.
+
+#ifndef TOOL_UTILS_H
+#define TOOL_UTILS_H
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Largest count ParseCount accepts
+#define TOOL_MAX_COUNT (1ul << 24)
+
+// Largest size of a ParseList list
+#define TOOL_MAX_LIST_SIZE 4096
+
+// ---------------------------------------------------------------------------
+// Monotonic wall-clock time in milliseconds.
+// ---------------------------------------------------------------------------
+static inline double NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// ---------------------------------------------------------------------------
+// Read count floats of a tensor binary, starting at float offset. Returns 1
+// on success.
+// ---------------------------------------------------------------------------
+static inline int ReadTensor(const char* path, float* data, size_t count, size_t offset) {
+  FILE* file = fopen(path, "rb");
+  int   ok   = 0;
+
+  if (!file) {
+    fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+    return 0;
+  }
+
+  ok = fseek(file, (long)(offset * sizeof(float)), SEEK_SET) == 0 &&
+       fread(data, sizeof(float), count, file) == count;
+  if (!ok) fprintf(stderr, "'%s' has less than %zu floats.\n", path, offset + count);
+  fclose(file);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Deterministic normal distributed values for synthetic data.
+// ---------------------------------------------------------------------------
+static inline float RandomNormal(uint64_t* state) {
+  double u1, u2;
+
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  u1     = ((*state >> 11) + 1.0) / 9007199254740993.0;
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  u2     = (*state >> 11) / 9007199254740992.0;
+  return (float)(sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2));
+}
+
+// ---------------------------------------------------------------------------
+// Parse the count of a flag, from min up to TOOL_MAX_COUNT. Returns 1 on
+// success.
+// ---------------------------------------------------------------------------
+static inline int ParseCount(const char* flag, const char* value, uint32_t min, uint32_t* out) {
+  char*         end = NULL;
+  unsigned long n   = value ? strtoul(value, &end, 10) : 0;
+
+  if (!value || *value == '\0' || *end != '\0' || n < min || n > TOOL_MAX_COUNT) {
+    fprintf(stderr, "%s expects a count of %u to %lu, got '%s'.\n", flag, min, TOOL_MAX_COUNT,
+            value ? value : "");
+    return 0;
+  }
+  *out = (uint32_t)n;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Parse a finite number of a flag, from min to max. Returns 1 on success.
+// ---------------------------------------------------------------------------
+static inline int ParseFloat(const char* flag, const char* value, float min, float max, float* out) {
+  char* end = NULL;
+  float f   = value ? strtof(value, &end) : 0.0f;
+
+  if (!value || end == value || *end != '\0' || !isfinite(f) || f < min || f > max) {
+    fprintf(stderr, "%s expects a number from %g to %g, got '%s'.\n", flag, min, max,
+            value ? value : "");
+    return 0;
+  }
+  *out = f;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Parse a comma separated list of up to max_sizes positive sizes. Returns
+// the number of sizes, 0 on error.
+// ---------------------------------------------------------------------------
+static inline int ParseList(const char* flag, const char* value, int* sizes, int max_sizes) {
+  int         count = 0;
+  const char* p     = value;
+
+  while (p && *p && count < max_sizes) {
+    char* end = NULL;
+    long  n   = strtol(p, &end, 10);
+
+    if (end == p || n <= 0 || n > TOOL_MAX_LIST_SIZE) break;
+    sizes[count++] = (int)n;
+    p = (*end == ',') ? end + 1 : end;
+    if (*end != ',' && *end != '\0') break;
+  }
+  if (count == 0 || (p && *p)) {
+    fprintf(stderr, "%s expects a list of sizes, got '%s'.\n", flag, value ? value : "");
+    return 0;
+  }
+  return count;
+}
+
+#endif  // TOOL_UTILS_H
@@ -0,0 +1,354 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// 3D morphable face model: a mesh is the mean face plus a linear
+// combination of basis shapes, weighted by the coefficients a face
+// landmark model predicts:
+//
+//   mesh[r] = mean[r] + sum_k basis[r][k] * coeffs[k]
+//
+// The blobs of facemap_3dmm_settings.json are raw little endian floats:
+//
+//   meanFace.bin     float mean[N], N = 3 * vertices, x y z per vertex
+//   blendShape.bin   float basis[N][K], one row of K weights per value
+//
+// Several bases, e.g. shape and expression, act as one basis of their
+// concatenated coefficients. The blobs are memory mapped and repacked once
+// into panels of FACE3DMM_PANEL rows stored coefficient major, so that one
+// coefficient of a panel is one aligned vector load:
+//
+//   panels[N / FACE3DMM_PANEL][K][FACE3DMM_PANEL], zero padded rows
+//
+// A panel is FACE3DMM_PANEL * K floats and stays in L1 while every face
+// of a batch passes over it, so the basis is read from memory once per
+// batch. Faces are reconstructed in blocks of FACE3DMM_FACE_BLOCK sharing
+// every panel load, with a kernel of its own for the remaining faces. The
+// kernels use NEON on ARM, SSE2 on x86 and plain C elsewhere.
+
+#ifndef FACE3DMM_H
+#define FACE3DMM_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FACE3DMM_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FACE3DMM_SSE2 1
+#endif
+
+#define FACE3DMM_PANEL       8
+#define FACE3DMM_FACE_BLOCK  4
+#define FACE3DMM_ALIGN       64
+#define FACE3DMM_MAX_BASES   4
+
+// ---------------------------------------------------------------------------
+// Model of num_values = 3 * vertices values and num_coeffs coefficients
+// ---------------------------------------------------------------------------
+typedef struct {
+  uint32_t num_values;
+  uint32_t num_coeffs;
+  uint32_t num_panels;
+  float*   mean;         // num_panels * FACE3DMM_PANEL, zero padded
+  float*   panels;
+} Face3dmm;
+
+static inline void Face3dmmClose(Face3dmm* model) {
+  free(model->mean);
+  free(model->panels);
+  memset(model, 0, sizeof(*model));
+}
+
+// ---------------------------------------------------------------------------
+// Map a blob of floats read-only. Returns the floats and their count, or
+// NULL if the file is missing, empty or not a whole number of floats.
+// Unmap with munmap(data, *size).
+// ---------------------------------------------------------------------------
+static inline const float* Face3dmmMapFloats(const char* path, size_t* count, size_t* size) {
+  struct stat st;
+  int         fd  = open(path, O_RDONLY | O_CLOEXEC);
+  void*       map = MAP_FAILED;
+
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open '%s'.\n", path);
+    return NULL;
+  }
+  if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size % sizeof(float) == 0)
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "'%s' is not a blob of floats.\n", path);
+    return NULL;
+  }
+  *size  = (size_t)st.st_size;
+  *count = *size / sizeof(float);
+  return (const float*)map;
+}
+
+// ---------------------------------------------------------------------------
+// Load a model from its mean face and num_bases basis blobs, whose
+// coefficients are concatenated in order. Returns 1 on success, 0 on
+// missing or mismatching blobs. Free with Face3dmmClose().
+// ---------------------------------------------------------------------------
+static inline int Face3dmmOpen(Face3dmm* model, const char* mean_path, const char* const* basis_paths,
+                               uint32_t num_bases) {
+  const float* bases[FACE3DMM_MAX_BASES];
+  size_t       sizes[FACE3DMM_MAX_BASES];
+  uint32_t     coeffs[FACE3DMM_MAX_BASES];
+  const float* mean;
+  size_t       count, mean_size;
+  uint32_t     mapped = 0;
+  int          ok     = 0;
+
+  memset(model, 0, sizeof(*model));
+  if (num_bases == 0 || num_bases > FACE3DMM_MAX_BASES) {
+    fprintf(stderr, "Expected 1 to %d basis blobs, got %u.\n", FACE3DMM_MAX_BASES, num_bases);
+    return 0;
+  }
+
+  if (!(mean = Face3dmmMapFloats(mean_path, &count, &mean_size))) return 0;
+  if (count % 3 != 0 || count > (1u << 24)) {
+    fprintf(stderr, "'%s' has %zu values, expected x y z per vertex.\n", mean_path, count);
+    goto done;
+  }
+  model->num_values = (uint32_t)count;
+  model->num_panels = (uint32_t)((count + FACE3DMM_PANEL - 1) / FACE3DMM_PANEL);
+
+  for (; mapped < num_bases; mapped++) {
+    if (!(bases[mapped] = Face3dmmMapFloats(basis_paths[mapped], &count, &sizes[mapped]))) goto done;
+    if (count % model->num_values != 0 || count / model->num_values > 4096) {
+      fprintf(stderr, "'%s' has %zu values, not a basis of rows of %u values.\n", basis_paths[mapped], count,
+              model->num_values);
+      mapped++;
+      goto done;
+    }
+    coeffs[mapped]     = (uint32_t)(count / model->num_values);
+    model->num_coeffs += coeffs[mapped];
+  }
+
+  if (posix_memalign((void**)&model->mean, FACE3DMM_ALIGN,
+                     (size_t)model->num_panels * FACE3DMM_PANEL * sizeof(float)) != 0 ||
+      posix_memalign((void**)&model->panels, FACE3DMM_ALIGN,
+                     (size_t)model->num_panels * model->num_coeffs * FACE3DMM_PANEL * sizeof(float)) != 0) {
+    fprintf(stderr, "Out of memory loading a model of %u values.\n", model->num_values);
+    goto done;
+  }
+
+  memset(model->mean, 0, (size_t)model->num_panels * FACE3DMM_PANEL * sizeof(float));
+  memcpy(model->mean, mean, (size_t)model->num_values * sizeof(float));
+  memset(model->panels, 0, (size_t)model->num_panels * model->num_coeffs * FACE3DMM_PANEL * sizeof(float));
+
+  // Panel rows of every basis, at the offset of its coefficients
+  for (uint32_t b = 0, first = 0; b < num_bases; first += coeffs[b], b++) {
+    for (uint32_t r = 0; r < model->num_values; r++) {
+      float*       panel = model->panels + (size_t)(r / FACE3DMM_PANEL) * model->num_coeffs * FACE3DMM_PANEL;
+      const float* row   = bases[b] + (size_t)r * coeffs[b];
+
+      for (uint32_t k = 0; k < coeffs[b]; k++)
+        panel[(size_t)(first + k) * FACE3DMM_PANEL + r % FACE3DMM_PANEL] = row[k];
+    }
+  }
+  ok = 1;
+
+done:
+  for (uint32_t b = 0; b < mapped; b++)
+    if (bases[b]) munmap((void*)bases[b], sizes[b]);
+  munmap((void*)mean, mean_size);
+  if (!ok) Face3dmmClose(model);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// One panel of FACE3DMM_FACE_BLOCK faces: out[f] = mean + panel * coeffs[f]
+// ---------------------------------------------------------------------------
+static inline void Face3dmmPanelBlock(const float* panel, const float* mean, uint32_t num_coeffs,
+                                      const float* const* coeffs, float* const* out) {
+  const float* c0 = coeffs[0];
+  const float* c1 = coeffs[1];
+  const float* c2 = coeffs[2];
+  const float* c3 = coeffs[3];
+  uint32_t     k  = 0;
+
+#if defined(FACE3DMM_NEON)
+  float32x4_t m0 = vld1q_f32(mean), m1 = vld1q_f32(mean + 4);
+  float32x4_t a00 = m0, a01 = m1, a10 = m0, a11 = m1, a20 = m0, a21 = m1, a30 = m0, a31 = m1;
+
+  for (; k < num_coeffs; k++, panel += FACE3DMM_PANEL) {
+    float32x4_t b0 = vld1q_f32(panel), b1 = vld1q_f32(panel + 4);
+
+    a00 = vfmaq_n_f32(a00, b0, c0[k]);
+    a01 = vfmaq_n_f32(a01, b1, c0[k]);
+    a10 = vfmaq_n_f32(a10, b0, c1[k]);
+    a11 = vfmaq_n_f32(a11, b1, c1[k]);
+    a20 = vfmaq_n_f32(a20, b0, c2[k]);
+    a21 = vfmaq_n_f32(a21, b1, c2[k]);
+    a30 = vfmaq_n_f32(a30, b0, c3[k]);
+    a31 = vfmaq_n_f32(a31, b1, c3[k]);
+  }
+  vst1q_f32(out[0], a00);
+  vst1q_f32(out[0] + 4, a01);
+  vst1q_f32(out[1], a10);
+  vst1q_f32(out[1] + 4, a11);
+  vst1q_f32(out[2], a20);
+  vst1q_f32(out[2] + 4, a21);
+  vst1q_f32(out[3], a30);
+  vst1q_f32(out[3] + 4, a31);
+#elif defined(FACE3DMM_SSE2)
+  __m128 m0 = _mm_load_ps(mean), m1 = _mm_load_ps(mean + 4);
+  __m128 a00 = m0, a01 = m1, a10 = m0, a11 = m1, a20 = m0, a21 = m1, a30 = m0, a31 = m1;
+
+  for (; k < num_coeffs; k++, panel += FACE3DMM_PANEL) {
+    __m128 b0 = _mm_load_ps(panel), b1 = _mm_load_ps(panel + 4);
+    __m128 s;
+
+    s   = _mm_set1_ps(c0[k]);
+    a00 = _mm_add_ps(a00, _mm_mul_ps(b0, s));
+    a01 = _mm_add_ps(a01, _mm_mul_ps(b1, s));
+    s   = _mm_set1_ps(c1[k]);
+    a10 = _mm_add_ps(a10, _mm_mul_ps(b0, s));
+    a11 = _mm_add_ps(a11, _mm_mul_ps(b1, s));
+    s   = _mm_set1_ps(c2[k]);
+    a20 = _mm_add_ps(a20, _mm_mul_ps(b0, s));
+    a21 = _mm_add_ps(a21, _mm_mul_ps(b1, s));
+    s   = _mm_set1_ps(c3[k]);
+    a30 = _mm_add_ps(a30, _mm_mul_ps(b0, s));
+    a31 = _mm_add_ps(a31, _mm_mul_ps(b1, s));
+  }
+  _mm_storeu_ps(out[0], a00);
+  _mm_storeu_ps(out[0] + 4, a01);
+  _mm_storeu_ps(out[1], a10);
+  _mm_storeu_ps(out[1] + 4, a11);
+  _mm_storeu_ps(out[2], a20);
+  _mm_storeu_ps(out[2] + 4, a21);
+  _mm_storeu_ps(out[3], a30);
+  _mm_storeu_ps(out[3] + 4, a31);
+#else
+  float acc[FACE3DMM_FACE_BLOCK][FACE3DMM_PANEL];
+
+  for (int f = 0; f < FACE3DMM_FACE_BLOCK; f++) memcpy(acc[f], mean, sizeof(acc[f]));
+  for (; k < num_coeffs; k++, panel += FACE3DMM_PANEL) {
+    for (int i = 0; i < FACE3DMM_PANEL; i++) {
+      acc[0][i] += panel[i] * c0[k];
+      acc[1][i] += panel[i] * c1[k];
+      acc[2][i] += panel[i] * c2[k];
+      acc[3][i] += panel[i] * c3[k];
+    }
+  }
+  for (int f = 0; f < FACE3DMM_FACE_BLOCK; f++) memcpy(out[f], acc[f], sizeof(acc[f]));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// One panel of a single face. Even and odd coefficients sum separately, to
+// keep two chains of multiply-adds in flight.
+// ---------------------------------------------------------------------------
+static inline void Face3dmmPanelOne(const float* panel, const float* mean, uint32_t num_coeffs,
+                                    const float* coeffs, float* out) {
+  uint32_t k = 0;
+
+#if defined(FACE3DMM_NEON)
+  float32x4_t a0 = vld1q_f32(mean), a1 = vld1q_f32(mean + 4);
+  float32x4_t a2 = vdupq_n_f32(0.0f), a3 = a2;
+
+  for (; k + 2 <= num_coeffs; k += 2, panel += 2 * FACE3DMM_PANEL) {
+    a0 = vfmaq_n_f32(a0, vld1q_f32(panel), coeffs[k]);
+    a1 = vfmaq_n_f32(a1, vld1q_f32(panel + 4), coeffs[k]);
+    a2 = vfmaq_n_f32(a2, vld1q_f32(panel + 8), coeffs[k + 1]);
+    a3 = vfmaq_n_f32(a3, vld1q_f32(panel + 12), coeffs[k + 1]);
+  }
+  if (k < num_coeffs) {
+    a0 = vfmaq_n_f32(a0, vld1q_f32(panel), coeffs[k]);
+    a1 = vfmaq_n_f32(a1, vld1q_f32(panel + 4), coeffs[k]);
+  }
+  vst1q_f32(out, vaddq_f32(a0, a2));
+  vst1q_f32(out + 4, vaddq_f32(a1, a3));
+#elif defined(FACE3DMM_SSE2)
+  __m128 a0 = _mm_load_ps(mean), a1 = _mm_load_ps(mean + 4);
+  __m128 a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+
+  for (; k + 2 <= num_coeffs; k += 2, panel += 2 * FACE3DMM_PANEL) {
+    __m128 s0 = _mm_set1_ps(coeffs[k]), s1 = _mm_set1_ps(coeffs[k + 1]);
+
+    a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_load_ps(panel), s0));
+    a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_load_ps(panel + 4), s0));
+    a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_load_ps(panel + 8), s1));
+    a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_load_ps(panel + 12), s1));
+  }
+  if (k < num_coeffs) {
+    __m128 s0 = _mm_set1_ps(coeffs[k]);
+
+    a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_load_ps(panel), s0));
+    a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_load_ps(panel + 4), s0));
+  }
+  _mm_storeu_ps(out, _mm_add_ps(a0, a2));
+  _mm_storeu_ps(out + 4, _mm_add_ps(a1, a3));
+#else
+  float acc[FACE3DMM_PANEL];
+
+  memcpy(acc, mean, sizeof(acc));
+  for (; k < num_coeffs; k++, panel += FACE3DMM_PANEL)
+    for (int i = 0; i < FACE3DMM_PANEL; i++) acc[i] += panel[i] * coeffs[k];
+  memcpy(out, acc, sizeof(acc));
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Reconstruct the meshes of num_faces faces. Face f takes num_coeffs
+// coefficients at coeffs + f * coeff_stride, e.g. inside a model output
+// with more values per face, and gets num_values values at
+// meshes + f * num_values.
+// ---------------------------------------------------------------------------
+static inline void Face3dmmReconstruct(const Face3dmm* model, const float* coeffs, size_t coeff_stride,
+                                       uint32_t num_faces, float* meshes) {
+  size_t panel_size = (size_t)model->num_coeffs * FACE3DMM_PANEL;
+  float  tail[FACE3DMM_FACE_BLOCK][FACE3DMM_PANEL];
+
+  for (uint32_t p = 0; p < model->num_panels; p++) {
+    const float* panel = model->panels + p * panel_size;
+    const float* mean  = model->mean + (size_t)p * FACE3DMM_PANEL;
+    size_t       first = (size_t)p * FACE3DMM_PANEL;
+    uint32_t     rows  = (model->num_values - first < FACE3DMM_PANEL) ? (uint32_t)(model->num_values - first)
+                                                                       : FACE3DMM_PANEL;
+    uint32_t     f     = 0;
+
+    // The last panel is written through a buffer, its padding rows would
+    // overwrite the next face
+    for (; f + FACE3DMM_FACE_BLOCK <= num_faces; f += FACE3DMM_FACE_BLOCK) {
+      const float* in[FACE3DMM_FACE_BLOCK];
+      float*       out[FACE3DMM_FACE_BLOCK];
+
+      for (int i = 0; i < FACE3DMM_FACE_BLOCK; i++) {
+        in[i]  = coeffs + (f + i) * coeff_stride;
+        out[i] = (rows == FACE3DMM_PANEL) ? meshes + (f + i) * (size_t)model->num_values + first : tail[i];
+      }
+      Face3dmmPanelBlock(panel, mean, model->num_coeffs, in, out);
+      if (rows < FACE3DMM_PANEL)
+        for (int i = 0; i < FACE3DMM_FACE_BLOCK; i++)
+          memcpy(meshes + (f + i) * (size_t)model->num_values + first, tail[i], rows * sizeof(float));
+    }
+
+    for (; f < num_faces; f++) {
+      float* out = meshes + f * (size_t)model->num_values + first;
+
+      if (rows == FACE3DMM_PANEL) {
+        Face3dmmPanelOne(panel, mean, model->num_coeffs, coeffs + f * coeff_stride, out);
+      } else {
+        Face3dmmPanelOne(panel, mean, model->num_coeffs, coeffs + f * coeff_stride, tail[0]);
+        memcpy(out, tail[0], rows * sizeof(float));
+      }
+    }
+  }
+}
+
+#endif  // FACE3DMM_H
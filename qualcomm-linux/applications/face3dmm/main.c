@@ -0,0 +1,244 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Reconstructs and benchmarks 3DMM face meshes, see face3dmm.h.
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "face3dmm.h"
+#include "../common/tool_utils.h"
+
+// ---------------------------------------------------------------------------
+// Locations of facemap_3dmm_settings.json
+// ---------------------------------------------------------------------------
+#define DEFAULT_MEAN_FACE   "/etc/data/meanFace.bin"
+#define DEFAULT_BLEND_SHAPE "/etc/data/blendShape.bin"
+
+#define DEFAULT_BENCH_ITERATIONS 50
+#define MAX_BATCH_SIZES          8
+
+typedef struct {
+  const char* mean_path;
+  const char* basis_paths[FACE3DMM_MAX_BASES];
+  uint32_t    num_bases;
+  uint32_t    offset;
+  int         iterations;
+  int         batch_sizes[MAX_BATCH_SIZES];
+  int         num_batch_sizes;
+} ToolOptions;
+
+// ---------------------------------------------------------------------------
+// mesh: reconstruct the mesh of a coefficient tensor as a Wavefront OBJ
+// point cloud
+// ---------------------------------------------------------------------------
+static int CommandMesh(const ToolOptions* opts, const Face3dmm* model, const char* coeffs_path,
+                       const char* obj_path) {
+  float* coeffs = (float*)malloc(((size_t)model->num_coeffs + 1) * sizeof(float));
+  float* mesh   = (float*)malloc((size_t)model->num_values * sizeof(float));
+  FILE*  file   = NULL;
+  int    ok     = coeffs && mesh && ReadTensor(coeffs_path, coeffs, model->num_coeffs, opts->offset);
+
+  if (ok) {
+    Face3dmmReconstruct(model, coeffs, model->num_coeffs, 1, mesh);
+
+    ok = (file = fopen(obj_path, "w")) != NULL;
+    for (uint32_t v = 0; ok && v < model->num_values; v += 3)
+      ok = fprintf(file, "v %.6f %.6f %.6f\n", mesh[v], mesh[v + 1], mesh[v + 2]) > 0;
+    if (file) ok = (fclose(file) == 0) && ok;
+    if (!ok) fprintf(stderr, "Failed to write '%s'.\n", obj_path);
+  }
+
+  if (ok) printf("'%s': %u vertices\n", obj_path, model->num_values / 3);
+  free(mesh);
+  free(coeffs);
+  return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Reference: one dot product per mesh value over the mapped row major
+// basis, the layout of the blobs.
+// ---------------------------------------------------------------------------
+static void ReconstructRows(const float* mean, const float* const* bases, const uint32_t* coeffs,
+                            uint32_t num_bases, uint32_t num_values, const float* face, float* mesh) {
+  for (uint32_t r = 0; r < num_values; r++) {
+    const float* c   = face;
+    float        sum = mean[r];
+
+    for (uint32_t b = 0; b < num_bases; c += coeffs[b], b++)
+      for (uint32_t k = 0; k < coeffs[b]; k++) sum += bases[b][(size_t)r * coeffs[b] + k] * c[k];
+    mesh[r] = sum;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// bench: latency per face of the row major reference and the panel kernel
+// for every batch size, and the largest difference of the two
+// ---------------------------------------------------------------------------
+static int CommandBench(const ToolOptions* opts, const Face3dmm* model) {
+  const float* bases[FACE3DMM_MAX_BASES] = { NULL };
+  size_t       sizes[FACE3DMM_MAX_BASES];
+  uint32_t     coeffs[FACE3DMM_MAX_BASES];
+  const float* mean      = NULL;
+  size_t       mean_size = 0, count;
+  uint32_t     max_batch = 0;
+  float*       faces     = NULL;
+  float*       meshes    = NULL;
+  float*       reference = NULL;
+  uint64_t     state     = 0x3d3d;
+  int          ok        = 1;
+
+  for (int b = 0; b < opts->num_batch_sizes; b++)
+    if ((uint32_t)opts->batch_sizes[b] > max_batch) max_batch = (uint32_t)opts->batch_sizes[b];
+
+  ok = (mean = Face3dmmMapFloats(opts->mean_path, &count, &mean_size)) != NULL;
+  for (uint32_t b = 0; ok && b < opts->num_bases; b++) {
+    ok        = (bases[b] = Face3dmmMapFloats(opts->basis_paths[b], &count, &sizes[b])) != NULL;
+    coeffs[b] = (uint32_t)(count / model->num_values);
+  }
+
+  faces     = (float*)malloc((size_t)max_batch * model->num_coeffs * sizeof(float));
+  meshes    = (float*)malloc((size_t)max_batch * model->num_values * sizeof(float));
+  reference = (float*)malloc((size_t)max_batch * model->num_values * sizeof(float));
+  ok        = ok && faces && meshes && reference;
+
+  // Coefficients of the order of the basis weights, so the meshes stay in
+  // the range of the mean face
+  for (size_t i = 0; ok && i < (size_t)max_batch * model->num_coeffs; i++) faces[i] = 0.5f * RandomNormal(&state);
+
+  if (ok)
+    printf("%u vertices, %u coefficients, %.1f KB basis in %u panels of %d rows\n", model->num_values / 3,
+           model->num_coeffs, (double)model->num_panels * model->num_coeffs * FACE3DMM_PANEL * sizeof(float) / 1024.0,
+           model->num_panels, FACE3DMM_PANEL);
+
+  for (int b = 0; ok && b < opts->num_batch_sizes; b++) {
+    uint32_t batch   = (uint32_t)opts->batch_sizes[b];
+    double   row_ms  = 0.0, panel_ms = 0.0, best_ms = 1e30;
+    float    max_err = 0.0f;
+
+    for (int it = 0; it < opts->iterations; it++) {
+      double start = NowMs(), elapsed;
+
+      for (uint32_t f = 0; f < batch; f++)
+        ReconstructRows(mean, bases, coeffs, opts->num_bases, model->num_values, faces + (size_t)f * model->num_coeffs,
+                        reference + (size_t)f * model->num_values);
+      row_ms += NowMs() - start;
+
+      start = NowMs();
+      Face3dmmReconstruct(model, faces, model->num_coeffs, batch, meshes);
+      elapsed   = NowMs() - start;
+      panel_ms += elapsed;
+      if (elapsed < best_ms) best_ms = elapsed;
+    }
+
+    for (size_t i = 0; i < (size_t)batch * model->num_values; i++)
+      max_err = fmaxf(max_err, fabsf(meshes[i] - reference[i]));
+
+    printf("  batch %3u: rows %.4f ms per face, panels %.4f ms per face (best %.4f), %.1fx, max diff %.2e\n",
+           batch, row_ms / opts->iterations / batch, panel_ms / opts->iterations / batch, best_ms / batch,
+           row_ms / panel_ms, max_err);
+  }
+
+  free(reference);
+  free(meshes);
+  free(faces);
+  for (uint32_t b = 0; b < opts->num_bases; b++)
+    if (bases[b]) munmap((void*)bases[b], sizes[b]);
+  if (mean) munmap((void*)mean, mean_size);
+  return ok ? 0 : 1;
+}
+
+static void PrintHelp(const char* prog) {
+  printf("Usage: %s <command> [options] ...\n\n", prog);
+  printf("Commands:\n");
+  printf("  mesh <coeffs.bin> <mesh.obj>  Reconstruct the mesh of a coefficient tensor\n");
+  printf("  bench                         Benchmark batched reconstruction\n\n");
+  printf("Options:\n");
+  printf("  --mean <file>      Mean face (default: %s)\n", DEFAULT_MEAN_FACE);
+  printf("  --basis <file>     Basis, repeat for several bases with concatenated\n");
+  printf("                     coefficients (default: %s)\n", DEFAULT_BLEND_SHAPE);
+  printf("  --offset <N>       First coefficient in the tensor, in floats (default: 0)\n");
+  printf("  --iterations <N>   Timed iterations (default: %d)\n", DEFAULT_BENCH_ITERATIONS);
+  printf("  --batch <N[,N...]> Faces per batch (default: 1,4,16)\n\n");
+  printf("Examples:\n");
+  printf("  %s mesh coeffs.bin face.obj\n", prog);
+  printf("  %s bench --mean artifacts/data/meanFace.bin --basis artifacts/data/blendShape.bin\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+  ToolOptions opts;
+  Face3dmm    model;
+  char**      args     = (char**)calloc((size_t)argc + 1, sizeof(char*));
+  int         num_args = 0;
+  int         ret      = 1;
+  uint32_t    value    = 0;
+
+  memset(&opts, 0, sizeof(opts));
+  memset(&model, 0, sizeof(model));
+  opts.mean_path       = DEFAULT_MEAN_FACE;
+  opts.iterations      = DEFAULT_BENCH_ITERATIONS;
+  opts.batch_sizes[0]  = 1;
+  opts.batch_sizes[1]  = 4;
+  opts.batch_sizes[2]  = 16;
+  opts.num_batch_sizes = 3;
+
+  if (!args) return 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg  = argv[i];
+    const char* next = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      PrintHelp(argv[0]);
+      free(args);
+      return 0;
+    } else if (strcmp(arg, "--mean") == 0) {
+      if (!next) goto done;
+      opts.mean_path = argv[++i];
+    } else if (strcmp(arg, "--basis") == 0) {
+      if (!next || opts.num_bases == FACE3DMM_MAX_BASES) {
+        fprintf(stderr, "--basis expects up to %d files.\n", FACE3DMM_MAX_BASES);
+        goto done;
+      }
+      opts.basis_paths[opts.num_bases++] = argv[++i];
+    } else if (strcmp(arg, "--offset") == 0) {
+      if (!ParseCount(arg, next, 0, &opts.offset)) goto done;
+      i++;
+    } else if (strcmp(arg, "--iterations") == 0) {
+      if (!ParseCount(arg, next, 1, &value)) goto done;
+      opts.iterations = (int)value;
+      i++;
+    } else if (strcmp(arg, "--batch") == 0) {
+      if (!(opts.num_batch_sizes = ParseList(arg, next, opts.batch_sizes, MAX_BATCH_SIZES))) goto done;
+      i++;
+    } else if (strncmp(arg, "--", 2) == 0) {
+      fprintf(stderr, "Unknown option '%s'.\n", arg);
+      goto done;
+    } else {
+      args[num_args++] = argv[i];
+    }
+  }
+
+  if (opts.num_bases == 0) opts.basis_paths[opts.num_bases++] = DEFAULT_BLEND_SHAPE;
+
+  if (!((num_args == 3 && strcmp(args[0], "mesh") == 0) || (num_args == 1 && strcmp(args[0], "bench") == 0))) {
+    PrintHelp(argv[0]);
+    goto done;
+  }
+
+  if (!Face3dmmOpen(&model, opts.mean_path, opts.basis_paths, opts.num_bases)) goto done;
+
+  if (strcmp(args[0], "mesh") == 0)
+    ret = CommandMesh(&opts, &model, args[1], args[2]);
+  else
+    ret = CommandBench(&opts, &model);
+
+done:
+  Face3dmmClose(&model);
+  free(args);
+  return ret;
+}
@@ -0,0 +1,936 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Face database of many enrolled persons, matched by cosine similarity.
+//
+// scripts/facedb.py writes a face.bin of version 4 for one person:
+//
+//   uint32 version (4), uint32 feature count F, uint32 liveness count L
+//   char   name[20], NUL padded
+//   float  liveness[L]
+//   uint32 template count T
+//   T times float features[F], stored twice
+//
+// Version 4 files are read as a database of one person. Databases of
+// several persons are written as version 5, laid out to be memory mapped
+// and searched in place:
+//
+//   FaceDbHeader                      64 bytes
+//   FaceDbPerson persons[P]           at persons_offset
+//   float        liveness[P][L]       at liveness_offset
+//   float        scales[T]            at scales_offset, int8 only
+//   templates[T][stride]              at templates_offset, 64 byte aligned
+//
+// The first three header fields match version 4, so a reader can tell the
+// versions apart. Templates are L2 normalized, so the cosine similarity is
+// a dot product, and rows are zero padded to 64 bytes, so the SIMD loops
+// have no tail. The templates of a person are stored one after another.
+// With FACEDB_INT8 every template is quantized symmetrically to int8 with
+// its own scale, a quarter of the float size. All values are little
+// endian.
+//
+// Queries are matched in blocks of FACEDB_QUERY_BLOCK: every template row
+// is loaded once for the whole block, and the templates are visited in
+// tiles of FACEDB_TILE rows that stay in cache while all blocks of a batch
+// pass over them. A single query has a kernel of its own. The kernels use
+// NEON on ARM, SSE2 on x86 and plain C elsewhere. Matching reuses a scratch
+// buffer of the database, a FaceDb must not be matched from several
+// threads at the same time.
+
+#ifndef FACEDB_H
+#define FACEDB_H
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FACEDB_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FACEDB_SSE2 1
+#endif
+
+#define FACEDB_VERSION_V4   4
+#define FACEDB_VERSION      5
+#define FACEDB_NAME_SIZE    20
+#define FACEDB_ALIGN        64
+#define FACEDB_QUERY_BLOCK  4
+#define FACEDB_TILE         128
+
+// Element types of the templates
+#define FACEDB_FLOAT32      0
+#define FACEDB_INT8         1
+
+// ---------------------------------------------------------------------------
+// File header of version 5
+// ---------------------------------------------------------------------------
+typedef struct {
+  uint32_t version;
+  uint32_t num_features;
+  uint32_t num_liveness;
+  uint32_t num_persons;
+  uint32_t num_templates;
+  uint32_t type;             // FACEDB_FLOAT32 or FACEDB_INT8
+  uint32_t stride;           // elements per template row
+  uint32_t reserved;
+  uint64_t persons_offset;
+  uint64_t liveness_offset;
+  uint64_t scales_offset;
+  uint64_t templates_offset;
+} FaceDbHeader;
+
+// ---------------------------------------------------------------------------
+// One enrolled person, 32 bytes in the file
+// ---------------------------------------------------------------------------
+typedef struct {
+  char     name[FACEDB_NAME_SIZE + 4];  // always NUL terminated
+  uint32_t first_template;
+  uint32_t num_templates;
+} FaceDbPerson;
+
+// ---------------------------------------------------------------------------
+// Best match of a query
+// ---------------------------------------------------------------------------
+typedef struct {
+  int32_t  person;    // -1 if the database has no templates
+  uint32_t template_index;
+  float    score;     // cosine similarity in [-1, 1]
+} FaceDbMatch;
+
+// ---------------------------------------------------------------------------
+// Database, opened from a file or built in memory
+// ---------------------------------------------------------------------------
+typedef struct {
+  uint32_t      num_features;
+  uint32_t      num_liveness;
+  uint32_t      num_persons;
+  uint32_t      num_templates;
+  uint32_t      type;
+  uint32_t      stride;
+  FaceDbPerson* persons;
+  float*        liveness;    // num_liveness per person
+  float*        scales;      // per template, int8 only
+  void*         templates;   // num_templates rows of stride elements
+
+  // Private
+  void*         map;         // mapped version 5 file, NULL when on the heap
+  size_t        map_size;
+  uint32_t      person_capacity;
+  uint32_t      template_capacity;
+  void*         scratch;     // encoded queries
+  size_t        scratch_size;
+} FaceDb;
+
+static inline size_t FaceDbAlignUp(size_t size, size_t align) {
+  return (size + align - 1) & ~(align - 1);
+}
+
+static inline size_t FaceDbElementSize(uint32_t type) {
+  return (type == FACEDB_INT8) ? 1 : sizeof(float);
+}
+
+static inline size_t FaceDbRowBytes(const FaceDb* db) {
+  return (size_t)db->stride * FaceDbElementSize(db->type);
+}
+
+// True when count elements of size bytes at offset lie inside the file,
+// without the offset + count * size sum wrapping around.
+static inline int FaceDbRangeFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+  return offset <= file_size && (size == 0 || count <= (file_size - offset) / size);
+}
+
+static inline const void* FaceDbRow(const FaceDb* db, uint32_t index) {
+  return (const uint8_t*)db->templates + (size_t)index * FaceDbRowBytes(db);
+}
+
+static inline void* FaceDbAlignedAlloc(size_t bytes) {
+  void* data = NULL;
+
+  bytes = FaceDbAlignUp(bytes ? bytes : 1, FACEDB_ALIGN);
+  if (posix_memalign(&data, FACEDB_ALIGN, bytes) != 0) return NULL;
+  return data;
+}
+
+// ---------------------------------------------------------------------------
+// Create an empty database in memory. Returns 1 on success, 0 on invalid
+// sizes. Free with FaceDbClose().
+// ---------------------------------------------------------------------------
+static inline int FaceDbCreate(FaceDb* db, uint32_t num_features, uint32_t num_liveness,
+                               uint32_t type) {
+  memset(db, 0, sizeof(*db));
+
+  if (num_features == 0 || num_features > (1u << 20) || num_liveness > (1u << 20) ||
+      (type != FACEDB_FLOAT32 && type != FACEDB_INT8)) {
+    fprintf(stderr, "Invalid face database with %u features, %u liveness features, type %u.\n",
+            num_features, num_liveness, type);
+    return 0;
+  }
+
+  db->num_features = num_features;
+  db->num_liveness = num_liveness;
+  db->type         = type;
+  db->stride       = (uint32_t)FaceDbAlignUp(num_features, FACEDB_ALIGN / FaceDbElementSize(type));
+  return 1;
+}
+
+static inline void FaceDbClose(FaceDb* db) {
+  if (db->map) {
+    munmap(db->map, db->map_size);
+  } else {
+    free(db->persons);
+    free(db->liveness);
+    free(db->scales);
+    free(db->templates);
+  }
+  free(db->scratch);
+  memset(db, 0, sizeof(*db));
+}
+
+// ---------------------------------------------------------------------------
+// L2 normalize count features into a row of stride elements, zero padded.
+// Returns the scale of an int8 row, 1 for a float row.
+// ---------------------------------------------------------------------------
+static inline float FaceDbEncode(const float* features, uint32_t count, uint32_t stride,
+                                 uint32_t type, void* row) {
+  double sum     = 0.0;
+  float  max_abs = 0.0f;
+  float  inv_norm, scale;
+
+  for (uint32_t i = 0; i < count; i++) {
+    sum    += (double)features[i] * features[i];
+    max_abs = fmaxf(max_abs, fabsf(features[i]));
+  }
+  inv_norm = (sum > 0.0) ? (float)(1.0 / sqrt(sum)) : 0.0f;
+
+  if (type == FACEDB_FLOAT32) {
+    float* out = (float*)row;
+
+    for (uint32_t i = 0; i < count; i++) out[i] = features[i] * inv_norm;
+    memset(out + count, 0, (stride - count) * sizeof(float));
+    return 1.0f;
+  }
+
+  // Symmetric: the largest normalized value maps to 127
+  scale = (max_abs > 0.0f && inv_norm > 0.0f) ? max_abs * inv_norm / 127.0f : 1.0f;
+  {
+    int8_t* out = (int8_t*)row;
+    float   mul = inv_norm / scale;
+
+    for (uint32_t i = 0; i < count; i++) {
+      long q = lrintf(features[i] * mul);
+      out[i] = (int8_t)(q > 127 ? 127 : (q < -127 ? -127 : q));
+    }
+    memset(out + count, 0, stride - count);
+  }
+  return scale;
+}
+
+// ---------------------------------------------------------------------------
+// Decode a stored template into num_features floats. Int8 templates come
+// back approximately.
+// ---------------------------------------------------------------------------
+static inline void FaceDbGetTemplate(const FaceDb* db, uint32_t index, float* features) {
+  if (db->type == FACEDB_FLOAT32) {
+    memcpy(features, FaceDbRow(db, index), db->num_features * sizeof(float));
+  } else {
+    const int8_t* row = (const int8_t*)FaceDbRow(db, index);
+
+    for (uint32_t i = 0; i < db->num_features; i++) features[i] = row[i] * db->scales[index];
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Dot products of one template row with a block of 4 encoded queries, over
+// the whole padded row.
+// ---------------------------------------------------------------------------
+static inline void FaceDbDotF32(const float* row, const float* queries, size_t query_stride,
+                                uint32_t stride, float* dots) {
+  const float* q0 = queries;
+  const float* q1 = queries + query_stride;
+  const float* q2 = queries + 2 * query_stride;
+  const float* q3 = queries + 3 * query_stride;
+  uint32_t     i  = 0;
+
+#if defined(FACEDB_NEON)
+  float32x4_t a0 = vdupq_n_f32(0.0f), a1 = a0, a2 = a0, a3 = a0;
+
+  for (; i < stride; i += 4) {
+    float32x4_t r = vld1q_f32(row + i);
+
+    a0 = vfmaq_f32(a0, r, vld1q_f32(q0 + i));
+    a1 = vfmaq_f32(a1, r, vld1q_f32(q1 + i));
+    a2 = vfmaq_f32(a2, r, vld1q_f32(q2 + i));
+    a3 = vfmaq_f32(a3, r, vld1q_f32(q3 + i));
+  }
+  dots[0] = vaddvq_f32(a0);
+  dots[1] = vaddvq_f32(a1);
+  dots[2] = vaddvq_f32(a2);
+  dots[3] = vaddvq_f32(a3);
+#elif defined(FACEDB_SSE2)
+  __m128 a[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+
+  for (; i < stride; i += 4) {
+    __m128 r = _mm_load_ps(row + i);
+
+    a[0] = _mm_add_ps(a[0], _mm_mul_ps(r, _mm_load_ps(q0 + i)));
+    a[1] = _mm_add_ps(a[1], _mm_mul_ps(r, _mm_load_ps(q1 + i)));
+    a[2] = _mm_add_ps(a[2], _mm_mul_ps(r, _mm_load_ps(q2 + i)));
+    a[3] = _mm_add_ps(a[3], _mm_mul_ps(r, _mm_load_ps(q3 + i)));
+  }
+  for (int k = 0; k < 4; k++) {
+    __m128 s = _mm_add_ps(a[k], _mm_movehl_ps(a[k], a[k]));
+    s        = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    dots[k]  = _mm_cvtss_f32(s);
+  }
+#else
+  dots[0] = dots[1] = dots[2] = dots[3] = 0.0f;
+  for (; i < stride; i++) {
+    dots[0] += row[i] * q0[i];
+    dots[1] += row[i] * q1[i];
+    dots[2] += row[i] * q2[i];
+    dots[3] += row[i] * q3[i];
+  }
+#endif
+}
+
+static inline void FaceDbDotS8(const int8_t* row, const int8_t* queries, size_t query_stride,
+                               uint32_t stride, int32_t* dots) {
+  const int8_t* q0 = queries;
+  const int8_t* q1 = queries + query_stride;
+  const int8_t* q2 = queries + 2 * query_stride;
+  const int8_t* q3 = queries + 3 * query_stride;
+  uint32_t      i  = 0;
+
+#if defined(FACEDB_NEON) && defined(__ARM_FEATURE_DOTPROD)
+  int32x4_t a0 = vdupq_n_s32(0), a1 = a0, a2 = a0, a3 = a0;
+
+  for (; i < stride; i += 16) {
+    int8x16_t r = vld1q_s8(row + i);
+
+    a0 = vdotq_s32(a0, r, vld1q_s8(q0 + i));
+    a1 = vdotq_s32(a1, r, vld1q_s8(q1 + i));
+    a2 = vdotq_s32(a2, r, vld1q_s8(q2 + i));
+    a3 = vdotq_s32(a3, r, vld1q_s8(q3 + i));
+  }
+  dots[0] = vaddvq_s32(a0);
+  dots[1] = vaddvq_s32(a1);
+  dots[2] = vaddvq_s32(a2);
+  dots[3] = vaddvq_s32(a3);
+#elif defined(FACEDB_NEON)
+  // Values are within [-127, 127], two products fit into int16
+  int32x4_t a[4] = { vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0) };
+  const int8_t* q[4] = { q0, q1, q2, q3 };
+
+  for (; i < stride; i += 16) {
+    int8x16_t r = vld1q_s8(row + i);
+
+    for (int k = 0; k < 4; k++) {
+      int8x16_t v = vld1q_s8(q[k] + i);
+      int16x8_t p = vmull_s8(vget_low_s8(r), vget_low_s8(v));
+
+      p    = vmlal_high_s8(p, r, v);
+      a[k] = vpadalq_s16(a[k], p);
+    }
+  }
+  for (int k = 0; k < 4; k++) dots[k] = vaddvq_s32(a[k]);
+#elif defined(FACEDB_SSE2)
+  __m128i a[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(),
+                   _mm_setzero_si128() };
+  const int8_t* q[4] = { q0, q1, q2, q3 };
+
+  for (; i < stride; i += 16) {
+    __m128i r  = _mm_load_si128((const __m128i*)(row + i));
+    // Sign extension to int16: the byte in the high half, shifted down
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(r, r), 8);
+    __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(r, r), 8);
+
+    for (int k = 0; k < 4; k++) {
+      __m128i v = _mm_load_si128((const __m128i*)(q[k] + i));
+
+      a[k] = _mm_add_epi32(a[k], _mm_madd_epi16(lo, _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8)));
+      a[k] = _mm_add_epi32(a[k], _mm_madd_epi16(hi, _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8)));
+    }
+  }
+  for (int k = 0; k < 4; k++) {
+    __m128i s = _mm_add_epi32(a[k], _mm_shuffle_epi32(a[k], 0x4E));
+    s         = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    dots[k]   = _mm_cvtsi128_si32(s);
+  }
+#else
+  dots[0] = dots[1] = dots[2] = dots[3] = 0;
+  for (; i < stride; i++) {
+    dots[0] += row[i] * q0[i];
+    dots[1] += row[i] * q1[i];
+    dots[2] += row[i] * q2[i];
+    dots[3] += row[i] * q3[i];
+  }
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Dot product of one template row with one encoded query, for batches that
+// do not fill a block.
+// ---------------------------------------------------------------------------
+static inline float FaceDbDotOneF32(const float* row, const float* query, uint32_t stride) {
+  uint32_t i = 0;
+
+#if defined(FACEDB_NEON)
+  float32x4_t a0 = vdupq_n_f32(0.0f), a1 = a0;
+
+  for (; i < stride; i += 8) {
+    a0 = vfmaq_f32(a0, vld1q_f32(row + i), vld1q_f32(query + i));
+    a1 = vfmaq_f32(a1, vld1q_f32(row + i + 4), vld1q_f32(query + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(a0, a1));
+#elif defined(FACEDB_SSE2)
+  __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+
+  for (; i < stride; i += 8) {
+    a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_load_ps(row + i), _mm_load_ps(query + i)));
+    a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_load_ps(row + i + 4), _mm_load_ps(query + i + 4)));
+  }
+  a0 = _mm_add_ps(a0, a1);
+  a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+  return _mm_cvtss_f32(_mm_add_ss(a0, _mm_shuffle_ps(a0, a0, 1)));
+#else
+  float sum = 0.0f;
+
+  for (; i < stride; i++) sum += row[i] * query[i];
+  return sum;
+#endif
+}
+
+static inline int32_t FaceDbDotOneS8(const int8_t* row, const int8_t* query, uint32_t stride) {
+  uint32_t i = 0;
+
+#if defined(FACEDB_NEON) && defined(__ARM_FEATURE_DOTPROD)
+  int32x4_t a = vdupq_n_s32(0);
+
+  for (; i < stride; i += 16) a = vdotq_s32(a, vld1q_s8(row + i), vld1q_s8(query + i));
+  return vaddvq_s32(a);
+#elif defined(FACEDB_NEON)
+  int32x4_t a = vdupq_n_s32(0);
+
+  for (; i < stride; i += 16) {
+    int8x16_t r = vld1q_s8(row + i), v = vld1q_s8(query + i);
+    a = vpadalq_s16(a, vmlal_high_s8(vmull_s8(vget_low_s8(r), vget_low_s8(v)), r, v));
+  }
+  return vaddvq_s32(a);
+#elif defined(FACEDB_SSE2)
+  __m128i a = _mm_setzero_si128();
+
+  for (; i < stride; i += 16) {
+    __m128i r = _mm_load_si128((const __m128i*)(row + i));
+    __m128i v = _mm_load_si128((const __m128i*)(query + i));
+
+    a = _mm_add_epi32(a, _mm_madd_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(r, r), 8),
+                                        _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8)));
+    a = _mm_add_epi32(a, _mm_madd_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(r, r), 8),
+                                        _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8)));
+  }
+  a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0x4E));
+  a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0xB1));
+  return _mm_cvtsi128_si32(a);
+#else
+  int32_t sum = 0;
+
+  for (; i < stride; i++) sum += row[i] * query[i];
+  return sum;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Person owning a template: the last person starting at or before it.
+// ---------------------------------------------------------------------------
+static inline int32_t FaceDbTemplatePerson(const FaceDb* db, uint32_t index) {
+  uint32_t lo = 0, hi = db->num_persons;
+
+  while (hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if (db->persons[mid].first_template <= index) lo = mid;
+    else                                          hi = mid;
+  }
+  return (db->num_persons > 0) ? (int32_t)lo : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Encode queries into the scratch buffer, padded to whole blocks by
+// repeating the last query. Int8 query scales follow the rows.
+// ---------------------------------------------------------------------------
+static inline int FaceDbEncodeQueries(FaceDb* db, const float* queries, uint32_t num_queries,
+                                      float** scales) {
+  size_t num_rows  = FaceDbAlignUp(num_queries, FACEDB_QUERY_BLOCK);
+  size_t row_bytes = FaceDbRowBytes(db);
+  size_t size      = num_rows * row_bytes + num_rows * sizeof(float);
+
+  if (size > db->scratch_size) {
+    void* scratch = FaceDbAlignedAlloc(size);
+
+    if (!scratch) return 0;
+    free(db->scratch);
+    db->scratch      = scratch;
+    db->scratch_size = size;
+  }
+
+  *scales = (float*)((uint8_t*)db->scratch + num_rows * row_bytes);
+  for (size_t k = 0; k < num_rows; k++) {
+    const float* query = queries + (size_t)((k < num_queries) ? k : num_queries - 1) * db->num_features;
+
+    (*scales)[k] = FaceDbEncode(query, db->num_features, db->stride, db->type,
+                                (uint8_t*)db->scratch + k * row_bytes);
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Match a batch of queries of num_features floats each, stored one after
+// another, against all templates. Returns 1 on success, 0 if the scratch
+// buffer can not be allocated.
+// ---------------------------------------------------------------------------
+static inline int FaceDbMatchBatch(FaceDb* db, const float* queries, uint32_t num_queries,
+                                   FaceDbMatch* matches) {
+  size_t row_bytes = FaceDbRowBytes(db);
+  float* query_scales = NULL;
+
+  for (uint32_t k = 0; k < num_queries; k++) {
+    matches[k].person         = -1;
+    matches[k].template_index = 0;
+    matches[k].score          = -INFINITY;
+  }
+  if (num_queries == 0 || db->num_templates == 0) return 1;
+  if (!FaceDbEncodeQueries(db, queries, num_queries, &query_scales)) return 0;
+
+  for (uint32_t tile = 0; tile < db->num_templates; tile += FACEDB_TILE) {
+    uint32_t tile_end = tile + FACEDB_TILE;
+
+    if (tile_end > db->num_templates) tile_end = db->num_templates;
+
+    for (uint32_t block = 0; block < num_queries; block += FACEDB_QUERY_BLOCK) {
+      const uint8_t* encoded = (const uint8_t*)db->scratch + (size_t)block * row_bytes;
+      uint32_t       count   = num_queries - block;
+      FaceDbMatch*   best    = matches + block;
+
+      if (count > FACEDB_QUERY_BLOCK) count = FACEDB_QUERY_BLOCK;
+
+      for (uint32_t t = tile; t < tile_end; t++) {
+        float scores[FACEDB_QUERY_BLOCK];
+
+        if (count == 1 && db->type == FACEDB_FLOAT32) {
+          scores[0] = FaceDbDotOneF32((const float*)FaceDbRow(db, t), (const float*)encoded, db->stride);
+        } else if (count == 1) {
+          scores[0] = (float)FaceDbDotOneS8((const int8_t*)FaceDbRow(db, t), (const int8_t*)encoded, db->stride) *
+                      db->scales[t] * query_scales[block];
+        } else if (db->type == FACEDB_FLOAT32) {
+          FaceDbDotF32((const float*)FaceDbRow(db, t), (const float*)encoded, db->stride,
+                       db->stride, scores);
+        } else {
+          int32_t dots[FACEDB_QUERY_BLOCK];
+
+          FaceDbDotS8((const int8_t*)FaceDbRow(db, t), (const int8_t*)encoded, db->stride,
+                      db->stride, dots);
+          for (int k = 0; k < FACEDB_QUERY_BLOCK; k++)
+            scores[k] = (float)dots[k] * db->scales[t] * query_scales[block + k];
+        }
+
+        for (uint32_t k = 0; k < count; k++) {
+          if (scores[k] > best[k].score) {
+            best[k].score          = scores[k];
+            best[k].template_index = t;
+          }
+        }
+      }
+    }
+  }
+
+  for (uint32_t k = 0; k < num_queries; k++)
+    matches[k].person = FaceDbTemplatePerson(db, matches[k].template_index);
+  return 1;
+}
+
+static inline int FaceDbMatchOne(FaceDb* db, const float* query, FaceDbMatch* match) {
+  return FaceDbMatchBatch(db, query, 1, match);
+}
+
+// ---------------------------------------------------------------------------
+// Index of a person by name, -1 if not enrolled.
+// ---------------------------------------------------------------------------
+static inline int32_t FaceDbFindPerson(const FaceDb* db, const char* name) {
+  for (uint32_t p = 0; p < db->num_persons; p++)
+    if (strcmp(db->persons[p].name, name) == 0) return (int32_t)p;
+  return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Copy a mapped database to the heap so persons can be added. Returns 1 on
+// success, 0 if out of memory.
+// ---------------------------------------------------------------------------
+static inline int FaceDbDetach(FaceDb* db) {
+  FaceDb copy = *db;
+  size_t row_bytes = FaceDbRowBytes(db);
+
+  if (!db->map) return 1;
+
+  copy.map               = NULL;
+  copy.map_size          = 0;
+  copy.scratch           = NULL;
+  copy.scratch_size      = 0;
+  copy.person_capacity   = db->num_persons;
+  copy.template_capacity = db->num_templates;
+  copy.persons   = (FaceDbPerson*)malloc((db->num_persons ? db->num_persons : 1) * sizeof(FaceDbPerson));
+  copy.liveness  = (float*)malloc(((size_t)db->num_persons * db->num_liveness + 1) * sizeof(float));
+  copy.scales    = (float*)malloc((db->num_templates + 1) * sizeof(float));
+  copy.templates = FaceDbAlignedAlloc((size_t)db->num_templates * row_bytes);
+
+  if (!copy.persons || !copy.liveness || !copy.scales || !copy.templates) {
+    free(copy.persons);
+    free(copy.liveness);
+    free(copy.scales);
+    free(copy.templates);
+    return 0;
+  }
+
+  memcpy(copy.persons, db->persons, db->num_persons * sizeof(FaceDbPerson));
+  memcpy(copy.liveness, db->liveness, (size_t)db->num_persons * db->num_liveness * sizeof(float));
+  if (db->type == FACEDB_INT8) memcpy(copy.scales, db->scales, db->num_templates * sizeof(float));
+  memcpy(copy.templates, db->templates, (size_t)db->num_templates * row_bytes);
+
+  FaceDbClose(db);
+  *db = copy;
+  return 1;
+}
+
+static inline int FaceDbReserve(FaceDb* db, uint32_t num_persons, uint32_t num_templates) {
+  size_t row_bytes = FaceDbRowBytes(db);
+
+  if (num_persons > db->person_capacity) {
+    uint32_t      capacity = num_persons > 2 * db->person_capacity ? num_persons : 2 * db->person_capacity;
+    FaceDbPerson* persons  = (FaceDbPerson*)realloc(db->persons, capacity * sizeof(FaceDbPerson));
+    float*        liveness = NULL;
+
+    if (!persons) return 0;
+    db->persons = persons;
+
+    liveness = (float*)realloc(db->liveness, ((size_t)capacity * db->num_liveness + 1) * sizeof(float));
+    if (!liveness) return 0;
+    db->liveness        = liveness;
+    db->person_capacity = capacity;
+  }
+
+  if (num_templates > db->template_capacity) {
+    uint32_t capacity  = num_templates > 2 * db->template_capacity ? num_templates : 2 * db->template_capacity;
+    float*   scales    = (float*)realloc(db->scales, (capacity + 1) * sizeof(float));
+    void*    templates = NULL;
+
+    if (!scales) return 0;
+    db->scales = scales;
+
+    // realloc() does not keep the alignment
+    if (!(templates = FaceDbAlignedAlloc((size_t)capacity * row_bytes))) return 0;
+    if (db->templates) memcpy(templates, db->templates, (size_t)db->num_templates * row_bytes);
+    free(db->templates);
+    db->templates         = templates;
+    db->template_capacity = capacity;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Enroll a person with num_templates templates of num_features floats and
+// num_liveness liveness features, which may be NULL for zeros. Returns 1 on
+// success, 0 if the name is invalid or taken, or out of memory.
+// ---------------------------------------------------------------------------
+static inline int FaceDbAddPerson(FaceDb* db, const char* name, const float* liveness,
+                                  const float* templates, uint32_t num_templates) {
+  size_t        row_bytes = FaceDbRowBytes(db);
+  FaceDbPerson* person    = NULL;
+
+  if (strlen(name) == 0 || strlen(name) > FACEDB_NAME_SIZE) {
+    fprintf(stderr, "Name '%s' must have 1 to %d characters.\n", name, FACEDB_NAME_SIZE);
+    return 0;
+  }
+  if (FaceDbFindPerson(db, name) >= 0) {
+    fprintf(stderr, "'%s' is already enrolled.\n", name);
+    return 0;
+  }
+  if (!FaceDbDetach(db) || !FaceDbReserve(db, db->num_persons + 1, db->num_templates + num_templates)) {
+    fprintf(stderr, "Out of memory enrolling '%s'.\n", name);
+    return 0;
+  }
+
+  person = &db->persons[db->num_persons];
+  memset(person, 0, sizeof(*person));
+  strcpy(person->name, name);
+  person->first_template = db->num_templates;
+  person->num_templates  = num_templates;
+
+  if (liveness)
+    memcpy(db->liveness + (size_t)db->num_persons * db->num_liveness, liveness,
+           db->num_liveness * sizeof(float));
+  else
+    memset(db->liveness + (size_t)db->num_persons * db->num_liveness, 0,
+           db->num_liveness * sizeof(float));
+
+  for (uint32_t t = 0; t < num_templates; t++) {
+    uint32_t index = db->num_templates + t;
+
+    db->scales[index] = FaceDbEncode(templates + (size_t)t * db->num_features, db->num_features,
+                                     db->stride, db->type,
+                                     (uint8_t*)db->templates + (size_t)index * row_bytes);
+  }
+
+  db->num_persons++;
+  db->num_templates += num_templates;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Read a version 4 face.bin of scripts/facedb.py as a one person database.
+// ---------------------------------------------------------------------------
+static inline int FaceDbReadV4(FaceDb* db, FILE* file, long file_size, const char* path) {
+  uint32_t header[3], num_templates = 0;
+  char     name[FACEDB_NAME_SIZE + 1] = { 0 };
+  float*   liveness  = NULL;
+  float*   templates = NULL;
+  size_t   features_bytes;
+  int      ok = 0;
+
+  if (fread(header, sizeof(header), 1, file) != 1 || !FaceDbCreate(db, header[1], header[2], FACEDB_FLOAT32))
+    goto done;
+
+  features_bytes = (size_t)db->num_features * sizeof(float);
+  if (fread(name, FACEDB_NAME_SIZE, 1, file) != 1) goto done;
+
+  liveness = (float*)malloc((db->num_liveness + 1) * sizeof(float));
+  if (!liveness || (db->num_liveness && fread(liveness, sizeof(float), db->num_liveness, file) != db->num_liveness) ||
+      fread(&num_templates, sizeof(num_templates), 1, file) != 1)
+    goto done;
+
+  // Check the size before trusting the count
+  if ((uint64_t)ftell(file) + (uint64_t)num_templates * 2 * features_bytes != (uint64_t)file_size) {
+    fprintf(stderr, "'%s' has %ld bytes, not %u templates of %u features.\n", path, file_size,
+            num_templates, db->num_features);
+    goto done;
+  }
+
+  templates = (float*)malloc((size_t)num_templates * features_bytes + 1);
+  if (!templates) goto done;
+
+  // The second copy of every template is skipped
+  for (uint32_t t = 0; t < num_templates; t++) {
+    if (fread(templates + (size_t)t * db->num_features, features_bytes, 1, file) != 1 ||
+        fseek(file, (long)features_bytes, SEEK_CUR) != 0)
+      goto done;
+  }
+
+  ok = FaceDbAddPerson(db, name, liveness, templates, num_templates);
+
+done:
+  if (!ok) fprintf(stderr, "Failed to read version 4 face database '%s'.\n", path);
+  free(liveness);
+  free(templates);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Map a version 5 database. All offsets and sizes are checked against the
+// file before use.
+// ---------------------------------------------------------------------------
+static inline int FaceDbMapV5(FaceDb* db, int fd, size_t file_size, const char* path) {
+  const FaceDbHeader* header = NULL;
+  uint64_t            row_bytes;
+  void*               map = NULL;
+
+  if (file_size < sizeof(FaceDbHeader)) goto invalid;
+
+  map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map '%s'.\n", path);
+    return 0;
+  }
+
+  header = (const FaceDbHeader*)map;
+  if (!FaceDbCreate(db, header->num_features, header->num_liveness, header->type) ||
+      header->stride != db->stride)
+    goto invalid;
+
+  row_bytes = FaceDbRowBytes(db);
+  if (!FaceDbRangeFits(header->persons_offset, header->num_persons, sizeof(FaceDbPerson), file_size) ||
+      !FaceDbRangeFits(header->liveness_offset, (uint64_t)header->num_persons * header->num_liveness,
+                       sizeof(float), file_size) ||
+      (header->type == FACEDB_INT8 &&
+       !FaceDbRangeFits(header->scales_offset, header->num_templates, sizeof(float), file_size)) ||
+      !FaceDbRangeFits(header->templates_offset, header->num_templates, row_bytes, file_size) ||
+      header->templates_offset % FACEDB_ALIGN != 0 ||
+      header->persons_offset % sizeof(uint32_t) != 0 || header->liveness_offset % sizeof(float) != 0 ||
+      header->scales_offset % sizeof(float) != 0)
+    goto invalid;
+
+  db->map           = map;
+  db->map_size      = file_size;
+  db->num_persons   = header->num_persons;
+  db->num_templates = header->num_templates;
+  db->persons       = (FaceDbPerson*)((uint8_t*)map + header->persons_offset);
+  db->liveness      = (float*)((uint8_t*)map + header->liveness_offset);
+  db->scales        = (header->type == FACEDB_INT8) ? (float*)((uint8_t*)map + header->scales_offset) : NULL;
+  db->templates     = (uint8_t*)map + header->templates_offset;
+
+  // Persons must cover the templates in order
+  for (uint32_t p = 0, next = 0; p < db->num_persons; p++) {
+    const FaceDbPerson* person = &db->persons[p];
+
+    if (person->first_template != next || person->num_templates > db->num_templates - next ||
+        memchr(person->name, '\0', sizeof(person->name)) == NULL) {
+      db->map = NULL;
+      goto invalid;
+    }
+    next += person->num_templates;
+    if (p + 1 == db->num_persons && next != db->num_templates) {
+      db->map = NULL;
+      goto invalid;
+    }
+  }
+  return 1;
+
+invalid:
+  fprintf(stderr, "'%s' is not a valid version %d face database.\n", path, FACEDB_VERSION);
+  if (map && map != MAP_FAILED) munmap(map, file_size);
+  memset(db, 0, sizeof(*db));
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Open a face database: version 5 files are mapped, version 4 files of
+// scripts/facedb.py are read into memory. Returns 1 on success, 0 on
+// failure. Free with FaceDbClose().
+// ---------------------------------------------------------------------------
+static inline int FaceDbOpen(FaceDb* db, const char* path) {
+  FILE*       file    = fopen(path, "rb");
+  uint32_t    version = 0;
+  struct stat st;
+  int         ok = 0;
+
+  memset(db, 0, sizeof(*db));
+  if (!file) {
+    fprintf(stderr, "Failed to open '%s'.\n", path);
+    return 0;
+  }
+
+  if (fstat(fileno(file), &st) != 0 || fread(&version, sizeof(version), 1, file) != 1) {
+    fprintf(stderr, "Failed to read '%s'.\n", path);
+  } else if (version == FACEDB_VERSION_V4) {
+    rewind(file);
+    ok = FaceDbReadV4(db, file, (long)st.st_size, path);
+  } else if (version == FACEDB_VERSION) {
+    ok = FaceDbMapV5(db, fileno(file), (size_t)st.st_size, path);
+  } else {
+    fprintf(stderr, "'%s' has unsupported face database version %u.\n", path, version);
+  }
+
+  fclose(file);
+  if (!ok) FaceDbClose(db);
+  return ok;
+}
+
+static inline int FaceDbWritePadded(FILE* file, const void* data, size_t size, uint64_t* offset,
+                                    uint64_t align) {
+  static const uint8_t zeros[FACEDB_ALIGN] = { 0 };
+  uint64_t             padded = FaceDbAlignUp(*offset + size, align);
+
+  if (size && fwrite(data, size, 1, file) != 1) return 0;
+  if (padded > *offset + size && fwrite(zeros, padded - *offset - size, 1, file) != 1) return 0;
+  *offset = padded;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Write a database as version 5. The file is written next to the target
+// and renamed, so readers mapping the old file are not disturbed.
+// ---------------------------------------------------------------------------
+static inline int FaceDbSave(const FaceDb* db, const char* path) {
+  FaceDbHeader header;
+  size_t       tmp_size = strlen(path) + 5;
+  char*        tmp      = (char*)malloc(tmp_size);
+  FILE*        file     = NULL;
+  uint64_t     offset   = 0;
+  size_t       persons_size  = (size_t)db->num_persons * sizeof(FaceDbPerson);
+  size_t       liveness_size = (size_t)db->num_persons * db->num_liveness * sizeof(float);
+  size_t       scales_size   = (db->type == FACEDB_INT8) ? db->num_templates * sizeof(float) : 0;
+  int          ok = 0;
+
+  if (!tmp) return 0;
+  snprintf(tmp, tmp_size, "%s.tmp", path);
+
+  memset(&header, 0, sizeof(header));
+  header.version          = FACEDB_VERSION;
+  header.num_features     = db->num_features;
+  header.num_liveness     = db->num_liveness;
+  header.num_persons      = db->num_persons;
+  header.num_templates    = db->num_templates;
+  header.type             = db->type;
+  header.stride           = db->stride;
+  header.persons_offset   = sizeof(header);
+  header.liveness_offset  = FaceDbAlignUp(header.persons_offset + persons_size, FACEDB_ALIGN);
+  header.scales_offset    = FaceDbAlignUp(header.liveness_offset + liveness_size, FACEDB_ALIGN);
+  header.templates_offset = FaceDbAlignUp(header.scales_offset + scales_size, FACEDB_ALIGN);
+
+  if ((file = fopen(tmp, "wb")) != NULL) {
+    ok = FaceDbWritePadded(file, &header, sizeof(header), &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, db->persons, persons_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, db->liveness, liveness_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, db->scales, scales_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, db->templates, (size_t)db->num_templates * FaceDbRowBytes(db),
+                           &offset, 1);
+    ok = (fclose(file) == 0) && ok;
+  }
+
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) {
+    fprintf(stderr, "Failed to write '%s'.\n", path);
+    unlink(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Write one person as a version 4 face.bin like scripts/facedb.py, for
+// consumers of the old format. Templates are written normalized.
+// ---------------------------------------------------------------------------
+static inline int FaceDbSaveV4(const FaceDb* db, uint32_t person_index, const char* path) {
+  const FaceDbPerson* person   = &db->persons[person_index];
+  uint32_t            header[3] = { FACEDB_VERSION_V4, db->num_features, db->num_liveness };
+  char                name[FACEDB_NAME_SIZE] = { 0 };
+  float*              features = (float*)malloc(db->num_features * sizeof(float));
+  FILE*               file     = fopen(path, "wb");
+  int                 ok       = file && features;
+
+  memcpy(name, person->name, strnlen(person->name, FACEDB_NAME_SIZE));
+  ok = ok && fwrite(header, sizeof(header), 1, file) == 1 && fwrite(name, sizeof(name), 1, file) == 1 &&
+       (db->num_liveness == 0 ||
+        fwrite(db->liveness + (size_t)person_index * db->num_liveness, sizeof(float), db->num_liveness,
+               file) == db->num_liveness) &&
+       fwrite(&person->num_templates, sizeof(uint32_t), 1, file) == 1;
+
+  for (uint32_t t = 0; ok && t < person->num_templates; t++) {
+    FaceDbGetTemplate(db, person->first_template + t, features);
+    ok = fwrite(features, sizeof(float), db->num_features, file) == db->num_features &&
+         fwrite(features, sizeof(float), db->num_features, file) == db->num_features;
+  }
+
+  if (file) ok = (fclose(file) == 0) && ok;
+  if (!ok) fprintf(stderr, "Failed to write '%s'.\n", path);
+  free(features);
+  return ok;
+}
+
+#endif  // FACEDB_H
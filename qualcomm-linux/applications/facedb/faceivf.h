@@ -0,0 +1,646 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Approximate nearest neighbor index of a face database (IVF-PQ).
+//
+// The normalized templates are split into lists by a spherical k-means
+// over the cosine similarity. Within a list a template is stored as the
+// product quantization of its residual to the list centroid: the row is
+// cut into subspaces of subspace_dim values, and every subspace is stored
+// as the index of the nearest of FACEIVF_CODEBOOK codewords, one byte.
+//
+// A query is compared with all list centroids using the kernels of
+// facedb.h, then only the nprobe closest lists are scanned. The score of a
+// code is the centroid score plus one table lookup per subspace, the table
+// holds the dot products of the query with all codewords. The best rerank
+// candidates are scored exactly on the database rows. Codes of a list are
+// stored one after another, so a probe is a sequential read.
+//
+// The index is written next to the database, e.g. faces.bin.ivf, and
+// mapped like it:
+//
+//   FaceIvfHeader                          128 bytes
+//   float    centroids[lists][stride]      64 byte aligned
+//   float    codebooks[subspaces][FACEIVF_CODEBOOK][subspace_dim]
+//   uint32   offsets[lists + 1]            first code of every list
+//   uint32   ids[templates]                template of every code
+//   uint8    codes[templates][subspaces]
+//
+// The header records a hash of the database persons, an index that no
+// longer matches its database is rejected on open.
+
+#ifndef FACEIVF_H
+#define FACEIVF_H
+
+#include "facedb.h"
+
+#define FACEIVF_MAGIC           "FDBIVF01"
+#define FACEIVF_CODEBOOK        256
+#define FACEIVF_SUBSPACE_DIM    8
+#define FACEIVF_TRAIN_SIZE      8192
+#define FACEIVF_ITERATIONS      8
+#define FACEIVF_DEFAULT_NPROBE  8
+#define FACEIVF_DEFAULT_RERANK  32
+#define FACEIVF_MAX_RERANK      256
+
+// ---------------------------------------------------------------------------
+// File header
+// ---------------------------------------------------------------------------
+typedef struct {
+  char     magic[8];
+  uint32_t num_features;
+  uint32_t stride;           // float row of the centroids and codes
+  uint32_t num_lists;
+  uint32_t num_subspaces;
+  uint32_t subspace_dim;
+  uint32_t num_templates;
+  uint64_t db_hash;
+  uint64_t centroids_offset;
+  uint64_t codebooks_offset;
+  uint64_t offsets_offset;
+  uint64_t ids_offset;
+  uint64_t codes_offset;
+  uint8_t  reserved[48];
+} FaceIvfHeader;
+
+// ---------------------------------------------------------------------------
+// Index, built in memory or mapped from a file
+// ---------------------------------------------------------------------------
+typedef struct {
+  uint32_t  num_features;
+  uint32_t  stride;
+  uint32_t  num_lists;
+  uint32_t  num_subspaces;
+  uint32_t  subspace_dim;
+  uint32_t  num_templates;
+  uint64_t  db_hash;
+  float*    centroids;
+  float*    codebooks;
+  uint32_t* offsets;
+  uint32_t* ids;
+  uint8_t*  codes;
+
+  // Private
+  void*     map;
+  size_t    map_size;
+  void*     scratch;
+  size_t    scratch_size;
+} FaceIvf;
+
+// A candidate of the scan, kept sorted by descending score
+typedef struct {
+  float    score;
+  uint32_t id;
+} FaceIvfCandidate;
+
+static inline void FaceIvfClose(FaceIvf* ivf) {
+  if (ivf->map) {
+    munmap(ivf->map, ivf->map_size);
+  } else {
+    free(ivf->centroids);
+    free(ivf->codebooks);
+    free(ivf->offsets);
+    free(ivf->ids);
+    free(ivf->codes);
+  }
+  free(ivf->scratch);
+  memset(ivf, 0, sizeof(*ivf));
+}
+
+// ---------------------------------------------------------------------------
+// Hash of the enrolled persons and the start of their first templates, so
+// an index built for another state of the database is detected.
+// ---------------------------------------------------------------------------
+static inline uint64_t FaceIvfHashBytes(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+
+  for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  return hash;
+}
+
+static inline uint64_t FaceIvfDbHash(const FaceDb* db) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t   head = FaceDbRowBytes(db) < 64 ? FaceDbRowBytes(db) : 64;
+
+  hash = FaceIvfHashBytes(hash, &db->num_templates, sizeof(db->num_templates));
+  hash = FaceIvfHashBytes(hash, &db->num_features, sizeof(db->num_features));
+  hash = FaceIvfHashBytes(hash, db->persons, (size_t)db->num_persons * sizeof(FaceDbPerson));
+  for (uint32_t p = 0; p < db->num_persons; p++)
+    if (db->persons[p].num_templates > 0)
+      hash = FaceIvfHashBytes(hash, FaceDbRow(db, db->persons[p].first_template), head);
+  return hash;
+}
+
+static inline uint32_t FaceIvfRandom(uint64_t* state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (uint32_t)(*state >> 33);
+}
+
+// ---------------------------------------------------------------------------
+// Index of the centroid with the largest dot product with a row.
+// ---------------------------------------------------------------------------
+static inline uint32_t FaceIvfNearestList(const FaceIvf* ivf, const float* row) {
+  uint32_t best       = 0;
+  float    best_score = -INFINITY;
+
+  for (uint32_t l = 0; l < ivf->num_lists; l++) {
+    float score = FaceDbDotOneF32(ivf->centroids + (size_t)l * ivf->stride, row, ivf->stride);
+
+    if (score > best_score) {
+      best_score = score;
+      best       = l;
+    }
+  }
+  return best;
+}
+
+// ---------------------------------------------------------------------------
+// Index of the codeword of subspace m closest to a residual subvector,
+// minimizing |c|^2 - 2 r.c with the precomputed codeword norms.
+// ---------------------------------------------------------------------------
+static inline uint8_t FaceIvfNearestCode(const float* codebook, const float* norms, const float* sub,
+                                         uint32_t dim) {
+  uint32_t best      = 0;
+  float    best_dist = INFINITY;
+
+  for (uint32_t k = 0; k < FACEIVF_CODEBOOK; k++) {
+    const float* code = codebook + (size_t)k * dim;
+    float        dot  = 0.0f;
+    float        dist;
+
+    for (uint32_t d = 0; d < dim; d++) dot += code[d] * sub[d];
+    dist = norms[k] - 2.0f * dot;
+    if (dist < best_dist) {
+      best_dist = dist;
+      best      = k;
+    }
+  }
+  return (uint8_t)best;
+}
+
+static inline void FaceIvfCodebookNorms(const FaceIvf* ivf, uint32_t m, float* norms) {
+  const float* codebook = ivf->codebooks + (size_t)m * FACEIVF_CODEBOOK * ivf->subspace_dim;
+
+  for (uint32_t k = 0; k < FACEIVF_CODEBOOK; k++) {
+    norms[k] = 0.0f;
+    for (uint32_t d = 0; d < ivf->subspace_dim; d++)
+      norms[k] += codebook[k * ivf->subspace_dim + d] * codebook[k * ivf->subspace_dim + d];
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Spherical k-means of the training rows into the list centroids. Lists
+// left empty restart at a random row.
+// ---------------------------------------------------------------------------
+static inline void FaceIvfTrainLists(FaceIvf* ivf, const float* rows, uint32_t num_rows, float* sums,
+                                     uint32_t* counts, uint64_t* state) {
+  size_t stride = ivf->stride;
+
+  for (uint32_t l = 0; l < ivf->num_lists; l++)
+    memcpy(ivf->centroids + l * stride, rows + (size_t)(FaceIvfRandom(state) % num_rows) * stride,
+           stride * sizeof(float));
+
+  for (int it = 0; it < FACEIVF_ITERATIONS; it++) {
+    memset(sums, 0, (size_t)ivf->num_lists * stride * sizeof(float));
+    memset(counts, 0, ivf->num_lists * sizeof(uint32_t));
+
+    for (uint32_t r = 0; r < num_rows; r++) {
+      const float* row = rows + (size_t)r * stride;
+      uint32_t     l   = FaceIvfNearestList(ivf, row);
+
+      for (size_t i = 0; i < stride; i++) sums[l * stride + i] += row[i];
+      counts[l]++;
+    }
+
+    for (uint32_t l = 0; l < ivf->num_lists; l++) {
+      float* centroid = ivf->centroids + l * stride;
+      double norm     = 0.0;
+
+      if (counts[l] == 0) {
+        memcpy(centroid, rows + (size_t)(FaceIvfRandom(state) % num_rows) * stride, stride * sizeof(float));
+        continue;
+      }
+      for (size_t i = 0; i < stride; i++) norm += (double)sums[l * stride + i] * sums[l * stride + i];
+      for (size_t i = 0; i < stride; i++)
+        centroid[i] = (norm > 0.0) ? (float)(sums[l * stride + i] / sqrt(norm)) : 0.0f;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// k-means of the residual subvectors of every subspace into the codebooks.
+// ---------------------------------------------------------------------------
+static inline void FaceIvfTrainCodebooks(FaceIvf* ivf, const float* residuals, uint32_t num_rows,
+                                         float* sums, uint32_t* counts, uint64_t* state) {
+  uint32_t dim = ivf->subspace_dim;
+  float    norms[FACEIVF_CODEBOOK];
+
+  for (uint32_t m = 0; m < ivf->num_subspaces; m++) {
+    float* codebook = ivf->codebooks + (size_t)m * FACEIVF_CODEBOOK * dim;
+
+    for (uint32_t k = 0; k < FACEIVF_CODEBOOK; k++)
+      memcpy(codebook + k * dim, residuals + (size_t)(FaceIvfRandom(state) % num_rows) * ivf->stride + m * dim,
+             dim * sizeof(float));
+
+    for (int it = 0; it < FACEIVF_ITERATIONS; it++) {
+      memset(sums, 0, FACEIVF_CODEBOOK * dim * sizeof(float));
+      memset(counts, 0, FACEIVF_CODEBOOK * sizeof(uint32_t));
+      FaceIvfCodebookNorms(ivf, m, norms);
+
+      for (uint32_t r = 0; r < num_rows; r++) {
+        const float* sub = residuals + (size_t)r * ivf->stride + m * dim;
+        uint8_t      k   = FaceIvfNearestCode(codebook, norms, sub, dim);
+
+        for (uint32_t d = 0; d < dim; d++) sums[k * dim + d] += sub[d];
+        counts[k]++;
+      }
+
+      for (uint32_t k = 0; k < FACEIVF_CODEBOOK; k++) {
+        const float* src = (counts[k] > 0) ? sums + k * dim
+                                           : residuals + (size_t)(FaceIvfRandom(state) % num_rows) * ivf->stride + m * dim;
+        float        div = (counts[k] > 0) ? (float)counts[k] : 1.0f;
+
+        for (uint32_t d = 0; d < dim; d++) codebook[k * dim + d] = src[d] / div;
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Build the index of a database. num_lists 0 picks sqrt(templates),
+// subspace_dim 0 picks FACEIVF_SUBSPACE_DIM. Returns 1 on success, 0 on
+// invalid parameters or out of memory. Free with FaceIvfClose().
+// ---------------------------------------------------------------------------
+static inline int FaceIvfBuild(FaceIvf* ivf, const FaceDb* db, uint32_t num_lists, uint32_t subspace_dim) {
+  uint32_t  n          = db->num_templates;
+  uint32_t  num_train  = (n < FACEIVF_TRAIN_SIZE) ? n : FACEIVF_TRAIN_SIZE;
+  uint64_t  state      = 0x1f5eedULL;
+  float*    rows       = NULL;
+  float*    sums       = NULL;
+  float*    row        = NULL;
+  float*    norms      = NULL;
+  uint32_t* counts     = NULL;
+  uint32_t* assignment = NULL;
+  uint32_t* sample     = NULL;
+  size_t    stride;
+  int       ok         = 0;
+
+  memset(ivf, 0, sizeof(*ivf));
+  if (subspace_dim == 0) subspace_dim = FACEIVF_SUBSPACE_DIM;
+  if (num_lists == 0) num_lists = (uint32_t)sqrt((double)n);
+  if (num_lists < 1) num_lists = 1;
+  if (num_lists > n) num_lists = n;
+
+  ivf->num_features  = db->num_features;
+  ivf->stride        = (uint32_t)FaceDbAlignUp(db->num_features, FACEDB_ALIGN / sizeof(float));
+  ivf->num_lists     = num_lists;
+  ivf->subspace_dim  = subspace_dim;
+  ivf->num_subspaces = ivf->stride / subspace_dim;
+  ivf->num_templates = n;
+  ivf->db_hash       = FaceIvfDbHash(db);
+  stride             = ivf->stride;
+
+  if (n == 0 || subspace_dim > 64 || ivf->stride % subspace_dim != 0) {
+    fprintf(stderr, "Can not index %u templates with subspaces of %u values.\n", n, subspace_dim);
+    return 0;
+  }
+
+  ivf->centroids = (float*)FaceDbAlignedAlloc((size_t)num_lists * stride * sizeof(float));
+  ivf->codebooks = (float*)malloc((size_t)ivf->num_subspaces * FACEIVF_CODEBOOK * subspace_dim * sizeof(float));
+  ivf->offsets   = (uint32_t*)calloc((size_t)num_lists + 1, sizeof(uint32_t));
+  ivf->ids       = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+  ivf->codes     = (uint8_t*)malloc((size_t)n * ivf->num_subspaces);
+  rows           = (float*)FaceDbAlignedAlloc((size_t)num_train * stride * sizeof(float));
+  sums           = (float*)malloc(((size_t)num_lists * stride + FACEIVF_CODEBOOK * subspace_dim) * sizeof(float));
+  row            = (float*)FaceDbAlignedAlloc(stride * sizeof(float));
+  norms          = (float*)malloc((size_t)ivf->num_subspaces * FACEIVF_CODEBOOK * sizeof(float));
+  counts         = (uint32_t*)malloc(((size_t)num_lists + FACEIVF_CODEBOOK) * sizeof(uint32_t));
+  assignment     = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+  sample         = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+  if (!ivf->centroids || !ivf->codebooks || !ivf->offsets || !ivf->ids || !ivf->codes || !rows || !sums ||
+      !row || !norms || !counts || !assignment || !sample) {
+    fprintf(stderr, "Out of memory building the index of %u templates.\n", n);
+    goto done;
+  }
+
+  // Training rows: a random subset of the templates, decoded and padded
+  for (uint32_t t = 0; t < n; t++) sample[t] = t;
+  for (uint32_t t = 0; t < num_train; t++) {
+    uint32_t j   = t + FaceIvfRandom(&state) % (n - t);
+    uint32_t tmp = sample[t];
+
+    sample[t] = sample[j];
+    sample[j] = tmp;
+    memset(rows + t * stride, 0, stride * sizeof(float));
+    FaceDbGetTemplate(db, sample[t], rows + t * stride);
+  }
+
+  FaceIvfTrainLists(ivf, rows, num_train, sums, counts, &state);
+
+  // Codebooks are trained on the residuals to the list centroids
+  for (uint32_t t = 0; t < num_train; t++) {
+    const float* centroid = ivf->centroids + (size_t)FaceIvfNearestList(ivf, rows + t * stride) * stride;
+
+    for (size_t i = 0; i < stride; i++) rows[t * stride + i] -= centroid[i];
+  }
+  FaceIvfTrainCodebooks(ivf, rows, num_train, sums, counts, &state);
+
+  // Lists in template order, then every template encoded at its position
+  memset(row, 0, stride * sizeof(float));
+  for (uint32_t t = 0; t < n; t++) {
+    FaceDbGetTemplate(db, t, row);
+    assignment[t] = FaceIvfNearestList(ivf, row);
+    ivf->offsets[assignment[t] + 1]++;
+  }
+  for (uint32_t l = 0; l < num_lists; l++) ivf->offsets[l + 1] += ivf->offsets[l];
+
+  memcpy(counts, ivf->offsets, num_lists * sizeof(uint32_t));
+  for (uint32_t m = 0; m < ivf->num_subspaces; m++) FaceIvfCodebookNorms(ivf, m, norms + m * FACEIVF_CODEBOOK);
+  for (uint32_t t = 0; t < n; t++) {
+    uint32_t     pos      = counts[assignment[t]]++;
+    const float* centroid = ivf->centroids + (size_t)assignment[t] * stride;
+
+    FaceDbGetTemplate(db, t, row);
+    for (size_t i = 0; i < stride; i++) row[i] -= centroid[i];
+
+    ivf->ids[pos] = t;
+    for (uint32_t m = 0; m < ivf->num_subspaces; m++)
+      ivf->codes[(size_t)pos * ivf->num_subspaces + m] =
+          FaceIvfNearestCode(ivf->codebooks + (size_t)m * FACEIVF_CODEBOOK * subspace_dim,
+                             norms + m * FACEIVF_CODEBOOK, row + m * subspace_dim, subspace_dim);
+    // The residual changes the padding, restore it for the next template
+    memset(row, 0, stride * sizeof(float));
+  }
+  ok = 1;
+
+done:
+  free(sample);
+  free(assignment);
+  free(counts);
+  free(norms);
+  free(row);
+  free(sums);
+  free(rows);
+  if (!ok) FaceIvfClose(ivf);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Write the index, like FaceDbSave() through a renamed temporary file.
+// ---------------------------------------------------------------------------
+static inline int FaceIvfSave(const FaceIvf* ivf, const char* path) {
+  FaceIvfHeader header;
+  size_t        tmp_size = strlen(path) + 5;
+  char*         tmp      = (char*)malloc(tmp_size);
+  FILE*         file     = NULL;
+  uint64_t      offset   = 0;
+  size_t        centroids_size = (size_t)ivf->num_lists * ivf->stride * sizeof(float);
+  size_t        codebooks_size = (size_t)ivf->num_subspaces * FACEIVF_CODEBOOK * ivf->subspace_dim * sizeof(float);
+  size_t        offsets_size   = ((size_t)ivf->num_lists + 1) * sizeof(uint32_t);
+  size_t        ids_size       = (size_t)ivf->num_templates * sizeof(uint32_t);
+  int           ok = 0;
+
+  if (!tmp) return 0;
+  snprintf(tmp, tmp_size, "%s.tmp", path);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FACEIVF_MAGIC, sizeof(header.magic));
+  header.num_features     = ivf->num_features;
+  header.stride           = ivf->stride;
+  header.num_lists        = ivf->num_lists;
+  header.num_subspaces    = ivf->num_subspaces;
+  header.subspace_dim     = ivf->subspace_dim;
+  header.num_templates    = ivf->num_templates;
+  header.db_hash          = ivf->db_hash;
+  header.centroids_offset = sizeof(header);
+  header.codebooks_offset = FaceDbAlignUp(header.centroids_offset + centroids_size, FACEDB_ALIGN);
+  header.offsets_offset   = FaceDbAlignUp(header.codebooks_offset + codebooks_size, FACEDB_ALIGN);
+  header.ids_offset       = FaceDbAlignUp(header.offsets_offset + offsets_size, FACEDB_ALIGN);
+  header.codes_offset     = FaceDbAlignUp(header.ids_offset + ids_size, FACEDB_ALIGN);
+
+  if ((file = fopen(tmp, "wb")) != NULL) {
+    ok = FaceDbWritePadded(file, &header, sizeof(header), &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, ivf->centroids, centroids_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, ivf->codebooks, codebooks_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, ivf->offsets, offsets_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, ivf->ids, ids_size, &offset, FACEDB_ALIGN) &&
+         FaceDbWritePadded(file, ivf->codes, (size_t)ivf->num_templates * ivf->num_subspaces, &offset, 1);
+    ok = (fclose(file) == 0) && ok;
+  }
+
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) {
+    fprintf(stderr, "Failed to write '%s'.\n", path);
+    unlink(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Map the index of a database. Returns 1 on success, 0 if the file is
+// missing, invalid or was built for another state of the database.
+// ---------------------------------------------------------------------------
+static inline int FaceIvfOpen(FaceIvf* ivf, const char* path, const FaceDb* db) {
+  const FaceIvfHeader* header = NULL;
+  struct stat          st;
+  int                  fd = open(path, O_RDONLY | O_CLOEXEC);
+  void*                map = MAP_FAILED;
+  uint64_t             size;
+
+  memset(ivf, 0, sizeof(*ivf));
+  if (fd < 0) return 0;
+
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(FaceIvfHeader))
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map '%s'.\n", path);
+    return 0;
+  }
+
+  header = (const FaceIvfHeader*)map;
+  size   = (uint64_t)st.st_size;
+  if (memcmp(header->magic, FACEIVF_MAGIC, sizeof(header->magic)) != 0 || header->num_lists == 0 ||
+      header->subspace_dim == 0 || header->subspace_dim > 64 ||
+      header->stride != FaceDbAlignUp(header->num_features, FACEDB_ALIGN / sizeof(float)) ||
+      (uint64_t)header->num_subspaces * header->subspace_dim != header->stride ||
+      header->centroids_offset % FACEDB_ALIGN != 0 || header->offsets_offset % sizeof(uint32_t) != 0 ||
+      header->ids_offset % sizeof(uint32_t) != 0 || header->codebooks_offset % sizeof(float) != 0 ||
+      !FaceDbRangeFits(header->centroids_offset, (uint64_t)header->num_lists * header->stride, sizeof(float),
+                       size) ||
+      !FaceDbRangeFits(header->codebooks_offset, header->stride, FACEIVF_CODEBOOK * sizeof(float), size) ||
+      !FaceDbRangeFits(header->offsets_offset, (uint64_t)header->num_lists + 1, sizeof(uint32_t), size) ||
+      !FaceDbRangeFits(header->ids_offset, header->num_templates, sizeof(uint32_t), size) ||
+      !FaceDbRangeFits(header->codes_offset, header->num_templates, header->num_subspaces, size)) {
+    fprintf(stderr, "'%s' is not a valid face index.\n", path);
+    munmap(map, (size_t)st.st_size);
+    return 0;
+  }
+
+  if (header->num_templates != db->num_templates || header->num_features != db->num_features ||
+      header->db_hash != FaceIvfDbHash(db)) {
+    fprintf(stderr, "'%s' does not match the database, rebuild the index.\n", path);
+    munmap(map, (size_t)st.st_size);
+    return 0;
+  }
+
+  ivf->map           = map;
+  ivf->map_size      = (size_t)st.st_size;
+  ivf->num_features  = header->num_features;
+  ivf->stride        = header->stride;
+  ivf->num_lists     = header->num_lists;
+  ivf->num_subspaces = header->num_subspaces;
+  ivf->subspace_dim  = header->subspace_dim;
+  ivf->num_templates = header->num_templates;
+  ivf->db_hash       = header->db_hash;
+  ivf->centroids     = (float*)((uint8_t*)map + header->centroids_offset);
+  ivf->codebooks     = (float*)((uint8_t*)map + header->codebooks_offset);
+  ivf->offsets       = (uint32_t*)((uint8_t*)map + header->offsets_offset);
+  ivf->ids           = (uint32_t*)((uint8_t*)map + header->ids_offset);
+  ivf->codes         = (uint8_t*)map + header->codes_offset;
+
+  // Lists must cover the codes in order and point at valid templates
+  for (uint32_t l = 0; l < ivf->num_lists; l++) {
+    if (ivf->offsets[l] > ivf->offsets[l + 1] || ivf->offsets[l + 1] > ivf->num_templates ||
+        (l == 0 && ivf->offsets[0] != 0) ||
+        (l + 1 == ivf->num_lists && ivf->offsets[l + 1] != ivf->num_templates)) {
+      fprintf(stderr, "'%s' has invalid lists.\n", path);
+      FaceIvfClose(ivf);
+      return 0;
+    }
+  }
+  for (uint32_t t = 0; t < ivf->num_templates; t++) {
+    if (ivf->ids[t] >= ivf->num_templates) {
+      fprintf(stderr, "'%s' has invalid template ids.\n", path);
+      FaceIvfClose(ivf);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Insert a candidate into a list sorted by descending score
+static inline void FaceIvfInsert(FaceIvfCandidate* top, uint32_t* count, uint32_t capacity, float score,
+                                 uint32_t id) {
+  uint32_t pos = *count;
+
+  if (*count == capacity && !(score > top[capacity - 1].score)) return;
+
+  while (pos > 0 && score > top[pos - 1].score) pos--;
+  if (*count < capacity) (*count)++;
+  memmove(&top[pos + 1], &top[pos], (*count - 1 - pos) * sizeof(FaceIvfCandidate));
+  top[pos].score = score;
+  top[pos].id    = id;
+}
+
+// ---------------------------------------------------------------------------
+// Best match of a query of num_features floats. nprobe lists are scanned
+// and the rerank best codes are scored exactly on the database, 0 picks the
+// defaults. Returns 1 on success, 0 if out of memory.
+// ---------------------------------------------------------------------------
+static inline int FaceIvfSearch(FaceIvf* ivf, const FaceDb* db, const float* query, uint32_t nprobe,
+                                uint32_t rerank, FaceDbMatch* match) {
+  size_t            stride    = ivf->stride;
+  size_t            row_bytes = FaceDbRowBytes(db);
+  uint32_t          dim       = ivf->subspace_dim;
+  uint32_t          num_probes = 0, num_candidates = 0;
+  size_t            size;
+  float*            encoded;
+  float*            table;
+  uint8_t*          db_query;
+  FaceIvfCandidate* probes;
+  FaceIvfCandidate* candidates;
+  float             db_scale;
+
+  match->person         = -1;
+  match->template_index = 0;
+  match->score          = -INFINITY;
+  if (ivf->num_templates == 0) return 1;
+
+  if (nprobe == 0) nprobe = FACEIVF_DEFAULT_NPROBE;
+  if (nprobe > ivf->num_lists) nprobe = ivf->num_lists;
+  if (rerank == 0) rerank = FACEIVF_DEFAULT_RERANK;
+  if (rerank > FACEIVF_MAX_RERANK) rerank = FACEIVF_MAX_RERANK;
+
+  // Aligned query rows first, then the lookup table and candidate lists
+  size = stride * sizeof(float) + row_bytes + (size_t)ivf->num_subspaces * FACEIVF_CODEBOOK * sizeof(float) +
+         ((size_t)nprobe + rerank) * sizeof(FaceIvfCandidate);
+  if (size > ivf->scratch_size) {
+    void* scratch = FaceDbAlignedAlloc(size);
+
+    if (!scratch) return 0;
+    free(ivf->scratch);
+    ivf->scratch      = scratch;
+    ivf->scratch_size = size;
+  }
+  encoded    = (float*)ivf->scratch;
+  db_query   = (uint8_t*)(encoded + stride);
+  table      = (float*)(db_query + row_bytes);
+  probes     = (FaceIvfCandidate*)(table + (size_t)ivf->num_subspaces * FACEIVF_CODEBOOK);
+  candidates = probes + nprobe;
+
+  FaceDbEncode(query, ivf->num_features, (uint32_t)stride, FACEDB_FLOAT32, encoded);
+  db_scale = FaceDbEncode(query, db->num_features, db->stride, db->type, db_query);
+
+  for (uint32_t l = 0; l < ivf->num_lists; l++)
+    FaceIvfInsert(probes, &num_probes, nprobe,
+                  FaceDbDotOneF32(ivf->centroids + l * stride, encoded, (uint32_t)stride), l);
+
+  for (uint32_t m = 0; m < ivf->num_subspaces; m++) {
+    const float* codebook = ivf->codebooks + (size_t)m * FACEIVF_CODEBOOK * dim;
+    const float* sub      = encoded + m * dim;
+
+    for (uint32_t k = 0; k < FACEIVF_CODEBOOK; k++) {
+      float dot = 0.0f;
+
+      for (uint32_t d = 0; d < dim; d++) dot += codebook[k * dim + d] * sub[d];
+      table[m * FACEIVF_CODEBOOK + k] = dot;
+    }
+  }
+
+  for (uint32_t p = 0; p < num_probes; p++) {
+    uint32_t l = probes[p].id;
+
+    for (uint32_t c = ivf->offsets[l]; c < ivf->offsets[l + 1]; c++) {
+      const uint8_t* code  = ivf->codes + (size_t)c * ivf->num_subspaces;
+      float          s0    = probes[p].score, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+      const float*   entry = table;
+      uint32_t       m     = 0;
+
+      // Independent sums hide the latency of the lookups
+      for (; m + 4 <= ivf->num_subspaces; m += 4, entry += 4 * FACEIVF_CODEBOOK) {
+        s0 += entry[code[m]];
+        s1 += entry[FACEIVF_CODEBOOK + code[m + 1]];
+        s2 += entry[2 * FACEIVF_CODEBOOK + code[m + 2]];
+        s3 += entry[3 * FACEIVF_CODEBOOK + code[m + 3]];
+      }
+      for (; m < ivf->num_subspaces; m++, entry += FACEIVF_CODEBOOK) s0 += entry[code[m]];
+
+      FaceIvfInsert(candidates, &num_candidates, rerank, (s0 + s1) + (s2 + s3), ivf->ids[c]);
+    }
+  }
+
+  for (uint32_t c = 0; c < num_candidates; c++) {
+    uint32_t t = candidates[c].id;
+    float    score;
+
+    if (db->type == FACEDB_FLOAT32)
+      score = FaceDbDotOneF32((const float*)FaceDbRow(db, t), (const float*)db_query, db->stride);
+    else
+      score = (float)FaceDbDotOneS8((const int8_t*)FaceDbRow(db, t), (const int8_t*)db_query, db->stride) *
+              db->scales[t] * db_scale;
+
+    if (score > match->score) {
+      match->score          = score;
+      match->template_index = t;
+    }
+  }
+
+  match->person = FaceDbTemplatePerson(db, match->template_index);
+  return 1;
+}
+
+#endif  // FACEIVF_H
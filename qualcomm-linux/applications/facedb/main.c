@@ -0,0 +1,664 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Builds, inspects and queries face databases, see facedb.h, and their
+// approximate nearest neighbor indexes, see faceivf.h.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "facedb.h"
+#include "faceivf.h"
+#include "../common/tool_utils.h"
+
+// ---------------------------------------------------------------------------
+// Defaults of scripts/facedb.py
+// ---------------------------------------------------------------------------
+#define DEFAULT_FEATURES   512
+#define DEFAULT_LIVENESS   32
+
+#define DEFAULT_BENCH_PERSONS    2000
+#define DEFAULT_BENCH_TEMPLATES  4
+#define DEFAULT_BENCH_QUERIES    256
+#define DEFAULT_BENCH_ITERATIONS 20
+#define DEFAULT_BENCH_GROUPS     64
+#define MAX_BATCH_SIZES          8
+
+typedef struct {
+  uint32_t    num_features;
+  uint32_t    num_liveness;
+  int         int8;
+  uint32_t    persons;
+  uint32_t    templates;
+  uint32_t    queries;
+  int         iterations;
+  int         batch_sizes[MAX_BATCH_SIZES];
+  int         num_batch_sizes;
+  float       threshold;
+  int         ann;
+  uint32_t    lists;
+  uint32_t    subspace_dim;
+  uint32_t    rerank;
+  int         nprobes[MAX_BATCH_SIZES];
+  int         num_nprobes;
+} ToolOptions;
+
+// ---------------------------------------------------------------------------
+// Helper: the index of a database is stored next to it as <db.bin>.ivf.
+// ---------------------------------------------------------------------------
+static char* IndexPath(const char* db_path) {
+  size_t size = strlen(db_path) + 5;
+  char*  path = (char*)malloc(size);
+
+  if (path) snprintf(path, size, "%s.ivf", db_path);
+  return path;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: enroll a person given as NAME=tensor.bin[,tensor.bin...]. The
+// liveness features are taken from the first tensor, like facedb.py.
+// ---------------------------------------------------------------------------
+static int AddTensors(FaceDb* db, const char* spec) {
+  char*    list      = strdup(spec);
+  char*    files     = list ? strchr(list, '=') : NULL;
+  float*   templates = NULL;
+  float*   liveness  = NULL;
+  uint32_t count     = 1;
+  int      ok        = 0;
+
+  if (!files) {
+    fprintf(stderr, "Expected NAME=tensor.bin[,tensor.bin...], got '%s'.\n", spec);
+    free(list);
+    return 0;
+  }
+  *files++ = '\0';
+
+  for (const char* p = files; *p; p++) count += (*p == ',');
+
+  templates = (float*)malloc((size_t)count * db->num_features * sizeof(float));
+  liveness  = (float*)malloc((db->num_liveness + 1) * sizeof(float));
+  if (templates && liveness) {
+    char*    save = NULL;
+    uint32_t t    = 0;
+
+    ok = 1;
+    for (char* file = strtok_r(files, ",", &save); ok && file; file = strtok_r(NULL, ",", &save), t++) {
+      ok = ReadTensor(file, templates + (size_t)t * db->num_features, db->num_features, 0) &&
+           (t > 0 || ReadTensor(file, liveness, db->num_liveness, db->num_features));
+    }
+    ok = ok && FaceDbAddPerson(db, list, liveness, templates, t);
+  }
+
+  free(liveness);
+  free(templates);
+  free(list);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: enroll all persons of another database, version 4 or 5.
+// ---------------------------------------------------------------------------
+static int AddDatabase(FaceDb* db, const char* path) {
+  FaceDb  src;
+  float*  templates = NULL;
+  int     ok        = 1;
+
+  if (!FaceDbOpen(&src, path)) return 0;
+
+  if (src.num_features != db->num_features || src.num_liveness != db->num_liveness) {
+    fprintf(stderr, "'%s' has %u features and %u liveness features, expected %u and %u.\n", path,
+            src.num_features, src.num_liveness, db->num_features, db->num_liveness);
+    FaceDbClose(&src);
+    return 0;
+  }
+
+  for (uint32_t p = 0; ok && p < src.num_persons; p++) {
+    const FaceDbPerson* person = &src.persons[p];
+
+    templates = (float*)realloc(templates, ((size_t)person->num_templates * src.num_features + 1) * sizeof(float));
+    ok        = templates != NULL;
+    for (uint32_t t = 0; ok && t < person->num_templates; t++)
+      FaceDbGetTemplate(&src, person->first_template + t, templates + (size_t)t * src.num_features);
+
+    ok = ok && FaceDbAddPerson(db, person->name, src.liveness + (size_t)p * src.num_liveness, templates,
+                               person->num_templates);
+  }
+
+  free(templates);
+  FaceDbClose(&src);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: peek the feature counts of a database to create a matching one.
+// ---------------------------------------------------------------------------
+static int PeekCounts(const char* path, uint32_t* num_features, uint32_t* num_liveness) {
+  FILE*    file = fopen(path, "rb");
+  uint32_t header[3];
+  int      ok   = file && fread(header, sizeof(header), 1, file) == 1 &&
+                  (header[0] == FACEDB_VERSION_V4 || header[0] == FACEDB_VERSION);
+
+  if (file) fclose(file);
+  if (ok) {
+    *num_features = header[1];
+    *num_liveness = header[2];
+  }
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// create / add: enroll databases and NAME=tensor lists into a database
+// ---------------------------------------------------------------------------
+static int CommandEnroll(const ToolOptions* opts, const char* db_path, int append,
+                         char** inputs, int num_inputs) {
+  FaceDb   db;
+  uint32_t num_features = opts->num_features, num_liveness = opts->num_liveness;
+  int      ok = 1;
+
+  if (append) {
+    if (!FaceDbOpen(&db, db_path) || !FaceDbDetach(&db)) return 1;
+  } else {
+    // A database input without NAME= sets the counts
+    for (int i = 0; i < num_inputs; i++)
+      if (!strchr(inputs[i], '=') && PeekCounts(inputs[i], &num_features, &num_liveness)) break;
+
+    if (!FaceDbCreate(&db, num_features, num_liveness, opts->int8 ? FACEDB_INT8 : FACEDB_FLOAT32))
+      return 1;
+  }
+
+  for (int i = 0; ok && i < num_inputs; i++)
+    ok = strchr(inputs[i], '=') ? AddTensors(&db, inputs[i]) : AddDatabase(&db, inputs[i]);
+
+  ok = ok && FaceDbSave(&db, db_path);
+  if (ok)
+    printf("'%s': %u persons, %u templates\n", db_path, db.num_persons, db.num_templates);
+  FaceDbClose(&db);
+  return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// info: print the persons of a database
+// ---------------------------------------------------------------------------
+static int CommandInfo(const char* db_path) {
+  FaceDb db;
+
+  if (!FaceDbOpen(&db, db_path)) return 1;
+
+  printf("'%s': %s, %u features, %u liveness features, %s templates of %zu bytes\n", db_path,
+         db.map ? "mapped" : "version 4", db.num_features, db.num_liveness,
+         db.type == FACEDB_INT8 ? "int8" : "float", FaceDbRowBytes(&db));
+  printf("%u persons, %u templates\n", db.num_persons, db.num_templates);
+  for (uint32_t p = 0; p < db.num_persons; p++)
+    printf("  %-20s %u templates\n", db.persons[p].name, db.persons[p].num_templates);
+
+  FaceDbClose(&db);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// export: write one person as a version 4 face.bin
+// ---------------------------------------------------------------------------
+static int CommandExport(const char* db_path, const char* name, const char* out_path) {
+  FaceDb  db;
+  int32_t person;
+  int     ok = 0;
+
+  if (!FaceDbOpen(&db, db_path)) return 1;
+
+  if ((person = FaceDbFindPerson(&db, name)) < 0)
+    fprintf(stderr, "'%s' is not enrolled in '%s'.\n", name, db_path);
+  else
+    ok = FaceDbSaveV4(&db, (uint32_t)person, out_path);
+
+  FaceDbClose(&db);
+  return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// index: build the approximate nearest neighbor index of a database
+// ---------------------------------------------------------------------------
+static int CommandIndex(const ToolOptions* opts, const char* db_path) {
+  FaceDb   db;
+  FaceIvf  ivf;
+  char*    ivf_path = IndexPath(db_path);
+  double   start;
+  int      ok = 0;
+
+  if (!ivf_path || !FaceDbOpen(&db, db_path)) {
+    free(ivf_path);
+    return 1;
+  }
+
+  start = NowMs();
+  if (FaceIvfBuild(&ivf, &db, opts->lists, opts->subspace_dim)) {
+    double elapsed = NowMs() - start;
+
+    ok = FaceIvfSave(&ivf, ivf_path);
+    if (ok)
+      printf("'%s': %u templates in %u lists, %u byte codes, built in %.1f ms\n", ivf_path,
+             ivf.num_templates, ivf.num_lists, ivf.num_subspaces, elapsed);
+    FaceIvfClose(&ivf);
+  }
+
+  FaceDbClose(&db);
+  free(ivf_path);
+  return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// match: match tensor binaries as one batch, or one by one through the
+// index with --ann
+// ---------------------------------------------------------------------------
+static int CommandMatch(const ToolOptions* opts, const char* db_path, char** inputs, int num_inputs) {
+  FaceDb       db;
+  FaceIvf      ivf;
+  float*       queries = NULL;
+  FaceDbMatch* matches = NULL;
+  double       start;
+  int          ok = 1;
+
+  memset(&ivf, 0, sizeof(ivf));
+  if (!FaceDbOpen(&db, db_path)) return 1;
+
+  if (opts->ann) {
+    char* ivf_path = IndexPath(db_path);
+
+    ok = ivf_path && FaceIvfOpen(&ivf, ivf_path, &db);
+    if (!ok) fprintf(stderr, "No usable index of '%s', build it with the index command.\n", db_path);
+    free(ivf_path);
+  }
+
+  queries = (float*)malloc(((size_t)num_inputs * db.num_features + 1) * sizeof(float));
+  matches = (FaceDbMatch*)malloc(((size_t)num_inputs + 1) * sizeof(FaceDbMatch));
+  ok      = ok && queries && matches;
+  for (int i = 0; ok && i < num_inputs; i++)
+    ok = ReadTensor(inputs[i], queries + (size_t)i * db.num_features, db.num_features, 0);
+
+  start = NowMs();
+  if (opts->ann) {
+    for (int i = 0; ok && i < num_inputs; i++)
+      ok = FaceIvfSearch(&ivf, &db, queries + (size_t)i * db.num_features, (uint32_t)opts->nprobes[0],
+                         opts->rerank, &matches[i]);
+  } else {
+    ok = ok && FaceDbMatchBatch(&db, queries, (uint32_t)num_inputs, matches);
+  }
+  if (ok) {
+    double elapsed = NowMs() - start;
+
+    for (int i = 0; i < num_inputs; i++) {
+      const char* name = (matches[i].person >= 0) ? db.persons[matches[i].person].name : "-";
+
+      printf("%s: %s score %.4f%s\n", inputs[i], name, matches[i].score,
+             matches[i].score < opts->threshold ? " (below threshold, unknown)" : "");
+    }
+    printf("Matched %d queries against %u templates in %.3f ms%s\n", num_inputs, db.num_templates, elapsed,
+           opts->ann ? " (approximate)" : "");
+  }
+
+  free(matches);
+  free(queries);
+  FaceIvfClose(&ivf);
+  FaceDbClose(&db);
+  return ok ? 0 : 1;
+}
+
+// Sample of a synthetic identity: its center plus noise
+static void SyntheticSample(const float* center, uint32_t count, float noise, uint64_t* state, float* out) {
+  for (uint32_t i = 0; i < count; i++) out[i] = center[i] + noise * RandomNormal(state);
+}
+
+// ---------------------------------------------------------------------------
+// bench: latency of single and batched queries against a database, or a
+// synthetic gallery of --persons identities. Matches of the first batch size
+// are kept in results, and compared with reference when given.
+// ---------------------------------------------------------------------------
+static int BenchDatabase(const ToolOptions* opts, FaceDb* db, const float* queries,
+                         const int32_t* expected, const FaceDbMatch* reference, FaceDbMatch* results) {
+  FaceDbMatch* matches = (FaceDbMatch*)malloc(((size_t)opts->queries + 1) * sizeof(FaceDbMatch));
+  int          ok      = matches != NULL;
+
+  printf("\n%s: %u persons, %u templates, %.1f MB\n", db->type == FACEDB_INT8 ? "int8" : "float",
+         db->num_persons, db->num_templates,
+         (double)db->num_templates * FaceDbRowBytes(db) / (1024.0 * 1024.0));
+
+  for (int b = 0; ok && b < opts->num_batch_sizes; b++) {
+    uint32_t batch   = (uint32_t)opts->batch_sizes[b];
+    double   best_ms = 1e30, sum_ms = 0.0;
+    uint32_t correct = 0, agree = 0;
+
+    for (int it = 0; ok && it < opts->iterations; it++) {
+      double start = NowMs(), elapsed;
+
+      for (uint32_t q = 0; ok && q < opts->queries; q += batch) {
+        uint32_t n = (opts->queries - q < batch) ? opts->queries - q : batch;
+        ok = FaceDbMatchBatch(db, queries + (size_t)q * db->num_features, n, matches + q);
+      }
+
+      elapsed = NowMs() - start;
+      sum_ms += elapsed;
+      if (elapsed < best_ms) best_ms = elapsed;
+    }
+
+    for (uint32_t q = 0; ok && q < opts->queries; q++) {
+      correct += (expected && matches[q].person == expected[q]);
+      agree   += (reference && matches[q].person == reference[q].person);
+    }
+
+    printf("  batch %3u: %.4f ms per query (best %.4f)", batch,
+           sum_ms / opts->iterations / opts->queries, best_ms / opts->queries);
+    if (expected) printf(", top-1 %.1f%%", 100.0 * correct / opts->queries);
+    if (reference) printf(", same person as float %.1f%%", 100.0 * agree / opts->queries);
+    printf("\n");
+
+    if (ok && b == 0 && results) memcpy(results, matches, opts->queries * sizeof(FaceDbMatch));
+  }
+
+  free(matches);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// bench --ann: latency of the index per nprobe, and how often it finds the
+// same template as the exact search in reference. The index of db_path is
+// used when it is valid, otherwise one is built.
+// ---------------------------------------------------------------------------
+static int BenchIndex(const ToolOptions* opts, FaceDb* db, const char* db_path, const float* queries,
+                      const int32_t* expected, const FaceDbMatch* reference) {
+  FaceIvf      ivf;
+  FaceDbMatch* matches  = (FaceDbMatch*)malloc(((size_t)opts->queries + 1) * sizeof(FaceDbMatch));
+  char*        ivf_path = db_path ? IndexPath(db_path) : NULL;
+  int          ok       = matches != NULL;
+  double       start    = NowMs();
+
+  memset(&ivf, 0, sizeof(ivf));
+  if (ok && !(ivf_path && FaceIvfOpen(&ivf, ivf_path, db))) {
+    ok = FaceIvfBuild(&ivf, db, opts->lists, opts->subspace_dim);
+    if (ok) printf("\nBuilt the index in %.1f ms\n", NowMs() - start);
+  } else if (ok) {
+    printf("\nMapped '%s'\n", ivf_path);
+  }
+
+  if (ok)
+    printf("ivf-pq: %u lists, %u byte codes, rerank %u, %.1f MB of codes\n", ivf.num_lists, ivf.num_subspaces,
+           opts->rerank ? opts->rerank : FACEIVF_DEFAULT_RERANK,
+           (double)ivf.num_templates * ivf.num_subspaces / (1024.0 * 1024.0));
+
+  for (int n = 0; ok && n < opts->num_nprobes; n++) {
+    uint32_t nprobe  = (uint32_t)opts->nprobes[n];
+    double   best_ms = 1e30, sum_ms = 0.0;
+    uint32_t correct = 0, recall = 0;
+
+    for (int it = 0; ok && it < opts->iterations; it++) {
+      double elapsed;
+
+      start = NowMs();
+      for (uint32_t q = 0; ok && q < opts->queries; q++)
+        ok = FaceIvfSearch(&ivf, db, queries + (size_t)q * db->num_features, nprobe, opts->rerank, &matches[q]);
+
+      elapsed = NowMs() - start;
+      sum_ms += elapsed;
+      if (elapsed < best_ms) best_ms = elapsed;
+    }
+
+    for (uint32_t q = 0; ok && q < opts->queries; q++) {
+      correct += (expected && matches[q].person == expected[q]);
+      recall  += (matches[q].template_index == reference[q].template_index);
+    }
+
+    printf("  nprobe %3u: %.4f ms per query (best %.4f), recall@1 %.1f%%", nprobe,
+           sum_ms / opts->iterations / opts->queries, best_ms / opts->queries, 100.0 * recall / opts->queries);
+    if (expected) printf(", top-1 %.1f%%", 100.0 * correct / opts->queries);
+    printf("\n");
+  }
+
+  FaceIvfClose(&ivf);
+  free(ivf_path);
+  free(matches);
+  return ok;
+}
+
+static int CommandBench(const ToolOptions* opts, const char* db_path) {
+  FaceDb       db, db8;
+  float*       queries   = NULL;
+  float*       centers   = NULL;
+  float*       groups    = NULL;
+  float*       templates = NULL;
+  int32_t*     expected  = NULL;
+  FaceDbMatch* reference = NULL;
+  uint64_t     state     = 0x5eed;
+  int          ok        = 0;
+
+  memset(&db8, 0, sizeof(db8));
+
+  if (db_path) {
+    // Queries are noisy copies of enrolled templates
+    if (!FaceDbOpen(&db, db_path)) return 1;
+  } else if (!FaceDbCreate(&db, opts->num_features, 0, FACEDB_FLOAT32)) {
+    return 1;
+  }
+
+  queries   = (float*)malloc(((size_t)opts->queries * db.num_features + 1) * sizeof(float));
+  expected  = (int32_t*)malloc(((size_t)opts->queries + 1) * sizeof(int32_t));
+  reference = (FaceDbMatch*)malloc(((size_t)opts->queries + 1) * sizeof(FaceDbMatch));
+  centers   = (float*)malloc(((size_t)db.num_features + 1) * sizeof(float));
+  groups    = (float*)malloc(((size_t)DEFAULT_BENCH_GROUPS * db.num_features + 1) * sizeof(float));
+  templates = (float*)malloc(((size_t)opts->templates * db.num_features + 1) * sizeof(float));
+  if (!queries || !expected || !reference || !centers || !groups || !templates) goto done;
+
+  if (!db_path) {
+    char name[FACEDB_NAME_SIZE + 1];
+    double start = NowMs();
+
+    // Identities scatter around a few group centers, so the gallery has
+    // clusters like real embeddings instead of being uniform on the sphere
+    for (size_t i = 0; i < (size_t)DEFAULT_BENCH_GROUPS * db.num_features; i++) groups[i] = RandomNormal(&state);
+
+    for (uint32_t p = 0; p < opts->persons; p++) {
+      const float* group = groups + (size_t)(p % DEFAULT_BENCH_GROUPS) * db.num_features;
+
+      SyntheticSample(group, db.num_features, 1.0f, &state, centers);
+      for (uint32_t t = 0; t < opts->templates; t++)
+        SyntheticSample(centers, db.num_features, 0.5f, &state, templates + (size_t)t * db.num_features);
+
+      snprintf(name, sizeof(name), "person%u", p);
+      if (!FaceDbAddPerson(&db, name, NULL, templates, opts->templates)) goto done;
+    }
+    printf("Enrolled %u synthetic persons in %.1f ms\n", opts->persons, NowMs() - start);
+  }
+
+  if (db.num_templates == 0) {
+    fprintf(stderr, "The database has no templates.\n");
+    goto done;
+  }
+
+  for (uint32_t q = 0; q < opts->queries; q++) {
+    uint32_t t = (uint32_t)(((state = state * 6364136223846793005ULL + 1442695040888963407ULL) >> 33) %
+                            db.num_templates);
+
+    // Templates are normalized, the noise is relative to a unit vector
+    FaceDbGetTemplate(&db, t, centers);
+    SyntheticSample(centers, db.num_features, 0.5f / sqrtf((float)db.num_features), &state,
+                    queries + (size_t)q * db.num_features);
+    expected[q] = FaceDbTemplatePerson(&db, t);
+  }
+
+  ok = BenchDatabase(opts, &db, queries, expected, NULL, reference);
+  ok = ok && (!opts->ann || BenchIndex(opts, &db, db_path, queries, expected, reference));
+
+  if (ok && opts->int8 && db.type == FACEDB_FLOAT32) {
+    ok = FaceDbCreate(&db8, db.num_features, db.num_liveness, FACEDB_INT8);
+    for (uint32_t p = 0; ok && p < db.num_persons; p++) {
+      const FaceDbPerson* person = &db.persons[p];
+      float*              rows   = (float*)realloc(templates,
+                                        ((size_t)person->num_templates * db.num_features + 1) * sizeof(float));
+
+      if (!(ok = rows != NULL)) break;
+      templates = rows;
+      for (uint32_t t = 0; t < person->num_templates; t++)
+        FaceDbGetTemplate(&db, person->first_template + t, templates + (size_t)t * db.num_features);
+      ok = FaceDbAddPerson(&db8, person->name, db.liveness + (size_t)p * db.num_liveness, templates,
+                           person->num_templates);
+    }
+    ok = ok && BenchDatabase(opts, &db8, queries, expected, reference, NULL);
+  }
+
+done:
+  free(templates);
+  free(groups);
+  free(centers);
+  free(reference);
+  free(expected);
+  free(queries);
+  FaceDbClose(&db8);
+  FaceDbClose(&db);
+  return ok ? 0 : 1;
+}
+
+static void PrintHelp(const char* prog) {
+  printf("Usage: %s <command> [options] ...\n\n", prog);
+  printf("Commands:\n");
+  printf("  create <db.bin> <input>...   Write a new database from the inputs\n");
+  printf("  add    <db.bin> <input>...   Enroll the inputs into an existing database\n");
+  printf("  info   <db.bin>              Print the enrolled persons\n");
+  printf("  export <db.bin> <name> <face.bin>  Write one person as a version 4 face.bin\n");
+  printf("  index  <db.bin>              Build the approximate search index <db.bin>.ivf\n");
+  printf("  match  <db.bin> <tensor.bin>...    Match face feature tensors as one batch\n");
+  printf("  bench  [<db.bin>]            Benchmark single and batched queries, against a\n");
+  printf("                               synthetic gallery without <db.bin>\n\n");
+  printf("Inputs are face.bin files of scripts/facedb.py, databases written by this\n");
+  printf("tool, or NAME=tensor.bin[,tensor.bin...] with the feature tensors of a person.\n\n");
+  printf("Options:\n");
+  printf("  --features <N>     Face features of tensor inputs (default: %d)\n", DEFAULT_FEATURES);
+  printf("  --liveness <N>     Liveness features of tensor inputs (default: %d)\n", DEFAULT_LIVENESS);
+  printf("  --int8             Store int8 quantized templates (create), or also\n");
+  printf("                     benchmark an int8 copy of the gallery (bench)\n");
+  printf("  --threshold <S>    Cosine similarity below which a match is unknown (default: 0.5)\n");
+  printf("  --persons <N>      Synthetic persons (default: %d)\n", DEFAULT_BENCH_PERSONS);
+  printf("  --templates <N>    Templates per synthetic person (default: %d)\n", DEFAULT_BENCH_TEMPLATES);
+  printf("  --queries <N>      Queries per iteration (default: %d)\n", DEFAULT_BENCH_QUERIES);
+  printf("  --iterations <N>   Timed iterations (default: %d)\n", DEFAULT_BENCH_ITERATIONS);
+  printf("  --batch <N[,N...]> Query batch sizes (default: 1,4,16)\n");
+  printf("  --ann              Search through the index (match), or also benchmark\n");
+  printf("                     the index against the exact search (bench)\n");
+  printf("  --lists <N>        Index lists (default: square root of the templates)\n");
+  printf("  --subspace-dim <N> Values per byte of the index codes (default: %d)\n", FACEIVF_SUBSPACE_DIM);
+  printf("  --nprobe <N[,N...]> Index lists scanned per query (default: %d)\n", FACEIVF_DEFAULT_NPROBE);
+  printf("  --rerank <N>       Index candidates scored exactly (default: %d)\n\n", FACEIVF_DEFAULT_RERANK);
+  printf("Examples:\n");
+  printf("  %s create faces.bin alice/face.bin bob/face.bin\n", prog);
+  printf("  %s add faces.bin carol=carol0.bin,carol1.bin\n", prog);
+  printf("  %s create --int8 faces8.bin faces.bin\n", prog);
+  printf("  %s match faces.bin query.bin\n", prog);
+  printf("  %s bench --persons 5000 --int8 --batch 1,8,32\n", prog);
+  printf("  %s index faces.bin && %s match --ann faces.bin query.bin\n", prog, prog);
+  printf("  %s bench --persons 30000 --templates 1 --ann --nprobe 1,4,8,16\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+  ToolOptions opts;
+  char**      args     = (char**)calloc((size_t)argc + 1, sizeof(char*));
+  int         num_args = 0;
+  int         ret      = 1;
+  uint32_t    value    = 0;
+
+  memset(&opts, 0, sizeof(opts));
+  opts.num_features    = DEFAULT_FEATURES;
+  opts.num_liveness    = DEFAULT_LIVENESS;
+  opts.persons         = DEFAULT_BENCH_PERSONS;
+  opts.templates       = DEFAULT_BENCH_TEMPLATES;
+  opts.queries         = DEFAULT_BENCH_QUERIES;
+  opts.iterations      = DEFAULT_BENCH_ITERATIONS;
+  opts.batch_sizes[0]  = 1;
+  opts.batch_sizes[1]  = 4;
+  opts.batch_sizes[2]  = 16;
+  opts.num_batch_sizes = 3;
+  opts.threshold       = 0.5f;
+  opts.nprobes[0]      = FACEIVF_DEFAULT_NPROBE;
+  opts.num_nprobes     = 1;
+
+  if (!args) return 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg  = argv[i];
+    const char* next = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      PrintHelp(argv[0]);
+      free(args);
+      return 0;
+    } else if (strcmp(arg, "--int8") == 0) {
+      opts.int8 = 1;
+    } else if (strcmp(arg, "--features") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.num_features)) goto done;
+      i++;
+    } else if (strcmp(arg, "--liveness") == 0) {
+      // Zero liveness features are allowed
+      if (!ParseCount(arg, next, 0, &opts.num_liveness)) goto done;
+      i++;
+    } else if (strcmp(arg, "--threshold") == 0) {
+      // Cosine similarities lie in [-1, 1]
+      if (!ParseFloat(arg, next, -1.0f, 1.0f, &opts.threshold)) goto done;
+      i++;
+    } else if (strcmp(arg, "--persons") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.persons)) goto done;
+      i++;
+    } else if (strcmp(arg, "--templates") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.templates)) goto done;
+      i++;
+    } else if (strcmp(arg, "--queries") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.queries)) goto done;
+      i++;
+    } else if (strcmp(arg, "--iterations") == 0) {
+      if (!ParseCount(arg, next, 1, &value)) goto done;
+      opts.iterations = (int)value;
+      i++;
+    } else if (strcmp(arg, "--batch") == 0) {
+      if (!(opts.num_batch_sizes = ParseList(arg, next, opts.batch_sizes, MAX_BATCH_SIZES))) goto done;
+      i++;
+    } else if (strcmp(arg, "--ann") == 0) {
+      opts.ann = 1;
+    } else if (strcmp(arg, "--lists") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.lists)) goto done;
+      i++;
+    } else if (strcmp(arg, "--subspace-dim") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.subspace_dim)) goto done;
+      i++;
+    } else if (strcmp(arg, "--rerank") == 0) {
+      if (!ParseCount(arg, next, 1, &opts.rerank)) goto done;
+      i++;
+    } else if (strcmp(arg, "--nprobe") == 0) {
+      if (!(opts.num_nprobes = ParseList(arg, next, opts.nprobes, MAX_BATCH_SIZES))) goto done;
+      i++;
+    } else if (strncmp(arg, "--", 2) == 0) {
+      fprintf(stderr, "Unknown option '%s'.\n", arg);
+      goto done;
+    } else {
+      args[num_args++] = argv[i];
+    }
+  }
+
+  if (num_args >= 3 && strcmp(args[0], "create") == 0) {
+    ret = CommandEnroll(&opts, args[1], 0, args + 2, num_args - 2);
+  } else if (num_args >= 3 && strcmp(args[0], "add") == 0) {
+    ret = CommandEnroll(&opts, args[1], 1, args + 2, num_args - 2);
+  } else if (num_args == 2 && strcmp(args[0], "info") == 0) {
+    ret = CommandInfo(args[1]);
+  } else if (num_args == 4 && strcmp(args[0], "export") == 0) {
+    ret = CommandExport(args[1], args[2], args[3]);
+  } else if (num_args == 2 && strcmp(args[0], "index") == 0) {
+    ret = CommandIndex(&opts, args[1]);
+  } else if (num_args >= 3 && strcmp(args[0], "match") == 0) {
+    ret = CommandMatch(&opts, args[1], args + 2, num_args - 2);
+  } else if (num_args <= 2 && num_args >= 1 && strcmp(args[0], "bench") == 0) {
+    ret = CommandBench(&opts, num_args == 2 ? args[1] : NULL);
+  } else {
+    PrintHelp(argv[0]);
+  }
+
+done:
+  free(args);
+  return ret;
+}
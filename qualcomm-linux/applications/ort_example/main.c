@@ -3,85 +3,1638 @@
 // SPDX-License-Identifier: BSD-3-Clause
 // ---------------------------------------------------------------------
 
+#define _GNU_SOURCE
 #include <assert.h>
+#include <dirent.h>
+#include <errno.h>
 #include <locale.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <onnxruntime_c_api.h>
 #include "onnxruntime_session_options_config_keys.h"
+#include "postprocess.h"
 
 // ---------------------------------------------------------------------------
 // Constants
 // ---------------------------------------------------------------------------
-#define INPUT_DATA_SIZE  (1 * 3 * 224 * 224)
-#define OUTPUT_DATA_SIZE (1 * 1000)
-#define MAX_LABEL_LEN    256
+#define LABEL_FILE       "synset.txt"
+#define MAX_DIMS         16
+#define MAX_BATCH_SIZES  16
 #define MAX_OPTIONS      4
 #define TOP_K            5
+#define MAX_PROFILE_OPS  256
+#define TOP_PROFILE_OPS  10
+#define BUFFER_ALIGN     64
+#define GRAPH_OPT_LEVEL  ORT_ENABLE_BASIC
+
+// Memory of the QNN EP shared with the HTP, see --htp-shared-memory
+#define QNN_HTP_SHARED_MEMORY "QnnHtpShared"
+
+// Packed dataset files, see PackHeader
+#define PACK_MAGIC       "ORTPACK1"
+#define PACK_DATA_ALIGN  4096
+
+// ---------------------------------------------------------------------------
+// Run configuration collected from the command line
+// ---------------------------------------------------------------------------
+typedef struct {
+  const char* backend;
+  const char* model_path;
+  const char* input_path;
+  int         generate_ctx;
+  int         float32_model;
+  int         warmup;       // untimed runs before the measurement
+  int         iterations;   // timed runs
+  const char* json_path;    // optional JSON results file
+  int         concurrency;  // inference worker threads
+  int         session_per_thread;
+  int         intra_op_threads;
+  int         inter_op_threads;  // 0: ORT default
+  int*        cpus;         // CPUs the workers are pinned to, round robin
+  int         num_cpus;
+  int         io_binding;   // run with pre-bound, reused input/output buffers
+  int         htp_shared_memory;  // allocate bound buffers from the QNN EP
+  int         batch;        // value of a dynamic first (batch) dimension
+  const char* dataset_path; // packed file, directory or list of raw samples, batched mode
+  const char* pack_path;    // write the dataset as a packed file and exit
+  const char* ctx_cache_dir;  // compiled context models, keyed by model and EP options
+  const char* profile_prefix; // ORT profiling output, NULL when disabled
+  float       output_scale;       // dequantization of integer outputs
+  int         output_zero_point;
+  int         batch_sizes[MAX_BATCH_SIZES];  // batched mode, 0 sizes: model batch
+  int         num_batch_sizes;
+} RunOptions;
+
+// ---------------------------------------------------------------------------
+// Latency statistics of the timed iterations, all values in milliseconds
+// ---------------------------------------------------------------------------
+typedef struct {
+  double min;
+  double mean;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+  double total;
+  double throughput;  // inferences per second
+} LatencyStats;
+
+// ---------------------------------------------------------------------------
+// Duration of the startup phases in milliseconds
+// ---------------------------------------------------------------------------
+typedef struct {
+  double create_env;
+  double session_options;
+  double append_ep;
+  double create_session;  // all sessions, including compilation
+  double metadata;        // allocator, input and output queries
+  double first_run;       // first inference on the first worker that ran
+} StartupTimes;
+
+// ---------------------------------------------------------------------------
+// Time spent in one operator type, aggregated from an ORT profile
+// ---------------------------------------------------------------------------
+typedef struct {
+  char   op[64];
+  double total_us;
+  size_t calls;
+} OpProfile;
+
+// ---------------------------------------------------------------------------
+// Results of one batch size in batched mode. The latencies are per batch,
+// the throughput is in samples per second, padding excluded.
+// ---------------------------------------------------------------------------
+typedef struct {
+  int          batch;
+  size_t       num_batches;
+  size_t       num_samples;
+  double       io_ms;       // time spent preparing the input batches
+  LatencyStats stats;
+} BatchResult;
+
+// ---------------------------------------------------------------------------
+// Packed dataset file: this header, an index of num_samples file offsets and
+// the samples, each sample_bytes long in the model input type. Written with
+// --pack, the samples are stored back to back from a page boundary so whole
+// batches can be run straight from the mapped file.
+// ---------------------------------------------------------------------------
+typedef struct {
+  char     magic[8];      // PACK_MAGIC, not NUL terminated
+  uint32_t header_size;   // offset of the index
+  int32_t  element_type;  // ONNXTensorElementDataType of the samples
+  uint32_t num_dims;      // rank of a sample, without the batch dimension
+  uint32_t reserved;
+  uint64_t num_samples;
+  uint64_t sample_bytes;
+  int64_t  dims[MAX_DIMS];
+} PackHeader;
+
+// Read-only mapping of a whole file
+typedef struct {
+  void*  data;
+  size_t size;
+} MappedFile;
+
+// Samples of a batched run: raw sample files, or a mapped packed file
+typedef struct {
+  char**            files;
+  size_t            num_samples;
+  MappedFile        pack;
+  const PackHeader* header;      // NULL for raw sample files
+  const uint64_t*   offsets;
+  int               contiguous;  // packed samples are back to back
+} Dataset;
+
+// ---------------------------------------------------------------------------
+// Helper: check an OrtStatus and print any error message.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int CheckStatus(const OrtApi* ort, OrtStatus* status) {
+  if (status != NULL) {
+    const char* msg = ort->GetErrorMessage(status);
+    fprintf(stderr, "ORT Error: %s\n", msg);
+    ort->ReleaseStatus(status);
+    return 0;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: free all dynamically allocated node metadata arrays.
+// ---------------------------------------------------------------------------
+static void FreeNodeInfo(OrtAllocator* allocator,
+                         char** names, size_t name_count,
+                         int64_t** dims, size_t* dims_count,
+                         size_t node_count) {
+  if (names) {
+    for (size_t i = 0; i < name_count; i++) {
+      if (names[i] && allocator) allocator->Free(allocator, names[i]);
+    }
+    free(names);
+  }
+  if (dims) {
+    for (size_t i = 0; i < node_count; i++) free(dims[i]);
+    free(dims);
+  }
+  free(dims_count);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: release an array of OrtValue tensors.
+// ---------------------------------------------------------------------------
+static void ReleaseTensors(const OrtApi* ort, OrtValue** tensors, size_t count) {
+  if (!tensors) return;
+  for (size_t i = 0; i < count; i++) {
+    if (tensors[i]) ort->ReleaseValue(tensors[i]);
+  }
+  free(tensors);
+}
+
+// ---------------------------------------------------------------------------
+// Start gate of the timed phase: the workers finish their warmup, then all
+// of them start the timed iterations at the same time.
+// ---------------------------------------------------------------------------
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  int             ready;   // workers waiting at the gate
+  int             open;
+} StartGate;
+
+// ---------------------------------------------------------------------------
+// State shared by all inference worker threads
+// ---------------------------------------------------------------------------
+typedef struct {
+  const OrtApi*      ort;
+  const RunOptions*  opts;
+  const char* const* input_names;
+  size_t             num_inputs;
+  const char* const* output_names;
+  size_t             num_outputs;
+  StartGate          gate;
+  atomic_int         next_iteration;  // timed iterations handed out so far
+  atomic_int         failed;
+} WorkerShared;
+
+// ---------------------------------------------------------------------------
+// Per-thread state of an inference worker. Every worker has its own input
+// and output tensors; the session is shared or owned by the worker.
+// ---------------------------------------------------------------------------
+typedef struct {
+  WorkerShared* shared;
+  OrtSession*   session;
+  OrtValue**    input_tensors;
+  OrtValue**    output_tensors;
+  double*       latencies;      // room for opts->iterations samples
+  size_t        num_latencies;
+  double        first_run_ms;   // 0 until the first run, warmup included
+  int           cpu;            // -1 when not pinned
+  pthread_t     thread;
+
+  // --io-binding: tensors over buffers allocated once, bound to the session
+  OrtIoBinding* binding;
+  OrtAllocator* buffer_allocator;  // EP allocator, NULL for aligned host memory
+  void**        buffers;           // one per input, then one per output
+} Worker;
+
+// ---------------------------------------------------------------------------
+// Helper: release the outputs of a previous run so the next ort->Run can
+// allocate fresh ones.
+// ---------------------------------------------------------------------------
+static void ClearTensors(const OrtApi* ort, OrtValue** tensors, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (tensors[i]) ort->ReleaseValue(tensors[i]);
+    tensors[i] = NULL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Helper: size in bytes of one tensor element, 0 for unsupported types.
+// ---------------------------------------------------------------------------
+static size_t ElementSize(ONNXTensorElementDataType type) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:    return 1;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return 2;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:  return 4;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:  return 8;
+    default:                                    return 0;
+  }
+}
+
+static const char* ElementTypeName(ONNXTensorElementDataType type) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:   return "float32";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return "float16";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:   return "uint8";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:    return "int8";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:  return "uint16";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:   return "int16";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:   return "int32";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:  return "uint32";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:   return "int64";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:  return "uint64";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:  return "float64";
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:    return "bool";
+    default:                                    return "unsupported";
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Helper: IEEE half precision conversion, rounding to nearest even.
+// ---------------------------------------------------------------------------
+static uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint32_t sign     = (bits >> 16) & 0x8000u;
+  int32_t  exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffffu;
+
+  if (((bits >> 23) & 0xff) == 0xff)  // Inf / NaN
+    return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+  if (exponent >= 31)                 // overflow
+    return (uint16_t)(sign | 0x7c00u);
+  if (exponent <= 0) {                // subnormal or zero
+    if (exponent < -10) return (uint16_t)sign;
+    mantissa |= 0x800000u;
+    uint32_t shift   = (uint32_t)(14 - exponent);
+    uint32_t half    = mantissa >> shift;
+    uint32_t rest    = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1u))) half++;
+    return (uint16_t)(sign | half);
+  }
+
+  uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fffu;
+  if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;
+  return (uint16_t)half;
+}
+
+static float HalfToFloat(uint16_t half) {
+  uint32_t sign     = (uint32_t)(half & 0x8000u) << 16;
+  uint32_t exponent = (half >> 10) & 0x1fu;
+  uint32_t mantissa = half & 0x3ffu;
+  uint32_t bits;
+
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  } else if (mantissa != 0) {  // subnormal, normalize
+    exponent = 127 - 15 + 1;
+    while (!(mantissa & 0x400u)) { mantissa <<= 1; exponent--; }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+  } else {
+    bits = sign;
+  }
+
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: element i of a tensor as a double, for every type ElementSize()
+// supports.
+// ---------------------------------------------------------------------------
+static double ElementValue(const void* data, ONNXTensorElementDataType type, size_t i) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:   return ((const float*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return HalfToFloat(((const uint16_t*)data)[i]);
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:   return ((const uint8_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:    return ((const int8_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:  return ((const uint16_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:   return ((const int16_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:   return ((const int32_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:  return ((const uint32_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:   return (double)((const int64_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:  return (double)((const uint64_t*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:  return ((const double*)data)[i];
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:    return ((const uint8_t*)data)[i];
+    default:                                    return 0.0;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Helper: fill a tensor buffer with the value 1 in its element type.
+// ---------------------------------------------------------------------------
+static void FillDefault(void* data, ONNXTensorElementDataType type, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    switch (type) {
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:   ((float*)data)[i]    = 1.0f;                break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: ((uint16_t*)data)[i] = FloatToHalf(1.0f);   break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:   ((uint16_t*)data)[i] = 1;                   break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:  ((uint32_t*)data)[i] = 1;                   break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:  ((uint64_t*)data)[i] = 1;                   break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:  ((double*)data)[i]   = 1.0;                 break;
+      default:                                    ((uint8_t*)data)[i]  = 1;                   break;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Helper: replace dynamic dimensions of a model input/output. The first
+// dimension is the batch; other dynamic dimensions become 1 for inputs and
+// stay unresolved (-1) for outputs. Returns the number of elements, or 0 if
+// the shape is still dynamic.
+// ---------------------------------------------------------------------------
+static size_t ResolveShape(int64_t* dims, size_t num_dims, int batch, int is_input) {
+  size_t count = 1;
+
+  for (size_t d = 0; d < num_dims; d++) {
+    if (dims[d] <= 0) {
+      if (d == 0)        dims[d] = batch;
+      else if (is_input) dims[d] = 1;
+    }
+    count = (dims[d] > 0 && count) ? count * (size_t)dims[d] : 0;
+  }
+  return count;
+}
+
+static void PrintShape(const char* kind, size_t index, const char* name,
+                       ONNXTensorElementDataType type, const int64_t* dims, size_t num_dims) {
+  printf("%s %zu '%s': %s [", kind, index, name, ElementTypeName(type));
+  for (size_t d = 0; d < num_dims; d++) printf("%s%lld", d ? "," : "", (long long)dims[d]);
+  printf("]\n");
+}
+
+// ---------------------------------------------------------------------------
+// Helper: load a raw input file into a tensor buffer. The file must hold
+// exactly the tensor in its element type; float16 inputs also accept float32
+// files, which are converted. Returns 1 on success, 0 on a size mismatch or
+// read error, -1 if the file can not be opened.
+// ---------------------------------------------------------------------------
+static int LoadRawInput(const char* path, ONNXTensorElementDataType type,
+                        size_t count, void* buffer) {
+  FILE*  file       = fopen(path, "rb");
+  size_t elem_size  = ElementSize(type);
+  long   file_size  = 0;
+  int    ok         = 0;
+
+  if (!file) return -1;
+
+  if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 ||
+      fseek(file, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "Failed to get the size of '%s'.\n", path);
+  } else if ((size_t)file_size == count * elem_size) {
+    ok = fread(buffer, elem_size, count, file) == count;
+  } else if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 &&
+             (size_t)file_size == count * sizeof(float)) {
+    float* floats = (float*)malloc(count * sizeof(float));
+    if (floats && fread(floats, sizeof(float), count, file) == count) {
+      for (size_t i = 0; i < count; i++) ((uint16_t*)buffer)[i] = FloatToHalf(floats[i]);
+      ok = 1;
+    }
+    free(floats);
+  } else {
+    fprintf(stderr, "'%s' has %ld bytes, the model input needs %zu %s elements (%zu bytes).\n",
+            path, file_size, count, ElementTypeName(type), count * elem_size);
+    fclose(file);
+    return 0;
+  }
+
+  if (!ok) fprintf(stderr, "Failed to read '%s'.\n", path);
+  fclose(file);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: map a whole file read-only. Returns 1 on success, 0 if the file is
+// empty or can not be mapped, -1 if it can not be opened.
+// ---------------------------------------------------------------------------
+static int MapFile(const char* path, MappedFile* map) {
+  struct stat st;
+  int         fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  map->data = NULL;
+  map->size = 0;
+  if (fd < 0) return -1;
+
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return 0;
+  }
+
+  map->data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map->data == MAP_FAILED) {
+    map->data = NULL;
+    return 0;
+  }
+
+  map->size = (size_t)st.st_size;
+  return 1;
+}
+
+static void UnmapFile(MappedFile* map) {
+  if (map->data) munmap(map->data, map->size);
+  map->data = NULL;
+  map->size = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: allocate a buffer for a bound tensor, from the EP allocator when
+// one is given, otherwise from host memory aligned for SIMD access.
+// ---------------------------------------------------------------------------
+static void* AllocBuffer(const OrtApi* ort, OrtAllocator* ep_allocator, size_t bytes) {
+  void* data = NULL;
+
+  if (ep_allocator) {
+    if (!CheckStatus(ort, ort->AllocatorAlloc(ep_allocator, bytes, &data))) return NULL;
+    return data;
+  }
+
+  bytes = (bytes + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+  if (posix_memalign(&data, BUFFER_ALIGN, bytes) != 0) return NULL;
+  return data;
+}
+
+static void FreeBuffer(const OrtApi* ort, OrtAllocator* ep_allocator, void* data) {
+  if (!data) return;
+  if (ep_allocator) CheckStatus(ort, ort->AllocatorFree(ep_allocator, data));
+  else              free(data);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: monotonic wall-clock time in milliseconds.
+// ---------------------------------------------------------------------------
+static double NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int CompareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: nearest-rank percentile of an ascending sorted array.
+// ---------------------------------------------------------------------------
+static double Percentile(const double* sorted, size_t count, double pct) {
+  size_t rank = (size_t)((pct / 100.0) * count + 0.999999);
+  if (rank < 1) rank = 1;
+  if (rank > count) rank = count;
+  return sorted[rank - 1];
+}
+
+// ---------------------------------------------------------------------------
+// Helper: compute latency statistics. Sorts the samples in place.
+// ---------------------------------------------------------------------------
+static void ComputeLatencyStats(double* samples, size_t count, LatencyStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (count == 0) return;
+
+  qsort(samples, count, sizeof(double), CompareDouble);
+  for (size_t i = 0; i < count; i++) stats->total += samples[i];
+
+  stats->min        = samples[0];
+  stats->max        = samples[count - 1];
+  stats->mean       = stats->total / count;
+  stats->p50        = Percentile(samples, count, 50.0);
+  stats->p90        = Percentile(samples, count, 90.0);
+  stats->p99        = Percentile(samples, count, 99.0);
+  stats->throughput = (stats->total > 0.0) ? count * 1000.0 / stats->total : 0.0;
+}
+
+static void PrintLatencyStats(const RunOptions* opts, const LatencyStats* stats) {
+  printf("\nBenchmark (%d warmup per thread, %d timed iterations, %d thread(s), %s):\n",
+         opts->warmup, opts->iterations, opts->concurrency,
+         opts->session_per_thread ? "session per thread" : "shared session");
+  printf("  min=%.2f ms  mean=%.2f ms  p50=%.2f ms  p90=%.2f ms  p99=%.2f ms  max=%.2f ms\n",
+         stats->min, stats->mean, stats->p50, stats->p90, stats->p99, stats->max);
+  printf("  throughput=%.2f inferences/s\n", stats->throughput);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: write the startup breakdown as a JSON member.
+// ---------------------------------------------------------------------------
+static void WriteStartupJson(FILE* json_file, const StartupTimes* startup) {
+  fprintf(json_file, "  \"startup_ms\": {\n");
+  fprintf(json_file, "    \"create_env\": %.4f,\n", startup->create_env);
+  fprintf(json_file, "    \"session_options\": %.4f,\n", startup->session_options);
+  fprintf(json_file, "    \"append_ep\": %.4f,\n", startup->append_ep);
+  fprintf(json_file, "    \"create_session\": %.4f,\n", startup->create_session);
+  fprintf(json_file, "    \"metadata\": %.4f,\n", startup->metadata);
+  fprintf(json_file, "    \"first_run\": %.4f\n", startup->first_run);
+  fprintf(json_file, "  },\n");
+}
+
+// ---------------------------------------------------------------------------
+// Helper: write the benchmark results as JSON for dashboards.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int WriteJsonResults(const RunOptions* opts, const LatencyStats* stats,
+                            const Worker* workers, const LatencyStats* thread_stats,
+                            const StartupTimes* startup) {
+  FILE* json_file = fopen(opts->json_path, "w");
+  if (!json_file) {
+    fprintf(stderr, "Failed to open '%s' for writing.\n", opts->json_path);
+    return 0;
+  }
+
+  // Paths are written as given; they are not expected to need escaping
+  fprintf(json_file, "{\n");
+  fprintf(json_file, "  \"model\": \"%s\",\n", opts->model_path);
+  fprintf(json_file, "  \"backend\": \"%s\",\n", opts->backend);
+  fprintf(json_file, "  \"warmup\": %d,\n", opts->warmup);
+  fprintf(json_file, "  \"iterations\": %d,\n", opts->iterations);
+  fprintf(json_file, "  \"concurrency\": %d,\n", opts->concurrency);
+  fprintf(json_file, "  \"sessions\": %d,\n", opts->session_per_thread ? opts->concurrency : 1);
+  fprintf(json_file, "  \"intra_op_threads\": %d,\n", opts->intra_op_threads);
+  fprintf(json_file, "  \"inter_op_threads\": %d,\n", opts->inter_op_threads);
+  fprintf(json_file, "  \"io_binding\": %s,\n", opts->io_binding ? "true" : "false");
+  fprintf(json_file, "  \"latency_ms\": {\n");
+  fprintf(json_file, "    \"min\": %.4f,\n", stats->min);
+  fprintf(json_file, "    \"mean\": %.4f,\n", stats->mean);
+  fprintf(json_file, "    \"p50\": %.4f,\n", stats->p50);
+  fprintf(json_file, "    \"p90\": %.4f,\n", stats->p90);
+  fprintf(json_file, "    \"p99\": %.4f,\n", stats->p99);
+  fprintf(json_file, "    \"max\": %.4f\n", stats->max);
+  fprintf(json_file, "  },\n");
+  fprintf(json_file, "  \"throughput_ips\": %.4f,\n", stats->throughput);
+  WriteStartupJson(json_file, startup);
+  fprintf(json_file, "  \"threads\": [\n");
+  for (int w = 0; w < opts->concurrency; w++) {
+    fprintf(json_file, "    { \"cpu\": %d, \"runs\": %zu, \"mean\": %.4f, \"p50\": %.4f, "
+                       "\"p99\": %.4f, \"throughput_ips\": %.4f }%s\n",
+            workers[w].cpu, workers[w].num_latencies, thread_stats[w].mean,
+            thread_stats[w].p50, thread_stats[w].p99, thread_stats[w].throughput,
+            (w + 1 < opts->concurrency) ? "," : "");
+  }
+  fprintf(json_file, "  ]\n");
+  fprintf(json_file, "}\n");
+
+  if (fclose(json_file) != 0) {
+    fprintf(stderr, "Failed to write '%s'.\n", opts->json_path);
+    return 0;
+  }
+  printf("Benchmark results written to '%s'.\n", opts->json_path);
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: 64-bit FNV-1a hash, chained through hash.
+// ---------------------------------------------------------------------------
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: path of the compiled context model of a model in the context
+// cache. The name holds a hash of the model's path, size and modification
+// time, the EP options, the graph optimization level and the ORT version, so
+// any change to them selects a new entry without reading the model. Creates
+// the cache directory if needed. Returns a string to free, NULL on failure.
+// ---------------------------------------------------------------------------
+static char* ContextCachePath(const char* cache_dir, const char* model_path,
+                              const char* const* keys, const char* const* values,
+                              size_t num_options) {
+  struct stat st;
+  uint64_t    hash      = 0xcbf29ce484222325ULL;
+  int         opt_level = GRAPH_OPT_LEVEL;
+  const char* version   = OrtGetApiBase()->GetVersionString();
+  const char* name      = strrchr(model_path, '/');
+  const char* ext       = NULL;
+  char*       real_path = NULL;
+  char*       path      = NULL;
+  int64_t     stamp[3];
+
+  if (stat(model_path, &st) != 0 || (real_path = realpath(model_path, NULL)) == NULL) {
+    fprintf(stderr, "Failed to read '%s': %s\n", model_path, strerror(errno));
+    return NULL;
+  }
+  stamp[0] = (int64_t)st.st_size;
+  stamp[1] = (int64_t)st.st_mtim.tv_sec;
+  stamp[2] = (int64_t)st.st_mtim.tv_nsec;
+  hash = HashBytes(hash, real_path, strlen(real_path) + 1);
+  hash = HashBytes(hash, stamp, sizeof(stamp));
+  free(real_path);
+
+  for (size_t i = 0; i < num_options; i++) {
+    hash = HashBytes(hash, keys[i], strlen(keys[i]) + 1);
+    hash = HashBytes(hash, values[i], strlen(values[i]) + 1);
+  }
+  hash = HashBytes(hash, &opt_level, sizeof(opt_level));
+  hash = HashBytes(hash, version, strlen(version) + 1);
+  printf("Context cache key %016llx.\n", (unsigned long long)hash);
+
+  if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create context cache '%s': %s\n", cache_dir, strerror(errno));
+    return NULL;
+  }
+
+  name = name ? name + 1 : model_path;
+  ext  = strrchr(name, '.');
+  if (asprintf(&path, "%s/%.*s_%016llx_ctx.onnx", cache_dir,
+               (int)(ext ? (size_t)(ext - name) : strlen(name)), name,
+               (unsigned long long)hash) < 0)
+    return NULL;
+  return path;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: compile a model into an EPContext model with an embedded QNN
+// context binary and store it in the context cache. The file is written
+// under a temporary name and renamed, so an interrupted compilation never
+// leaves a partial cache entry. The compile session runs on a copy of the
+// session options without profiling, so it neither writes a profile nor
+// leaves the EPContext entries on the options of the later sessions.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int CompileContextCache(const OrtApi* ort, OrtEnv* env,
+                               const OrtSessionOptions* session_options,
+                               const char* model_path, const char* cache_path) {
+  OrtSessionOptions* compile_options = NULL;
+  OrtSession*        session         = NULL;
+  char*              tmp_path        = NULL;
+  double             t_start         = 0.0;
+  int                ok              = 0;
+
+  if (asprintf(&tmp_path, "%s.tmp.%d", cache_path, (int)getpid()) < 0) return 0;
+
+  if (!CheckStatus(ort, ort->CloneSessionOptions(session_options, &compile_options)) ||
+      !CheckStatus(ort, ort->DisableProfiling(compile_options)) ||
+      !CheckStatus(ort, ort->AddSessionConfigEntry(
+                          compile_options, kOrtSessionOptionEpContextEnable, "1")) ||
+      !CheckStatus(ort, ort->AddSessionConfigEntry(
+                          compile_options, kOrtSessionOptionEpContextFilePath, tmp_path)) ||
+      !CheckStatus(ort, ort->AddSessionConfigEntry(
+                          compile_options, kOrtSessionOptionEpContextEmbedMode, "1")))
+    goto done;
+
+  t_start = NowMs();
+  if (!CheckStatus(ort, ort->CreateSession(env, model_path, compile_options, &session)))
+    goto done;
+  ort->ReleaseSession(session);
+
+  if (rename(tmp_path, cache_path) != 0) {
+    fprintf(stderr, "Failed to store context cache '%s': %s\n", cache_path, strerror(errno));
+    goto done;
+  }
+
+  printf("Compiled '%s' into context cache '%s' in %.1f ms.\n",
+         model_path, cache_path, NowMs() - t_start);
+  ok = 1;
+
+done:
+  if (compile_options) ort->ReleaseSessionOptions(compile_options);
+  unlink(tmp_path);
+  free(tmp_path);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: convert count elements of an output, starting at offset, to float
+// scores. Integer outputs are dequantized with --output-scale and
+// --output-zero-point.
+// ---------------------------------------------------------------------------
+static void OutputScores(const RunOptions* opts, const void* data, ONNXTensorElementDataType type,
+                         size_t offset, size_t count, float* scores) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+      memcpy(scores, (const float*)data + offset, count * sizeof(float));
+      break;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+      for (size_t i = 0; i < count; i++) scores[i] = HalfToFloat(((const uint16_t*)data)[offset + i]);
+      break;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+      DequantizeU8((const uint8_t*)data + offset, count, opts->output_scale,
+                   opts->output_zero_point, scores);
+      break;
+    default:
+      for (size_t i = 0; i < count; i++) {
+        scores[i] = (float)(ElementValue(data, type, offset + i) - opts->output_zero_point) *
+                    opts->output_scale;
+      }
+      break;
+  }
+}
+
+static void PrintStartupTimes(const StartupTimes* startup) {
+  printf("\nStartup (ms):\n");
+  printf("  create env        %10.2f\n", startup->create_env);
+  printf("  session options   %10.2f\n", startup->session_options);
+  printf("  append QNN EP     %10.2f\n", startup->append_ep);
+  printf("  create session(s) %10.2f\n", startup->create_session);
+  printf("  metadata queries  %10.2f\n", startup->metadata);
+  if (startup->first_run > 0.0) printf("  first inference   %10.2f\n", startup->first_run);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: find "key" in a JSON object and copy its string value, or parse
+// its number value. Nested objects are searched too, which is enough for the
+// flat events of an ORT profile. Returns 1 if the key was found.
+// ---------------------------------------------------------------------------
+static int JsonValue(const char* obj, const char* end, const char* key,
+                     char* str, size_t str_size, double* number) {
+  char        pattern[64];
+  int         len = snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+  const char* p   = (const char*)memmem(obj, end - obj, pattern, len);
+
+  if (!p) return 0;
+  for (p += len; p < end && (*p == ' ' || *p == ':' || *p == '\t' || *p == '\n'); p++)
+    ;
+  if (p >= end) return 0;
+
+  if (*p == '"') {
+    const char* q = NULL;
+    size_t      n = 0;
+
+    p++;
+    q = memchr(p, '"', end - p);
+    n = q ? (size_t)(q - p) : 0;
+
+    if (!q || !str) return 0;
+    if (n >= str_size) n = str_size - 1;
+    memcpy(str, p, n);
+    str[n] = '\0';
+    return 1;
+  }
+
+  if (!number) return 0;
+  *number = strtod(p, NULL);
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: add the kernel times of an ORT profile (Chrome trace JSON) to the
+// per-operator totals. Only "Node" events ending in "_kernel_time" are
+// counted; fence events are ignored. Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int AddProfile(const char* path, OpProfile* ops, size_t* num_ops) {
+  MappedFile  profile;
+  const char* text      = NULL;
+  const char* end       = NULL;
+  const char* obj       = NULL;
+  int         depth     = 0;
+  int         in_string = 0;
+
+  if (MapFile(path, &profile) <= 0) {
+    fprintf(stderr, "Failed to read profile '%s'.\n", path);
+    return 0;
+  }
+  text = (const char*)profile.data;
+  end  = text + profile.size;
+
+  for (const char* p = text; p < end; p++) {
+    if (in_string) {
+      if (*p == '\\') p++;
+      else if (*p == '"') in_string = 0;
+      continue;
+    }
+
+    if (*p == '"') {
+      in_string = 1;
+    } else if (*p == '{') {
+      if (depth++ == 0) obj = p;
+    } else if (*p == '}' && depth > 0 && --depth == 0) {
+      char   cat[16], name[256], op[64];
+      double dur = 0.0;
+      size_t name_len, i;
+
+      if (!JsonValue(obj, p, "cat", cat, sizeof(cat), NULL) || strcmp(cat, "Node") != 0 ||
+          !JsonValue(obj, p, "name", name, sizeof(name), NULL) ||
+          !JsonValue(obj, p, "dur", NULL, 0, &dur))
+        continue;
+
+      name_len = strlen(name);
+      if (name_len < 12 || strcmp(name + name_len - 12, "_kernel_time") != 0) continue;
+      if (!JsonValue(obj, p, "op_name", op, sizeof(op), NULL)) {
+        snprintf(op, sizeof(op), "%.*s", (int)(name_len - 12), name);
+      }
+
+      for (i = 0; i < *num_ops && strcmp(ops[i].op, op) != 0; i++)
+        ;
+      if (i == *num_ops) {
+        if (*num_ops == MAX_PROFILE_OPS) continue;
+        memset(&ops[i], 0, sizeof(ops[i]));
+        snprintf(ops[i].op, sizeof(ops[i].op), "%s", op);
+        (*num_ops)++;
+      }
+      ops[i].total_us += dur;
+      ops[i].calls++;
+    }
+  }
+
+  UnmapFile(&profile);
+  return 1;
+}
+
+static int CompareOpProfile(const void* a, const void* b) {
+  double x = ((const OpProfile*)a)->total_us;
+  double y = ((const OpProfile*)b)->total_us;
+  return (x < y) - (x > y);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: end profiling on every session and print the operators that took
+// the most time over all profiles.
+// ---------------------------------------------------------------------------
+static void SummarizeProfiles(const OrtApi* ort, OrtSession** sessions, int num_sessions) {
+  static OpProfile ops[MAX_PROFILE_OPS];
+  OrtAllocator*    allocator = NULL;
+  size_t           num_ops   = 0;
+  double           total_us  = 0.0;
+
+  if (!CheckStatus(ort, ort->GetAllocatorWithDefaultOptions(&allocator))) return;
+
+  for (int i = 0; i < num_sessions; i++) {
+    char* profile_path = NULL;
+
+    if (!sessions[i] ||
+        !CheckStatus(ort, ort->SessionEndProfiling(sessions[i], allocator, &profile_path)))
+      continue;
+
+    printf("ORT profile written to '%s'.\n", profile_path);
+    AddProfile(profile_path, ops, &num_ops);
+    ort->AllocatorFree(allocator, profile_path);
+  }
+
+  if (num_ops == 0) return;
+
+  qsort(ops, num_ops, sizeof(OpProfile), CompareOpProfile);
+  for (size_t i = 0; i < num_ops; i++) total_us += ops[i].total_us;
+
+  printf("\nTop operators by kernel time:\n");
+  printf("  %-32s %8s %12s %10s %7s\n", "operator", "calls", "total ms", "mean us", "share");
+  for (size_t i = 0; i < num_ops && i < TOP_PROFILE_OPS; i++) {
+    printf("  %-32s %8zu %12.3f %10.1f %6.1f%%\n",
+           ops[i].op, ops[i].calls, ops[i].total_us / 1000.0,
+           ops[i].total_us / ops[i].calls, 100.0 * ops[i].total_us / total_us);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Helper: run one inference on a worker's session and tensors.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int RunInference(Worker* worker, double* duration_ms) {
+  WorkerShared* shared = worker->shared;
+  const OrtApi* ort    = shared->ort;
+
+  // Bound outputs are written in place, nothing is allocated per run
+  if (worker->binding) {
+    double t_start = NowMs();
+    if (!CheckStatus(ort, ort->RunWithBinding(worker->session, NULL, worker->binding)))
+      return 0;
+    *duration_ms = NowMs() - t_start;
+    return 1;
+  }
+
+  ClearTensors(ort, worker->output_tensors, shared->num_outputs);
+
+  double t_start = NowMs();
+  if (!CheckStatus(ort, ort->Run(worker->session, NULL,
+                                 shared->input_names,
+                                 (const OrtValue* const*)worker->input_tensors,
+                                 shared->num_inputs,
+                                 shared->output_names,
+                                 shared->num_outputs,
+                                 worker->output_tensors)))
+    return 0;
+
+  *duration_ms = NowMs() - t_start;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: pre-allocate the input and output buffers of a worker, wrap them
+// in tensors and bind them to the worker's session. The input data is
+// copied once into the input buffers. Output shapes must be static.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int SetupIoBinding(Worker* worker, const OrtMemoryInfo* buffer_memory_info,
+                          void* const* input_buffers, const size_t* input_bytes,
+                          int64_t** input_dims, size_t* input_dims_count,
+                          const ONNXTensorElementDataType* input_types,
+                          int64_t** output_dims, size_t* output_dims_count,
+                          const ONNXTensorElementDataType* output_types) {
+  WorkerShared* shared = worker->shared;
+  const OrtApi* ort    = shared->ort;
+  size_t num_buffers   = shared->num_inputs + shared->num_outputs;
+
+  worker->buffers = (void**)calloc(num_buffers, sizeof(void*));
+  if (!worker->buffers) return 0;
+
+  if (!CheckStatus(ort, ort->CreateIoBinding(worker->session, &worker->binding)))
+    return 0;
+
+  for (size_t b = 0; b < num_buffers; b++) {
+    int       is_input = b < shared->num_inputs;
+    size_t    i        = is_input ? b : b - shared->num_inputs;
+    int64_t*  dims     = is_input ? input_dims[i] : output_dims[i];
+    size_t    num_dims = is_input ? input_dims_count[i] : output_dims_count[i];
+    ONNXTensorElementDataType type = is_input ? input_types[i] : output_types[i];
+    size_t    bytes    = ElementSize(type);
+    OrtValue** tensor  = is_input ? &worker->input_tensors[i] : &worker->output_tensors[i];
+
+    if (bytes == 0) {
+      fprintf(stderr, "Unsupported type for %s %zu.\n", is_input ? "input" : "output", i);
+      return 0;
+    }
+
+    for (size_t d = 0; d < num_dims; d++) {
+      if (dims[d] <= 0) {
+        fprintf(stderr, "%s %zu has dynamic dimensions; run without --io-binding.\n", is_input ? "Input" : "Output", i);
+        return 0;
+      }
+      bytes *= (size_t)dims[d];
+    }
+
+    worker->buffers[b] = AllocBuffer(ort, worker->buffer_allocator, bytes);
+    if (!worker->buffers[b]) {
+      fprintf(stderr, "Failed to allocate a %zu byte buffer.\n", bytes);
+      return 0;
+    }
+
+    if (is_input) {
+      memcpy(worker->buffers[b], input_buffers[i], input_bytes[i]);
+    } else {
+      memset(worker->buffers[b], 0, bytes);
+    }
+
+    if (!CheckStatus(ort, ort->CreateTensorWithDataAsOrtValue(
+                            buffer_memory_info, worker->buffers[b], bytes,
+                            dims, num_dims, type, tensor)))
+      return 0;
+
+    if (is_input) {
+      if (!CheckStatus(ort, ort->BindInput(worker->binding, shared->input_names[i], *tensor)))
+        return 0;
+    } else {
+      if (!CheckStatus(ort, ort->BindOutput(worker->binding, shared->output_names[i], *tensor)))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Worker thread: warmup runs, then timed iterations taken from the shared
+// counter until all of them are handed out.
+// ---------------------------------------------------------------------------
+static void* InferenceWorker(void* arg) {
+  Worker*           worker = (Worker*)arg;
+  WorkerShared*     shared = worker->shared;
+  const RunOptions* opts   = shared->opts;
+  double duration_ms = 0.0;
+
+  if (worker->cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(worker->cpu, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+      fprintf(stderr, "Warning: could not pin a worker thread to CPU %d.\n", worker->cpu);
+  }
+
+  for (int it = 0; it < opts->warmup && !atomic_load(&shared->failed); it++) {
+    if (!RunInference(worker, &duration_ms)) {
+      atomic_store(&shared->failed, 1);
+      break;
+    }
+    if (it == 0) worker->first_run_ms = duration_ms;
+    if (opts->concurrency == 1) printf("Warmup %d: %.1f ms\n", it + 1, duration_ms);
+  }
+
+  // Wait until every worker is warm
+  pthread_mutex_lock(&shared->gate.lock);
+  shared->gate.ready++;
+  pthread_cond_broadcast(&shared->gate.cond);
+  while (!shared->gate.open) pthread_cond_wait(&shared->gate.cond, &shared->gate.lock);
+  pthread_mutex_unlock(&shared->gate.lock);
+
+  while (!atomic_load(&shared->failed) &&
+         atomic_fetch_add(&shared->next_iteration, 1) < opts->iterations) {
+    if (!RunInference(worker, &duration_ms)) {
+      atomic_store(&shared->failed, 1);
+      break;
+    }
+    if (worker->first_run_ms == 0.0) worker->first_run_ms = duration_ms;
+    worker->latencies[worker->num_latencies++] = duration_ms;
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: collect the sample files of a dataset, either the regular files of
+// a directory in name order or the lines of a list file. Empty lines and
+// lines starting with '#' in a list are skipped.
+// Returns the number of files, 0 on failure. Free with FreeFileList().
+// ---------------------------------------------------------------------------
+static int CompareString(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void FreeFileList(char** files, size_t count) {
+  for (size_t i = 0; files && i < count; i++) free(files[i]);
+  free(files);
+}
+
+static int AppendFile(char*** files, size_t* count, size_t* capacity, char* file) {
+  if (*count == *capacity) {
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    char** grown = (char**)realloc(*files, new_capacity * sizeof(char*));
+    if (!grown) return 0;
+    *files    = grown;
+    *capacity = new_capacity;
+  }
+  (*files)[(*count)++] = file;
+  return 1;
+}
+
+static size_t ListDataset(const char* path, char*** files_out) {
+  struct stat st;
+  char**      files    = NULL;
+  size_t      count    = 0;
+  size_t      capacity = 0;
+
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "Failed to open dataset '%s'.\n", path);
+    return 0;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR*           dir   = opendir(path);
+    struct dirent* entry = NULL;
+
+    if (!dir) {
+      fprintf(stderr, "Failed to open dataset '%s'.\n", path);
+      return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+      char* file = NULL;
+
+      if (entry->d_name[0] == '.') continue;
+      if (asprintf(&file, "%s/%s", path, entry->d_name) < 0) break;
+      if (stat(file, &st) != 0 || !S_ISREG(st.st_mode) ||
+          !AppendFile(&files, &count, &capacity, file))
+        free(file);
+    }
+    closedir(dir);
+
+    if (count > 1) qsort(files, count, sizeof(char*), CompareString);
+  } else {
+    FILE* list = fopen(path, "r");
+    char  line[4096];
+
+    if (!list) {
+      fprintf(stderr, "Failed to open dataset '%s'.\n", path);
+      return 0;
+    }
+
+    while (fgets(line, sizeof(line), list)) {
+      size_t len  = strcspn(line, "\r\n");
+      char*  file = NULL;
+
+      line[len] = '\0';
+      if (len == 0 || line[0] == '#') continue;
+      if (!(file = strdup(line)) || !AppendFile(&files, &count, &capacity, file)) {
+        free(file);
+        break;
+      }
+    }
+    fclose(list);
+  }
+
+  if (count == 0) {
+    fprintf(stderr, "Dataset '%s' has no samples.\n", path);
+    FreeFileList(files, count);
+    return 0;
+  }
+
+  *files_out = files;
+  return count;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: create a packed dataset file from raw sample files, see PackHeader.
+// The samples are converted like single inputs (float32 files are accepted
+// for float16 models) and stored back to back after the index, starting on a
+// page boundary. Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int WritePack(const char* path, char* const* files, size_t num_files,
+                     ONNXTensorElementDataType type, const int64_t* dims, size_t num_dims) {
+  PackHeader header;
+  FILE*      pack         = NULL;
+  void*      sample       = NULL;
+  size_t     sample_count = 1;
+  uint64_t   data_offset  = 0;
+  int        ok           = 0;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+  header.header_size  = sizeof(PackHeader);
+  header.element_type = (int32_t)type;
+  header.num_dims     = (uint32_t)num_dims;
+  for (size_t d = 0; d < num_dims; d++) {
+    header.dims[d] = dims[d];
+    sample_count  *= (size_t)dims[d];
+  }
+  header.num_samples  = num_files;
+  header.sample_bytes = sample_count * ElementSize(type);
+
+  data_offset = sizeof(PackHeader) + num_files * sizeof(uint64_t);
+  data_offset = (data_offset + PACK_DATA_ALIGN - 1) & ~(uint64_t)(PACK_DATA_ALIGN - 1);
+
+  sample = malloc(header.sample_bytes);
+  pack   = fopen(path, "wb");
+  if (!sample || !pack) {
+    fprintf(stderr, "Failed to create '%s'.\n", path);
+    goto done;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, pack) != 1) goto write_error;
+  for (size_t k = 0; k < num_files; k++) {
+    uint64_t offset = data_offset + k * header.sample_bytes;
+    if (fwrite(&offset, sizeof(offset), 1, pack) != 1) goto write_error;
+  }
+  if (fseek(pack, (long)data_offset, SEEK_SET) != 0) goto write_error;
+
+  for (size_t k = 0; k < num_files; k++) {
+    int loaded = LoadRawInput(files[k], type, sample_count, sample);
+    if (loaded < 0) fprintf(stderr, "Failed to open '%s'.\n", files[k]);
+    if (loaded <= 0) goto done;
+    if (fwrite(sample, header.sample_bytes, 1, pack) != 1) goto write_error;
+  }
+
+  ok = 1;
+  printf("Packed %zu sample(s) of %llu bytes into '%s'.\n",
+         num_files, (unsigned long long)header.sample_bytes, path);
+  goto done;
+
+write_error:
+  fprintf(stderr, "Failed to write '%s'.\n", path);
+
+done:
+  if (pack && fclose(pack) != 0 && ok) {
+    fprintf(stderr, "Failed to write '%s'.\n", path);
+    ok = 0;
+  }
+  free(sample);
+  return ok;
+}
 
 // ---------------------------------------------------------------------------
-// Helper: check an OrtStatus and print any error message.
-// Returns 1 on success, 0 on failure.
+// Helper: open a dataset: a packed file (mapped, see PackHeader), a directory
+// of raw sample files or a list file. Returns 1 on success, 0 on failure.
 // ---------------------------------------------------------------------------
-static int CheckStatus(const OrtApi* ort, OrtStatus* status) {
-  if (status != NULL) {
-    const char* msg = ort->GetErrorMessage(status);
-    fprintf(stderr, "ORT Error: %s\n", msg);
-    ort->ReleaseStatus(status);
+static int OpenDataset(const char* path, Dataset* dataset) {
+  struct stat st;
+  char        magic[sizeof(((PackHeader*)0)->magic)];
+  FILE*       file   = NULL;
+  int         packed = 0;
+
+  memset(dataset, 0, sizeof(*dataset));
+
+  if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && (file = fopen(path, "rb")) != NULL) {
+    packed = fread(magic, sizeof(magic), 1, file) == 1 &&
+             memcmp(magic, PACK_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+  }
+
+  if (!packed) {
+    dataset->num_samples = ListDataset(path, &dataset->files);
+    return dataset->num_samples > 0;
+  }
+
+  if (MapFile(path, &dataset->pack) <= 0) {
+    fprintf(stderr, "Failed to map '%s'.\n", path);
+    return 0;
+  }
+
+  const PackHeader* header = (const PackHeader*)dataset->pack.data;
+  size_t            size   = dataset->pack.size;
+
+  // The index of num_samples offsets must fit between the header and the end
+  if (size < sizeof(PackHeader) || header->header_size < sizeof(PackHeader) ||
+      header->header_size > size || header->header_size % sizeof(uint64_t) != 0 ||
+      header->num_dims > MAX_DIMS || header->sample_bytes == 0 ||
+      header->num_samples == 0 ||
+      header->num_samples > (size - header->header_size) / sizeof(uint64_t)) {
+    fprintf(stderr, "'%s' is not a valid packed dataset.\n", path);
+    UnmapFile(&dataset->pack);
     return 0;
   }
+
+  dataset->header      = header;
+  dataset->offsets     = (const uint64_t*)((const uint8_t*)header + header->header_size);
+  dataset->num_samples = (size_t)header->num_samples;
+  dataset->contiguous  = 1;
+
+  for (size_t k = 0; k < dataset->num_samples; k++) {
+    uint64_t offset = dataset->offsets[k];
+    if (offset > size || header->sample_bytes > size - offset) {
+      fprintf(stderr, "Sample %zu of '%s' is out of bounds.\n", k, path);
+      UnmapFile(&dataset->pack);
+      return 0;
+    }
+    if (k > 0 && offset != dataset->offsets[k - 1] + header->sample_bytes)
+      dataset->contiguous = 0;
+  }
+
+  // Batches are read front to back
+  madvise(dataset->pack.data, dataset->pack.size, MADV_SEQUENTIAL);
   return 1;
 }
 
+static void CloseDataset(Dataset* dataset) {
+  FreeFileList(dataset->files, dataset->num_samples);
+  UnmapFile(&dataset->pack);
+  memset(dataset, 0, sizeof(*dataset));
+}
+
+static void PrintSampleName(const RunOptions* opts, const Dataset* dataset, size_t k) {
+  if (dataset->files) printf("  %s", dataset->files[k]);
+  else                printf("  %s[%zu]", opts->dataset_path, k);
+}
+
 // ---------------------------------------------------------------------------
-// Helper: free all dynamically allocated node metadata arrays.
+// Batched mode: pack the dataset samples into batches of every requested
+// size, padding the last batch by repeating its last sample, and run them on
+// one session. Output 0 is split back into per-sample top-1 results, which
+// are printed for the first batch size. A model with a fixed batch dimension
+// only runs its own batch size.
+//
+// Samples are not copied where the layout allows it: full batches of a
+// packed dataset with back to back samples and single raw files at batch 1
+// are run on tensors over the mapped file pages. Other batches are assembled
+// in a batch buffer. The first run, warmup included, is timed into
+// *first_run_ms for the startup breakdown if that is still 0.
+// Returns 1 on success, 0 on failure.
 // ---------------------------------------------------------------------------
-static void FreeNodeInfo(OrtAllocator* allocator,
-                         char** names, size_t name_count,
-                         int64_t** dims, size_t* dims_count,
-                         size_t node_count) {
-  if (names) {
-    for (size_t i = 0; i < name_count; i++) {
-      if (names[i] && allocator) allocator->Free(allocator, names[i]);
+static int RunDataset(const OrtApi* ort, OrtSession* session, const RunOptions* opts,
+                      const LabelTable* labels,
+                      const char* const* input_names, const char* const* output_names,
+                      size_t num_outputs, ONNXTensorElementDataType input_type,
+                      const int64_t* input_dims, size_t num_dims, int64_t model_batch,
+                      BatchResult* results, int* num_results, double* first_run_ms) {
+  Dataset        dataset;
+  OrtMemoryInfo* memory_info   = NULL;
+  OrtValue*      input_tensor  = NULL;  // over the batch buffer
+  OrtValue*      mapped_tensor = NULL;  // over mapped file pages, per batch
+  OrtValue**     outputs       = NULL;
+  MappedFile     sample_map    = { NULL, 0 };
+  void*          batch_data    = NULL;
+  double*        latencies     = NULL;
+  float*         scores        = NULL;  // one output item
+  int            default_size  = (model_batch > 0) ? (int)model_batch : 1;
+  const int*     sizes         = opts->num_batch_sizes ? opts->batch_sizes : &default_size;
+  int            num_sizes     = opts->num_batch_sizes ? opts->num_batch_sizes : 1;
+  size_t         item_count    = 1;
+  size_t         item_bytes    = 0;
+  size_t         num_files     = 0;
+  int64_t        dims[MAX_DIMS];
+  int            ok            = 0;
+
+  *num_results = 0;
+  if (!OpenDataset(opts->dataset_path, &dataset)) return 0;
+  num_files = dataset.num_samples;
+
+  if (num_dims < 1 || num_dims > MAX_DIMS) {
+    fprintf(stderr, "Batched mode needs a batch dimension on input 0.\n");
+    goto done;
+  }
+  for (size_t d = 1; d < num_dims; d++) item_count *= (size_t)input_dims[d];
+  item_bytes = item_count * ElementSize(input_type);
+
+  if (dataset.header && (dataset.header->element_type != (int32_t)input_type ||
+                         dataset.header->sample_bytes != item_bytes)) {
+    fprintf(stderr, "The samples of '%s' do not match the %zu %s elements of input 0.\n",
+            opts->dataset_path, item_count, ElementTypeName(input_type));
+    goto done;
+  }
+
+  outputs = (OrtValue**)calloc(num_outputs, sizeof(OrtValue*));
+  if (!outputs || item_bytes == 0 ||
+      !CheckStatus(ort, ort->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memory_info)))
+    goto done;
+
+  printf("\nDataset '%s': %zu sample(s) of %zu %s element(s)%s.\n",
+         opts->dataset_path, num_files, item_count, ElementTypeName(input_type),
+         dataset.header ? (dataset.contiguous ? ", packed" : ", packed with gaps") : "");
+
+  for (int s = 0; s < num_sizes; s++) {
+    int    batch       = sizes[s];
+    size_t num_batches = (num_files + batch - 1) / batch;
+    int    print_items = (*num_results == 0);
+    double io_ms       = 0.0;
+
+    if (model_batch > 0 && batch != model_batch) {
+      fprintf(stderr, "Warning: the model has a fixed batch of %lld; skipping batch %d.\n",
+              (long long)model_batch, batch);
+      continue;
     }
-    free(names);
+
+    memcpy(dims, input_dims, num_dims * sizeof(int64_t));
+    dims[0] = batch;
+
+    batch_data = AllocBuffer(ort, NULL, batch * item_bytes);
+    latencies  = (double*)malloc(num_batches * sizeof(double));
+    if (!batch_data || !latencies) {
+      fprintf(stderr, "Failed to allocate memory for batch %d.\n", batch);
+      goto done;
+    }
+
+    // The tensor wraps the batch buffer, which is refilled for every batch
+    if (!CheckStatus(ort, ort->CreateTensorWithDataAsOrtValue(
+                            memory_info, batch_data, batch * item_bytes, dims, num_dims,
+                            input_type, &input_tensor)))
+      goto done;
+
+    if (print_items) printf("\nTop-1 Results:\n");
+
+    // Negative runs are warmup runs on the first batch
+    for (long run = -(long)opts->warmup; run < (long)num_batches; run++) {
+      size_t    b         = (run < 0) ? 0 : (size_t)run;
+      size_t    first     = b * batch;
+      size_t    n         = (num_files - first < (size_t)batch) ? num_files - first : (size_t)batch;
+      uint8_t*  slots     = (uint8_t*)batch_data;
+      void*     mapped    = NULL;
+      OrtValue* run_input = input_tensor;
+      double    t_start   = NowMs();
+      double    run_ms    = 0.0;
+
+      if (dataset.header) {
+        const uint8_t* base = (const uint8_t*)dataset.pack.data;
+
+        if (n == (size_t)batch && (n == 1 || dataset.contiguous)) {
+          mapped = (void*)(base + dataset.offsets[first]);
+        } else {
+          for (size_t j = 0; j < n; j++)
+            memcpy(slots + j * item_bytes, base + dataset.offsets[first + j], item_bytes);
+        }
+      } else if (batch == 1 && MapFile(dataset.files[first], &sample_map) > 0 &&
+                 sample_map.size == item_bytes) {
+        mapped = sample_map.data;
+      } else {
+        UnmapFile(&sample_map);
+        for (size_t j = 0; j < n; j++) {
+          int loaded = LoadRawInput(dataset.files[first + j], input_type, item_count,
+                                    slots + j * item_bytes);
+          if (loaded < 0) fprintf(stderr, "Failed to open '%s'.\n", dataset.files[first + j]);
+          if (loaded <= 0) goto done;
+        }
+      }
+
+      if (mapped) {
+        // Input tensors are only read, so the read-only pages are safe
+        if (!CheckStatus(ort, ort->CreateTensorWithDataAsOrtValue(
+                                memory_info, mapped, batch * item_bytes, dims, num_dims,
+                                input_type, &mapped_tensor)))
+          goto done;
+        run_input = mapped_tensor;
+      } else {
+        for (size_t j = n; j < (size_t)batch; j++)
+          memcpy(slots + j * item_bytes, slots + (n - 1) * item_bytes, item_bytes);
+      }
+      if (run >= 0) io_ms += NowMs() - t_start;
+
+      ClearTensors(ort, outputs, num_outputs);
+      t_start = NowMs();
+      if (!CheckStatus(ort, ort->Run(session, NULL, input_names,
+                                     (const OrtValue* const*)&run_input, 1,
+                                     output_names, num_outputs, outputs)))
+        goto done;
+      run_ms = NowMs() - t_start;
+      if (*first_run_ms == 0.0) *first_run_ms = run_ms;
+      if (run >= 0) latencies[b] = run_ms;
+
+      if (mapped_tensor) {
+        ort->ReleaseValue(mapped_tensor);
+        mapped_tensor = NULL;
+      }
+      UnmapFile(&sample_map);
+
+      if (run < 0 || !print_items) continue;
+
+      {
+        OrtTensorTypeAndShapeInfo* shape_info  = NULL;
+        ONNXTensorElementDataType  output_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+        size_t  output_count = 0, output_dims_count = 0;
+        int64_t output_batch = 0;
+        void*   raw_buffer   = NULL;
+
+        if (!CheckStatus(ort, ort->GetTensorMutableData(outputs[0], &raw_buffer)) ||
+            !CheckStatus(ort, ort->GetTensorTypeAndShape(outputs[0], &shape_info)))
+          goto done;
+        if (!CheckStatus(ort, ort->GetTensorElementType(shape_info, &output_type)) ||
+            !CheckStatus(ort, ort->GetTensorShapeElementCount(shape_info, &output_count)) ||
+            !CheckStatus(ort, ort->GetDimensionsCount(shape_info, &output_dims_count)) ||
+            output_dims_count < 1 ||
+            !CheckStatus(ort, ort->GetDimensions(shape_info, &output_batch, 1))) {
+          ort->ReleaseTensorTypeAndShapeInfo(shape_info);
+          goto done;
+        }
+        ort->ReleaseTensorTypeAndShapeInfo(shape_info);
+
+        if (output_batch != batch || ElementSize(output_type) == 0) {
+          fprintf(stderr, "Output 0 is not batched along its first dimension.\n");
+          goto done;
+        }
+
+        size_t per_item = output_count / batch;
+        if (!scores && !(scores = (float*)malloc(per_item * sizeof(float)))) goto done;
+
+        for (size_t j = 0; j < n; j++) {
+          TopKEntry   top;
+          const char* label = NULL;
+
+          OutputScores(opts, raw_buffer, output_type, j * per_item, per_item, scores);
+          TopK(scores, per_item, 1, &top);
+          label = LabelTableGet(labels, top.index);
+
+          PrintSampleName(opts, &dataset, first + j);
+          printf(": index=%zu  label=%s  score=%.6f\n", top.index, label ? label : "unknown",
+                 top.score);
+        }
+      }
+    }
+
+    BatchResult* result = &results[(*num_results)++];
+    result->batch       = batch;
+    result->num_batches = num_batches;
+    result->num_samples = num_files;
+    result->io_ms       = io_ms;
+    ComputeLatencyStats(latencies, num_batches, &result->stats);
+    result->stats.throughput = (result->stats.total > 0.0)
+                                   ? num_files * 1000.0 / result->stats.total : 0.0;
+
+    ort->ReleaseValue(input_tensor);
+    input_tensor = NULL;
+    free(batch_data);
+    batch_data = NULL;
+    free(latencies);
+    latencies = NULL;
   }
-  if (dims) {
-    for (size_t i = 0; i < node_count; i++) free(dims[i]);
-    free(dims);
+
+  ok = (*num_results > 0);
+  if (!ok) fprintf(stderr, "No batch size matches the model.\n");
+
+done:
+  ReleaseTensors(ort, outputs, num_outputs);
+  if (mapped_tensor) ort->ReleaseValue(mapped_tensor);
+  if (input_tensor)  ort->ReleaseValue(input_tensor);
+  if (memory_info)   ort->ReleaseMemoryInfo(memory_info);
+  UnmapFile(&sample_map);
+  free(batch_data);
+  free(latencies);
+  free(scores);
+  CloseDataset(&dataset);
+  return ok;
+}
+
+static void PrintBatchResults(const RunOptions* opts, const BatchResult* results, int num_results) {
+  printf("\nBatch sweep (%zu samples, %d warmup run(s) per batch size):\n",
+         results[0].num_samples, opts->warmup);
+  printf("  batch  batches  mean ms/batch  p90 ms/batch  ms/sample  io ms/sample  samples/s\n");
+  for (int r = 0; r < num_results; r++) {
+    const BatchResult* result = &results[r];
+    printf("  %5d  %7zu  %13.2f  %12.2f  %9.3f  %12.3f  %9.2f\n",
+           result->batch, result->num_batches, result->stats.mean, result->stats.p90,
+           result->stats.total / result->num_samples, result->io_ms / result->num_samples,
+           result->stats.throughput);
   }
-  free(dims_count);
 }
 
-// ---------------------------------------------------------------------------
-// Helper: release an array of OrtValue tensors.
-// ---------------------------------------------------------------------------
-static void ReleaseTensors(const OrtApi* ort, OrtValue** tensors, size_t count) {
-  if (!tensors) return;
-  for (size_t i = 0; i < count; i++) {
-    if (tensors[i]) ort->ReleaseValue(tensors[i]);
+static int WriteBatchJson(const RunOptions* opts, const BatchResult* results, int num_results,
+                          const StartupTimes* startup) {
+  FILE* json_file = fopen(opts->json_path, "w");
+  if (!json_file) {
+    fprintf(stderr, "Failed to open '%s' for writing.\n", opts->json_path);
+    return 0;
   }
-  free(tensors);
+
+  fprintf(json_file, "{\n");
+  fprintf(json_file, "  \"model\": \"%s\",\n", opts->model_path);
+  fprintf(json_file, "  \"backend\": \"%s\",\n", opts->backend);
+  fprintf(json_file, "  \"dataset\": \"%s\",\n", opts->dataset_path);
+  fprintf(json_file, "  \"samples\": %zu,\n", results[0].num_samples);
+  fprintf(json_file, "  \"warmup\": %d,\n", opts->warmup);
+  WriteStartupJson(json_file, startup);
+  fprintf(json_file, "  \"batches\": [\n");
+  for (int r = 0; r < num_results; r++) {
+    const BatchResult* result = &results[r];
+    fprintf(json_file, "    { \"batch\": %d, \"runs\": %zu, \"mean\": %.4f, \"p50\": %.4f, "
+                       "\"p90\": %.4f, \"p99\": %.4f, \"ms_per_sample\": %.4f, "
+                       "\"io_ms_per_sample\": %.4f, \"throughput_ips\": %.4f }%s\n",
+            result->batch, result->num_batches, result->stats.mean, result->stats.p50,
+            result->stats.p90, result->stats.p99, result->stats.total / result->num_samples,
+            result->io_ms / result->num_samples, result->stats.throughput,
+            (r + 1 < num_results) ? "," : "");
+  }
+  fprintf(json_file, "  ]\n");
+  fprintf(json_file, "}\n");
+
+  if (fclose(json_file) != 0) {
+    fprintf(stderr, "Failed to write '%s'.\n", opts->json_path);
+    return 0;
+  }
+  printf("Benchmark results written to '%s'.\n", opts->json_path);
+  return 1;
 }
 
 // ---------------------------------------------------------------------------
 // Core inference routine using the QNN Execution Provider.
 // ---------------------------------------------------------------------------
-static void run_ort_qnn_ep(const char* backend,
-                           const char* model_path,
-                           const char* input_path,
-                           int generate_ctx,
-                           int float32_model) {
+static void run_ort_qnn_ep(const RunOptions* opts) {
   const OrtApi* ort = OrtGetApiBase()->GetApi(ORT_API_VERSION);
+  const char* backend     = opts->backend;
+  const char* model_path  = opts->model_path;
+  const char* input_path  = opts->input_path;
+  int generate_ctx        = opts->generate_ctx;
+  int float32_model       = opts->float32_model;
 
   // ORT handles
   OrtEnv*            env             = NULL;
   OrtSessionOptions* session_options = NULL;
   OrtSession*        session         = NULL;
+  OrtSession**       sessions        = NULL;  // one, or one per worker
+  OrtMemoryInfo*     ep_memory_info  = NULL;
+  OrtAllocator**     ep_allocators   = NULL;  // per session, --htp-shared-memory
+  int                num_sessions    = opts->session_per_thread ? opts->concurrency : 1;
   OrtAllocator*      allocator       = NULL;
   OrtMemoryInfo*     memory_info     = NULL;
+  char*              cache_path      = NULL;  // --ctx-cache entry of the model
+  const char*        session_model   = model_path;
+  int                cache_retried   = 0;
+  StartupTimes       startup;
+  double             t_phase         = 0.0;
+
+  // QNN EP options, also part of the context cache key
+  const char* options_keys[MAX_OPTIONS];
+  const char* options_values[MAX_OPTIONS];
+  size_t      num_options = 0;
 
   // Input node metadata
   size_t                      num_input_nodes      = 0;
@@ -90,6 +1643,7 @@ static void run_ort_qnn_ep(const char* backend,
   size_t*                     input_node_dims_count = NULL;
   ONNXTensorElementDataType*  input_types          = NULL;
   OrtValue**                  input_tensors        = NULL;
+  ONNXTensorElementDataType*  output_types         = NULL;
 
   // Output node metadata
   size_t     num_output_nodes       = 0;
@@ -99,32 +1653,57 @@ static void run_ort_qnn_ep(const char* backend,
   OrtValue** output_tensors         = NULL;
 
   // Data buffers / file handles
-  float* input_data      = NULL;
-  FILE*  input_raw_file  = NULL;
-  FILE*  label_file      = NULL;
+  void**  input_buffers   = NULL;  // one per input, read-only once loaded
+  size_t* input_bytes     = NULL;
+  MappedFile* input_maps  = NULL;  // inputs used straight from their file
+  char*   input_paths     = NULL;
+  LabelTable labels       = { NULL, NULL, 0 };
+  double* latencies       = NULL;
+
+  // Inference workers
+  Worker*       workers       = NULL;
+  int           num_started   = 0;
+  int           gate_ready    = 0;
+  WorkerShared  shared;
+  LatencyStats* thread_stats  = NULL;
+  int64_t       model_batch   = 0;  // first dimension of input 0, <= 0 if dynamic
 
   // -------------------------------------------------------------------------
   // 1. Create ORT environment
   // -------------------------------------------------------------------------
+  memset(&startup, 0, sizeof(startup));
+  t_phase = NowMs();
   if (!CheckStatus(ort, ort->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "qnn_sample", &env)))
     goto cleanup;
+  startup.create_env = NowMs() - t_phase;
 
   // -------------------------------------------------------------------------
   // 2. Configure session options
   // -------------------------------------------------------------------------
+  t_phase = NowMs();
   if (!CheckStatus(ort, ort->CreateSessionOptions(&session_options)))         goto cleanup;
-  if (!CheckStatus(ort, ort->SetIntraOpNumThreads(session_options, 1)))       goto cleanup;
+  if (!CheckStatus(ort, ort->SetIntraOpNumThreads(session_options,
+                                                  opts->intra_op_threads)))  goto cleanup;
+  if (opts->inter_op_threads > 0) {
+    // Inter-op threads are only used by the parallel executor
+    if (!CheckStatus(ort, ort->SetInterOpNumThreads(session_options,
+                                                    opts->inter_op_threads))) goto cleanup;
+    if (opts->inter_op_threads > 1 &&
+        !CheckStatus(ort, ort->SetSessionExecutionMode(session_options, ORT_PARALLEL)))
+      goto cleanup;
+  }
   if (!CheckStatus(ort, ort->SetSessionGraphOptimizationLevel(
-                            session_options, ORT_ENABLE_BASIC)))              goto cleanup;
+                            session_options, GRAPH_OPT_LEVEL)))               goto cleanup;
+  // Every session writes its own <prefix>_<timestamp>.json profile
+  if (opts->profile_prefix &&
+      !CheckStatus(ort, ort->EnableProfiling(session_options, opts->profile_prefix)))
+    goto cleanup;
+  startup.session_options = NowMs() - t_phase;
 
   // -------------------------------------------------------------------------
   // 3. Append QNN Execution Provider
   // -------------------------------------------------------------------------
   {
-    const char* options_keys[MAX_OPTIONS];
-    const char* options_values[MAX_OPTIONS];
-    size_t num_options = 0;
-
     // Required: path to the QNN backend shared library
     options_keys[num_options]   = "backend_path";
     options_values[num_options] = backend;
@@ -137,6 +1716,13 @@ static void run_ort_qnn_ep(const char* backend,
       num_options++;
     }
 
+    // Let the EP allocate bound buffers in memory shared with the HTP
+    if (opts->htp_shared_memory) {
+      options_keys[num_options]   = "enable_htp_shared_memory_allocator";
+      options_values[num_options] = "1";
+      num_options++;
+    }
+
     // Optionally generate a QNN context binary embedded in an EPContext ONNX model
     if (generate_ctx) {
       if (!CheckStatus(ort, ort->AddSessionConfigEntry(
@@ -144,17 +1730,61 @@ static void run_ort_qnn_ep(const char* backend,
         goto cleanup;
     }
 
+    t_phase = NowMs();
     if (!CheckStatus(ort, ort->SessionOptionsAppendExecutionProvider(
                             session_options, "QNN",
                             options_keys, options_values, num_options)))
       goto cleanup;
+    startup.append_ep = NowMs() - t_phase;
   }
 
   // -------------------------------------------------------------------------
-  // 4. Create session (loads and compiles the model)
+  // 4. Create session(s) (loads and compiles the model). A session can run
+  //    on several threads at once, or every worker gets its own session.
+  //    With a context cache the model is compiled once into a cached context
+  //    model, which later runs load instead of compiling again.
   // -------------------------------------------------------------------------
-  if (!CheckStatus(ort, ort->CreateSession(env, model_path, session_options, &session)))
+  sessions = (OrtSession**)calloc(num_sessions, sizeof(OrtSession*));
+  if (!sessions) {
+    fprintf(stderr, "Failed to allocate memory for sessions.\n");
     goto cleanup;
+  }
+
+  t_phase = NowMs();
+  if (opts->ctx_cache_dir) {
+    cache_path = ContextCachePath(opts->ctx_cache_dir, model_path,
+                                  options_keys, options_values, num_options);
+    if (!cache_path) goto cleanup;
+
+    if (access(cache_path, R_OK) != 0 &&
+        !CompileContextCache(ort, env, session_options, model_path, cache_path))
+      goto cleanup;
+    session_model = cache_path;
+  }
+
+  for (int i = 0; i < num_sessions; i++) {
+    double t_start = NowMs();
+
+    if (!CheckStatus(ort, ort->CreateSession(env, session_model, session_options, &sessions[i]))) {
+      // A stale or corrupt cache entry is replaced once
+      if (i > 0 || !cache_path || cache_retried) goto cleanup;
+      fprintf(stderr, "Warning: failed to load context cache '%s'; recompiling.\n", cache_path);
+      cache_retried = 1;
+      unlink(cache_path);
+      if (!CompileContextCache(ort, env, session_options, model_path, cache_path)) goto cleanup;
+      t_start = NowMs();
+      if (!CheckStatus(ort, ort->CreateSession(env, cache_path, session_options, &sessions[i])))
+        goto cleanup;
+    }
+    if (generate_ctx) break;
+
+    if (i == 0) {
+      printf("Session created in %.1f ms%s.\n", NowMs() - t_start,
+             cache_path ? " from the context cache" : "");
+    }
+  }
+  session = sessions[0];
+  startup.create_session = NowMs() - t_phase;
 
   if (generate_ctx) {
     printf("\nONNX model with embedded QNN context binary has been generated.\n");
@@ -164,6 +1794,7 @@ static void run_ort_qnn_ep(const char* backend,
   // -------------------------------------------------------------------------
   // 5. Retrieve default allocator
   // -------------------------------------------------------------------------
+  t_phase = NowMs();
   if (!CheckStatus(ort, ort->GetAllocatorWithDefaultOptions(&allocator)))
     goto cleanup;
 
@@ -226,6 +1857,10 @@ static void run_ort_qnn_ep(const char* backend,
     }
 
     ort->ReleaseTypeInfo(type_info);
+
+    if (i == 0 && num_dims > 0) model_batch = input_node_dims[i][0];
+    ResolveShape(input_node_dims[i], num_dims, opts->batch, 1);
+    PrintShape("Input", i, input_node_names[i], input_types[i], input_node_dims[i], num_dims);
   }
 
   // -------------------------------------------------------------------------
@@ -238,8 +1873,11 @@ static void run_ort_qnn_ep(const char* backend,
   output_node_dims       = (int64_t**)calloc(num_output_nodes, sizeof(int64_t*));
   output_node_dims_count = (size_t*)calloc(num_output_nodes, sizeof(size_t));
   output_tensors         = (OrtValue**)calloc(num_output_nodes, sizeof(OrtValue*));
+  output_types           = (ONNXTensorElementDataType*)calloc(num_output_nodes,
+                             sizeof(ONNXTensorElementDataType));
 
-  if (!output_node_names || !output_node_dims || !output_node_dims_count || !output_tensors) {
+  if (!output_node_names || !output_node_dims || !output_node_dims_count ||
+      !output_tensors || !output_types) {
     fprintf(stderr, "Failed to allocate memory for output node metadata.\n");
     goto cleanup;
   }
@@ -260,6 +1898,11 @@ static void run_ort_qnn_ep(const char* backend,
       goto cleanup;
     }
 
+    if (!CheckStatus(ort, ort->GetTensorElementType(tensor_info, &output_types[i]))) {
+      ort->ReleaseTypeInfo(type_info);
+      goto cleanup;
+    }
+
     if (!CheckStatus(ort, ort->GetDimensionsCount(tensor_info, &num_dims))) {
       ort->ReleaseTypeInfo(type_info);
       goto cleanup;
@@ -279,156 +1922,429 @@ static void run_ort_qnn_ep(const char* backend,
     }
 
     ort->ReleaseTypeInfo(type_info);
+
+    ResolveShape(output_node_dims[i], num_dims, opts->batch, 0);
+    PrintShape("Output", i, output_node_names[i], output_types[i], output_node_dims[i], num_dims);
+  }
+  startup.metadata = NowMs() - t_phase;
+
+  // Labels are loaded once and shared by all post-processing
+  if (!LabelTableLoad(&labels, LABEL_FILE))
+    fprintf(stderr, "Warning: could not open %s; labels unavailable.\n", LABEL_FILE);
+
+  // Batched mode runs the dataset instead of the benchmark below
+  if (opts->dataset_path) {
+    BatchResult results[MAX_BATCH_SIZES];
+    int         num_results = 0;
+
+    if (num_input_nodes != 1) {
+      fprintf(stderr, "Batched mode supports models with a single input.\n");
+      goto cleanup;
+    }
+    if (opts->pack_path) {
+      char** files     = NULL;
+      size_t num_files = ListDataset(opts->dataset_path, &files);
+
+      if (num_files > 0)
+        WritePack(opts->pack_path, files, num_files, input_types[0],
+                  input_node_dims[0] + 1, input_node_dims_count[0] - 1);
+      FreeFileList(files, num_files);
+      goto cleanup;
+    }
+    if (RunDataset(ort, session, opts, &labels, (const char* const*)input_node_names,
+                   (const char* const*)output_node_names, num_output_nodes, input_types[0],
+                   input_node_dims[0], input_node_dims_count[0], model_batch,
+                   results, &num_results, &startup.first_run)) {
+      PrintBatchResults(opts, results, num_results);
+      PrintStartupTimes(&startup);
+      if (opts->json_path) WriteBatchJson(opts, results, num_results, &startup);
+    }
+    goto cleanup;
   }
 
   // -------------------------------------------------------------------------
-  // 8. Prepare input data (default: all 1.0f; overridden by raw file if present)
+  // 8. Prepare input data, sized from the model inputs. Input i is read from
+  //    the i-th file of the comma separated input path; a file holding exactly
+  //    the tensor is mapped and used in place. Inputs without a readable file
+  //    are filled with 1.
   // -------------------------------------------------------------------------
-  input_data = (float*)malloc(INPUT_DATA_SIZE * sizeof(float));
-  if (!input_data) {
+  input_buffers = (void**)calloc(num_input_nodes, sizeof(void*));
+  input_bytes   = (size_t*)calloc(num_input_nodes, sizeof(size_t));
+  input_maps    = (MappedFile*)calloc(num_input_nodes, sizeof(MappedFile));
+  input_paths   = strdup(input_path);
+  if (!input_buffers || !input_bytes || !input_maps || !input_paths) {
     fprintf(stderr, "Failed to allocate memory for input data.\n");
     goto cleanup;
   }
 
-  // Fill with a default value
-  for (size_t i = 0; i < INPUT_DATA_SIZE; i++) input_data[i] = 1.0f;
-
-  // Attempt to load raw float data from file
-  input_raw_file = fopen(input_path, "rb");
-  if (input_raw_file) {
-    fseek(input_raw_file, 0, SEEK_END);
-    long file_size    = ftell(input_raw_file);
-    size_t num_floats = (size_t)(file_size / sizeof(float));
-    fseek(input_raw_file, 0, SEEK_SET);
-    fread(input_data, sizeof(float), num_floats, input_raw_file);
-    fclose(input_raw_file);
-    input_raw_file = NULL;
-    printf("Loaded %zu float(s) from '%s'.\n", num_floats, input_path);
-  } else {
-    fprintf(stderr, "Warning: could not open '%s'; using default input (all 1.0f).\n", input_path);
+  {
+    char* save_ptr = NULL;
+    char* path     = strtok_r(input_paths, ",", &save_ptr);
+
+    for (size_t i = 0; i < num_input_nodes; i++) {
+      size_t count = ResolveShape(input_node_dims[i], input_node_dims_count[i], opts->batch, 1);
+
+      input_bytes[i] = count * ElementSize(input_types[i]);
+      if (input_bytes[i] == 0) {
+        fprintf(stderr, "Input %zu has an unsupported type.\n", i);
+        goto cleanup;
+      }
+
+      if (path && MapFile(path, &input_maps[i]) > 0) {
+        if (input_maps[i].size == input_bytes[i]) {
+          input_buffers[i] = input_maps[i].data;
+          printf("Mapped %zu %s element(s) from '%s'.\n", count, ElementTypeName(input_types[i]), path);
+          path = strtok_r(NULL, ",", &save_ptr);
+          continue;
+        }
+        UnmapFile(&input_maps[i]);
+      }
+
+      input_buffers[i] = AllocBuffer(ort, NULL, input_bytes[i]);
+      if (!input_buffers[i]) {
+        fprintf(stderr, "Failed to allocate memory for input %zu.\n", i);
+        goto cleanup;
+      }
+      FillDefault(input_buffers[i], input_types[i], count);
+
+      int loaded = path ? LoadRawInput(path, input_types[i], count, input_buffers[i]) : -1;
+      if (loaded == 0) goto cleanup;
+      if (loaded > 0) {
+        printf("Loaded %zu %s element(s) from '%s'.\n", count, ElementTypeName(input_types[i]), path);
+      } else {
+        fprintf(stderr, "Warning: could not open '%s'; using default input %zu (all 1).\n",
+                path ? path : "", i);
+      }
+
+      path = strtok_r(NULL, ",", &save_ptr);
+    }
   }
 
   // -------------------------------------------------------------------------
-  // 9. Create input tensor
+  // 9. Create the workers and their input tensors. The input tensors of all
+  //    workers wrap the same read-only input buffers. Worker 0 uses the tensor arrays above,
+  //    its outputs are post-processed.
   // -------------------------------------------------------------------------
+  workers      = (Worker*)calloc(opts->concurrency, sizeof(Worker));
+  thread_stats = (LatencyStats*)calloc(opts->concurrency, sizeof(LatencyStats));
+  latencies    = (double*)malloc(opts->iterations * sizeof(double));
+  if (!workers || !thread_stats || !latencies) {
+    fprintf(stderr, "Failed to allocate memory for the workers.\n");
+    goto cleanup;
+  }
+
+  memset(&shared, 0, sizeof(shared));
+  shared.ort          = ort;
+  shared.opts         = opts;
+  shared.input_names  = (const char* const*)input_node_names;
+  shared.num_inputs   = num_input_nodes;
+  shared.output_names = (const char* const*)output_node_names;
+  shared.num_outputs  = num_output_nodes;
+  atomic_init(&shared.next_iteration, 0);
+  atomic_init(&shared.failed, 0);
+  pthread_mutex_init(&shared.gate.lock, NULL);
+  pthread_cond_init(&shared.gate.cond, NULL);
+  gate_ready = 1;
+
   if (!CheckStatus(ort, ort->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memory_info)))
     goto cleanup;
 
-  {
-    size_t input_data_bytes = INPUT_DATA_SIZE * sizeof(float);
-    if (!CheckStatus(ort, ort->CreateTensorWithDataAsOrtValue(
-                            memory_info, (void*)input_data, input_data_bytes,
-                            input_node_dims[0], input_node_dims_count[0],
-                            input_types[0], &input_tensors[0])))
+  // Bound buffers come from the EP allocator of each session if requested
+  if (opts->htp_shared_memory) {
+    ep_allocators = (OrtAllocator**)calloc(num_sessions, sizeof(OrtAllocator*));
+    if (!ep_allocators ||
+        !CheckStatus(ort, ort->CreateMemoryInfo(QNN_HTP_SHARED_MEMORY, OrtDeviceAllocator, 0,
+                                                OrtMemTypeDefault, &ep_memory_info)))
+      goto cleanup;
+
+    for (int i = 0; i < num_sessions; i++) {
+      if (!CheckStatus(ort, ort->CreateAllocator(sessions[i], ep_memory_info, &ep_allocators[i]))) {
+        fprintf(stderr, "The EP provides no '%s' allocator.\n", QNN_HTP_SHARED_MEMORY);
+        goto cleanup;
+      }
+    }
+  }
+
+  for (int w = 0; w < opts->concurrency; w++) {
+    Worker* worker = &workers[w];
+
+    worker->shared  = &shared;
+    worker->session = sessions[opts->session_per_thread ? w : 0];
+    worker->cpu     = (opts->num_cpus > 0) ? opts->cpus[w % opts->num_cpus] : -1;
+
+    if (w == 0) {
+      worker->input_tensors  = input_tensors;
+      worker->output_tensors = output_tensors;
+    } else {
+      worker->input_tensors  = (OrtValue**)calloc(num_input_nodes, sizeof(OrtValue*));
+      worker->output_tensors = (OrtValue**)calloc(num_output_nodes, sizeof(OrtValue*));
+    }
+    worker->latencies = (double*)malloc(opts->iterations * sizeof(double));
+
+    if (!worker->input_tensors || !worker->output_tensors || !worker->latencies) {
+      fprintf(stderr, "Failed to allocate memory for worker %d.\n", w);
       goto cleanup;
+    }
+
+    if (opts->io_binding) {
+      worker->buffer_allocator = ep_allocators ? ep_allocators[opts->session_per_thread ? w : 0]
+                                               : NULL;
+      if (!SetupIoBinding(worker, ep_allocators ? ep_memory_info : memory_info,
+                          input_buffers, input_bytes,
+                          input_node_dims, input_node_dims_count, input_types,
+                          output_node_dims, output_node_dims_count, output_types)) {
+        fprintf(stderr, "Failed to set up I/O binding for worker %d.\n", w);
+        goto cleanup;
+      }
+      continue;
+    }
+
+    for (size_t i = 0; i < num_input_nodes; i++) {
+      if (!CheckStatus(ort, ort->CreateTensorWithDataAsOrtValue(
+                              memory_info, input_buffers[i], input_bytes[i],
+                              input_node_dims[i], input_node_dims_count[i],
+                              input_types[i], &worker->input_tensors[i])))
+        goto cleanup;
+    }
   }
 
   ort->ReleaseMemoryInfo(memory_info);
   memory_info = NULL;
 
   // -------------------------------------------------------------------------
-  // 10. Run inference and measure wall-clock time
+  // 10. Run inference: every worker does its warmup runs, then all workers
+  //     share the timed iterations. Each run reuses the worker's session and
+  //     input tensor.
   // -------------------------------------------------------------------------
+  for (int w = 0; w < opts->concurrency; w++) {
+    if (pthread_create(&workers[w].thread, NULL, InferenceWorker, &workers[w]) != 0) {
+      fprintf(stderr, "Failed to start worker thread %d.\n", w);
+      atomic_store(&shared.failed, 1);
+      break;
+    }
+    num_started++;
+  }
+
   {
-    struct timespec t_start, t_end;
-    clock_gettime(CLOCK_MONOTONIC, &t_start);
-
-    if (!CheckStatus(ort, ort->Run(session, NULL,
-                                   (const char* const*)input_node_names,
-                                   (const OrtValue* const*)input_tensors,
-                                   num_input_nodes,
-                                   (const char* const*)output_node_names,
-                                   num_output_nodes,
-                                   output_tensors)))
+    double t_start = 0.0, wall_ms = 0.0;
+    size_t num_samples = 0;
+    LatencyStats stats;
+
+    // Open the gate once all started workers are warm
+    pthread_mutex_lock(&shared.gate.lock);
+    while (shared.gate.ready < num_started)
+      pthread_cond_wait(&shared.gate.cond, &shared.gate.lock);
+    shared.gate.open = 1;
+    t_start = NowMs();
+    pthread_cond_broadcast(&shared.gate.cond);
+    pthread_mutex_unlock(&shared.gate.lock);
+
+    for (int w = 0; w < num_started; w++) pthread_join(workers[w].thread, NULL);
+    wall_ms     = NowMs() - t_start;
+    num_started = 0;
+
+    if (atomic_load(&shared.failed)) goto cleanup;
+
+    if (opts->warmup == 0 && opts->iterations == 1 && opts->concurrency == 1) {
+      printf("Inference time: %.1f ms\n", workers[0].latencies[0]);
+    }
+
+    // Per-thread statistics; throughput is measured over the wall clock
+    for (int w = 0; w < opts->concurrency; w++) {
+      Worker* worker = &workers[w];
+      memcpy(latencies + num_samples, worker->latencies,
+             worker->num_latencies * sizeof(double));
+      num_samples += worker->num_latencies;
+
+      ComputeLatencyStats(worker->latencies, worker->num_latencies, &thread_stats[w]);
+      thread_stats[w].throughput = worker->num_latencies * 1000.0 / wall_ms;
+    }
+
+    ComputeLatencyStats(latencies, num_samples, &stats);
+    stats.throughput = num_samples * 1000.0 / wall_ms;
+
+    if (opts->iterations > 1 || opts->concurrency > 1) PrintLatencyStats(opts, &stats);
+    if (opts->concurrency > 1) {
+      for (int w = 0; w < opts->concurrency; w++) {
+        printf("  thread %d (cpu %d): runs=%zu  mean=%.2f ms  p50=%.2f ms  p99=%.2f ms  "
+               "throughput=%.2f inferences/s\n",
+               w, workers[w].cpu, workers[w].num_latencies, thread_stats[w].mean,
+               thread_stats[w].p50, thread_stats[w].p99, thread_stats[w].throughput);
+      }
+    }
+    // The first inference pays for lazy initialization in ORT and the EP
+    for (int w = 0; w < opts->concurrency && startup.first_run == 0.0; w++)
+      startup.first_run = workers[w].first_run_ms;
+    PrintStartupTimes(&startup);
+
+    if (opts->json_path && !WriteJsonResults(opts, &stats, workers, thread_stats, &startup))
       goto cleanup;
+  }
 
-    clock_gettime(CLOCK_MONOTONIC, &t_end);
-    double duration_ms = (t_end.tv_sec  - t_start.tv_sec)  * 1000.0
-                       + (t_end.tv_nsec - t_start.tv_nsec) / 1e6;
-    printf("Inference time: %.1f ms\n", duration_ms);
+  // Worker 0 may not have run when other workers took all iterations
+  if (!output_tensors[0]) {
+    printf("\nNo outputs on the first worker; skipping post-processing.\n");
+    goto cleanup;
   }
 
   // -------------------------------------------------------------------------
-  // 11. Post-process: find the top-1 class and print the label
+  // 11. Post-process: print the top-K classes of the first output per batch
+  //     item with their labels
   // -------------------------------------------------------------------------
   {
-    void*  raw_buffer  = NULL;
-    float* float_buffer = NULL;
+    void*                      raw_buffer  = NULL;
+    OrtTensorTypeAndShapeInfo* shape_info  = NULL;
+    ONNXTensorElementDataType  output_type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    size_t  output_count = 0, num_dims = 0, num_items = 1;
+    int64_t dims[MAX_DIMS];
 
     if (!CheckStatus(ort, ort->GetTensorMutableData(output_tensors[0], &raw_buffer)))
       goto cleanup;
 
-    float_buffer = (float*)raw_buffer;
+    // The actual output shape, which is known now even for dynamic outputs
+    if (!CheckStatus(ort, ort->GetTensorTypeAndShape(output_tensors[0], &shape_info)))
+      goto cleanup;
+    if (!CheckStatus(ort, ort->GetTensorElementType(shape_info, &output_type)) ||
+        !CheckStatus(ort, ort->GetTensorShapeElementCount(shape_info, &output_count)) ||
+        !CheckStatus(ort, ort->GetDimensionsCount(shape_info, &num_dims)) ||
+        num_dims > MAX_DIMS ||
+        !CheckStatus(ort, ort->GetDimensions(shape_info, dims, num_dims))) {
+      ort->ReleaseTensorTypeAndShapeInfo(shape_info);
+      goto cleanup;
+    }
+    ort->ReleaseTensorTypeAndShapeInfo(shape_info);
+
+    if (num_dims > 1 && dims[0] > 1) num_items = (size_t)dims[0];
+    if (output_count == 0 || ElementSize(output_type) == 0) {
+      fprintf(stderr, "Output 0 is empty or has an unsupported type.\n");
+      goto cleanup;
+    }
 
-    // Find argmax
-    float max_val  = float_buffer[0];
-    int   max_idx  = 0;
-    for (size_t i = 1; i < OUTPUT_DATA_SIZE; i++) {
-      if (float_buffer[i] > max_val) {
-        max_val = float_buffer[i];
-        max_idx = (int)i;
-      }
+    size_t    item_count = output_count / num_items;
+    float*    scores     = (float*)malloc(item_count * sizeof(float));
+    float*    probs      = (float*)malloc(item_count * sizeof(float));
+    TopKEntry top[TOP_K];
+
+    if (!scores || !probs) {
+      fprintf(stderr, "Failed to allocate memory for post-processing.\n");
+      free(scores);
+      free(probs);
+      goto cleanup;
     }
 
-    // Attempt to load ImageNet labels from synset.txt
-    label_file = fopen("synset.txt", "r");
-    if (label_file) {
-      char labels[OUTPUT_DATA_SIZE][MAX_LABEL_LEN];
-      int  label_count = 0;
-      memset(labels, 0, sizeof(labels));
-
-      while (label_count < OUTPUT_DATA_SIZE &&
-             fgets(labels[label_count], MAX_LABEL_LEN, label_file)) {
-        // Strip trailing newline
-        size_t len = strlen(labels[label_count]);
-        if (len > 0 && labels[label_count][len - 1] == '\n')
-          labels[label_count][len - 1] = '\0';
-        label_count++;
+    // Top-K classes per batch item, with softmax probabilities
+    for (size_t item = 0; item < num_items; item++) {
+      size_t num_top = 0;
+
+      OutputScores(opts, raw_buffer, output_type, item * item_count, item_count, scores);
+      Softmax(scores, item_count, probs);
+      num_top = TopK(scores, item_count, TOP_K, top);
+
+      if (num_items > 1) printf("\nTop-%d Results (item %zu):\n", TOP_K, item);
+      else               printf("\nTop-%d Results:\n", TOP_K);
+
+      for (size_t r = 0; r < num_top; r++) {
+        const char* label = LabelTableGet(&labels, top[r].index);
+        printf("  %zu. index=%zu  label=%s  score=%.6f  prob=%.4f\n", r + 1, top[r].index,
+               label ? label : "unknown", top[r].score, probs[top[r].index]);
       }
-      fclose(label_file);
-      label_file = NULL;
-
-      printf("\nTop-1 Result:\n");
-      printf("  index=%d  label=%s  score=%.6f\n",
-             max_idx,
-             (max_idx < label_count) ? labels[max_idx] : "unknown",
-             max_val);
-    } else {
-      fprintf(stderr, "Warning: could not open synset.txt; labels unavailable.\n");
-      printf("\nTop-1 Result:\n");
-      printf("  index=%d  score=%.6f\n", max_idx, max_val);
     }
+
+    free(scores);
+    free(probs);
   }
 
 // ---------------------------------------------------------------------------
 // Cleanup: release all ORT objects and free heap memory
 // ---------------------------------------------------------------------------
 cleanup:
-  if (input_raw_file) fclose(input_raw_file);
-  if (label_file)     fclose(label_file);
+  // Workers which were started are only joined here after an error
+  if (num_started > 0) {
+    pthread_mutex_lock(&shared.gate.lock);
+    shared.gate.open = 1;
+    pthread_cond_broadcast(&shared.gate.cond);
+    pthread_mutex_unlock(&shared.gate.lock);
+    for (int w = 0; w < num_started; w++) pthread_join(workers[w].thread, NULL);
+  }
+
+  free(thread_stats);
+
+  if (opts->profile_prefix && sessions && !generate_ctx)
+    SummarizeProfiles(ort, sessions, num_sessions);
+
+  if (gate_ready) {
+    pthread_mutex_destroy(&shared.gate.lock);
+    pthread_cond_destroy(&shared.gate.cond);
+  }
+
+  LabelTableFree(&labels);
   if (memory_info)    ort->ReleaseMemoryInfo(memory_info);
 
+  // Tensors go before the buffers they wrap, allocators before the sessions
+  if (workers) {
+    for (int w = 0; w < opts->concurrency; w++) {
+      Worker* worker = &workers[w];
+
+      if (worker->binding) ort->ReleaseIoBinding(worker->binding);
+      if (w > 0) {
+        ReleaseTensors(ort, worker->input_tensors,  num_input_nodes);
+        ReleaseTensors(ort, worker->output_tensors, num_output_nodes);
+      } else {
+        ClearTensors(ort, input_tensors,  num_input_nodes);
+        ClearTensors(ort, output_tensors, num_output_nodes);
+      }
+      for (size_t b = 0; worker->buffers && b < num_input_nodes + num_output_nodes; b++)
+        FreeBuffer(ort, worker->buffer_allocator, worker->buffers[b]);
+      free(worker->buffers);
+      free(worker->latencies);
+    }
+    free(workers);
+  }
+
   ReleaseTensors(ort, input_tensors,  num_input_nodes);
   ReleaseTensors(ort, output_tensors, num_output_nodes);
 
+  if (ep_allocators) {
+    for (int i = 0; i < num_sessions; i++) {
+      if (ep_allocators[i]) ort->ReleaseAllocator(ep_allocators[i]);
+    }
+    free(ep_allocators);
+  }
+  if (ep_memory_info) ort->ReleaseMemoryInfo(ep_memory_info);
+
   FreeNodeInfo(allocator, input_node_names,  num_input_nodes,
                input_node_dims,  input_node_dims_count,  num_input_nodes);
   FreeNodeInfo(allocator, output_node_names, num_output_nodes,
                output_node_dims, output_node_dims_count, num_output_nodes);
 
   free(input_types);
-  free(input_data);
-
-  if (session)         ort->ReleaseSession(session);
+  free(output_types);
+  for (size_t i = 0; input_buffers && i < num_input_nodes; i++) {
+    if (input_maps && input_maps[i].data) UnmapFile(&input_maps[i]);
+    else                                  free(input_buffers[i]);
+  }
+  free(input_maps);
+  free(input_buffers);
+  free(input_bytes);
+  free(input_paths);
+  free(latencies);
+
+  if (sessions) {
+    for (int i = 0; i < num_sessions; i++) {
+      if (sessions[i]) ort->ReleaseSession(sessions[i]);
+    }
+    free(sessions);
+  }
   if (session_options) ort->ReleaseSessionOptions(session_options);
   if (env)             ort->ReleaseEnv(env);
+  free(cache_path);
 }
 
 // ---------------------------------------------------------------------------
 // Usage / help text
 // ---------------------------------------------------------------------------
 static void PrintHelp(const char* prog) {
-  printf("Usage: %s <backend_flag> <model_path> <input_raw_path> [--gen_ctx]\n\n", prog);
+  printf("Usage: %s <backend_flag> <model_path> <input_raw_path> [options]\n\n", prog);
   printf("Backend flags:\n");
   printf("  --cpu   Run on QNN CPU backend  (e.g. Inception-v3_float.onnx)\n");
   printf("  --htp   Run on QNN HTP backend  (e.g. Inception-v3_w8a8.onnx)\n");
@@ -436,12 +2352,122 @@ static void PrintHelp(const char* prog) {
   printf("  --fp32  Run a float32 model on HTP with FP16 precision\n");
   printf("  --fp16  Run a float16 model on HTP\n\n");
   printf("Optional flags:\n");
-  printf("  --gen_ctx  Generate an ONNX model with embedded QNN context binary\n\n");
+  printf("  --gen_ctx         Generate an ONNX model with embedded QNN context binary\n");
+  printf("  --ctx-cache <dir>  Compile the model once into a context model cached in <dir>\n");
+  printf("                    and load it on later runs\n");
+  printf("  --warmup <W>      Untimed runs before the measurement (default: 0)\n");
+  printf("  --iterations <N>  Timed runs on the same session (default: 1)\n");
+  printf("  --json <file>     Write the latency statistics as JSON\n");
+  printf("  --profile <prefix>  Enable ORT profiling and print the top operators by time\n");
+  printf("  --output-scale <s>       Dequantize integer outputs: (q - zero point) * s (default: 1)\n");
+  printf("  --output-zero-point <z>  Zero point of integer outputs (default: 0)\n");
+  printf("  --concurrency <K>  Run K inference threads (alias: --threads, default: 1)\n");
+  printf("  --session-per-thread  Give every thread its own session instead of sharing one\n");
+  printf("  --intra-op-threads <N>  ORT intra-op threads per session (default: 1)\n");
+  printf("  --inter-op-threads <N>  ORT inter-op threads per session (default: ORT default)\n");
+  printf("  --affinity <cpus>  Pin the inference threads round robin, e.g. 4-7 or 0,2,4\n");
+  printf("  --io-binding       Bind pre-allocated input/output buffers reused by every run\n");
+  printf("  --htp-shared-memory  Allocate the bound buffers in memory shared with the HTP\n");
+  printf("  --batch <N[,N...]>  Size of a dynamic batch dimension (default: 1); a list of\n");
+  printf("                     sizes is swept with --dataset\n");
+  printf("  --dataset <path>   Batched mode: run every raw sample of a directory or list\n");
+  printf("                     file (one path per line), or a packed file written with\n");
+  printf("                     --pack, instead of <input_raw_path>\n");
+  printf("  --pack <file>      Write the samples of --dataset as a packed file and exit\n\n");
+  printf("The input tensors are sized from the model. For models with several inputs,\n");
+  printf("pass one raw file per input as a comma separated list.\n\n");
   printf("Examples:\n");
   printf("  %s --cpu  Inception-v3_float.onnx input.raw\n", prog);
   printf("  %s --htp  Inception-v3_w8a8.onnx  input.raw\n", prog);
   printf("  %s --htp  Inception-v3_w8a8.onnx  input.raw --gen_ctx\n", prog);
   printf("  %s --qnn  qnn_ctx_binary.onnx      input_nhwc.raw\n", prog);
+  printf("  %s --htp  Inception-v3_w8a8.onnx  input.raw --warmup 10 --iterations 200 --json out.json\n", prog);
+  printf("  %s --cpu  Inception-v3_float.onnx input.raw --iterations 400 --concurrency 4 --affinity 4-7\n", prog);
+  printf("  %s --htp  model-batch-dyn.onnx     -        --dataset samples/ --batch 1,2,4,8\n", prog);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: parse a CPU list such as "0-3,6" into an array of CPU numbers.
+// Returns the number of CPUs, 0 on failure.
+// ---------------------------------------------------------------------------
+static int ParseCpuList(const char* list, int* cpus, int max_cpus) {
+  const char* p = list;
+  int count = 0;
+
+  while (*p) {
+    char* end   = NULL;
+    long  first = strtol(p, &end, 10);
+    long  last  = first;
+
+    if (end == p || first < 0 || first >= CPU_SETSIZE) return 0;
+    p = end;
+
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first || last >= CPU_SETSIZE) return 0;
+      p = end;
+    }
+
+    for (long cpu = first; cpu <= last; cpu++) {
+      if (count == max_cpus) return 0;
+      cpus[count++] = (int)cpu;
+    }
+
+    if (*p == ',') p++;
+    else if (*p) return 0;
+  }
+  return count;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: parse a non-negative integer option value.
+// Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static int ParseCount(const char* flag, const char* value, int* out) {
+  char* end = NULL;
+  long  val = 0;
+
+  if (!value) {
+    fprintf(stderr, "Option '%s' requires a value.\n", flag);
+    return 0;
+  }
+
+  val = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || val < 0 || val > 1000000) {
+    fprintf(stderr, "Invalid value '%s' for option '%s'.\n", value, flag);
+    return 0;
+  }
+  *out = (int)val;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: parse a comma separated list of batch sizes.
+// Returns the number of sizes, 0 on failure.
+// ---------------------------------------------------------------------------
+static int ParseBatchList(const char* flag, const char* value, int* sizes, int max_sizes) {
+  char* list     = NULL;
+  char* save_ptr = NULL;
+  int   count    = 0;
+
+  if (!value) {
+    fprintf(stderr, "Option '%s' requires a value.\n", flag);
+    return 0;
+  }
+  if (!(list = strdup(value))) return 0;
+
+  for (char* token = strtok_r(list, ",", &save_ptr); token;
+       token = strtok_r(NULL, ",", &save_ptr)) {
+    if (count == max_sizes || !ParseCount(flag, token, &sizes[count]) || sizes[count] < 1) {
+      count = 0;
+      break;
+    }
+    count++;
+  }
+
+  free(list);
+  if (count == 0) fprintf(stderr, "Invalid batch sizes '%s' for option '%s'.\n", value, flag);
+  return count;
 }
 
 // ---------------------------------------------------------------------------
@@ -455,30 +2481,172 @@ int main(int argc, char* argv[]) {
   static const char* FLAG_FP32     = "--fp32";
   static const char* FLAG_FP16     = "--fp16";
   static const char* FLAG_GEN_CTX  = "--gen_ctx";
-
+  static const char* FLAG_WARMUP   = "--warmup";
+  static const char* FLAG_ITERS    = "--iterations";
+  static const char* FLAG_JSON     = "--json";
+  static const char* FLAG_CONC     = "--concurrency";
+  static const char* FLAG_THREADS  = "--threads";
+  static const char* FLAG_SESSIONS = "--session-per-thread";
+  static const char* FLAG_INTRA    = "--intra-op-threads";
+  static const char* FLAG_INTER    = "--inter-op-threads";
+  static const char* FLAG_AFFINITY = "--affinity";
+  static const char* FLAG_IOBIND   = "--io-binding";
+  static const char* FLAG_SHMEM    = "--htp-shared-memory";
+  static const char* FLAG_BATCH    = "--batch";
+  static const char* FLAG_DATASET  = "--dataset";
+  static const char* FLAG_PACK     = "--pack";
+  static const char* FLAG_CTXCACHE = "--ctx-cache";
+  static const char* FLAG_PROFILE  = "--profile";
+  static const char* FLAG_OSCALE   = "--output-scale";
+  static const char* FLAG_OZERO    = "--output-zero-point";
+  static int cpus[CPU_SETSIZE];
+
+  RunOptions  opts;
   const char* backend     = NULL;
-  const char* model_path  = NULL;
-  const char* input_path  = NULL;
   int generate_ctx        = 0;
   int float32_model       = 0;
 
-  // Expect exactly 3 positional args + optional --gen_ctx
-  if (argc != 4 && argc != 5) {
+  memset(&opts, 0, sizeof(opts));
+  opts.warmup           = 0;
+  opts.iterations       = 1;
+  opts.concurrency      = 1;
+  opts.intra_op_threads = 1;
+  opts.inter_op_threads = 0;
+  opts.batch            = 1;
+  opts.output_scale     = 1.0f;
+
+  // Expect 3 positional args followed by options
+  if (argc < 4) {
     PrintHelp(argv[0]);
     return EXIT_FAILURE;
   }
 
-  // Parse optional 5th argument
-  if (argc == 5) {
-    if (strcmp(argv[4], FLAG_GEN_CTX) == 0) {
+  // Parse the options after the positional arguments
+  for (int i = 4; i < argc; i++) {
+    const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(argv[i], FLAG_GEN_CTX) == 0) {
       generate_ctx = 1;
+    } else if (strcmp(argv[i], FLAG_WARMUP) == 0) {
+      if (!ParseCount(argv[i], value, &opts.warmup)) return EXIT_FAILURE;
+      i++;
+    } else if (strcmp(argv[i], FLAG_ITERS) == 0) {
+      if (!ParseCount(argv[i], value, &opts.iterations)) return EXIT_FAILURE;
+      i++;
+    } else if (strcmp(argv[i], FLAG_JSON) == 0) {
+      if (!value) {
+        fprintf(stderr, "Option '%s' requires a value.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.json_path = value;
+      i++;
+    } else if (strcmp(argv[i], FLAG_CONC) == 0 || strcmp(argv[i], FLAG_THREADS) == 0) {
+      if (!ParseCount(argv[i], value, &opts.concurrency)) return EXIT_FAILURE;
+      i++;
+    } else if (strcmp(argv[i], FLAG_SESSIONS) == 0) {
+      opts.session_per_thread = 1;
+    } else if (strcmp(argv[i], FLAG_INTRA) == 0) {
+      if (!ParseCount(argv[i], value, &opts.intra_op_threads)) return EXIT_FAILURE;
+      i++;
+    } else if (strcmp(argv[i], FLAG_INTER) == 0) {
+      if (!ParseCount(argv[i], value, &opts.inter_op_threads)) return EXIT_FAILURE;
+      i++;
+    } else if (strcmp(argv[i], FLAG_AFFINITY) == 0) {
+      if (!value || (opts.num_cpus = ParseCpuList(value, cpus, CPU_SETSIZE)) == 0) {
+        fprintf(stderr, "Invalid CPU list '%s' for option '%s'.\n",
+                value ? value : "", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.cpus = cpus;
+      i++;
+    } else if (strcmp(argv[i], FLAG_BATCH) == 0) {
+      opts.num_batch_sizes = ParseBatchList(argv[i], value, opts.batch_sizes, MAX_BATCH_SIZES);
+      if (opts.num_batch_sizes == 0) return EXIT_FAILURE;
+      opts.batch = opts.batch_sizes[0];
+      i++;
+    } else if (strcmp(argv[i], FLAG_DATASET) == 0) {
+      if (!value) {
+        fprintf(stderr, "Option '%s' requires a value.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.dataset_path = value;
+      i++;
+    } else if (strcmp(argv[i], FLAG_OSCALE) == 0) {
+      char* end = NULL;
+      opts.output_scale = value ? strtof(value, &end) : 0.0f;
+      if (!value || end == value || *end != '\0' || !(opts.output_scale > 0.0f)) {
+        fprintf(stderr, "Invalid value '%s' for option '%s'.\n", value ? value : "", argv[i]);
+        return EXIT_FAILURE;
+      }
+      i++;
+    } else if (strcmp(argv[i], FLAG_OZERO) == 0) {
+      // int8 quantized outputs commonly have negative zero points
+      char* end  = NULL;
+      long  zero = 0;
+      errno = 0;
+      zero  = value ? strtol(value, &end, 10) : 0;
+      if (!value || end == value || *end != '\0' || errno == ERANGE ||
+          zero < INT32_MIN || zero > INT32_MAX) {
+        fprintf(stderr, "Invalid value '%s' for option '%s'.\n", value ? value : "", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.output_zero_point = (int)zero;
+      i++;
+    } else if (strcmp(argv[i], FLAG_PROFILE) == 0) {
+      if (!value) {
+        fprintf(stderr, "Option '%s' requires a value.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.profile_prefix = value;
+      i++;
+    } else if (strcmp(argv[i], FLAG_CTXCACHE) == 0) {
+      if (!value) {
+        fprintf(stderr, "Option '%s' requires a value.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.ctx_cache_dir = value;
+      i++;
+    } else if (strcmp(argv[i], FLAG_PACK) == 0) {
+      if (!value) {
+        fprintf(stderr, "Option '%s' requires a value.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      opts.pack_path = value;
+      i++;
+    } else if (strcmp(argv[i], FLAG_IOBIND) == 0) {
+      opts.io_binding = 1;
+    } else if (strcmp(argv[i], FLAG_SHMEM) == 0) {
+      opts.io_binding        = 1;
+      opts.htp_shared_memory = 1;
     } else {
-      fprintf(stderr, "Unknown option '%s'. Expected '%s'.\n", argv[4], FLAG_GEN_CTX);
+      fprintf(stderr, "Unknown option '%s'.\n", argv[i]);
       PrintHelp(argv[0]);
       return EXIT_FAILURE;
     }
   }
 
+  if (opts.iterations < 1 || opts.concurrency < 1) {
+    fprintf(stderr, "'%s' and '%s' must be at least 1.\n", FLAG_ITERS, FLAG_CONC);
+    return EXIT_FAILURE;
+  }
+
+  if (opts.dataset_path && (opts.concurrency > 1 || opts.io_binding)) {
+    fprintf(stderr, "'%s' runs on one thread without I/O binding.\n", FLAG_DATASET);
+    return EXIT_FAILURE;
+  }
+  if (opts.ctx_cache_dir && generate_ctx) {
+    fprintf(stderr, "'%s' can not be combined with --gen_ctx.\n", FLAG_CTXCACHE);
+    return EXIT_FAILURE;
+  }
+  if (!opts.dataset_path && opts.pack_path) {
+    fprintf(stderr, "'%s' requires '%s'.\n", FLAG_PACK, FLAG_DATASET);
+    return EXIT_FAILURE;
+  }
+  if (!opts.dataset_path && opts.num_batch_sizes > 1) {
+    fprintf(stderr, "A list of batch sizes requires '%s'.\n", FLAG_DATASET);
+    return EXIT_FAILURE;
+  }
+
   // Parse backend flag
   if (strcmp(argv[1], FLAG_CPU) == 0) {
     backend = "libQnnCpu.so";
@@ -486,6 +2654,14 @@ int main(int argc, char* argv[]) {
       fprintf(stderr, "--gen_ctx is not supported with --cpu.\n");
       return EXIT_FAILURE;
     }
+    if (opts.htp_shared_memory) {
+      fprintf(stderr, "%s is not supported with --cpu.\n", FLAG_SHMEM);
+      return EXIT_FAILURE;
+    }
+    if (opts.ctx_cache_dir) {
+      fprintf(stderr, "%s is not supported with --cpu.\n", FLAG_CTXCACHE);
+      return EXIT_FAILURE;
+    }
   } else if (strcmp(argv[1], FLAG_HTP) == 0) {
     backend = "libQnnHtp.so";
   } else if (strcmp(argv[1], FLAG_QNN) == 0) {
@@ -494,6 +2670,10 @@ int main(int argc, char* argv[]) {
       fprintf(stderr, "--gen_ctx is not supported with --qnn.\n");
       return EXIT_FAILURE;
     }
+    if (opts.ctx_cache_dir) {
+      fprintf(stderr, "%s is not supported with --qnn.\n", FLAG_CTXCACHE);
+      return EXIT_FAILURE;
+    }
   } else if (strcmp(argv[1], FLAG_FP32) == 0) {
     backend      = "libQnnHtp.so";
     float32_model = 1;
@@ -505,13 +2685,16 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  model_path = argv[2];
-  input_path = argv[3];
+  opts.backend       = backend;
+  opts.model_path    = argv[2];
+  opts.input_path    = argv[3];
+  opts.generate_ctx  = generate_ctx;
+  opts.float32_model = float32_model;
 
   // Use the "C" locale for consistent numeric formatting
   setlocale(LC_ALL, "C");
 
-  run_ort_qnn_ep(backend, model_path, input_path, generate_ctx, float32_model);
+  run_ort_qnn_ep(&opts);
 
   printf("-------------------- done --------------------\n");
   return EXIT_SUCCESS;
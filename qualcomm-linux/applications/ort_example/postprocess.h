@@ -0,0 +1,271 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Post-processing kernels for classification outputs: dequantization of
+// uint8 outputs, softmax, top-K selection and a label table. The kernels use
+// NEON on ARM and plain C elsewhere, and allocate no memory per call, so
+// they can run on every frame of a stream.
+
+#ifndef ORT_EXAMPLE_POSTPROCESS_H
+#define ORT_EXAMPLE_POSTPROCESS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define POSTPROCESS_NEON 1
+#endif
+
+// ---------------------------------------------------------------------------
+// One entry of a top-K result
+// ---------------------------------------------------------------------------
+typedef struct {
+  size_t index;
+  float  score;
+} TopKEntry;
+
+// ---------------------------------------------------------------------------
+// Labels, one per class. The strings are interned: all distinct labels are
+// stored once, NUL terminated, in one block and classes with the same label
+// share it.
+// ---------------------------------------------------------------------------
+typedef struct {
+  char*     text;
+  uint32_t* offsets;  // per class, into text
+  size_t    count;
+} LabelTable;
+
+// ---------------------------------------------------------------------------
+// Dequantize uint8 values: out[i] = (in[i] - zero_point) * scale. The
+// difference is taken in float, which is exact for zero points within
+// +-2^24 and does not overflow for any int32 zero point.
+// ---------------------------------------------------------------------------
+static inline void DequantizeU8(const uint8_t* in, size_t count, float scale,
+                                int32_t zero_point, float* out) {
+  const float zp = (float)zero_point;
+  size_t      i  = 0;
+
+#ifdef POSTPROCESS_NEON
+  const float32x4_t zpv = vdupq_n_f32(zp);
+  const float32x4_t scl = vdupq_n_f32(scale);
+
+  for (; i + 16 <= count; i += 16) {
+    uint8x16_t q  = vld1q_u8(in + i);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(q));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(q));
+
+    vst1q_f32(out + i,      vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))),  zpv), scl));
+    vst1q_f32(out + i + 4,  vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), zpv), scl));
+    vst1q_f32(out + i + 8,  vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))),  zpv), scl));
+    vst1q_f32(out + i + 12, vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), zpv), scl));
+  }
+#endif
+
+  for (; i < count; i++) out[i] = ((float)in[i] - zp) * scale;
+}
+
+#ifdef POSTPROCESS_NEON
+// ---------------------------------------------------------------------------
+// exp() of 4 floats: range reduction to 2^n * exp(r), |r| <= ln(2)/2, and a
+// degree 5 polynomial for exp(r). Relative error is below 2e-7 for inputs
+// in [-87, 88]; softmax only passes values <= 0.
+// ---------------------------------------------------------------------------
+static inline float32x4_t ExpF32x4(float32x4_t x) {
+  const float32x4_t log2e = vdupq_n_f32(1.44269504088896341f);
+  const float32x4_t ln2hi = vdupq_n_f32(0.693359375f);
+  const float32x4_t ln2lo = vdupq_n_f32(-2.12194440e-4f);
+
+  x = vmaxq_f32(vminq_f32(x, vdupq_n_f32(88.3762626647949f)), vdupq_n_f32(-87.3365447504f));
+
+  float32x4_t n = vrndnq_f32(vmulq_f32(x, log2e));
+  float32x4_t r = vmlsq_f32(vmlsq_f32(x, n, ln2hi), n, ln2lo);
+
+  float32x4_t p = vdupq_n_f32(1.9875691500e-4f);
+  p = vmlaq_f32(vdupq_n_f32(1.3981999507e-3f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(8.3334519073e-3f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(4.1665795894e-2f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.6666665459e-1f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(5.0000001201e-1f), p, r);
+  p = vmlaq_f32(vaddq_f32(r, vdupq_n_f32(1.0f)), p, vmulq_f32(r, r));
+
+  // Scale by 2^n through the exponent bits
+  int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(e));
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Softmax over count values. in and out may be the same array.
+// ---------------------------------------------------------------------------
+static inline void Softmax(const float* in, size_t count, float* out) {
+  float  max_val = -INFINITY;
+  float  sum     = 0.0f;
+  size_t i       = 0;
+
+  if (count == 0) return;
+
+#ifdef POSTPROCESS_NEON
+  if (count >= 4) {
+    float32x4_t vmax = vld1q_f32(in);
+    for (i = 4; i + 4 <= count; i += 4) vmax = vmaxq_f32(vmax, vld1q_f32(in + i));
+    max_val = vmaxvq_f32(vmax);
+  }
+#endif
+  for (; i < count; i++) max_val = (in[i] > max_val) ? in[i] : max_val;
+
+  i = 0;
+#ifdef POSTPROCESS_NEON
+  {
+    float32x4_t vmax = vdupq_n_f32(max_val);
+    float32x4_t vsum = vdupq_n_f32(0.0f);
+
+    for (; i + 4 <= count; i += 4) {
+      float32x4_t e = ExpF32x4(vsubq_f32(vld1q_f32(in + i), vmax));
+      vst1q_f32(out + i, e);
+      vsum = vaddq_f32(vsum, e);
+    }
+    sum = vaddvq_f32(vsum);
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = expf(in[i] - max_val);
+    sum   += out[i];
+  }
+
+  float inv_sum = 1.0f / sum;
+
+  i = 0;
+#ifdef POSTPROCESS_NEON
+  for (; i + 4 <= count; i += 4) vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(out + i), inv_sum));
+#endif
+  for (; i < count; i++) out[i] *= inv_sum;
+}
+
+// ---------------------------------------------------------------------------
+// The k largest scores in descending order; ties keep the lower index
+// first. Only the k best entries are kept sorted while scanning, which is
+// linear in count for small k. Returns the number of entries, min(k, count).
+// ---------------------------------------------------------------------------
+static inline size_t TopK(const float* scores, size_t count, size_t k, TopKEntry* top) {
+  size_t num = 0;
+
+  if (k > count) k = count;
+  if (k == 0) return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    float  score = scores[i];
+    size_t pos   = num;
+
+    // Most scores lose against the current k-th best
+    if (num == k && !(score > top[k - 1].score)) continue;
+
+    while (pos > 0 && score > top[pos - 1].score) pos--;
+    if (num < k) num++;
+    memmove(&top[pos + 1], &top[pos], (num - 1 - pos) * sizeof(TopKEntry));
+    top[pos].index = i;
+    top[pos].score = score;
+  }
+  return num;
+}
+
+// ---------------------------------------------------------------------------
+// Load a label file with one label per line. Returns 1 on success, 0 on
+// failure. Free with LabelTableFree().
+// ---------------------------------------------------------------------------
+static inline uint32_t LabelHash(const char* label) {
+  uint32_t hash = 2166136261u;
+  for (; *label; label++) hash = (hash ^ (uint8_t)*label) * 16777619u;
+  return hash;
+}
+
+static inline void LabelTableFree(LabelTable* table) {
+  free(table->text);
+  free(table->offsets);
+  memset(table, 0, sizeof(*table));
+}
+
+static inline int LabelTableLoad(LabelTable* table, const char* path) {
+  FILE*     file       = fopen(path, "rb");
+  char*     raw        = NULL;
+  uint32_t* slots      = NULL;  // open addressing, offset + 1 of interned labels
+  size_t    num_slots  = 0;
+  size_t    num_lines  = 0;
+  size_t    text_size  = 0;
+  long      file_size  = 0;
+  int       ok         = 0;
+
+  memset(table, 0, sizeof(*table));
+  if (!file) return 0;
+
+  if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 ||
+      fseek(file, 0, SEEK_SET) != 0 || (size_t)file_size >= UINT32_MAX)
+    goto done;
+
+  raw = (char*)malloc((size_t)file_size + 1);
+  if (!raw || fread(raw, 1, (size_t)file_size, file) != (size_t)file_size) goto done;
+  raw[file_size] = '\0';
+
+  for (long i = 0; i < file_size; i++) num_lines += (raw[i] == '\n');
+  if (file_size > 0 && raw[file_size - 1] != '\n') num_lines++;
+
+  for (num_slots = 16; num_slots < num_lines * 2; num_slots *= 2)
+    ;
+  table->text    = (char*)malloc((size_t)file_size + 1);
+  table->offsets = (uint32_t*)malloc((num_lines ? num_lines : 1) * sizeof(uint32_t));
+  slots          = (uint32_t*)calloc(num_slots, sizeof(uint32_t));
+  if (!table->text || !table->offsets || !slots) goto done;
+
+  for (char* line = raw; table->count < num_lines; ) {
+    char*    end  = strchr(line, '\n');
+    size_t   len  = 0;
+    uint32_t slot = 0;
+
+    if (end) *end = '\0';
+    len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+    // Reuse the stored copy of a label seen before
+    for (slot = LabelHash(line) & (num_slots - 1);
+         slots[slot] && strcmp(table->text + slots[slot] - 1, line) != 0;
+         slot = (slot + 1) & (num_slots - 1))
+      ;
+    if (!slots[slot]) {
+      memcpy(table->text + text_size, line, len + 1);
+      slots[slot] = (uint32_t)text_size + 1;
+      text_size  += len + 1;
+    }
+    table->offsets[table->count++] = slots[slot] - 1;
+
+    if (!end) break;
+    line = end + 1;
+  }
+
+  // Keep only the interned strings
+  {
+    char* text = (char*)realloc(table->text, text_size ? text_size : 1);
+    if (text) table->text = text;
+  }
+  ok = 1;
+
+done:
+  if (!ok) LabelTableFree(table);
+  free(slots);
+  free(raw);
+  fclose(file);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Label of a class, NULL if the class has none.
+// ---------------------------------------------------------------------------
+static inline const char* LabelTableGet(const LabelTable* table, size_t index) {
+  return (index < table->count) ? table->text + table->offsets[index] : NULL;
+}
+
+#endif  // ORT_EXAMPLE_POSTPROCESS_H
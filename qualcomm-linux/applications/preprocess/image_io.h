@@ -0,0 +1,342 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Image decoding into 8 bit BGR, like cv2.imread(path, IMREAD_COLOR):
+//
+//   JPEG  libjpeg, default integer DCT and fancy upsampling, rotated by the
+//         EXIF orientation, grayscale replicated, CMYK rejected
+//   PNG   libpng, 16 bit values stripped to their high byte, palettes
+//         expanded, gray replicated, alpha dropped
+//   BMP   uncompressed 8, 24 and 32 bit, alpha dropped
+//
+// The decoder is picked by the file contents, not the extension.
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <png.h>
+
+#define IMAGE_MAX_PIXELS  (1u << 28)
+
+// ---------------------------------------------------------------------------
+// Decoded image, rows of width * 3 bytes, B G R
+// ---------------------------------------------------------------------------
+typedef struct {
+  int      width;
+  int      height;
+  uint8_t* data;
+} Image;
+
+static inline void ImageFree(Image* image) {
+  free(image->data);
+  memset(image, 0, sizeof(*image));
+}
+
+static inline int ImageAlloc(Image* image, int width, int height) {
+  if (width <= 0 || height <= 0 || (uint64_t)width * height > IMAGE_MAX_PIXELS) return 0;
+
+  image->width  = width;
+  image->height = height;
+  image->data   = (uint8_t*)malloc((size_t)width * height * 3);
+  return image->data != NULL;
+}
+
+// ---------------------------------------------------------------------------
+// EXIF orientation of a JPEG APP1 segment, 1 if missing or invalid.
+// ---------------------------------------------------------------------------
+static inline int ImageExifOrientation(const uint8_t* data, size_t size) {
+  const uint8_t* tiff;
+  size_t         tiff_size, ifd;
+  int            le;
+
+  if (size < 14 || memcmp(data, "Exif\0\0", 6) != 0) return 1;
+  tiff      = data + 6;
+  tiff_size = size - 6;
+  le        = tiff[0] == 'I';
+  if (!(le ? tiff[0] == 'I' && tiff[1] == 'I' : tiff[0] == 'M' && tiff[1] == 'M')) return 1;
+
+#define EXIF_U16(p) (le ? (uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 : (uint32_t)(p)[0] << 8 | (uint32_t)(p)[1])
+#define EXIF_U32(p) (le ? EXIF_U16(p) | EXIF_U16((p) + 2) << 16 : EXIF_U16(p) << 16 | EXIF_U16((p) + 2))
+  ifd = EXIF_U32(tiff + 4);
+  if (ifd + 2 > tiff_size) return 1;
+
+  for (uint32_t n = EXIF_U16(tiff + ifd), i = 0; i < n; i++) {
+    const uint8_t* entry = tiff + ifd + 2 + 12 * i;
+
+    if ((size_t)(entry - tiff) + 12 > tiff_size) break;
+    if (EXIF_U16(entry) == 0x0112) {
+      uint32_t value = EXIF_U16(entry + 8);
+
+      return (value >= 1 && value <= 8) ? (int)value : 1;
+    }
+  }
+#undef EXIF_U32
+#undef EXIF_U16
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Turn an image upright by its EXIF orientation, 2 to 8 mirror and rotate.
+// Returns 1 on success, 0 if out of memory.
+// ---------------------------------------------------------------------------
+static inline int ImageOrient(Image* image, int orientation) {
+  int   transpose = orientation >= 5;
+  Image out;
+
+  if (orientation <= 1 || orientation > 8) return 1;
+  if (!ImageAlloc(&out, transpose ? image->height : image->width, transpose ? image->width : image->height))
+    return 0;
+
+  for (int y = 0; y < out.height; y++) {
+    for (int x = 0; x < out.width; x++) {
+      int sx = 0, sy = 0;
+
+      switch (orientation) {
+        case 2: sx = image->width - 1 - x; sy = y; break;
+        case 3: sx = image->width - 1 - x; sy = image->height - 1 - y; break;
+        case 4: sx = x; sy = image->height - 1 - y; break;
+        case 5: sx = y; sy = x; break;
+        case 6: sx = y; sy = image->height - 1 - x; break;
+        case 7: sx = image->width - 1 - y; sy = image->height - 1 - x; break;
+        case 8: sx = image->width - 1 - y; sy = x; break;
+      }
+      memcpy(out.data + ((size_t)y * out.width + x) * 3, image->data + ((size_t)sy * image->width + sx) * 3, 3);
+    }
+  }
+
+  ImageFree(image);
+  *image = out;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// JPEG
+// ---------------------------------------------------------------------------
+typedef struct {
+  struct jpeg_error_mgr base;
+  jmp_buf               jump;
+  char                  message[JMSG_LENGTH_MAX];
+} ImageJpegError;
+
+static void ImageJpegExit(j_common_ptr cinfo) {
+  ImageJpegError* error = (ImageJpegError*)cinfo->err;
+
+  error->base.format_message(cinfo, error->message);
+  longjmp(error->jump, 1);
+}
+
+static inline int ImageLoadJpeg(FILE* file, const char* path, Image* image) {
+  struct jpeg_decompress_struct cinfo;
+  ImageJpegError                error;
+  volatile int                  orientation = 1;
+  volatile int                  ok          = 0;
+
+  cinfo.err              = jpeg_std_error(&error.base);
+  error.base.error_exit  = ImageJpegExit;
+  error.message[0]       = '\0';
+  if (setjmp(error.jump)) {
+    fprintf(stderr, "Failed to decode '%s': %s\n", path, error.message);
+    jpeg_destroy_decompress(&cinfo);
+    ImageFree(image);
+    return 0;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, file);
+  jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xffff);
+  jpeg_read_header(&cinfo, TRUE);
+
+  for (jpeg_saved_marker_ptr marker = cinfo.marker_list; marker; marker = marker->next)
+    if (marker->marker == JPEG_APP0 + 1 && (orientation = ImageExifOrientation(marker->data, marker->data_length)) != 1)
+      break;
+
+  if (cinfo.num_components == 4) {
+    fprintf(stderr, "'%s': CMYK JPEG is not supported.\n", path);
+  } else {
+    // RGB or gray output, swapped or replicated below, works with any libjpeg
+    int gray = cinfo.num_components == 1;
+
+    cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    if (ImageAlloc(image, (int)cinfo.output_width, (int)cinfo.output_height)) {
+      while (cinfo.output_scanline < cinfo.output_height) {
+        uint8_t* row = image->data + (size_t)cinfo.output_scanline * image->width * 3;
+
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        for (int x = image->width - 1; gray && x >= 0; x--) row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = row[x];
+        for (int x = 0; !gray && x < image->width; x++) {
+          uint8_t r = row[3 * x];
+
+          row[3 * x]     = row[3 * x + 2];
+          row[3 * x + 2] = r;
+        }
+      }
+      jpeg_finish_decompress(&cinfo);
+      ok = ImageOrient(image, orientation);
+    } else {
+      fprintf(stderr, "'%s' is too large.\n", path);
+    }
+  }
+
+  jpeg_destroy_decompress(&cinfo);
+  if (!ok) ImageFree(image);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// PNG
+// ---------------------------------------------------------------------------
+static inline int ImageLoadPng(FILE* file, const char* path, Image* image) {
+  png_structp       png  = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop         info = png ? png_create_info_struct(png) : NULL;
+  png_bytep* volatile rows = NULL;
+  png_uint_32       width, height;
+  int               depth, color, ok = 0;
+
+  if (!png || !info) {
+    png_destroy_read_struct(&png, &info, NULL);
+    return 0;
+  }
+  if (setjmp(png_jmpbuf(png))) {
+    fprintf(stderr, "Failed to decode '%s'.\n", path);
+    goto done;
+  }
+
+  png_init_io(png, file);
+  png_read_info(png, info);
+  png_get_IHDR(png, info, &width, &height, &depth, &color, NULL, NULL, NULL);
+
+  if (depth == 16) png_set_strip_16(png);
+  if (color & PNG_COLOR_MASK_ALPHA) png_set_strip_alpha(png);
+  if (color == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+  if ((color & PNG_COLOR_MASK_COLOR) == 0 && depth < 8) png_set_expand_gray_1_2_4_to_8(png);
+  if (color & PNG_COLOR_MASK_COLOR) png_set_bgr(png);
+  else png_set_gray_to_rgb(png);
+  png_set_interlace_handling(png);
+  png_read_update_info(png, info);
+
+  if (png_get_rowbytes(png, info) != (size_t)width * 3 || !ImageAlloc(image, (int)width, (int)height) ||
+      !(rows = (png_bytep*)malloc(height * sizeof(png_bytep)))) {
+    fprintf(stderr, "'%s' is not supported or too large.\n", path);
+    goto done;
+  }
+
+  for (png_uint_32 y = 0; y < height; y++) rows[y] = image->data + (size_t)y * width * 3;
+  png_read_image(png, rows);
+  png_read_end(png, NULL);
+  ok = 1;
+
+done:
+  png_destroy_read_struct(&png, &info, NULL);
+  free(rows);
+  if (!ok) ImageFree(image);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// BMP, uncompressed
+// ---------------------------------------------------------------------------
+static inline int ImageLoadBmp(FILE* file, const char* path, Image* image) {
+  uint8_t  header[54], palette[256 * 4];
+  uint8_t* row = NULL;
+  int32_t  width, height;
+  uint32_t offset, colors;
+  int      bits, bottom_up, ok = 0;
+  size_t   row_bytes;
+
+  if (fread(header, sizeof(header), 1, file) != 1) goto invalid;
+
+#define BMP_U16(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8)
+#define BMP_U32(p) (BMP_U16(p) | BMP_U16((p) + 2) << 16)
+  offset    = BMP_U32(header + 10);
+  width     = (int32_t)BMP_U32(header + 18);
+  height    = (int32_t)BMP_U32(header + 22);
+  bits      = (int)BMP_U16(header + 28);
+  colors    = BMP_U32(header + 46);
+  bottom_up = height > 0;
+  height    = bottom_up ? height : -height;
+
+  // BI_RGB only, BI_BITFIELDS of 32 bit images use the standard masks
+  if (BMP_U32(header + 14) < 40 || (BMP_U32(header + 30) != 0 && !(BMP_U32(header + 30) == 3 && bits == 32)) ||
+      (bits != 8 && bits != 24 && bits != 32))
+    goto invalid;
+#undef BMP_U32
+#undef BMP_U16
+
+  if (bits == 8) {
+    colors = (colors == 0 || colors > 256) ? 256 : colors;
+    memset(palette, 0, sizeof(palette));
+    if (fseek(file, 14 + (long)(header[14] | header[15] << 8), SEEK_SET) != 0 ||
+        fread(palette, 4, colors, file) != colors)
+      goto invalid;
+  }
+
+  row_bytes = (((size_t)width * bits + 31) / 32) * 4;
+  if (!ImageAlloc(image, width, height) || !(row = (uint8_t*)malloc(row_bytes))) {
+    fprintf(stderr, "'%s' is too large.\n", path);
+    goto done;
+  }
+  if (fseek(file, (long)offset, SEEK_SET) != 0) goto invalid;
+
+  for (int y = 0; y < height; y++) {
+    uint8_t* out = image->data + (size_t)(bottom_up ? height - 1 - y : y) * width * 3;
+
+    if (fread(row, row_bytes, 1, file) != 1) goto invalid;
+    for (int x = 0; x < width; x++) {
+      const uint8_t* in = (bits == 8) ? palette + 4 * row[x] : row + x * (bits / 8);
+
+      out[3 * x]     = in[0];
+      out[3 * x + 1] = in[1];
+      out[3 * x + 2] = in[2];
+    }
+  }
+  ok = 1;
+  goto done;
+
+invalid:
+  fprintf(stderr, "'%s' is not a supported BMP.\n", path);
+done:
+  free(row);
+  if (!ok) ImageFree(image);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Decode an image file. Returns 1 on success, 0 on failure.
+// ---------------------------------------------------------------------------
+static inline int ImageLoad(const char* path, Image* image) {
+  FILE*   file = fopen(path, "rb");
+  uint8_t magic[8];
+  int     ok = 0;
+
+  memset(image, 0, sizeof(*image));
+  if (!file) {
+    fprintf(stderr, "Failed to open '%s'.\n", path);
+    return 0;
+  }
+
+  if (fread(magic, sizeof(magic), 1, file) != 1 || fseek(file, 0, SEEK_SET) != 0)
+    fprintf(stderr, "'%s' is not an image.\n", path);
+  else if (magic[0] == 0xff && magic[1] == 0xd8)
+    ok = ImageLoadJpeg(file, path, image);
+  else if (png_sig_cmp(magic, 0, sizeof(magic)) == 0)
+    ok = ImageLoadPng(file, path, image);
+  else if (magic[0] == 'B' && magic[1] == 'M')
+    ok = ImageLoadBmp(file, path, image);
+  else
+    fprintf(stderr, "'%s' is not a JPEG, PNG or BMP image.\n", path);
+
+  fclose(file);
+  return ok;
+}
+
+#endif  // IMAGE_IO_H
@@ -0,0 +1,281 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Letterbox preprocessing of BGR images into model input tensors, bit
+// exact with letterbox() of scripts/preprocess.py (auto=False) and the
+// conversions that follow it:
+//
+//   1. scale to fit the tensor keeping the aspect ratio, the geometry of
+//      ml_preprocess_letterbox() in Hello-QIM
+//   2. cv2.resize(INTER_LINEAR), reproduced below
+//   3. pad with 114 around the image, the left and top padding rounded down
+//   4. BGR to RGB, NHWC or NCHW, uint8 or float32 value / 255
+//
+// cv2.resize of 8 bit images is fixed point: the filter weights are scaled
+// by 2048 and rounded, a row is filtered horizontally into ints, then two
+// rows are blended vertically. OpenCV blends in 16 bits, shifting the
+// horizontal sums right by 4 and keeping the high 16 bits of the products,
+// which is reproduced, as is the 2x2 average OpenCV uses instead for an
+// exact downscale by 2. The rounding of Python's round() and cvRound() is
+// the round half to even of lrint().
+
+#ifndef LETTERBOX_H
+#define LETTERBOX_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LETTERBOX_PAD_VALUE   114
+#define LETTERBOX_COEF_BITS   11
+#define LETTERBOX_COEF_SCALE  (1 << LETTERBOX_COEF_BITS)
+
+#define LETTERBOX_NHWC     0
+#define LETTERBOX_NCHW     1
+
+#define LETTERBOX_UINT8    0
+#define LETTERBOX_FLOAT32  1
+
+// ---------------------------------------------------------------------------
+// Output tensor of the preprocessing
+// ---------------------------------------------------------------------------
+typedef struct {
+  int width;
+  int height;
+  int layout;   // LETTERBOX_NHWC or LETTERBOX_NCHW
+  int type;     // LETTERBOX_UINT8 or LETTERBOX_FLOAT32
+} LetterboxConfig;
+
+// ---------------------------------------------------------------------------
+// Scratch buffers of a preprocessor, one per thread. Grown as needed, free
+// with LetterboxFreeScratch().
+// ---------------------------------------------------------------------------
+typedef struct {
+  uint8_t* resized;
+  size_t   resized_size;
+  int*     rows;         // two filtered rows
+  size_t   rows_size;
+  int*     xofs;         // source index of every output value
+  size_t   xofs_size;
+  short*   alpha;        // weights of the source values
+  size_t   alpha_size;
+} LetterboxScratch;
+
+static inline void LetterboxFreeScratch(LetterboxScratch* scratch) {
+  free(scratch->resized);
+  free(scratch->rows);
+  free(scratch->xofs);
+  free(scratch->alpha);
+  memset(scratch, 0, sizeof(*scratch));
+}
+
+static inline size_t LetterboxTensorBytes(const LetterboxConfig* config) {
+  return (size_t)config->width * config->height * 3 * (config->type == LETTERBOX_FLOAT32 ? sizeof(float) : 1);
+}
+
+// ---------------------------------------------------------------------------
+// Size and offset of the resized image inside the tensor. Returns the scale.
+// ---------------------------------------------------------------------------
+static inline double LetterboxGeometry(int src_width, int src_height, int dst_width, int dst_height, int* left,
+                                       int* top, int* width, int* height) {
+  double r = fmin((double)dst_height / src_height, (double)dst_width / src_width);
+
+  *width  = (int)lrint(src_width * r);
+  *height = (int)lrint(src_height * r);
+  *left   = (int)lrint((dst_width - *width) / 2.0 - 0.1);
+  *top    = (int)lrint((dst_height - *height) / 2.0 - 0.1);
+  return r;
+}
+
+static inline int LetterboxGrow(void** data, size_t* size, size_t needed) {
+  void* grown;
+
+  if (needed <= *size) return 1;
+  if (!(grown = realloc(*data, needed))) return 0;
+  *data = grown;
+  *size = needed;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// 2x2 average of an exact downscale by 2, cv::resize uses INTER_AREA then
+// ---------------------------------------------------------------------------
+static inline void LetterboxHalve(const uint8_t* src, size_t src_stride, uint8_t* dst, int dst_width,
+                                  int dst_height, int cn) {
+  for (int y = 0; y < dst_height; y++) {
+    const uint8_t* s0 = src + (size_t)(2 * y) * src_stride;
+    const uint8_t* s1 = s0 + src_stride;
+    uint8_t*       d  = dst + (size_t)y * dst_width * cn;
+
+    for (int x = 0; x < dst_width; x++)
+      for (int c = 0; c < cn; c++) {
+        int i = 2 * x * cn + c;
+
+        d[x * cn + c] = (uint8_t)((s0[i] + s0[i + cn] + s1[i] + s1[i + cn] + 2) >> 2);
+      }
+  }
+}
+
+// Horizontal pass of one source row into LETTERBOX_COEF_SCALE scaled ints
+static inline void LetterboxFilterRow(const uint8_t* src, const int* xofs, const short* alpha, int xmax,
+                                      int width, int cn, int* out) {
+  int dx = 0;
+
+  for (; dx < xmax * cn; dx++) out[dx] = src[xofs[dx]] * alpha[2 * dx] + src[xofs[dx] + cn] * alpha[2 * dx + 1];
+  for (; dx < width * cn; dx++) out[dx] = src[xofs[dx]] * LETTERBOX_COEF_SCALE;
+}
+
+static inline uint8_t LetterboxSaturate(int v) {
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// ---------------------------------------------------------------------------
+// Vertical blend of two filtered rows, in the 16 bit steps of OpenCV. The
+// filtered values fit 16 bits after the shift, 255 * 2048 >> 4.
+// ---------------------------------------------------------------------------
+static inline void LetterboxBlendRows(const int* s0, const int* s1, short b0, short b1, int width,
+                                      uint8_t* dst) {
+  for (int x = 0; x < width; x++)
+    dst[x] = LetterboxSaturate(((((s0[x] >> 4) * b0) >> 16) + (((s1[x] >> 4) * b1) >> 16) + 2) >> 2);
+}
+
+// ---------------------------------------------------------------------------
+// cv2.resize(src, (dst_width, dst_height), interpolation=INTER_LINEAR) of
+// an interleaved image of cn channels. Returns 1 on success, 0 if out of
+// memory.
+// ---------------------------------------------------------------------------
+static inline int LetterboxResize(const uint8_t* src, int src_width, int src_height, size_t src_stride,
+                                  uint8_t* dst, int dst_width, int dst_height, int cn,
+                                  LetterboxScratch* scratch) {
+  double scale_x = 1.0 / ((double)dst_width / src_width);
+  double scale_y = 1.0 / ((double)dst_height / src_height);
+  size_t row_size = (size_t)dst_width * cn;
+  int    xmax = dst_width, prev0 = -1, prev1 = -1;
+  int*   rows[2];
+
+  if (dst_width == src_width && dst_height == src_height) {
+    for (int y = 0; y < src_height; y++) memcpy(dst + y * row_size, src + y * src_stride, row_size);
+    return 1;
+  }
+
+  if (fabs(scale_x - 2.0) < 2.220446049250313e-16 && fabs(scale_y - 2.0) < 2.220446049250313e-16) {
+    LetterboxHalve(src, src_stride, dst, dst_width, dst_height, cn);
+    return 1;
+  }
+
+  if (!LetterboxGrow((void**)&scratch->rows, &scratch->rows_size, 2 * row_size * sizeof(int)) ||
+      !LetterboxGrow((void**)&scratch->xofs, &scratch->xofs_size, row_size * sizeof(int)) ||
+      !LetterboxGrow((void**)&scratch->alpha, &scratch->alpha_size, 2 * row_size * sizeof(short)))
+    return 0;
+
+  for (int dx = 0; dx < dst_width; dx++) {
+    float fx = (float)((dx + 0.5) * scale_x - 0.5);
+    int   sx = (int)floorf(fx);
+
+    fx -= sx;
+    if (sx < 0) fx = 0.0f, sx = 0;
+    if (sx + 1 >= src_width) {
+      if (dx < xmax) xmax = dx;
+      if (sx >= src_width - 1) fx = 0.0f, sx = src_width - 1;
+    }
+    for (int c = 0; c < cn; c++) {
+      scratch->xofs[dx * cn + c]          = sx * cn + c;
+      scratch->alpha[2 * (dx * cn + c)]     = (short)lrintf((1.0f - fx) * LETTERBOX_COEF_SCALE);
+      scratch->alpha[2 * (dx * cn + c) + 1] = (short)lrintf(fx * LETTERBOX_COEF_SCALE);
+    }
+  }
+
+  rows[0] = scratch->rows;
+  rows[1] = scratch->rows + row_size;
+
+  for (int dy = 0; dy < dst_height; dy++) {
+    float fy = (float)((dy + 0.5) * scale_y - 0.5);
+    int   sy = (int)floorf(fy);
+    int   y0, y1;
+    short b0, b1;
+
+    fy -= sy;
+    b0 = (short)lrintf((1.0f - fy) * LETTERBOX_COEF_SCALE);
+    b1 = (short)lrintf(fy * LETTERBOX_COEF_SCALE);
+    y0 = sy < 0 ? 0 : (sy >= src_height ? src_height - 1 : sy);
+    y1 = sy + 1 < 0 ? 0 : (sy + 1 >= src_height ? src_height - 1 : sy + 1);
+
+    // Filtered rows are reused while the source rows advance
+    if (y0 == prev1 && y0 != prev0) {
+      int* tmp = rows[0];
+
+      rows[0] = rows[1];
+      rows[1] = tmp;
+      prev0   = prev1;
+      prev1   = -1;
+    }
+    if (y0 != prev0) {
+      LetterboxFilterRow(src + y0 * src_stride, scratch->xofs, scratch->alpha, xmax, dst_width, cn, rows[0]);
+      prev0 = y0;
+    }
+    if (y1 != prev1) {
+      if (y1 == prev0)
+        memcpy(rows[1], rows[0], row_size * sizeof(int));
+      else
+        LetterboxFilterRow(src + y1 * src_stride, scratch->xofs, scratch->alpha, xmax, dst_width, cn, rows[1]);
+      prev1 = y1;
+    }
+
+    LetterboxBlendRows(rows[0], rows[1], b0, b1, (int)row_size, dst + dy * row_size);
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Letterbox a BGR image into a tensor of config, see the top of the file.
+// Returns 1 on success, 0 if out of memory.
+// ---------------------------------------------------------------------------
+static inline int LetterboxImage(const uint8_t* bgr, int src_width, int src_height, size_t src_stride,
+                                 const LetterboxConfig* config, void* tensor, LetterboxScratch* scratch) {
+  int            left, top, width, height;
+  size_t         plane = (size_t)config->width * config->height;
+  const uint8_t* resized;
+  float          lut[256];
+
+  LetterboxGeometry(src_width, src_height, config->width, config->height, &left, &top, &width, &height);
+  if (width < 1 || height < 1 || width > config->width || height > config->height) return 0;
+
+  if (width == src_width && height == src_height) {
+    resized = bgr;
+  } else {
+    if (!LetterboxGrow((void**)&scratch->resized, &scratch->resized_size, (size_t)width * height * 3) ||
+        !LetterboxResize(bgr, src_width, src_height, src_stride, scratch->resized, width, height, 3, scratch))
+      return 0;
+    resized    = scratch->resized;
+    src_stride = (size_t)width * 3;
+  }
+
+  // img / 255 is float64 in numpy, then stored as float32
+  for (int v = 0; v < 256; v++) lut[v] = (float)(v / 255.0);
+
+  for (int y = 0; y < config->height; y++) {
+    const uint8_t* row   = (y >= top && y < top + height) ? resized + (y - top) * src_stride : NULL;
+
+    for (int x = 0; x < config->width; x++) {
+      int     inside = row && x >= left && x < left + width;
+      size_t  pixel  = (size_t)y * config->width + x;
+
+      for (int c = 0; c < 3; c++) {
+        // RGB output of BGR pixels
+        uint8_t v     = inside ? row[(x - left) * 3 + 2 - c] : LETTERBOX_PAD_VALUE;
+        size_t  index = (config->layout == LETTERBOX_NCHW) ? c * plane + pixel : pixel * 3 + c;
+
+        if (config->type == LETTERBOX_FLOAT32)
+          ((float*)tensor)[index] = lut[v];
+        else
+          ((uint8_t*)tensor)[index] = v;
+      }
+    }
+  }
+  return 1;
+}
+
+#endif  // LETTERBOX_H
@@ -0,0 +1,386 @@
+// ---------------------------------------------------------------------
+// Copyright (c) Qualcomm Innovation Center, Inc. All rights reserved.
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+// Prepares directories of images as model inputs, like
+// scripts/preprocess.py with the same arguments and bit identical raw
+// files, but on all cores. See letterbox.h and image_io.h.
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "image_io.h"
+#include "letterbox.h"
+#include "../common/tool_utils.h"
+
+#define DEFAULT_SIZE  320
+#define MAX_THREADS   64
+
+// Packed dataset file of ort_example, see PackHeader in ort_example/main.c
+#define PACK_MAGIC       "ORTPACK1"
+#define PACK_DATA_ALIGN  4096
+#define PACK_MAX_DIMS    16
+
+// ONNXTensorElementDataType of the samples
+#define ONNX_TYPE_FLOAT  1
+#define ONNX_TYPE_UINT8  2
+
+typedef struct {
+  char     magic[8];
+  uint32_t header_size;
+  int32_t  element_type;
+  uint32_t num_dims;
+  uint32_t reserved;
+  uint64_t num_samples;
+  uint64_t sample_bytes;
+  int64_t  dims[PACK_MAX_DIMS];
+} PackHeader;
+
+typedef struct {
+  const char*     input_dir;
+  const char*     output;      // directory of raw files, or the packed file
+  int             pack;
+  int             threads;
+  int             quiet;
+  LetterboxConfig config;
+} ToolOptions;
+
+// ---------------------------------------------------------------------------
+// Images shared by the workers, taken in order through next
+// ---------------------------------------------------------------------------
+typedef struct {
+  const ToolOptions* opts;
+  char**             names;
+  size_t             num_names;
+  atomic_size_t      next;
+  atomic_size_t      failed;
+  int                pack_fd;
+  uint64_t           data_offset;
+} Job;
+
+static int CompareNames(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// ---------------------------------------------------------------------------
+// Helper: names of the images in a directory, the extensions of
+// preprocess.py, sorted. TIFF images have no decoder in image_io.h and are
+// skipped with a warning. Returns the count, 0 on failure.
+// ---------------------------------------------------------------------------
+static size_t ListImages(const char* dir_path, char*** names) {
+  static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp" };
+  static const char* skipped[]    = { ".tiff", ".tif" };
+  DIR*               dir   = opendir(dir_path);
+  size_t             count = 0, capacity = 0;
+  struct dirent*     entry;
+
+  *names = NULL;
+  if (!dir) {
+    fprintf(stderr, "Failed to open '%s': %s\n", dir_path, strerror(errno));
+    return 0;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    size_t len   = strlen(entry->d_name);
+    int    match = 0;
+
+    for (size_t e = 0; e < sizeof(skipped) / sizeof(skipped[0]); e++) {
+      size_t ext = strlen(skipped[e]);
+      match |= len >= ext && strcasecmp(entry->d_name + len - ext, skipped[e]) == 0;
+    }
+    if (match) {
+      fprintf(stderr, "Skipping '%s': TIFF images are not supported.\n", entry->d_name);
+      continue;
+    }
+
+    for (size_t e = 0; e < sizeof(extensions) / sizeof(extensions[0]); e++) {
+      size_t ext = strlen(extensions[e]);
+      match |= len >= ext && strcasecmp(entry->d_name + len - ext, extensions[e]) == 0;
+    }
+    if (!match) continue;
+
+    if (count == capacity) {
+      char** grown = (char**)realloc(*names, (capacity = capacity ? 2 * capacity : 256) * sizeof(char*));
+      if (!grown) break;
+      *names = grown;
+    }
+    if (!((*names)[count] = strdup(entry->d_name))) break;
+    count++;
+  }
+  closedir(dir);
+
+  if (count == 0) fprintf(stderr, "No images in '%s'.\n", dir_path);
+  else qsort(*names, count, sizeof(char*), CompareNames);
+  return count;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: create a directory and its parents, like os.makedirs().
+// ---------------------------------------------------------------------------
+static int MakeDirs(const char* path) {
+  char* copy = strdup(path);
+  int   ok   = copy != NULL;
+
+  for (char* p = copy ? copy + 1 : NULL; ok && p && *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    ok = mkdir(copy, 0755) == 0 || errno == EEXIST;
+    *p = '/';
+  }
+  ok = ok && (mkdir(path, 0755) == 0 || errno == EEXIST);
+  if (!ok) fprintf(stderr, "Failed to create '%s': %s\n", path, strerror(errno));
+  free(copy);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: write one tensor as <output>/<name without extension>.raw.
+// ---------------------------------------------------------------------------
+static int WriteRaw(const char* dir, const char* name, const void* tensor, size_t bytes) {
+  const char* dot  = strrchr(name, '.');
+  int         stem = dot && dot != name ? (int)(dot - name) : (int)strlen(name);
+  char*       path = NULL;
+  FILE*       file = NULL;
+  int         ok   = 0;
+
+  if (asprintf(&path, "%s/%.*s.raw", dir, stem, name) < 0) return 0;
+
+  if ((file = fopen(path, "wb")) != NULL) {
+    ok = fwrite(tensor, bytes, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+  }
+  if (!ok) fprintf(stderr, "Failed to write '%s'.\n", path);
+  free(path);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Worker: decode, letterbox and write images until none are left. A packed
+// sample goes to its own offset, so the workers write in any order.
+// ---------------------------------------------------------------------------
+static void* Worker(void* arg) {
+  Job*                   job    = (Job*)arg;
+  const LetterboxConfig* config = &job->opts->config;
+  size_t                 bytes  = LetterboxTensorBytes(config);
+  void*                  tensor = malloc(bytes);
+  LetterboxScratch       scratch;
+  size_t                 k;
+
+  memset(&scratch, 0, sizeof(scratch));
+
+  while ((k = atomic_fetch_add(&job->next, 1)) < job->num_names) {
+    const char* name = job->names[k];
+    char*       path = NULL;
+    Image       image;
+    int         ok   = 0;
+
+    memset(&image, 0, sizeof(image));
+    if (tensor && asprintf(&path, "%s/%s", job->opts->input_dir, name) >= 0 && ImageLoad(path, &image)) {
+      ok = LetterboxImage(image.data, image.width, image.height, (size_t)image.width * 3, config, tensor, &scratch);
+      if (!ok) fprintf(stderr, "Failed to preprocess '%s'.\n", path);
+    }
+
+    if (ok && job->pack_fd >= 0) {
+      ok = pwrite(job->pack_fd, tensor, bytes, (off_t)(job->data_offset + k * bytes)) == (ssize_t)bytes;
+      if (!ok) fprintf(stderr, "Failed to write sample %zu of '%s'.\n", k, job->opts->output);
+    } else if (ok) {
+      ok = WriteRaw(job->opts->output, name, tensor, bytes);
+    }
+
+    if (ok && !job->opts->quiet) {
+      if (config->layout == LETTERBOX_NCHW) printf("Processed %s: (3, %d, %d)\n", name, config->height, config->width);
+      else printf("Processed %s: (%d, %d, 3)\n", name, config->height, config->width);
+    }
+    if (!ok) atomic_fetch_add(&job->failed, 1);
+
+    ImageFree(&image);
+    free(path);
+  }
+
+  LetterboxFreeScratch(&scratch);
+  free(tensor);
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Helper: create the packed file with its header and index, sized for all
+// samples. Returns the descriptor, -1 on failure.
+// ---------------------------------------------------------------------------
+static int CreatePack(const ToolOptions* opts, size_t num_samples, uint64_t* data_offset) {
+  PackHeader header;
+  size_t     index_size = num_samples * sizeof(uint64_t);
+  uint64_t*  index      = (uint64_t*)malloc(index_size);
+  int        fd         = open(opts->output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  int        ok         = fd >= 0 && index;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+  header.header_size  = sizeof(PackHeader);
+  header.element_type = opts->config.type == LETTERBOX_FLOAT32 ? ONNX_TYPE_FLOAT : ONNX_TYPE_UINT8;
+  header.num_dims     = 3;
+  header.num_samples  = num_samples;
+  header.sample_bytes = LetterboxTensorBytes(&opts->config);
+  header.dims[0]      = opts->config.layout == LETTERBOX_NCHW ? 3 : opts->config.height;
+  header.dims[1]      = opts->config.layout == LETTERBOX_NCHW ? opts->config.height : opts->config.width;
+  header.dims[2]      = opts->config.layout == LETTERBOX_NCHW ? opts->config.width : 3;
+
+  *data_offset = (sizeof(PackHeader) + index_size + PACK_DATA_ALIGN - 1) & ~(uint64_t)(PACK_DATA_ALIGN - 1);
+  for (size_t k = 0; ok && k < num_samples; k++) index[k] = *data_offset + k * header.sample_bytes;
+
+  ok = ok && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+       pwrite(fd, index, index_size, sizeof(header)) == (ssize_t)index_size &&
+       ftruncate(fd, (off_t)(*data_offset + num_samples * header.sample_bytes)) == 0;
+
+  if (!ok) {
+    fprintf(stderr, "Failed to create '%s'.\n", opts->output);
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  free(index);
+  return fd;
+}
+
+static void PrintHelp(const char* prog) {
+  printf("Usage: %s [options] <input_dir> <output> <is_nchw> <is_uint8>\n\n", prog);
+  printf("Letterboxes the JPEG, PNG and BMP images of <input_dir> into model inputs,\n");
+  printf("bit identical to scripts/preprocess.py with the same arguments:\n\n");
+  printf("  <output>    Directory of <image name>.raw files, or the packed file with --pack\n");
+  printf("  <is_nchw>   1 for NCHW, 0 for NHWC\n");
+  printf("  <is_uint8>  1 for uint8, 0 for float32 values / 255\n\n");
+  printf("Options:\n");
+  printf("  --size <N|WxH>     Tensor size (default: %d)\n", DEFAULT_SIZE);
+  printf("  --threads <N>      Worker threads (default: one per core)\n");
+  printf("  --pack             Write all samples into one packed file for the --dataset\n");
+  printf("                     option of onnxruntime-example, in name order\n");
+  printf("  --quiet            Print the summary only\n\n");
+  printf("Examples:\n");
+  printf("  %s images/ inputs/ 1 0\n", prog);
+  printf("  %s --pack --size 224 calibration/ calibration.pack 0 1\n", prog);
+}
+
+static int ParseFlag(const char* name, const char* value, int* out) {
+  if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0) {
+    fprintf(stderr, "<%s> expects 0 or 1, got '%s'.\n", name, value);
+    return 0;
+  }
+  *out = value[0] == '1';
+  return 1;
+}
+
+int main(int argc, char* argv[]) {
+  ToolOptions opts;
+  Job         job;
+  pthread_t   threads[MAX_THREADS];
+  int         num_threads = 0;
+  const char* args[4];
+  int         num_args = 0, nchw = 0, uint8 = 0, ret = 1;
+  double      start, elapsed;
+  size_t      failed;
+
+  memset(&opts, 0, sizeof(opts));
+  memset(&job, 0, sizeof(job));
+  opts.config.width  = DEFAULT_SIZE;
+  opts.config.height = DEFAULT_SIZE;
+  opts.threads       = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg  = argv[i];
+    const char* next = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      PrintHelp(argv[0]);
+      return 0;
+    } else if (strcmp(arg, "--pack") == 0) {
+      opts.pack = 1;
+    } else if (strcmp(arg, "--quiet") == 0) {
+      opts.quiet = 1;
+    } else if (strcmp(arg, "--size") == 0 && next) {
+      int w = 0, h = 0, n = sscanf(next, "%dx%d", &w, &h);
+
+      opts.config.width  = w;
+      opts.config.height = (n == 2) ? h : w;
+      if (n < 1 || opts.config.width < 2 || opts.config.height < 2 || opts.config.width > 16384 ||
+          opts.config.height > 16384) {
+        fprintf(stderr, "--size expects N or WxH, got '%s'.\n", next);
+        return 1;
+      }
+      i++;
+    } else if (strcmp(arg, "--threads") == 0 && next) {
+      opts.threads = atoi(next);
+      if (opts.threads < 1) {
+        fprintf(stderr, "--threads expects a positive count, got '%s'.\n", next);
+        return 1;
+      }
+      i++;
+    } else if (strncmp(arg, "--", 2) == 0 || num_args == 4) {
+      fprintf(stderr, "Unexpected argument '%s'.\n", arg);
+      return 1;
+    } else {
+      args[num_args++] = arg;
+    }
+  }
+
+  if (num_args != 4) {
+    PrintHelp(argv[0]);
+    return 1;
+  }
+  if (!ParseFlag("is_nchw", args[2], &nchw) || !ParseFlag("is_uint8", args[3], &uint8)) return 1;
+
+  opts.input_dir     = args[0];
+  opts.output        = args[1];
+  opts.config.layout = nchw ? LETTERBOX_NCHW : LETTERBOX_NHWC;
+  opts.config.type   = uint8 ? LETTERBOX_UINT8 : LETTERBOX_FLOAT32;
+  if (opts.threads > MAX_THREADS) opts.threads = MAX_THREADS;
+
+  job.opts      = &opts;
+  job.pack_fd   = -1;
+  job.num_names = ListImages(opts.input_dir, &job.names);
+  if (job.num_names == 0) return 1;
+
+  if (opts.pack) {
+    if ((job.pack_fd = CreatePack(&opts, job.num_names, &job.data_offset)) < 0) goto done;
+  } else if (!MakeDirs(opts.output)) {
+    goto done;
+  }
+
+  start = NowMs();
+  if ((size_t)opts.threads > job.num_names) opts.threads = (int)job.num_names;
+  for (; num_threads < opts.threads; num_threads++)
+    if (pthread_create(&threads[num_threads], NULL, Worker, &job) != 0) break;
+  if (num_threads == 0) Worker(&job);
+  for (int t = 0; t < num_threads; t++) pthread_join(threads[t], NULL);
+
+  failed = atomic_load(&job.failed);
+  elapsed = NowMs() - start;
+  printf("Processed %zu of %zu images in %.1f ms with %d threads (%.1f images/s)\n", job.num_names - failed,
+         job.num_names, elapsed, num_threads ? num_threads : 1, (job.num_names - failed) * 1000.0 / elapsed);
+
+  // A packed file with missing samples is not kept
+  if (job.pack_fd >= 0) {
+    if (close(job.pack_fd) != 0 && failed == 0) {
+      fprintf(stderr, "Failed to write '%s'.\n", opts.output);
+      failed = 1;
+    }
+    job.pack_fd = -1;
+    if (failed) unlink(opts.output);
+    else printf("Packed %zu sample(s) of %zu bytes into '%s'.\n", job.num_names,
+                LetterboxTensorBytes(&opts.config), opts.output);
+  }
+  ret = failed ? 1 : 0;
+
+done:
+  if (job.pack_fd >= 0) close(job.pack_fd);
+  for (size_t k = 0; k < job.num_names; k++) free(job.names[k]);
+  free(job.names);
+  return ret;
+}